@@ -0,0 +1,56 @@
+// Point lights of the view, binned into clusters by the LightBinner (see light_binner.h).
+// A pixel finds its cluster from its screen position and view depth
+// and only loops over the lights of that cluster.
+
+struct PointLight
+{
+    float3 position;
+    float radius;
+    float3 color;
+    float intensity;
+};
+
+struct LightCluster
+{
+    uint firstLight;
+    uint lightCount;
+};
+
+StructuredBuffer<PointLight> gPointLights : register(t1);
+StructuredBuffer<LightCluster> gLightClusters : register(t2);
+StructuredBuffer<uint> gLightIndices : register(t3);
+
+static const uint noLightClusters = 0xFFFFFFFF;
+
+// ClusterConstants in light_binner.h.
+cbuffer ClusterCB : register(b1)
+{
+    uint firstCluster;
+    uint tilesX;
+    uint tilesY;
+    uint slices;
+    float2 tileScale;
+    float sliceScale;
+    float sliceBias;
+};
+
+// svPosition is SV_POSITION in the pixel shader: the pixel in xy and the view depth in w.
+float3 pointLights(float4 svPosition, float3 worldPosition, float3 normal, float3 albedo)
+{
+    if (firstCluster == noLightClusters) return 0;
+
+    uint2 tile = min(uint2(svPosition.xy * tileScale), uint2(tilesX - 1, tilesY - 1));
+    uint slice = (uint) clamp(log(svPosition.w) * sliceScale + sliceBias, 0, slices - 1);
+    LightCluster cluster = gLightClusters[firstCluster + (slice * tilesY + tile.y) * tilesX + tile.x];
+
+    float3 result = 0;
+    for (uint i = 0; i < cluster.lightCount; i++) {
+        PointLight light = gPointLights[gLightIndices[cluster.firstLight + i]];
+        float3 toLight = light.position - worldPosition;
+        float distance = length(toLight);
+        float falloff = saturate(1 - (distance * distance) / (light.radius * light.radius));
+        float nDotL = saturate(dot(normal, toLight / max(distance, 0.0001)));
+        result += albedo * light.color * (light.intensity * falloff * falloff * nDotL);
+    }
+    return result;
+}
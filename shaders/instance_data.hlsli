@@ -0,0 +1,158 @@
+// Per instance data of the instanced draws, see InstanceFormat in renderer.h.
+// The renderer defines INSTANCE_FORMAT when it compiles the shader of a pipeline.
+// 0: Matrix, 1: Affine, 2: PositionRotationScale, 3: PositionYawScale
+
+#ifndef INSTANCE_FORMAT
+#define INSTANCE_FORMAT 0
+#endif
+
+#if INSTANCE_FORMAT == 1
+struct InstanceData {
+    float4 columns[3];
+};
+#elif INSTANCE_FORMAT == 2
+struct InstanceData {
+    float3 position;
+    float scale;
+    float4 rotation;
+};
+#elif INSTANCE_FORMAT == 3
+struct InstanceData {
+    float3 position;
+    uint yawScale;
+};
+#else
+struct InstanceData {
+    row_major float4x4 World;   
+};
+#endif
+StructuredBuffer<InstanceData> gInstances : register(t0);
+
+// Draws of shared instance pools only get the indices of their visible 
+// instances, gInstances then holds the whole pool.
+StructuredBuffer<uint> gInstanceIndices : register(t1);
+
+static const uint noInstanceIndices = 0xFFFFFFFF;
+
+// The InstanceAttributes the pipeline declares (see InstanceAttribute in renderer.h),
+// one uint each per instance, in the order of these bits.
+#ifndef INSTANCE_ATTRIBUTES
+#define INSTANCE_ATTRIBUTES 0
+#endif
+#define ATTRIBUTE_TEAM_COLOR 1
+#define ATTRIBUTE_TINT 2
+#define ATTRIBUTE_HEALTH 4
+#define ATTRIBUTE_ANIMATION_FRAME 8
+#define ATTRIBUTE_SELECTION 16
+#define ATTRIBUTE_TEXTURE_SLICE 32
+StructuredBuffer<uint> gInstanceAttributes : register(t2);
+
+static const uint noInstanceAttributes = 0xFFFFFFFF;
+
+// Where the instances of the current draw start in gInstances,
+// the draws of a frame share one buffer. 
+// Pooled draws also set where their indices start in gInstanceIndices.
+// Draws which have no attributes uploaded, like retained ones, get noInstanceAttributes.
+// Textures are slices of texture arrays (see texture_arrays.h), drawTextureSlice is 
+// the slice of the draw's texture. Draws which read the slice per instance get 0, 
+// the two add up.
+cbuffer InstanceCB : register(b2)
+{
+    uint firstInstance;
+    uint firstInstanceIndex;
+    uint firstInstanceAttribute;
+    uint drawTextureSlice;
+};
+
+// Where the instance is in the data of the draw, pooled draws go through their indices.
+uint instanceIndex(uint iid)
+{
+    return firstInstanceIndex == noInstanceIndices ? iid : gInstanceIndices[firstInstanceIndex + iid];
+}
+
+struct InstanceAttributes
+{
+    float4 teamColor;
+    float4 tint;
+    float health;
+    uint animationFrame;
+    uint selection;
+    uint textureSlice;
+};
+
+uint instanceAttribute(uint instance, uint bit)
+{
+    uint count = countbits(INSTANCE_ATTRIBUTES);
+    uint slot = countbits(INSTANCE_ATTRIBUTES & (bit - 1));
+    return gInstanceAttributes[firstInstanceAttribute + instance * count + slot];
+}
+
+// The declared attributes of an instance, the others keep their defaults.
+InstanceAttributes instanceAttributes(uint iid)
+{
+    InstanceAttributes a;
+    a.teamColor = float4(1, 1, 1, 1);
+    a.tint = float4(1, 1, 1, 1);
+    a.health = 1;
+    a.animationFrame = 0;
+    a.selection = 0;
+    a.textureSlice = drawTextureSlice;
+#if INSTANCE_ATTRIBUTES != 0
+    if (firstInstanceAttribute == noInstanceAttributes) return a;
+    uint instance = instanceIndex(iid);
+#if INSTANCE_ATTRIBUTES & ATTRIBUTE_TEAM_COLOR
+    uint teamColor = instanceAttribute(instance, ATTRIBUTE_TEAM_COLOR);
+    a.teamColor = float4(teamColor & 0xFF, (teamColor >> 8) & 0xFF, (teamColor >> 16) & 0xFF, teamColor >> 24) / 255.0;
+#endif
+#if INSTANCE_ATTRIBUTES & ATTRIBUTE_TINT
+    uint tint = instanceAttribute(instance, ATTRIBUTE_TINT);
+    a.tint = float4(tint & 0xFF, (tint >> 8) & 0xFF, (tint >> 16) & 0xFF, tint >> 24) / 255.0;
+#endif
+#if INSTANCE_ATTRIBUTES & ATTRIBUTE_HEALTH
+    a.health = asfloat(instanceAttribute(instance, ATTRIBUTE_HEALTH));
+#endif
+#if INSTANCE_ATTRIBUTES & ATTRIBUTE_ANIMATION_FRAME
+    a.animationFrame = instanceAttribute(instance, ATTRIBUTE_ANIMATION_FRAME);
+#endif
+#if INSTANCE_ATTRIBUTES & ATTRIBUTE_SELECTION
+    a.selection = instanceAttribute(instance, ATTRIBUTE_SELECTION);
+#endif
+#if INSTANCE_ATTRIBUTES & ATTRIBUTE_TEXTURE_SLICE
+    a.textureSlice += instanceAttribute(instance, ATTRIBUTE_TEXTURE_SLICE);
+#endif
+#endif
+    return a;
+}
+
+// Rebuilds the (row vector) world matrix of an instance.
+float4x4 instanceWorld(uint iid)
+{
+    InstanceData inst = gInstances[firstInstance + instanceIndex(iid)];
+#if INSTANCE_FORMAT == 1
+    float4 c0 = inst.columns[0];
+    float4 c1 = inst.columns[1];
+    float4 c2 = inst.columns[2];
+    return float4x4(c0.x, c1.x, c2.x, 0,
+                    c0.y, c1.y, c2.y, 0,
+                    c0.z, c1.z, c2.z, 0,
+                    c0.w, c1.w, c2.w, 1);
+#elif INSTANCE_FORMAT == 2
+    float4 q = inst.rotation;
+    float s = inst.scale;
+    float3 r0 = float3(1 - 2 * (q.y * q.y + q.z * q.z), 2 * (q.x * q.y + q.z * q.w), 2 * (q.x * q.z - q.y * q.w));
+    float3 r1 = float3(2 * (q.x * q.y - q.z * q.w), 1 - 2 * (q.x * q.x + q.z * q.z), 2 * (q.y * q.z + q.x * q.w));
+    float3 r2 = float3(2 * (q.x * q.z + q.y * q.w), 2 * (q.y * q.z - q.x * q.w), 1 - 2 * (q.x * q.x + q.y * q.y));
+    return float4x4(float4(r0 * s, 0), float4(r1 * s, 0), float4(r2 * s, 0), float4(inst.position, 1));
+#elif INSTANCE_FORMAT == 3
+    float yaw = f16tof32(inst.yawScale & 0xFFFF);
+    float s = f16tof32(inst.yawScale >> 16);
+    float sinYaw, cosYaw;
+    sincos(yaw, sinYaw, cosYaw);
+    return float4x4(cosYaw * s, 0, -sinYaw * s, 0,
+                    0,          s, 0,           0,
+                    sinYaw * s, 0, cosYaw * s,  0,
+                    inst.position,              1);
+#else
+    return inst.World;
+#endif
+}
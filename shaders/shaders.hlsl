@@ -7,13 +7,15 @@ struct PSInput
     float4 position : SV_POSITION;
     float2 uv: TEXCOORD0;
     float3 normal : NORMAL;
+    float3 worldPosition : POSITION1;
+    // Team color times tint, see InstanceAttributes.
+    nointerpolation float4 color : COLOR0;
+    nointerpolation uint selection : SELECTION;
+    nointerpolation uint textureSlice : TEXTURESLICE;
 };
 
-struct InstanceData {
-    row_major float4x4 World;   
-    // uint boneBase; float4 tint; // add more per-instance fields later
-};
-StructuredBuffer<InstanceData> gInstances : register(t0);
+#include "instance_data.hlsli"
+#include "clustered_lights.hlsli"
 
 cbuffer FrameCB : register(b0)
 {
@@ -32,16 +34,21 @@ PSInput VSMain(float4 position : POSITION, float2 uv : TEXCOORD0,
                             float3 normal : NORMAL, 
                             uint iid : SV_InstanceID)
 {
-    InstanceData inst = gInstances[iid];
-    float4x4 W = inst.World;
+    float4x4 W = instanceWorld(iid);
+    InstanceAttributes attributes = instanceAttributes(iid);
     PSInput result;
 
     result.position = mul(position, W);
+    result.worldPosition = result.position.xyz;
     result.position = mul(result.position, View);
     result.position = mul(result.position, Proj);
     
-    result.normal = normal;
+    // The point lights need the normal in world space.
+    result.normal = mul(normal, (float3x3) W);
     result.uv = uv;
+    result.color = attributes.teamColor * attributes.tint;
+    result.selection = attributes.selection;
+    result.textureSlice = attributes.textureSlice;
 
     return result;
 }
@@ -57,7 +64,8 @@ cbuffer MaterialCB : register(b0)
 
 };
 
-Texture2D diffuseTexture : register(t0);
+// Every texture is a slice of a texture array, see instance_data.hlsli.
+Texture2DArray diffuseTexture : register(t0);
 SamplerState defaultSampler : register(s0);
 
 struct PSOut { 
@@ -67,7 +75,8 @@ struct PSOut {
 
 float4 directionalLight(PSInput pixelShaderInput) 
 {
-    float4 colorFromTexture = diffuseTexture.Sample(defaultSampler, pixelShaderInput.uv);
+    float4 colorFromTexture = diffuseTexture.Sample(defaultSampler, float3(pixelShaderInput.uv, pixelShaderInput.textureSlice)) 
+                                * pixelShaderInput.color;
     // float4 colorFromTexture = float4(0.9, 0.9, 0.9, 1);
     // float teamColorValue = getTeamColorMapValue(pixelShaderInput.uv);
     // colorFromTexture.rgb = lerp(colorFromTexture.rgb, teamColor.rgb, teamColorValue);
@@ -79,6 +88,11 @@ float4 directionalLight(PSInput pixelShaderInput)
     float4 litColor = (float4)0;
     float3 diffuse = nDotL * colorFromTexture.rgb;
     litColor.rgb = ambient + diffuse;
+    litColor.rgb += pointLights(pixelShaderInput.position, pixelShaderInput.worldPosition, normal, colorFromTexture.rgb);
+    // Selected instances are lit up a little.
+    if (pixelShaderInput.selection != 0) {
+        litColor.rgb += 0.15;
+    }
     litColor.a = colorFromTexture.a;
     return litColor;
 }
@@ -0,0 +1,85 @@
+#pragma pack_matrix(row_major)
+
+// Sprites of the 2D views, see SpriteRecord in renderer.h.
+// There is no vertex buffer, every instance is one sprite
+// and its six vertices are made up from SV_VertexID.
+
+struct PSInput
+{
+    float4 position : SV_POSITION;
+    float2 uv: TEXCOORD0;
+    float4 color : COLOR0;
+    nointerpolation uint textureSlice : TEXTURESLICE;
+};
+
+struct SpriteData
+{
+    float2 position;
+    float2 size;
+    uint uvMin;
+    uint uvMax;
+    uint color;
+    float layer;
+};
+StructuredBuffer<SpriteData> gSprites : register(t0);
+
+cbuffer FrameCB : register(b0)
+{
+    row_major float4x4 View;
+    row_major float4x4 Proj;
+};
+
+// Where the sprites of the current draw start in gSprites,
+// and the slice of their texture in its texture array.
+cbuffer InstanceCB : register(b2)
+{
+    uint firstInstance;
+    uint firstInstanceIndex;
+    uint firstInstanceAttribute;
+    uint drawTextureSlice;
+};
+
+// Two clockwise triangles, in the order of the "quad" mesh.
+static const float2 corners[6] = {
+    float2(0, 0), float2(0, 1), float2(1, 1),
+    float2(0, 0), float2(1, 1), float2(1, 0)
+};
+
+float2 unpackUnorm16x2(uint value)
+{
+    return float2(value & 0xFFFF, value >> 16) / 65535.0;
+}
+
+float4 unpackColor(uint value)
+{
+    return float4(value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, value >> 24) / 255.0;
+}
+
+PSInput VSMain(uint vid : SV_VertexID, uint iid : SV_InstanceID)
+{
+    SpriteData sprite = gSprites[firstInstance + iid];
+    float2 corner = corners[vid];
+
+    PSInput result;
+    float2 position = sprite.position + (corner - 0.5) * sprite.size;
+    result.position = mul(float4(position, sprite.layer, 1), View);
+    result.position = mul(result.position, Proj);
+    result.uv = lerp(unpackUnorm16x2(sprite.uvMin), unpackUnorm16x2(sprite.uvMax), corner);
+    result.color = unpackColor(sprite.color);
+    result.textureSlice = drawTextureSlice;
+
+    return result;
+}
+
+
+// --------------------------------------------------------------------------------------------
+// PixelShader
+// --------------------------------------------------------------------------------------------
+
+Texture2DArray diffuseTexture : register(t0);
+SamplerState defaultSampler : register(s0);
+
+float4 PSMain(PSInput input) : SV_TARGET
+{
+    return diffuseTexture.Sample(defaultSampler, float3(input.uv, input.textureSlice)) * input.color;
+}
@@ -7,13 +7,12 @@ struct PSInput
     float4 position : SV_POSITION;
     float2 uv: TEXCOORD0;
     float3 normal : NORMAL;
+    // The tint of the instance, see InstanceAttributes.
+    nointerpolation float4 color : COLOR0;
+    nointerpolation uint textureSlice : TEXTURESLICE;
 };
 
-struct InstanceData {
-    row_major float4x4 World;   
-    // uint boneBase; float4 tint; // add more per-instance fields later
-};
-StructuredBuffer<InstanceData> gInstances : register(t0);
+#include "instance_data.hlsli"
 
 cbuffer FrameCB : register(b0)
 {
@@ -32,8 +31,8 @@ PSInput VSMain(float4 position : POSITION, float2 uv : TEXCOORD0,
                             float3 normal : NORMAL, 
                             uint iid : SV_InstanceID)
 {
-    InstanceData inst = gInstances[iid];
-    float4x4 W = inst.World;
+    float4x4 W = instanceWorld(iid);
+    InstanceAttributes attributes = instanceAttributes(iid);
     PSInput result;
 
     result.position = mul(position, W);
@@ -42,6 +41,8 @@ PSInput VSMain(float4 position : POSITION, float2 uv : TEXCOORD0,
     
     result.normal = normal;
     result.uv = uv;
+    result.color = attributes.tint;
+    result.textureSlice = attributes.textureSlice;
 
     return result;
 }
@@ -57,7 +58,8 @@ cbuffer MaterialCB : register(b0)
 
 };
 
-Texture2D diffuseTexture : register(t0);
+// Every texture is a slice of a texture array, see instance_data.hlsli.
+Texture2DArray diffuseTexture : register(t0);
 SamplerState defaultSampler : register(s0);
 
 struct PSOut { 
@@ -67,7 +69,7 @@ struct PSOut {
 
 float4 directionalLight(PSInput pixelShaderInput) 
 {
-    float4 colorFromTexture = diffuseTexture.Sample(defaultSampler, pixelShaderInput.uv);
+    float4 colorFromTexture = diffuseTexture.Sample(defaultSampler, float3(pixelShaderInput.uv, pixelShaderInput.textureSlice));
     // float4 colorFromTexture = float4(0.9, 0.9, 0.9, 1);
     // float teamColorValue = getTeamColorMapValue(pixelShaderInput.uv);
     // colorFromTexture.rgb = lerp(colorFromTexture.rgb, teamColor.rgb, teamColorValue);
@@ -86,6 +88,6 @@ float4 directionalLight(PSInput pixelShaderInput)
 
 float4 PSMain(PSInput input) : SV_TARGET
 {
-    return diffuseTexture.Sample(defaultSampler, input.uv);
+    return diffuseTexture.Sample(defaultSampler, float3(input.uv, input.textureSlice)) * input.color;
 
 }
\ No newline at end of file
@@ -1,5 +1,9 @@
 #pragma once
+#ifdef _WIN32
 #include <Windows.h>
+#else
+using HWND = void*;
+#endif
 #include <string>
 #include <vector>
 #include "engine.h"
@@ -216,6 +216,7 @@ public:
                     out.vertices.push_back(p[0]);
                     out.vertices.push_back(p[1]);
                     out.vertices.push_back(p[2]);
+                    out.positions.push_back({p[0], p[1], p[2]});
 
                     out.vertices.push_back(uv[0]);
                     out.vertices.push_back(uv[1]);
@@ -5,11 +5,40 @@
 #include <string>
 #include <d3dcompiler.h>
 #include <optional>
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
 #include <DirectXTK/SimpleMath.h>
 #include "renderer.h"
 #include "../lib/include/stb_image.h"
 
-extern DirectX::SimpleMath::Vector2 resizedDimension; 
+// The compiler behind the shader cache.
+class D3DShaderCompiler : public ShaderCompiler
+{
+    public:
+        bool compile(const ShaderCompileRequest& request, std::vector<uint8_t>& bytecode, std::string& errors) override
+        {
+            std::vector<D3D_SHADER_MACRO> macros;
+            for (auto& define : request.defines) {
+                macros.push_back({define.name.c_str(), define.value.c_str()});
+            }
+            macros.push_back({nullptr, nullptr});
+
+            ComPtr<ID3DBlob> blob;
+            ComPtr<ID3DBlob> errorBlob;
+            auto result = D3DCompileFromFile(request.sourcePath.c_str(), macros.data(), D3D_COMPILE_STANDARD_FILE_INCLUDE,
+                                                request.entryPoint.c_str(), request.profile.c_str(), request.flags, 0,
+                                                blob.GetAddressOf(), errorBlob.GetAddressOf());
+            if (errorBlob) {
+                errors.assign(static_cast<const char*>(errorBlob->GetBufferPointer()), errorBlob->GetBufferSize());
+            }
+            if (FAILED(result)) return false;
+
+            auto data = static_cast<const uint8_t*>(blob->GetBufferPointer());
+            bytecode.assign(data, data + blob->GetBufferSize());
+            return true;
+        }
+};
 
 void DX11Renderer::initialize(RenderInitData initData) 
 {
@@ -141,38 +170,83 @@ void DX11Renderer::initialize(RenderInitData initData)
     
     bindBackBuffer(0, 0, initData.screenWidth, initData.screenHeight);
 
+    shaderCache = std::make_unique<ShaderCache>(std::make_unique<D3DShaderCompiler>(), "../shader_cache");
     for (auto& pso : initData.pipelineStates) {
-        auto shader = createShaderProgram(pso.shader);
+        auto shader = createShaderProgram(pso.shader, pso.instanceFormat, pso.instanceAttributes);
         auto inputLayout = createInputLayout(pso.inputLayout, &shader);
-        shaderMap[pso.id] = shader;
-        dxInputLayoutMap[pso.id] =  inputLayout ;
-        inputLayoutMap[pso.id] = { pso.inputLayout };
+        pipelines.push_back({shader, inputLayout, pso.inputLayout.stride(), pso.instanceFormat, pso.instanceAttributes});
     }
+    renderQueue.initialize(initData);
 
     
 
     objectTransformBuffer = createBuffer(nullptr, sizeof(ObjectTransformCB), D3D11_USAGE_DYNAMIC, D3D11_BIND_CONSTANT_BUFFER);
     cameraBuffer = createBuffer(nullptr, sizeof(CameraCB), D3D11_USAGE_DYNAMIC, D3D11_BIND_CONSTANT_BUFFER);
-    instanceBuffer = createBuffer(nullptr, sizeof(InstanceData) * maxInstances, 
-                D3D11_USAGE_DYNAMIC, D3D11_BIND_SHADER_RESOURCE, 
-                D3D11_RESOURCE_MISC_BUFFER_STRUCTURED, 
-                sizeof(InstanceData));
-    instanceSRV = createShaderResourceViewForBuffer(instanceBuffer, maxInstances);
+    InstanceCB instanceCB = {};
+    instanceOffsetBuffer = createBuffer(&instanceCB, sizeof(InstanceCB), D3D11_USAGE_DEFAULT, D3D11_BIND_CONSTANT_BUFFER);
+    ClusterConstants clusterCB;
+    clusterBuffer = createBuffer(&clusterCB, sizeof(ClusterConstants), D3D11_USAGE_DEFAULT, D3D11_BIND_CONSTANT_BUFFER);
+
+    D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+    if (SUCCEEDED(device_->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options)))) {
+        noOverwriteInstances = options.MapNoOverwriteOnDynamicBufferSRV;
+    }
+    for (auto& pipeline : pipelines) {
+        if (!instanceStreams[(uint32_t) pipeline.instanceFormat].buffer) {
+            auto stride = instanceStride(pipeline.instanceFormat);
+            growStream(instanceStreams[(uint32_t) pipeline.instanceFormat], stride, stride * maxInstances);
+        }
+        auto& identity = identityInstances[(uint32_t) pipeline.instanceFormat];
+        if (!identity.buffer) {
+            std::vector<uint8_t> packed(instanceStride(pipeline.instanceFormat));
+            auto transform = DirectX::SimpleMath::Matrix::Identity;
+            packInstances(pipeline.instanceFormat, {&transform, 1}, packed.data());
+            identity.buffer = createBuffer(packed.data(), packed.size(), D3D11_USAGE_IMMUTABLE, D3D11_BIND_SHADER_RESOURCE,
+                                           D3D11_RESOURCE_MISC_BUFFER_STRUCTURED, packed.size());
+            identity.srv = createShaderResourceViewForBuffer(identity.buffer, 1);
+            identity.capacity = 1;
+        }
+    }
+    growStream(indexStream, sizeof(uint32_t), sizeof(uint32_t) * maxInstances);
+    growStream(attributeStream, sizeof(uint32_t), sizeof(uint32_t) * maxInstances);
+    growStream(spriteStream, sizeof(SpriteRecord), sizeof(SpriteRecord) * maxInstances);
+    growStream(lightStream, sizeof(PointLight), sizeof(PointLight) * 1024);
+    growStream(lightClusterStream, sizeof(LightCluster), sizeof(LightCluster) * LightBinner::viewClusters);
+    growStream(lightIndexStream, sizeof(uint32_t), sizeof(uint32_t) * LightBinner::viewClusters * 4);
+    lightBinner.initialize(initData.jobSystem);
 
     // Now create gpu resources for the assets:
-    for (auto& md : initData.meshDescriptors)  {
-        auto vb = createBuffer(md.geometry.vertices.data(), md.geometry.vertices.size() * sizeof(float), 
+    auto createMesh = [this](Geometry& geometry) {
+        auto vb = createBuffer(geometry.vertices.data(), geometry.vertices.size() * sizeof(float), 
                     D3D11_USAGE_DEFAULT, D3D11_BIND_VERTEX_BUFFER);
-        auto ib = createBuffer(md.geometry.indices.data(), md.geometry.indices.size() * sizeof(uint32_t), 
+        auto ib = createBuffer(geometry.indices.data(), geometry.indices.size() * sizeof(uint32_t), 
                     D3D11_USAGE_DEFAULT, D3D11_BIND_INDEX_BUFFER);
         
-        meshMap[md.id] = Mesh {vb, ib, md.geometry.indices.size()};
+        meshes.push_back(Mesh {vb, ib, geometry.indices.size()});
+    };
+    for (auto& md : initData.meshDescriptors)  {
+        createMesh(md.geometry);
+    }
+    // The LOD levels live behind the game's meshes, see mesh_lod.h.
+    for (auto& md : initData.meshDescriptors)  {
+        for (auto& lod : md.lods) {
+            createMesh(lod.geometry);
+        }
     }
 
+    // One GPU texture per array, see texture_arrays.h.
+    for (auto& ta : initData.textureArrays) {
+        std::vector<Image> images;
+        for (auto texture : ta.textures) {
+            images.push_back(loadImagePixels(initData.textureDescriptors[texture.index].filePath));
+        }
+        textureArrays.push_back(createTextureArray(images));
+        for (auto& image : images) {
+            stbi_image_free(image.pixels);
+        }
+    }
     for (auto& td : initData.textureDescriptors) {
-        auto image = loadImagePixels(td.filePath);
-        auto texture = createTexture(image.pixels, image.w, image.h);
-        textureMap[td.id] = texture;
+        textureSlots.push_back(td.slot);
     }
 
     // Text rendering
@@ -182,36 +256,46 @@ void DX11Renderer::initialize(RenderInitData initData)
         auto textInputLayout = InputLayout().addElement({InputElementType::POSITION}).addElement({InputElementType::UV});
         auto inputLayout = createInputLayout(textInputLayout, &textShader);
         
-        shaderMap["text"] = textShader;
-        dxInputLayoutMap["text"] =  inputLayout ;
-        inputLayoutMap["text"] = { textInputLayout };
+        textPipelineIndex = pipelines.size();
+        pipelines.push_back({textShader, inputLayout, textInputLayout.stride()});
+
+        // Sprites make up their vertices in the shader.
+        spritePipelineIndex = pipelines.size();
+        pipelines.push_back({createShaderProgram(L"../shaders/sprite.hlsl"), nullptr, 0});
+        std::cout << "Shader stages: " << shaderCache->stats().hits << " cached, "
+                    << shaderCache->stats().compiles << " compiled" << std::endl;
 
         for (auto& fd : initData.fontDescriptors) {
-            auto font = createFont(fd.fontFilePath, fd.size);
-            fontMap[fd.id] = font;
+            fontIndices[fd.id] = fonts.size();
+            fonts.push_back(createFont(fd.fontFilePath, fd.size));
         }
 
-        for (auto& sd : initData.snippetDescriptors) {
-            renderTextIntoQuad(sd.snippetId, sd.fontId, sd.text);
+        // Snippets are created in descriptor order, 
+        // so the index matches the SnippetHandle.
+        for (uint32_t i = 0; i < initData.snippetDescriptors.size(); i++) {
+            auto& sd = initData.snippetDescriptors[i];
+            renderTextIntoQuad(i, fontIndices[sd.fontId], sd.text);
         }
     }
 
 }
 
-void DX11Renderer::renderTextIntoQuad(const std::string& snippetId, const std::string& fontId, const std::string& text) {
+void DX11Renderer::renderTextIntoQuad(uint32_t snippetIndex, uint32_t fontIndex, std::string_view text) {
     std::optional<TextSnippet> oldSnippet;
-    if (snippetMap.find(snippetId) != snippetMap.end()) {
-        oldSnippet = snippetMap[snippetId];
+    if (snippetIndex < snippets.size()) {
+        oldSnippet = std::move(snippets[snippetIndex]);
         oldSnippet.value().geometry.vertices.clear();
         oldSnippet.value().geometry.indices.clear();
         oldSnippet.value().geometry.positions.clear();
         oldSnippet.value().geometry.uvs.clear();
     }
 
-    const Font& font = fontMap[fontId];
+    const Font& font = fonts[fontIndex];
 
-    auto textSnippet = oldSnippet.has_value() ? oldSnippet : TextSnippet();
-    textSnippet.value().fontId = fontId;
+    // Moving keeps the capacity of the old geometry, so steady state
+    // text updates don't allocate.
+    auto textSnippet = oldSnippet.has_value() ? std::move(oldSnippet) : std::optional<TextSnippet>(TextSnippet());
+    textSnippet.value().fontIndex = fontIndex;
     float penX = 0, penY = 0;
     float minX = std::numeric_limits<float>::max();
     float maxX = -std::numeric_limits<float>::max();
@@ -336,7 +420,11 @@ void DX11Renderer::renderTextIntoQuad(const std::string& snippetId, const std::s
     }
     textSnippet.value().mesh.indexCount = textSnippet.value().geometry.indices.size();
 
-    snippetMap[snippetId] = textSnippet.value();
+    if (snippetIndex < snippets.size()) {
+        snippets[snippetIndex] = std::move(textSnippet.value());
+    } else {
+        snippets.push_back(std::move(textSnippet.value()));
+    }
     
 }
 
@@ -395,6 +483,46 @@ Texture DX11Renderer::createTexture(uint8_t* pixels, uint32_t width, uint32_t he
     
 }
 
+// All images must have the same size, they become the slices in their order.
+Texture DX11Renderer::createTextureArray(std::span<const Image> images) {
+
+    for (auto& image : images) {
+        if (!image.pixels || image.w != images[0].w || image.h != images[0].h) {
+            throw std::runtime_error("texture array slices must be loaded and of the same size");
+        }
+    }
+
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Width = images[0].w;
+    desc.Height = images[0].h;
+    desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+    desc.Usage = D3D11_USAGE_IMMUTABLE;
+    desc.MipLevels = 1;
+    desc.ArraySize = images.size();
+    desc.SampleDesc.Count = 1;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+    std::vector<D3D11_SUBRESOURCE_DATA> slices;
+    for (auto& image : images) {
+        slices.push_back({image.pixels, (UINT) image.w * 4, 0});
+    }
+    ComPtr<ID3D11Texture2D> dxTex;
+    ThrowIfFailed(device_->CreateTexture2D(&desc, slices.data(), dxTex.GetAddressOf()));
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+    srvDesc.Format = desc.Format;
+    srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+    srvDesc.Texture2DArray.MostDetailedMip = 0;
+    srvDesc.Texture2DArray.MipLevels = 1;
+    srvDesc.Texture2DArray.FirstArraySlice = 0;
+    srvDesc.Texture2DArray.ArraySize = desc.ArraySize;
+
+    ComPtr<ID3D11ShaderResourceView> srv;
+    ThrowIfFailed(device_->CreateShaderResourceView(dxTex.Get(), &srvDesc, srv.GetAddressOf()));
+
+    return {dxTex, srv};
+}
+
 ComPtr<ID3D11ShaderResourceView> DX11Renderer::createShaderResourceViewForBuffer(ComPtr<ID3D11Buffer> buffer, 
                                                     uint32_t numInstances) {
     D3D11_SHADER_RESOURCE_VIEW_DESC sd = {};
@@ -418,20 +546,25 @@ void DX11Renderer::ThrowIfFailed(HRESULT result)
 
 /// @brief This function expects a single file containing at least vertex- and pixel shader.
 /// @param filePath 
+/// @param instanceFormat How the vertex shader decodes the per instance data.
+/// @param instanceAttributes The InstanceAttribute bits the shader reads.
 /// @return A shaderprogram with the vertex and pixel-shader.
-ShaderProgram DX11Renderer::createShaderProgram(const std::wstring &filePath) {
+ShaderProgram DX11Renderer::createShaderProgram(const std::wstring &filePath, InstanceFormat instanceFormat,
+                                                uint32_t instanceAttributes) {
     UINT flags = D3DCOMPILE_ENABLE_STRICTNESS;
     #ifndef NDEBUG
     flags |= D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
     #endif
 
-    ComPtr<ID3DBlob> vsBlob;
-    ThrowIfFailed(D3DCompileFromFile(filePath.c_str(), nullptr, nullptr, "VSMain", "vs_5_0", 
-                                            flags, 0, vsBlob.GetAddressOf(), nullptr));
+    ShaderCompileRequest request;
+    request.sourcePath = filePath;
+    // Selects the instance decoding of shaders/instance_data.hlsli.
+    request.defines = {{"INSTANCE_FORMAT", std::to_string((int) instanceFormat)},
+                        {"INSTANCE_ATTRIBUTES", std::to_string(instanceAttributes)}};
+    request.flags = flags;
 
-    ComPtr<ID3DBlob> psBlob;
-    ThrowIfFailed(D3DCompileFromFile(filePath.c_str(), nullptr, nullptr, "PSMain", "ps_5_0", 
-                                            flags, 0, psBlob.GetAddressOf(), nullptr));
+    auto vsBlob = loadShaderBlob(request, "VSMain", "vs_5_0");
+    auto psBlob = loadShaderBlob(request, "PSMain", "ps_5_0");
     
     ComPtr<ID3D11VertexShader> vertexShader;
     ThrowIfFailed(device_->CreateVertexShader(vsBlob->GetBufferPointer(),
@@ -445,6 +578,25 @@ ShaderProgram DX11Renderer::createShaderProgram(const std::wstring &filePath) {
     
 }
 
+/// @brief Takes the bytecode of one stage from the shader cache, which compiles it if needed.
+ComPtr<ID3DBlob> DX11Renderer::loadShaderBlob(ShaderCompileRequest request, const char* entryPoint, const char* profile)
+{
+    request.entryPoint = entryPoint;
+    request.profile = profile;
+
+    std::vector<uint8_t> bytecode;
+    std::string errors;
+    if (!shaderCache->load(request, bytecode, errors)) {
+        std::cerr << "Failed to compile " << request.sourcePath.string() << " " << entryPoint << ":\n" << errors << std::endl;
+        throw std::exception("failed shader compilation");
+    }
+
+    ComPtr<ID3DBlob> blob;
+    ThrowIfFailed(D3DCreateBlob(bytecode.size(), blob.GetAddressOf()));
+    memcpy(blob->GetBufferPointer(), bytecode.data(), bytecode.size());
+    return blob;
+}
+
 ComPtr<ID3D11DeviceChild> DX11Renderer::createShader(const std::wstring &filePath, ShaderType shaderType)
 {
     UINT flags = D3DCOMPILE_ENABLE_STRICTNESS;
@@ -510,114 +662,547 @@ ComPtr<ID3D11Buffer> DX11Renderer::createBuffer(void *data, int size, D3D11_USAG
     return buffer;
 }
 
-void DX11Renderer::doFrame(FrameSubmission frameSubmission)
+void DX11Renderer::doFrame(const FrameSubmission& frameSubmission)
 {
     
-    if ((resizedDimension.x > 0 && resizedDimension.y > 0) && (resizedDimension.x != screenWidth || resizedDimension.y != screenHeight)){
-        screenWidth = resizedDimension.x;
-        screenHeight = resizedDimension.y;
-        resizeSwapChain(hwnd, resizedDimension.x, resizedDimension.y);
+    int newWidth = frameSubmission.resizeWidth;
+    int newHeight = frameSubmission.resizeHeight;
+    if ((newWidth > 0 && newHeight > 0) && (newWidth != screenWidth || newHeight != screenHeight)){
+        screenWidth = newWidth;
+        screenHeight = newHeight;
+        resizeSwapChain(hwnd, newWidth, newHeight);
     }
     
-    clearBackBuffer(0, 0, 0, 1);
-    bindBackBuffer(0, 0, screenWidth, screenHeight);
-    for (auto& vs: frameSubmission.viewSubmissions) {
-
-        // Upload camera matrices
-        CameraCB ccb = { vs.viewMatrix, vs.projectionMatrix };
-        ConstantBufferDesc cameraCB = {};
-        cameraCB.buffer = cameraBuffer;
-        cameraCB.bufferData = &ccb;
-        cameraCB.shaderType = ShaderType::Vertex;
-        cameraCB.size = sizeof(ccb);
-        cameraCB.slot = 0;
-        uploadConstantBufferData(cameraCB);
-
-        for (auto& ord : vs.objectRenderData)
-        {
-            
-            // Upload world matrix
-            ConstantBufferDesc ocb= {};
-            ocb.buffer = objectTransformBuffer;
-            ocb.size = sizeof(ObjectTransformCB);
-            ocb.bufferData = &ord.worldMatrices[0];
-            ocb.slot = 1;
-            ocb.shaderType = ShaderType::Vertex;
-            uploadConstantBufferData(ocb);
+    for (auto& update : frameSubmission.retainedUpdates) {
+        applyRetainedUpdate(update);
+    }
+    for (auto& update : frameSubmission.staticUpdates) {
+        applyStaticUpdate(update);
+    }
 
+    stateCache.resetStats();
+    renderQueue.build(frameSubmission);
+    spriteBatcher.build(frameSubmission);
+    lightBinner.build(frameSubmission, screenWidth, screenHeight);
+    uploadFrameLights();
+    uploadFrameInstances(frameSubmission);
+
+    // Every view draws on top of the previous ones into the back buffer,
+    // the graph orders the passes and culls the ones nothing is presented from.
+    renderGraph.beginFrame();
+    auto backBufferResource = renderGraph.importResource("back buffer");
+    auto depthResource = renderGraph.importResource("depth");
+    renderGraph.markOutput(backBufferResource);
+
+    renderGraph.addPass("clear", [this] {
+        // Present may unbind the back buffer, so the frame starts from unknown state.
+        stateCache.invalidate();
+        clearBackBuffer(0, 0, 0, 1);
+        bindBackBuffer(0, 0, screenWidth, screenHeight);
+        if (stateCache.bind(StateKind::Topology, 0, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST)) {
             ctx->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-            auto& mesh = meshMap[ord.meshId];
-            
-
-            auto inputLayout = inputLayoutMap[ord.inputLayoutId];
-            auto dxInputLayout = dxInputLayoutMap[ord.inputLayoutId];
-            auto stride = inputLayout.stride();
-
-            // Instancing
-            StructuredBufferDesc sbd = {};
-            sbd.buffer = instanceBuffer;
-            sbd.srv = instanceSRV;
-            sbd.slot = 0;
-            std::vector<InstanceData> instanceItems;
-            for (auto& w : ord.worldMatrices) {
-                instanceItems.push_back({w});
+        }
+        bindConstantBuffer(ShaderType::Vertex, 2, instanceOffsetBuffer.Get());
+    }).write(backBufferResource).write(depthResource);
+
+    for (uint32_t viewIndex = 0; viewIndex < frameSubmission.viewSubmissions.size(); viewIndex++) {
+        renderGraph.addPass("view", [this, &frameSubmission, viewIndex] {
+            drawView(frameSubmission, viewIndex);
+        }).readWrite(backBufferResource).readWrite(depthResource);
+    }
+
+    if (renderGraph.compile()) {
+        createGraphTargets();
+    }
+    renderGraph.execute();
+
+    flipBackbuffer();
+}
+
+void DX11Renderer::drawView(const FrameSubmission& frameSubmission, uint32_t viewIndex)
+{
+    auto& vs = frameSubmission.viewSubmissions[viewIndex];
+    uint32_t objectBatch = viewFirstObjectBatch[viewIndex];
+
+    // Upload camera matrices
+    CameraCB ccb = { vs.viewMatrix, vs.projectionMatrix };
+    ConstantBufferDesc cameraCB = {};
+    cameraCB.buffer = cameraBuffer;
+    cameraCB.bufferData = &ccb;
+    cameraCB.shaderType = ShaderType::Vertex;
+    cameraCB.size = sizeof(ccb);
+    cameraCB.slot = 0;
+    uploadConstantBufferData(cameraCB);
+    bindViewLights(viewIndex);
+
+    // Walk the draws in sorted order, 
+    // compatible ObjectRenderData are already merged into one batch:
+    for (auto& batch : renderQueue.viewBatches(viewIndex)) 
+    {
+        if (batch.type == DrawItemType::Static) {
+            drawStatic(vs.staticDraws[renderQueue.batchItems(batch)[0].index]);
+        } else if (batch.type != DrawItemType::Retained) {
+            // The instances were uploaded before, all batches of a format share one stream.
+            // Pooled batches draw their pool through the indices of the visible instances.
+            // Object batches which read the slice per instance may mix the textures of an array.
+            auto& pipeline = pipelines[batch.pipeline.index];
+            bool slicePerInstance = batch.type == DrawItemType::Object &&
+                                    (pipeline.instanceAttributes & instanceAttributeBit(InstanceAttribute::TextureSlice));
+            setFirstInstance(batchFirstInstances[objectBatch], batchFirstIndices[objectBatch], 
+                             batchFirstAttributes[objectBatch], 
+                             slicePerInstance ? 0 : textureSlots[batch.texture.index].slice);
+            objectBatch++;
+            bindVertexResource(0, instanceStreams[(uint32_t) pipeline.instanceFormat].srv.Get());
+            if (batch.type == DrawItemType::Pooled) {
+                bindVertexResource(1, indexStream.srv.Get());
             }
-            sbd.data = instanceItems;
-            uploadStructuredBufferData(sbd);
-            
-            auto texture = textureMap[ord.textureId];
-            bindTexture(0, texture);
-            ctx->IASetInputLayout(dxInputLayout.Get());
-            ctx->VSSetShader((ID3D11VertexShader*) shaderMap[ord.inputLayoutId].vs.vertexShader.Get(), nullptr, 0);
-            ctx->PSSetShader((ID3D11PixelShader*) shaderMap[ord.inputLayoutId].ps.pixelShader.Get(), nullptr, 0);
-            std::vector<ID3D11Buffer*> vertexBuffers = {mesh.vb.Get()};
-            uint32_t offsets[] = {0};
-            ctx->IASetVertexBuffers(0, 1, vertexBuffers.data(), &stride, offsets);
-            ctx->IASetIndexBuffer(mesh.ib.Get(), DXGI_FORMAT_R32_UINT, 0);
-            ctx->DrawIndexedInstanced(mesh.indexCount, instanceItems.size(), 0, 0, 0);
+            if (pipeline.instanceAttributes) {
+                bindVertexResource(2, attributeStream.srv.Get());
+            }
+
+            drawInstanced(batch.mesh, batch.pipeline, batch.texture, batch.instanceCount);
+        } else {
+            // Retained RenderScene batch, the instances already live on the GPU.
+            auto& draw = vs.retainedDraws[renderQueue.batchItems(batch)[0].index];
+            auto& batchBuffer = retainedBatches[draw.batch];
+            setFirstInstance(0, noInstanceIndices, noInstanceAttributes, textureSlots[draw.texture.index].slice);
+            bindVertexResource(0, batchBuffer.srv.Get());
+
+            drawInstanced(draw.mesh, draw.pipeline, draw.texture, draw.instanceCount);
         }
+    }
 
-        // Text rendering:
-        for (auto& snippetDesc : vs.textRenderData) 
-        {
+    drawSprites(viewIndex);
+
+    // Text rendering, always on top of the rest of the view:
+    for (auto& snippetDesc : vs.textRenderData) 
+    {
+        if (snippetDesc.worldMatrices.empty()) continue;
+
+        auto snippetIndex = snippetDesc.snippet.index;
+        renderTextIntoQuad(snippetIndex, snippets[snippetIndex].fontIndex, snippetDesc.updatedText);
+        auto& snippet = snippets[snippetIndex];
+
+        // Upload world matrix
+        ConstantBufferDesc ocb= {};
+        ocb.buffer = objectTransformBuffer;
+        ocb.size = sizeof(ObjectTransformCB);
+        ocb.bufferData = &snippetDesc.worldMatrices[0];
+        ocb.slot = 1;
+        ocb.shaderType = ShaderType::Vertex;
+        uploadConstantBufferData(ocb);
+
+        auto& mesh = snippet.mesh;
+        auto& pipeline = pipelines[textPipelineIndex];
+
+        bindTexture(0, fonts[snippet.fontIndex].atlasTexture);
+        bindInputLayout(pipeline.inputLayout);
+        bindShader(&pipeline.shader);
+        bindVertexBuffer(mesh.vb.Get(), pipeline.stride);
+        bindIndexBuffer(mesh.ib.Get());
+        ctx->DrawIndexed(mesh.indexCount, 0, 0);
+    }
+}
+
+// One instanced draw of six vertices per sprite for every batch,
+// the sprites come from spriteStream and the quads are made up in the vertex shader.
+void DX11Renderer::drawSprites(uint32_t viewIndex)
+{
+    auto spriteBatches = spriteBatcher.viewBatches(viewIndex);
+    if (spriteBatches.empty()) return;
+
+    auto& pipeline = pipelines[spritePipelineIndex];
+    bindInputLayout(pipeline.inputLayout);
+    bindShader(&pipeline.shader);
+    bindVertexResource(0, spriteStream.srv.Get());
+    for (auto& batch : spriteBatches) {
+        auto& slot = textureSlots[batch.texture.index];
+        setFirstInstance(spriteFirstInstance + batch.firstSprite, noInstanceIndices, noInstanceAttributes, slot.slice);
+        bindTexture(0, textureArrays[slot.array]);
+        ctx->DrawInstanced(6, batch.spriteCount, 0, 0);
+    }
+}
 
-            auto snippet = snippetMap[snippetDesc.snippetId];
-            renderTextIntoQuad(snippetDesc.snippetId, snippet.fontId, snippetDesc.updatedText);
-            snippet = snippetMap[snippetDesc.snippetId];
+// (Re)creates the textures behind the transient resources of the render graph,
+// one per physical resource, so transients with disjoint lifetimes share them.
+void DX11Renderer::createGraphTargets()
+{
+    graphTargets.clear();
+    for (auto& desc : renderGraph.physicalResources()) {
+        bool depth = desc.format == GraphFormat::Depth;
+
+        D3D11_TEXTURE2D_DESC td = {};
+        td.Width = desc.width;
+        td.Height = desc.height;
+        td.MipLevels = 1;
+        td.ArraySize = 1;
+        td.Format = depth ? DXGI_FORMAT_R32_TYPELESS : DXGI_FORMAT_R8G8B8A8_UNORM;
+        td.SampleDesc.Count = 1;
+        td.Usage = D3D11_USAGE_DEFAULT;
+        td.BindFlags = D3D11_BIND_SHADER_RESOURCE | (depth ? D3D11_BIND_DEPTH_STENCIL : D3D11_BIND_RENDER_TARGET);
+
+        GraphTarget target;
+        ThrowIfFailed(device_->CreateTexture2D(&td, nullptr, target.texture.GetAddressOf()));
+
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+        srvDesc.Format = depth ? DXGI_FORMAT_R32_FLOAT : td.Format;
+        srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+        srvDesc.Texture2D.MipLevels = 1;
+        ThrowIfFailed(device_->CreateShaderResourceView(target.texture.Get(), &srvDesc, target.srv.GetAddressOf()));
+
+        if (depth) {
+            D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+            dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+            dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+            ThrowIfFailed(device_->CreateDepthStencilView(target.texture.Get(), &dsvDesc, target.dsv.GetAddressOf()));
+        } else {
+            ThrowIfFailed(device_->CreateRenderTargetView(target.texture.Get(), nullptr, target.rtv.GetAddressOf()));
+        }
+        graphTargets.push_back(std::move(target));
+    }
+}
 
-            // Upload world matrix
-            ConstantBufferDesc ocb= {};
-            ocb.buffer = objectTransformBuffer;
-            ocb.size = sizeof(ObjectTransformCB);
-            ocb.bufferData = &snippetDesc.worldMatrices[0];
-            ocb.slot = 1;
-            ocb.shaderType = ShaderType::Vertex;
-            uploadConstantBufferData(ocb);
+// Packs the visible instances of all object batches of the frame into 
+// the instance streams, with one map per stream instead of one per draw.
+// The instance pools drawn by a view are packed once per format they are drawn with,
+// their batches only add the indices of the visible instances to the index stream.
+// The sprites of the frame go to their own stream.
+template <typename T>
+static T* findPoolAttributes(std::vector<T>& packed, uint32_t pool, uint32_t attributes)
+{
+    for (auto& p : packed) {
+        if (p.pool == pool && p.attributes == attributes) return &p;
+    }
+    return nullptr;
+}
 
-            
+void DX11Renderer::uploadFrameInstances(const FrameSubmission& frameSubmission)
+{
+    constexpr uint32_t notPacked = 0xFFFFFFFF;
+    auto& pools = frameSubmission.instancePools;
+    poolFirstInstances.assign(pools.size() * instanceFormatCount, notPacked);
+
+    poolFirstAttributes.clear();
+
+    size_t bytes[instanceFormatCount] = {};
+    size_t indexBytes = 0;
+    size_t attributeBytes = 0;
+    for (uint32_t v = 0; v < frameSubmission.viewSubmissions.size(); v++) {
+        for (auto& batch : renderQueue.viewBatches(v)) {
+            if (batch.type == DrawItemType::Retained || batch.type == DrawItemType::Static) continue;
+            auto& pipeline = pipelines[batch.pipeline.index];
+            auto format = pipeline.instanceFormat;
+            auto f = (uint32_t) format;
+            auto attributeStride = instanceAttributeStride(pipeline.instanceAttributes);
+            if (batch.type == DrawItemType::Object) {
+                bytes[f] += batch.instanceCount * instanceStride(format);
+                attributeBytes += batch.instanceCount * attributeStride;
+                continue;
+            }
 
-            ctx->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-            
-            auto& mesh = snippet.mesh;
-            
-            auto inputLayout = inputLayoutMap["text"];
-            auto dxInputLayout = dxInputLayoutMap["text"];
-            auto stride = inputLayout.stride();
-
-            auto font = fontMap[snippet.fontId];
-            bindTexture(0, font.atlasTexture);
-            ctx->IASetInputLayout(dxInputLayout.Get());
-            ctx->VSSetShader((ID3D11VertexShader*) shaderMap["text"].vs.vertexShader.Get(), nullptr, 0);
-            ctx->PSSetShader((ID3D11PixelShader*) shaderMap["text"].ps.pixelShader.Get(), nullptr, 0);
-            std::vector<ID3D11Buffer*> vertexBuffers = {mesh.vb.Get()};
-            uint32_t offsets[] = {0};
-            ctx->IASetVertexBuffers(0, 1, vertexBuffers.data(), &stride, offsets);
-            ctx->IASetIndexBuffer(mesh.ib.Get(), DXGI_FORMAT_R32_UINT, 0);
-            ctx->DrawIndexed(mesh.indexCount, 0, 0);
+            auto& packed = poolFirstInstances[batch.pool * instanceFormatCount + f];
+            auto poolSize = pools[batch.pool].worldMatrices.size();
+            if (packed == notPacked) {
+                bytes[f] += poolSize * instanceStride(format);
+                packed = 0;
+            }
+            if (pipeline.instanceAttributes && !findPoolAttributes(poolFirstAttributes, batch.pool, pipeline.instanceAttributes)) {
+                poolFirstAttributes.push_back({batch.pool, pipeline.instanceAttributes, 0});
+                attributeBytes += poolSize * attributeStride;
+            }
+            indexBytes += batch.instanceCount * sizeof(uint32_t);
         }
     }
 
-    flipBackbuffer();
+    uint8_t* mapped[instanceFormatCount] = {};
+    uint32_t nextInstance[instanceFormatCount] = {};
+    for (uint32_t f = 0; f < instanceFormatCount; f++) {
+        if (bytes[f] == 0) continue;
+        mapped[f] = mapStream(instanceStreams[f], instanceStride((InstanceFormat) f), bytes[f], nextInstance[f]);
+    }
+    uint32_t nextIndex = 0;
+    uint32_t* indices = nullptr;
+    if (indexBytes > 0) {
+        indices = reinterpret_cast<uint32_t*>(mapStream(indexStream, sizeof(uint32_t), indexBytes, nextIndex));
+    }
+    uint32_t nextAttribute = 0;
+    uint32_t* attributes = nullptr;
+    if (attributeBytes > 0) {
+        attributes = reinterpret_cast<uint32_t*>(mapStream(attributeStream, sizeof(uint32_t), attributeBytes, nextAttribute));
+    }
+
+    // The pools first, so every batch knows where its pool starts.
+    for (uint32_t pool = 0; pool < pools.size(); pool++) {
+        for (uint32_t f = 0; f < instanceFormatCount; f++) {
+            auto& first = poolFirstInstances[pool * instanceFormatCount + f];
+            if (first == notPacked) continue;
+            auto format = (InstanceFormat) f;
+            first = nextInstance[f];
+            packInstances(format, pools[pool].worldMatrices, mapped[f] + nextInstance[f] * instanceStride(format));
+            nextInstance[f] += pools[pool].worldMatrices.size();
+        }
+    }
+    for (auto& packed : poolFirstAttributes) {
+        auto& pool = pools[packed.pool];
+        packed.first = nextAttribute;
+        packInstanceAttributes(packed.attributes, pool.attributes, {}, pool.worldMatrices.size(), attributes + nextAttribute);
+        nextAttribute += pool.worldMatrices.size() * instanceAttributeStride(packed.attributes) / sizeof(uint32_t);
+    }
+
+    // Same order as the draws in drawView.
+    batchFirstInstances.clear();
+    batchFirstIndices.clear();
+    batchFirstAttributes.clear();
+    viewFirstObjectBatch.clear();
+    for (uint32_t v = 0; v < frameSubmission.viewSubmissions.size(); v++) {
+        viewFirstObjectBatch.push_back(static_cast<uint32_t>(batchFirstInstances.size()));
+        for (auto& batch : renderQueue.viewBatches(v)) {
+            if (batch.type == DrawItemType::Retained || batch.type == DrawItemType::Static) continue;
+            auto& pipeline = pipelines[batch.pipeline.index];
+            auto format = pipeline.instanceFormat;
+            auto f = (uint32_t) format;
+            auto stride = instanceStride(format);
+
+            if (batch.type == DrawItemType::Pooled) {
+                batchFirstInstances.push_back(poolFirstInstances[batch.pool * instanceFormatCount + f]);
+                batchFirstIndices.push_back(nextIndex);
+                auto packed = findPoolAttributes(poolFirstAttributes, batch.pool, pipeline.instanceAttributes);
+                batchFirstAttributes.push_back(packed ? packed->first : noInstanceAttributes);
+                for (auto& item : renderQueue.batchItems(batch)) {
+                    auto poolIndices = renderQueue.itemPoolIndices(item);
+                    memcpy(indices + nextIndex, poolIndices.data(), poolIndices.size_bytes());
+                    nextIndex += poolIndices.size();
+                }
+                continue;
+            }
+
+            batchFirstInstances.push_back(nextInstance[f]);
+            batchFirstIndices.push_back(noInstanceIndices);
+            batchFirstAttributes.push_back(pipeline.instanceAttributes ? nextAttribute : noInstanceAttributes);
+            for (auto& item : renderQueue.batchItems(batch)) {
+                auto instances = renderQueue.itemInstances(item);
+                packInstances(format, instances, mapped[f] + nextInstance[f] * stride);
+                nextInstance[f] += instances.size();
+                if (pipeline.instanceAttributes) {
+                    auto& ord = frameSubmission.viewSubmissions[v].objectRenderData[item.index];
+                    packInstanceAttributes(pipeline.instanceAttributes, ord.attributes, renderQueue.itemInstanceIndices(item),
+                                           item.instanceCount, attributes + nextAttribute, 
+                                           textureSlots[item.texture.index].slice);
+                    nextAttribute += item.instanceCount * instanceAttributeStride(pipeline.instanceAttributes) / sizeof(uint32_t);
+                }
+            }
+        }
+    }
+
+    for (uint32_t f = 0; f < instanceFormatCount; f++) {
+        if (mapped[f]) {
+            ctx->Unmap(instanceStreams[f].buffer.Get(), 0);
+        }
+    }
+    if (indices) {
+        ctx->Unmap(indexStream.buffer.Get(), 0);
+    }
+    if (attributes) {
+        ctx->Unmap(attributeStream.buffer.Get(), 0);
+    }
+
+    // The sprites of all views in one go, already in draw order.
+    if (spriteBatcher.spriteCount() > 0) {
+        auto spriteBytes = spriteBatcher.spriteCount() * sizeof(SpriteRecord);
+        auto sprites = reinterpret_cast<SpriteRecord*>(mapStream(spriteStream, sizeof(SpriteRecord), 
+                                                                  spriteBytes, spriteFirstInstance));
+        spriteBatcher.writeRecords(sprites + spriteFirstInstance);
+        ctx->Unmap(spriteStream.buffer.Get(), 0);
+    }
+    frameNumber++;
+}
+
+// The lights, clusters and light indices of all views, once per frame.
+// The indices are rebased to where the frame starts in the streams.
+void DX11Renderer::uploadFrameLights()
+{
+    if (lightBinner.clusterCount() == 0) return;
+
+    auto lights = lightBinner.lights();
+    uint32_t firstLight = 0;
+    auto lightData = mapStream(lightStream, sizeof(PointLight), lights.size_bytes(), firstLight);
+    memcpy(lightData + firstLight * sizeof(PointLight), lights.data(), lights.size_bytes());
+    ctx->Unmap(lightStream.buffer.Get(), 0);
+
+    uint32_t firstIndex = 0;
+    if (lightBinner.lightIndexCount() > 0) {
+        auto indices = reinterpret_cast<uint32_t*>(mapStream(lightIndexStream, sizeof(uint32_t), 
+                                                             lightBinner.lightIndexCount() * sizeof(uint32_t), firstIndex));
+        lightBinner.writeLightIndices(indices + firstIndex, firstLight);
+        ctx->Unmap(lightIndexStream.buffer.Get(), 0);
+    }
+
+    auto clusters = reinterpret_cast<LightCluster*>(mapStream(lightClusterStream, sizeof(LightCluster), 
+                                                              lightBinner.clusterCount() * sizeof(LightCluster), lightFirstCluster));
+    lightBinner.writeClusters(clusters + lightFirstCluster, firstIndex);
+    ctx->Unmap(lightClusterStream.buffer.Get(), 0);
+}
+
+// Views without clusters still set the constants, so their pixel shaders skip the point lights.
+void DX11Renderer::bindViewLights(uint32_t viewIndex)
+{
+    auto constants = lightBinner.viewConstants(viewIndex);
+    if (constants.firstCluster != noLightClusters) {
+        constants.firstCluster += lightFirstCluster;
+        bindPixelResource(1, lightStream.srv.Get());
+        bindPixelResource(2, lightClusterStream.srv.Get());
+        bindPixelResource(3, lightIndexStream.srv.Get());
+    }
+    if (stateCache.updateConstants(clusterBuffer.Get(), &constants, sizeof(constants))) {
+        ctx->UpdateSubresource(clusterBuffer.Get(), 0, nullptr, &constants, 0, 0);
+    }
+    bindConstantBuffer(ShaderType::Pixel, 1, clusterBuffer.Get());
+}
+
+// Maps a stream for bytes of the frame and returns the start of the buffer,
+// firstElement is where the room of the frame starts, in elements of stride bytes.
+// While the frame fits behind what earlier frames wrote, the stream is mapped
+// with NO_OVERWRITE, so the GPU can keep reading those. Otherwise it is discarded,
+// the driver then hands out fresh memory and the ring starts over at the front.
+// Discarding is what retires old frames here, so the ring never needs reclaim().
+// A frame bigger than the whole stream grows it.
+uint8_t* DX11Renderer::mapStream(InstanceStream& stream, uint32_t stride, size_t bytes, uint32_t& firstElement)
+{
+    if (bytes > stream.ring.capacity()) {
+        growStream(stream, stride, std::max(bytes, 2 * stream.ring.capacity()));
+    } else if (!stream.ring.canFit(bytes, stride)) {
+        stream.ring.reset();
+    }
+    bool discard = !noOverwriteInstances || stream.ring.bytesInUse() == 0;
+    if (discard) {
+        stream.ring.reset();
+    }
+
+    auto offset = stream.ring.allocate(bytes, stride);
+    assert(offset != UploadRing::invalidOffset);
+    stream.ring.endFrame(frameNumber);
+    firstElement = offset / stride;
+
+    D3D11_MAPPED_SUBRESOURCE subresource;
+    ThrowIfFailed(ctx->Map(stream.buffer.Get(), 0, discard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE, 
+                            0, &subresource));
+    return static_cast<uint8_t*>(subresource.pData);
+}
+
+// (Re)creates a stream with room for at least bytes.
+// The GPU may still read the old buffer, D3D11 keeps it alive until then.
+void DX11Renderer::growStream(InstanceStream& stream, uint32_t stride, size_t bytes)
+{
+    uint32_t numElements = (bytes + stride - 1) / stride;
+    stream.buffer = createBuffer(nullptr, stride * numElements, 
+            D3D11_USAGE_DYNAMIC, D3D11_BIND_SHADER_RESOURCE, 
+            D3D11_RESOURCE_MISC_BUFFER_STRUCTURED, stride);
+    stream.srv = createShaderResourceViewForBuffer(stream.buffer, numElements);
+    stream.ring.reset(stride * numElements);
+}
+
+void DX11Renderer::setFirstInstance(uint32_t firstInstance, uint32_t firstIndex, uint32_t firstAttribute,
+                                    uint32_t textureSlice)
+{
+    InstanceCB instanceCB = {firstInstance, firstIndex, firstAttribute, textureSlice};
+    if (stateCache.updateConstants(instanceOffsetBuffer.Get(), &instanceCB, sizeof(instanceCB))) {
+        ctx->UpdateSubresource(instanceOffsetBuffer.Get(), 0, nullptr, &instanceCB, 0, 0);
+    }
+}
+
+// Only binds what differs from the previous draw, 
+// the render queue sorts draws so that this is as little as possible.
+void DX11Renderer::drawInstanced(MeshHandle meshHandle, PipelineHandle pipelineHandle, 
+                                TextureHandle textureHandle, uint32_t instanceCount)
+{
+    auto& mesh = meshes[meshHandle.index];
+    auto& pipeline = pipelines[pipelineHandle.index];
+
+    // The state cache drops whatever the previous draw already bound,
+    // draws with textures of the same array keep it bound.
+    bindTexture(0, textureArrays[textureSlots[textureHandle.index].array]);
+    bindInputLayout(pipeline.inputLayout);
+    bindShader(&pipeline.shader);
+    bindVertexBuffer(mesh.vb.Get(), pipeline.stride);
+    bindIndexBuffer(mesh.ib.Get());
+
+    ctx->DrawIndexedInstanced(mesh.indexCount, instanceCount, 0, 0, 0);
+}
+
+void DX11Renderer::applyRetainedUpdate(const RetainedBatchUpdate& update)
+{
+    if (update.batch >= retainedBatches.size()) {
+        retainedBatches.resize(update.batch + 1);
+    }
+
+    // The batch is stored in the instance format of the pipeline it is drawn with.
+    auto format = pipelines[update.pipeline.index].instanceFormat;
+    auto stride = instanceStride(format);
+
+    // (Re)create the buffer when the batch outgrew it.
+    // The scene sends the complete batch in this case.
+    auto& batchBuffer = retainedBatches[update.batch];
+    if (batchBuffer.capacity != update.capacity) {
+        batchBuffer.buffer = createBuffer(nullptr, stride * update.capacity,
+                D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE,
+                D3D11_RESOURCE_MISC_BUFFER_STRUCTURED,
+                stride);
+        batchBuffer.srv = createShaderResourceViewForBuffer(batchBuffer.buffer, update.capacity);
+        batchBuffer.capacity = update.capacity;
+    }
+
+    const void* data = update.transforms.data();
+    if (format != InstanceFormat::Matrix) {
+        retainedPackBuffer.resize(update.transforms.size() * stride);
+        packInstances(format, update.transforms, retainedPackBuffer.data());
+        data = retainedPackBuffer.data();
+    }
+
+    // Only the changed range goes over the bus.
+    D3D11_BOX box = {};
+    box.left = update.firstInstance * stride;
+    box.right = (update.firstInstance + update.transforms.size()) * stride;
+    box.top = 0;
+    box.bottom = 1;
+    box.front = 0;
+    box.back = 1;
+    ctx->UpdateSubresource(batchBuffer.buffer.Get(), 0, &box, data, 0, 0);
+}
+
+// Static batches are only rebuilt when a building is placed or destroyed,
+// so the buffers are simply created again with the new geometry.
+void DX11Renderer::applyStaticUpdate(const StaticBatchUpdate& update)
+{
+    if (update.batch >= staticBatches.size()) {
+        staticBatches.resize(update.batch + 1);
+    }
+
+    auto& batchBuffer = staticBatches[update.batch];
+    batchBuffer = {};
+    if (update.indices.empty()) return;
+
+    batchBuffer.vb = createBuffer((void*) update.vertices.data(), update.vertices.size_bytes(), 
+                                  D3D11_USAGE_IMMUTABLE, D3D11_BIND_VERTEX_BUFFER);
+    batchBuffer.ib = createBuffer((void*) update.indices.data(), update.indices.size_bytes(), 
+                                  D3D11_USAGE_IMMUTABLE, D3D11_BIND_INDEX_BUFFER);
+}
+
+// The vertices are in world space already, the pipeline gets a single identity instance.
+void DX11Renderer::drawStatic(const StaticBatchDraw& draw)
+{
+    auto& batchBuffer = staticBatches[draw.batch];
+    auto& pipeline = pipelines[draw.pipeline.index];
+
+    auto& slot = textureSlots[draw.texture.index];
+    setFirstInstance(0, noInstanceIndices, noInstanceAttributes, slot.slice);
+    bindVertexResource(0, identityInstances[(uint32_t) pipeline.instanceFormat].srv.Get());
+    bindTexture(0, textureArrays[slot.array]);
+    bindInputLayout(pipeline.inputLayout);
+    bindShader(&pipeline.shader);
+    bindVertexBuffer(batchBuffer.vb.Get(), pipeline.stride);
+    bindIndexBuffer(batchBuffer.ib.Get());
+
+    ctx->DrawIndexedInstanced(draw.indexCount, 1, 0, 0, 0);
 }
 
 void DX11Renderer::updateBuffer(BufferUpdateDesc desc) {
@@ -630,31 +1215,27 @@ void DX11Renderer::updateBuffer(BufferUpdateDesc desc) {
 
 void DX11Renderer::uploadConstantBufferData(ConstantBufferDesc constantBuffer)
 {
-    D3D11_MAPPED_SUBRESOURCE mapped;
-    ctx->Map(constantBuffer.buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-    memcpy(mapped.pData, constantBuffer.bufferData, constantBuffer.size);
-    ctx->Unmap(constantBuffer.buffer.Get(), 0);
-    ID3D11Buffer* buffers[] = { constantBuffer.buffer.Get() };
-    switch (constantBuffer.shaderType) {
-        case ShaderType::Vertex: ctx->VSSetConstantBuffers(constantBuffer.slot, 1, buffers);break;
-        case ShaderType::Pixel: ctx->PSSetConstantBuffers(constantBuffer.slot, 1, buffers); break;
+    // Unchanged content, e.g. the camera of a view that did not move, is not uploaded again.
+    if (stateCache.updateConstants(constantBuffer.buffer.Get(), constantBuffer.bufferData, constantBuffer.size)) {
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        ctx->Map(constantBuffer.buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+        memcpy(mapped.pData, constantBuffer.bufferData, constantBuffer.size);
+        ctx->Unmap(constantBuffer.buffer.Get(), 0);
     }
-    
+    bindConstantBuffer(constantBuffer.shaderType, constantBuffer.slot, constantBuffer.buffer.Get());
 }
 
-void DX11Renderer::uploadStructuredBufferData(StructuredBufferDesc desc) 
+void DX11Renderer::bindConstantBuffer(ShaderType shaderType, uint32_t slot, ID3D11Buffer* buffer)
 {
-    if (desc.data.size() == 0) return;
-    D3D11_MAPPED_SUBRESOURCE mapped;
-    auto result = ctx->Map(desc.buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-    assert(SUCCEEDED(result));
-    memcpy(mapped.pData, desc.data.data(), desc.data.size() * sizeof(InstanceData));
-    ctx->Unmap(desc.buffer.Get(), 0);
-    assert(SUCCEEDED(result));
-    
-    ID3D11ShaderResourceView* srvs[] = { desc.srv.Get()};
-    ctx->VSSetShaderResources(desc.slot, 1, srvs);
-        
+    ID3D11Buffer* buffers[] = { buffer };
+    switch (shaderType) {
+        case ShaderType::Vertex: 
+            if (stateCache.bind(StateKind::VertexConstantBuffer, slot, buffer)) ctx->VSSetConstantBuffers(slot, 1, buffers);
+            break;
+        case ShaderType::Pixel: 
+            if (stateCache.bind(StateKind::PixelConstantBuffer, slot, buffer)) ctx->PSSetConstantBuffers(slot, 1, buffers);
+            break;
+    }
 }
 
 Font DX11Renderer::createFont(const std::string& fontPath, int fontSize)
@@ -720,8 +1301,6 @@ void DX11Renderer::flipBackbuffer()
 
 void DX11Renderer::clearBackBuffer(float r, float g, float b, float a) 
 {
-    ID3D11RenderTargetView* rtvs[] = {renderTargetView.Get()};
-    ctx->OMSetRenderTargets(1, rtvs, depthStencilView.Get());
     float color[] = {r, g, b, a};
     ctx->ClearRenderTargetView(renderTargetView.Get(), color);
     ctx->ClearDepthStencilView(depthStencilView.Get(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
@@ -755,30 +1334,69 @@ void DX11Renderer::createDefaultRasterizerState() {
 }
 
 void DX11Renderer::bindTexture(uint32_t slot, Texture& texture) {
-    ctx->PSSetShaderResources(slot, 1, texture.srv.GetAddressOf());
+    if (stateCache.bind(StateKind::PixelResource, slot, texture.srv.Get())) {
+        ctx->PSSetShaderResources(slot, 1, texture.srv.GetAddressOf());
+    }
 
         // if (sampler) {
         //     ctx->PSSetSamplers(sampler->slot(), 1, sampler->samplerState().GetAddressOf());
         // } else {
         
-    ctx->PSSetSamplers(0, 1, &defaultSamplerState);
+    if (stateCache.bind(StateKind::Sampler, 0, defaultSamplerState.Get())) {
+        ctx->PSSetSamplers(0, 1, &defaultSamplerState);
+    }
         
        // }
 }
  
 
-void DX11Renderer::bindInputLayout(ComPtr<ID3D11InputLayout> inputLayout) {
-    ctx->IASetInputLayout(inputLayout.Get());
+void DX11Renderer::bindInputLayout(const ComPtr<ID3D11InputLayout>& inputLayout) {
+    if (stateCache.bind(StateKind::InputLayout, 0, inputLayout.Get())) {
+        ctx->IASetInputLayout(inputLayout.Get());
+    }
 }
 
 void DX11Renderer::bindShader(const ShaderProgram* shaderProgram) {
-    ctx->VSSetShader((ID3D11VertexShader*) shaderProgram->vs.vertexShader.Get(), nullptr, 0);
-    ctx->PSSetShader((ID3D11PixelShader*) shaderProgram->ps.pixelShader.Get(), nullptr, 0);
+    auto vs = (ID3D11VertexShader*) shaderProgram->vs.vertexShader.Get();
+    auto ps = (ID3D11PixelShader*) shaderProgram->ps.pixelShader.Get();
+    if (stateCache.bind(StateKind::VertexShader, 0, vs)) ctx->VSSetShader(vs, nullptr, 0);
+    if (stateCache.bind(StateKind::PixelShader, 0, ps)) ctx->PSSetShader(ps, nullptr, 0);
+}
+
+// The vertex stride is part of the binding, the same mesh 
+// drawn with pipelines of different layouts is bound again.
+void DX11Renderer::bindVertexBuffer(ID3D11Buffer* buffer, uint32_t stride) {
+    if (!stateCache.bind(StateKind::VertexBuffer, 0, buffer, stride)) return;
+    ID3D11Buffer* vertexBuffers[] = {buffer};
+    uint32_t offsets[] = {0};
+    ctx->IASetVertexBuffers(0, 1, vertexBuffers, &stride, offsets);
+}
+
+void DX11Renderer::bindIndexBuffer(ID3D11Buffer* buffer) {
+    if (stateCache.bind(StateKind::IndexBuffer, 0, buffer)) {
+        ctx->IASetIndexBuffer(buffer, DXGI_FORMAT_R32_UINT, 0);
+    }
+}
+
+void DX11Renderer::bindVertexResource(uint32_t slot, ID3D11ShaderResourceView* srv) {
+    if (stateCache.bind(StateKind::VertexResource, slot, srv)) {
+        ID3D11ShaderResourceView* srvs[] = { srv };
+        ctx->VSSetShaderResources(slot, 1, srvs);
+    }
+}
+
+void DX11Renderer::bindPixelResource(uint32_t slot, ID3D11ShaderResourceView* srv) {
+    if (stateCache.bind(StateKind::PixelResource, slot, srv)) {
+        ID3D11ShaderResourceView* srvs[] = { srv };
+        ctx->PSSetShaderResources(slot, 1, srvs);
+    }
 }
 
 void DX11Renderer::bindBackBuffer(int x, int y, int width, int height) {
-    ID3D11RenderTargetView* rtvs[] = { renderTargetView.Get()};
-    ctx->OMSetRenderTargets(1, rtvs, depthStencilView.Get());
+    if (stateCache.bind(StateKind::RenderTargets, 0, renderTargetView.Get(), reinterpret_cast<uintptr_t>(depthStencilView.Get()))) {
+        ID3D11RenderTargetView* rtvs[] = { renderTargetView.Get()};
+        ctx->OMSetRenderTargets(1, rtvs, depthStencilView.Get());
+    }
     setViewport(x, y, width, height);
 }
 
@@ -804,22 +1422,6 @@ std::vector<D3D11_INPUT_ELEMENT_DESC> InputLayout::asDX11InputLayout()
     return descs;
 }
 
-uint32_t InputLayout::stride()
-{
-    uint32_t str = 0;
-    for (auto& e : elements) {
-         switch (e.type) {
-            case InputElementType::POSITION: str += 12; break;
-            case InputElementType::UV: str += 8;  break;
-            case InputElementType::NORMAL: str += 12; break;
-         }
-    }
-
-    return str;
-
-    
-
-}
 ComPtr<ID3D11InputLayout> DX11Renderer::createInputLayout(InputLayout attributeDescriptions, 
                                             ShaderProgram* shaderProgram)
 {
@@ -862,6 +1464,8 @@ void DX11Renderer::createDefaultBlendState() {
 }
 
 void DX11Renderer::resizeSwapChain(HWND hwnd, int width, int height) {
+    // Everything is unbound below and the views are recreated.
+    stateCache.invalidate();
     ctx->OMSetRenderTargets(0, nullptr, nullptr);
     ID3D11ShaderResourceView* nullsrvs[16] = {nullptr};
     ctx->VSSetShaderResources(0, 16, nullsrvs);
@@ -1012,7 +1616,11 @@ void DX11Renderer::setViewport(int originX, int originY, int width, int height)
     vp.Height = (FLOAT)height;
     vp.MinDepth = 0.0f;
     vp.MaxDepth = 1.0f;
-    ctx->RSSetViewports(1, &vp);
+    uint64_t origin = (uint32_t) originX | (uint64_t) (uint32_t) originY << 32;
+    uint64_t size = (uint32_t) width | (uint64_t) (uint32_t) height << 32;
+    if (stateCache.bind(StateKind::Viewport, 0, size, origin)) {
+        ctx->RSSetViewports(1, &vp);
+    }
 }
 
 void DX11Renderer::printDXGIError(HRESULT hr) {
@@ -4,23 +4,44 @@
 #include <map>
 #include "comptr.h"
 #include "shader.h"
+#include "render_queue.h"
+#include "instance_packing.h"
+#include "upload_ring.h"
+#include "render_graph.h"
+#include "state_cache.h"
+#include "sprite_batcher.h"
+#include "light_binner.h"
+#include "shader_cache.h"
 #include <stb_truetype.h>
 
 struct Mesh;
 struct ConstantBufferDesc;
-struct StructuredBufferDesc;
 struct Texture;
 struct Image;
 struct BufferUpdateDesc;
 struct Font;
 struct TextSnippet;
+struct Pipeline;
+struct RetainedBatchBuffer;
+struct StaticBatchBuffer;
+
+// firstInstanceIndex of the draws which don't go through gInstanceIndices, see shaders/instance_data.hlsli.
+constexpr uint32_t noInstanceIndices = 0xFFFFFFFF;
+// firstInstanceAttribute of the draws without uploaded attributes.
+constexpr uint32_t noInstanceAttributes = 0xFFFFFFFF;
+
 class DX11Renderer : public Renderer {
 
     public:
         virtual void initialize(RenderInitData initData) override;
-        void doFrame(FrameSubmission frameData) override;
+        void doFrame(const FrameSubmission& frameData) override;
+
+        // Device calls of the last frame, issued and dropped as redundant.
+        const StateCacheStats& stateStats() const { return stateCache.stats(); }
 
     protected:
+        struct InstanceStream;
+
         void ThrowIfFailed(HRESULT result);
         void clearBackBuffer(float r, float g, float b, float a);
         void flipBackbuffer();
@@ -31,18 +52,39 @@ class DX11Renderer : public Renderer {
         void createDefaultBlendState();
         void createDefaultRasterizerState();
         void bindTexture(uint32_t slot, Texture &texture);
-        void bindInputLayout(ComPtr<ID3D11InputLayout> inputLayout);
+        void bindInputLayout(const ComPtr<ID3D11InputLayout>& inputLayout);
         void bindShader(const ShaderProgram *shaderProgram);
+        void bindVertexBuffer(ID3D11Buffer* buffer, uint32_t stride);
+        void bindIndexBuffer(ID3D11Buffer* buffer);
+        void bindVertexResource(uint32_t slot, ID3D11ShaderResourceView* srv);
+        void bindPixelResource(uint32_t slot, ID3D11ShaderResourceView* srv);
+        void bindConstantBuffer(ShaderType shaderType, uint32_t slot, ID3D11Buffer* buffer);
         void bindBackBuffer(int x, int y, int width, int height);
         void createDefaultSamplerState();
         void uploadConstantBufferData(ConstantBufferDesc constantBuffer);
-        void uploadStructuredBufferData(StructuredBufferDesc desc);
-        void renderTextIntoQuad(const std::string &snippedId, const std::string &fontId, const std::string &text);
+        void renderTextIntoQuad(uint32_t snippetIndex, uint32_t fontIndex, std::string_view text);
         void updateBuffer(BufferUpdateDesc desc);
+        void applyRetainedUpdate(const RetainedBatchUpdate& update);
+        void applyStaticUpdate(const StaticBatchUpdate& update);
+        void drawStatic(const StaticBatchDraw& draw);
+        void drawInstanced(MeshHandle mesh, PipelineHandle pipeline, TextureHandle texture, uint32_t instanceCount);
+        void drawView(const FrameSubmission& frameSubmission, uint32_t viewIndex);
+        void drawSprites(uint32_t viewIndex);
+        void createGraphTargets();
+        void uploadFrameInstances(const FrameSubmission& frameSubmission);
+        void uploadFrameLights();
+        void bindViewLights(uint32_t viewIndex);
+        uint8_t* mapStream(InstanceStream& stream, uint32_t stride, size_t bytes, uint32_t& firstElement);
+        void growStream(InstanceStream& stream, uint32_t stride, size_t bytes);
+        void setFirstInstance(uint32_t firstInstance, uint32_t firstIndex = noInstanceIndices, 
+                                uint32_t firstAttribute = noInstanceAttributes, uint32_t textureSlice = 0);
         Font createFont(const std::string& fontPath, int size);
         Geometry *renderTextIntoQuad(const std::string &fontId, const std::string &text, Geometry *oldMesh);
-        ShaderProgram createShaderProgram(const std::wstring &filePath);
+        ShaderProgram createShaderProgram(const std::wstring &filePath, InstanceFormat instanceFormat = InstanceFormat::Matrix,
+                                            uint32_t instanceAttributes = 0);
+        ComPtr<ID3DBlob> loadShaderBlob(ShaderCompileRequest request, const char* entryPoint, const char* profile);
         Texture createTexture(uint8_t *pixels, uint32_t width, uint32_t height, uint32_t numChannels = 4, DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB);
+        Texture createTextureArray(std::span<const Image> images);
         Image loadImagePixels(const std::string &filePath);
         ComPtr<ID3D11DeviceChild> createShader(const std::wstring &filePath, ShaderType shaderType);
         ComPtr<ID3D11Buffer> createBuffer(void *data, int size, D3D11_USAGE bufferUsage, D3D11_BIND_FLAG bindFlags, uint32_t miscFlags = 0, uint32_t structuredByteStrid = 0);
@@ -56,8 +98,62 @@ class DX11Renderer : public Renderer {
         
         ComPtr<ID3D11Buffer> objectTransformBuffer;
         ComPtr<ID3D11Buffer> cameraBuffer;
-        ComPtr<ID3D11Buffer> instanceBuffer;
-        ComPtr<ID3D11ShaderResourceView> instanceSRV;
+        // One dynamic instance buffer per InstanceFormat in use, 
+        // the object batches of a frame are appended to it, see uploadFrameInstances().
+        struct InstanceStream
+        {
+            ComPtr<ID3D11Buffer> buffer;
+            ComPtr<ID3D11ShaderResourceView> srv;
+            UploadRing ring;
+        };
+        InstanceStream instanceStreams[instanceFormatCount];
+        // The indices of the visible pool instances of the pooled batches.
+        InstanceStream indexStream;
+        // The InstanceAttributes of the batches whose pipeline declares any, 
+        // packed as uints with the stride of the pipeline.
+        InstanceStream attributeStream;
+
+        // Where the instances of every object and pooled batch of the frame start 
+        // in their stream, and the indices of the pooled ones in indexStream, in draw order.
+        std::vector<uint32_t> batchFirstInstances;
+        std::vector<uint32_t> batchFirstIndices;
+        std::vector<uint32_t> batchFirstAttributes;
+        // Index of the first such batch of every view in batchFirstInstances.
+        std::vector<uint32_t> viewFirstObjectBatch;
+        // Where every instance pool starts in the stream of each format, 
+        // indexed by pool * instanceFormatCount + format.
+        std::vector<uint32_t> poolFirstInstances;
+        // Where the attributes of a pool start in attributeStream, once per attribute set it is drawn with.
+        struct PoolAttributes
+        {
+            uint32_t pool;
+            uint32_t attributes;
+            uint32_t first;
+        };
+        std::vector<PoolAttributes> poolFirstAttributes;
+
+        // The sprite records of all views, in the order of spriteBatcher.
+        InstanceStream spriteStream;
+        uint32_t spriteFirstInstance = 0;
+
+        // The binned point lights of all views, see light_binner.h.
+        InstanceStream lightStream;
+        InstanceStream lightClusterStream;
+        InstanceStream lightIndexStream;
+        uint32_t lightFirstCluster = 0;
+        // Holds the ClusterConstants of the view for shaders/clustered_lights.hlsli.
+        ComPtr<ID3D11Buffer> clusterBuffer;
+
+        // Holds firstInstance, firstInstanceIndex and firstInstanceAttribute for shaders/instance_data.hlsli.
+        ComPtr<ID3D11Buffer> instanceOffsetBuffer;
+
+        // Without D3D11.1 support for it, the instance streams 
+        // can't be mapped with NO_OVERWRITE and are discarded every frame.
+        bool noOverwriteInstances = false;
+        uint64_t frameNumber = 0;
+
+        // Retained updates are packed here before they go to the GPU.
+        std::vector<uint8_t> retainedPackBuffer;
 
         ComPtr<ID3D11Texture2D> backBuffer = nullptr;
         ComPtr<ID3D11RenderTargetView> renderTargetView = nullptr;
@@ -75,15 +171,65 @@ class DX11Renderer : public Renderer {
 
 
 
-        std::map<std::string, Mesh> meshMap;
-        std::map<std::string, Texture> textureMap;
-        std::map<std::string, Font> fontMap;
-        std::map<std::string, TextSnippet> snippetMap;
-        std::map<std::string, ShaderProgram> shaderMap;
-        std::map<std::string, ComPtr<ID3D11InputLayout>> dxInputLayoutMap;
-        std::map<std::string, InputLayout> inputLayoutMap;
+        // Dense resource arrays, indexed by the handles 
+        // handed out through RenderInitData.
+        std::vector<Mesh> meshes;
+        // Every texture is a slice of one of the textureArrays, see texture_arrays.h.
+        std::vector<Texture> textureArrays;
+        std::vector<TextureSlot> textureSlots;
+        std::vector<Font> fonts;
+        std::vector<TextSnippet> snippets;
+        std::vector<Pipeline> pipelines;
+
+        // GPU side instance data of the RenderScene batches,
+        // indexed by RetainedBatchUpdate::batch.
+        std::vector<RetainedBatchBuffer> retainedBatches;
 
-        const int maxInstances = 50000;
+        // Merged geometry of the StaticBatcher batches, indexed by StaticBatchUpdate::batch.
+        std::vector<StaticBatchBuffer> staticBatches;
+        // One identity transform per InstanceFormat in use,
+        // the only instance of every static draw.
+        RetainedBatchBuffer identityInstances[instanceFormatCount];
+
+        // The text pipeline is internal to the renderer and 
+        // lives behind the pipelines registered by the game.
+        uint32_t textPipelineIndex = 0;
+        // So is the sprite pipeline, it has no input layout.
+        uint32_t spritePipelineIndex = 0;
+
+        // Orders the draws of a frame, see render_queue.h.
+        RenderQueue renderQueue;
+        // Orders and groups the sprites of a frame, see sprite_batcher.h.
+        SpriteBatcher spriteBatcher;
+        // Sorts the point lights of the views into clusters.
+        LightBinner lightBinner;
+
+        // Orders the passes of a frame, see render_graph.h.
+        // The transient resources live in graphTargets,
+        // indexed by RenderGraph::physicalIndex().
+        struct GraphTarget
+        {
+            ComPtr<ID3D11Texture2D> texture;
+            ComPtr<ID3D11RenderTargetView> rtv;
+            ComPtr<ID3D11DepthStencilView> dsv;
+            ComPtr<ID3D11ShaderResourceView> srv;
+        };
+        RenderGraph renderGraph;
+        std::vector<GraphTarget> graphTargets;
+
+        // What is bound on ctx, so the bind functions
+        // drop calls that would not change anything.
+        StateCache stateCache;
+
+        // Compiled shader bytecode on disk, see shader_cache.h.
+        // Only used during initialization.
+        std::unique_ptr<ShaderCache> shaderCache;
+
+        // Only used during initialization to resolve the font of a snippet.
+        std::map<std::string, uint32_t> fontIndices;
+
+        // Initial capacity of the instance streams, they grow when a frame needs more.
+        const uint32_t maxInstances = 50000;
 
 };
 
@@ -107,6 +253,13 @@ struct Mesh {
 
 };
 
+struct InstanceCB {
+    uint32_t firstInstance;
+    uint32_t firstInstanceIndex = noInstanceIndices;
+    uint32_t firstInstanceAttribute = noInstanceAttributes;
+    uint32_t textureSlice = 0;
+};
+
 struct CameraCB {
     DirectX::SimpleMath::Matrix view;
     DirectX::SimpleMath::Matrix projection;
@@ -118,20 +271,6 @@ struct ObjectTransformCB
     DirectX::SimpleMath::Matrix world;
 };
 
-struct alignas(16) InstanceData
-{
-    DirectX::SimpleMath::Matrix world;
-};
-
-struct StructuredBufferDesc 
-{
-    ComPtr<ID3D11Buffer> buffer;
-    ComPtr<ID3D11ShaderResourceView> srv;
-    std::vector<InstanceData> data;
-    uint32_t slot;
-
-};
-
 struct BufferUpdateDesc {
     ComPtr<ID3D11Buffer> buffer;
     void* data = nullptr;
@@ -160,9 +299,31 @@ struct Font {
 };
 
 
+struct Pipeline
+{
+    ShaderProgram shader;
+    ComPtr<ID3D11InputLayout> inputLayout;
+    uint32_t stride = 0;
+    InstanceFormat instanceFormat = InstanceFormat::Matrix;
+    uint32_t instanceAttributes = 0;
+};
+
+struct RetainedBatchBuffer
+{
+    ComPtr<ID3D11Buffer> buffer;
+    ComPtr<ID3D11ShaderResourceView> srv;
+    uint32_t capacity = 0;
+};
+
+struct StaticBatchBuffer
+{
+    ComPtr<ID3D11Buffer> vb;
+    ComPtr<ID3D11Buffer> ib;
+};
+
 struct TextSnippet 
 {
     Mesh mesh;
     Geometry geometry;
-    std::string fontId;
+    uint32_t fontIndex = 0;
 };
\ No newline at end of file
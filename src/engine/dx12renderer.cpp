@@ -5,6 +5,8 @@
 #include <d3dcompiler.h>
 #include <dxgidebug.h>
 #include "appwindow.h"
+#include <algorithm>
+#include <cassert>
 #include <string>
 #include <map>
 #include <stdexcept>
@@ -84,16 +86,24 @@ void DX12Renderer::createVertexBuffers()
         ibView.SizeInBytes = ibSize;
         ibView.Format = DXGI_FORMAT_R32_UINT;
 
-        meshMap[md.id] = {vbView, ibView, vb, ib, md.geometry.indices.size()};
+        meshes.push_back({vbView, ibView, vb, ib, md.geometry.indices.size()});
     }
 
 }
 
+// Textures of the same size share an array and with it a view, see texture_arrays.h.
 void DX12Renderer::createTextures() {
 
-    for (auto td : initData.textureDescriptors) {
-        auto texture = loadTextureFromFile(td.filePath);
-        textureMap[td.id] = texture;
+    for (auto& ta : initData.textureArrays) {
+        std::vector<std::wstring> fileNames;
+        for (auto texture : ta.textures) {
+            auto& filePath = initData.textureDescriptors[texture.index].filePath;
+            fileNames.push_back(std::wstring(filePath.begin(), filePath.end()));
+        }
+        textureArrays.push_back(loadTextureArray(fileNames));
+    }
+    for (auto& td : initData.textureDescriptors) {
+        textureSlots.push_back(td.slot);
     }
 
 }
@@ -143,9 +153,9 @@ void DX12Renderer::createPipelineStatesNew() {
         
         auto shaderPath = ps.shader;
         
-        ThrowIfFailed(D3DCompileFromFile(shaderPath.c_str(), nullptr, nullptr, "VSMain", "vs_5_0", 
+        ThrowIfFailed(D3DCompileFromFile(shaderPath.c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "VSMain", "vs_5_0", 
                                                 compileFlags, 0, &vertexShader, nullptr));
-        ThrowIfFailed(D3DCompileFromFile(shaderPath.c_str(), nullptr, nullptr, "PSMain", "ps_5_0", 
+        ThrowIfFailed(D3DCompileFromFile(shaderPath.c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "PSMain", "ps_5_0", 
                                                 compileFlags, 0, &pixelShader, nullptr));
 
         auto dx12InputLayout = ps.inputLayout.asDX12InputLayout();
@@ -177,7 +187,7 @@ void DX12Renderer::createPipelineStatesNew() {
         psoDesc.SampleDesc.Count = 1;
         ComPtr<ID3D12PipelineState> pipelineState;
         ThrowIfFailed(m_device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(pipelineState.GetAddressOf())));
-        psos[ps.id] = pipelineState;
+        psos.push_back(pipelineState);
                                 
     }
        
@@ -292,51 +302,7 @@ void DX12Renderer::createDescriptorHeaps()
 
 
         // Instancing data structures:
-        {
-
-            // Default heap buffer, close to the srv:
-            
-            {
-                auto defaultProps = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
-                auto desc = CD3DX12_RESOURCE_DESC::Buffer(instBytes);
-                ThrowIfFailed(m_device->CreateCommittedResource(
-                    &defaultProps,
-                    D3D12_HEAP_FLAG_NONE,
-                    &desc,
-                    D3D12_RESOURCE_STATE_COMMON,   
-                    nullptr,
-                    IID_PPV_ARGS(m_instanceDefault.GetAddressOf())));
-            }
-
-            // InstanceData upload buffer
-            auto uploadProps = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-            for (UINT i = 0; i < frameCount; ++i) {
-                auto desc = CD3DX12_RESOURCE_DESC::Buffer(instBytes);
-                ThrowIfFailed(m_device->CreateCommittedResource(
-                    &uploadProps,
-                    D3D12_HEAP_FLAG_NONE,
-                    &desc,
-                    D3D12_RESOURCE_STATE_GENERIC_READ,
-                    nullptr,
-                    IID_PPV_ARGS(m_instanceUploadBuffer[i].GetAddressOf())));
-
-                ThrowIfFailed(m_instanceUploadBuffer[i]->Map(0, nullptr, (void**)&m_instanceUploadMapped[i]));
-            }
-
-
-            D3D12_SHADER_RESOURCE_VIEW_DESC isrv = {};
-            isrv.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
-            isrv.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-            isrv.Format = DXGI_FORMAT_UNKNOWN;
-            isrv.Buffer.FirstElement = 0;
-            isrv.Buffer.NumElements = MaxInstances;
-            isrv.Buffer.StructureByteStride = sizeof(InstanceDataCPU);
-            isrv.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
-
-            // Placing it at srv slot 16, away from the textures.. 
-            m_device->CreateShaderResourceView(m_instanceDefault.Get(), &isrv, cpuDescriptorHandle(16));
-
-        }
+        createInstanceUpload(instBytes * frameCount);
 
     }
     
@@ -352,7 +318,7 @@ void DX12Renderer::createDescriptorHeaps()
     CD3DX12_DESCRIPTOR_RANGE1 samplerRange;
     samplerRange.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER, 1, 0); // Samplers starting at s0
 
-    CD3DX12_ROOT_PARAMETER1 rps[6];
+    CD3DX12_ROOT_PARAMETER1 rps[7];
     //rps[0].InitAsConstantBufferView(0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_NONE, D3D12_SHADER_VISIBILITY_VERTEX);
     rps[0].InitAsConstants(32, 0, D3D12_SHADER_VISIBILITY_VERTEX);
     rps[1].InitAsConstants(16, 1, 0, D3D12_SHADER_VISIBILITY_VERTEX);
@@ -360,10 +326,13 @@ void DX12Renderer::createDescriptorHeaps()
     rps[3].InitAsDescriptorTable(1, &srvRange, D3D12_SHADER_VISIBILITY_PIXEL);
     rps[4].InitAsDescriptorTable(1, &samplerRange, D3D12_SHADER_VISIBILITY_PIXEL);
     rps[5].InitAsDescriptorTable(1, &instanceDataSRVRange, D3D12_SHADER_VISIBILITY_VERTEX);
+    // firstInstance, firstInstanceIndex, firstInstanceAttribute and drawTextureSlice 
+    // of shaders/instance_data.hlsli
+    rps[6].InitAsConstants(4, 2, 0, D3D12_SHADER_VISIBILITY_VERTEX);
     
 
     CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC rsd = {};
-    rsd.Init_1_1(6, rps, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+    rsd.Init_1_1(7, rps, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
     ComPtr<ID3DBlob> signature;
     ComPtr<ID3DBlob> error;
     ThrowIfFailed(D3D12SerializeVersionedRootSignature(&rsd, &signature, &error));
@@ -404,6 +373,43 @@ void DX12Renderer::createDescriptorHeaps()
     }
 }
 
+// (Re)creates the upload buffer of the instances with capacity bytes.
+// Nothing may still read the old one, neither the GPU nor a recorded command list.
+void DX12Renderer::createInstanceUpload(UINT64 capacity)
+{
+    if (m_instanceUpload) {
+        m_instanceUpload->Unmap(0, nullptr);
+        m_instanceUpload.Reset();
+    }
+
+    // One upload buffer for the instances of all frames in flight.
+    // Upload heap memory is readable by the GPU, so there is no copy.
+    auto uploadProps = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+    auto desc = CD3DX12_RESOURCE_DESC::Buffer(capacity);
+    ThrowIfFailed(m_device->CreateCommittedResource(
+        &uploadProps,
+        D3D12_HEAP_FLAG_NONE,
+        &desc,
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        nullptr,
+        IID_PPV_ARGS(m_instanceUpload.GetAddressOf())));
+    ThrowIfFailed(m_instanceUpload->Map(0, nullptr, (void**)&m_instanceUploadMapped));
+    instanceRing.reset(capacity);
+
+
+    D3D12_SHADER_RESOURCE_VIEW_DESC isrv = {};
+    isrv.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+    isrv.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    isrv.Format = DXGI_FORMAT_UNKNOWN;
+    isrv.Buffer.FirstElement = 0;
+    isrv.Buffer.NumElements = UINT(capacity / sizeof(InstanceDataCPU));
+    isrv.Buffer.StructureByteStride = sizeof(InstanceDataCPU);
+    isrv.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+
+    // Placing it at srv slot 16, away from the textures.. 
+    m_device->CreateShaderResourceView(m_instanceUpload.Get(), &isrv, cpuDescriptorHandle(16));
+}
+
 void DX12Renderer::GetHardwareAdapter(
     IDXGIFactory1* pFactory,
     IDXGIAdapter1** ppAdapter,
@@ -475,8 +481,6 @@ void DX12Renderer::createDeviceAndSwapChain()
     m_renderTargets.resize(frameCount);
     g_frameFence.resize(frameCount);
     g_alloc.resize(frameCount);
-    m_instanceUploadBuffer.resize(frameCount);
-    m_instanceUploadMapped.resize(frameCount);
 
     #ifndef NDEBUG
     {
@@ -543,40 +547,53 @@ void DX12Renderer::createDeviceAndSwapChain()
 }
 
 
-DX12Renderer::Texture DX12Renderer::loadTextureFromFile(const std::wstring& fileName) {
+// The images become the slices in their order, they must all have the same size and format.
+DX12Renderer::Texture DX12Renderer::loadTextureArray(std::span<const std::wstring> fileNames) {
 
     static_assert(sizeof(void*) == 8, "Build x64");
     static_assert(sizeof(D3D12_SUBRESOURCE_DATA) == 24, "Bad packing for D3D12_SUBRESOURCE_DATA");
     static_assert(alignof(D3D12_SUBRESOURCE_DATA) == 8, "Bad align");
 
 
-    DirectX::ScratchImage image;
+    std::vector<DirectX::ScratchImage> images(fileNames.size());
+    std::vector<D3D12_SUBRESOURCE_DATA> slices;
     DirectX::TexMetadata metadata;
-    ThrowIfFailed(DirectX::LoadFromWICFile(fileName.c_str(), DirectX::WIC_FLAGS_FORCE_RGB, &metadata, image));
+    for (size_t i = 0; i < fileNames.size(); i++) {
+        DirectX::ScratchImage image;
+        DirectX::TexMetadata imageMetadata;
+        ThrowIfFailed(DirectX::LoadFromWICFile(fileNames[i].c_str(), DirectX::WIC_FLAGS_FORCE_RGB, &imageMetadata, image));
 
-    {
-        DirectX::ScratchImage flipped;
-        // For all subresources (mips/array), not just the first image:
-        ThrowIfFailed(FlipRotate(
-            image.GetImages(), image.GetImageCount(), metadata,
-            DirectX::TEX_FR_FLIP_VERTICAL, flipped));
-        image  = std::move(flipped);
-        metadata = image.GetMetadata();
-    }
+        {
+            // For all subresources (mips/array), not just the first image:
+            ThrowIfFailed(FlipRotate(
+                image.GetImages(), image.GetImageCount(), imageMetadata,
+                DirectX::TEX_FR_FLIP_VERTICAL, images[i]));
+            imageMetadata = images[i].GetMetadata();
+        }
+
+        if (i == 0) {
+            metadata = imageMetadata;
+        } else if (imageMetadata.width != metadata.width || imageMetadata.height != metadata.height ||
+                   imageMetadata.format != metadata.format) {
+            throw std::runtime_error("texture array slices must have the same size and format");
+        }
 
-    const DirectX::Image* img = image.GetImage(0, 0, 0);
-    D3D12_SUBRESOURCE_DATA s{};
-    s.pData      = img->pixels;
-    s.RowPitch   = static_cast<LONG_PTR>(img->rowPitch);
-    s.SlicePitch = static_cast<LONG_PTR>(img->slicePitch);
+        const DirectX::Image* img = images[i].GetImage(0, 0, 0);
+        D3D12_SUBRESOURCE_DATA s{};
+        s.pData      = img->pixels;
+        s.RowPitch   = static_cast<LONG_PTR>(img->rowPitch);
+        s.SlicePitch = static_cast<LONG_PTR>(img->slicePitch);
+        slices.push_back(s);
+    }
+    const UINT numSlices = static_cast<UINT>(slices.size());
 
 
     CD3DX12_RESOURCE_DESC texDesc = CD3DX12_RESOURCE_DESC::Tex2D(
         metadata.format,
         static_cast<UINT64>(metadata.width),
         static_cast<UINT>(metadata.height),
-        static_cast<UINT16>(metadata.arraySize),
-        static_cast<UINT16>(metadata.mipLevels));
+        static_cast<UINT16>(numSlices),
+        1);
 
     ComPtr<ID3D12Resource> texture;
     auto defaultProps = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
@@ -588,7 +605,8 @@ DX12Renderer::Texture DX12Renderer::loadTextureFromFile(const std::wstring& file
         nullptr,
         IID_PPV_ARGS(texture.GetAddressOf())));
    
-    const UINT64 uploadBufferSize = GetRequiredIntermediateSize(texture.Get(), 0, 1);
+    // One subresource per slice, as there is only one mip level.
+    const UINT64 uploadBufferSize = GetRequiredIntermediateSize(texture.Get(), 0, numSlices);
 
     auto uploadProps = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
     auto bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(uploadBufferSize);
@@ -605,8 +623,8 @@ DX12Renderer::Texture DX12Renderer::loadTextureFromFile(const std::wstring& file
     auto cmdList = createOneTimeCommandList();
     UpdateSubresources(cmdList.cmdList.Get(),
         texture.Get(), textureUploadHeap.Get(),
-        0, 0, 1,
-        &s);
+        0, 0, numSlices,
+        slices.data());
 
     // barrier to transition into shader-visible state
     auto barrier = CD3DX12_RESOURCE_BARRIER::Transition(
@@ -628,13 +646,15 @@ DX12Renderer::Texture DX12Renderer::loadTextureFromFile(const std::wstring& file
     D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
     srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
     srvDesc.Format = DirectX::MakeSRGB(metadata.format);
-    srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-    srvDesc.Texture2D.MostDetailedMip = 0;
-    srvDesc.Texture2D.MipLevels = (UINT)metadata.mipLevels;
+    srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+    srvDesc.Texture2DArray.MostDetailedMip = 0;
+    srvDesc.Texture2DArray.MipLevels = 1;
+    srvDesc.Texture2DArray.FirstArraySlice = 0;
+    srvDesc.Texture2DArray.ArraySize = numSlices;
 
     auto slot = m_nextSrvIndex++;
 
-    // We only have place for 16 textures, 
+    // We only have place for 16 texture arrays, 
     // check overflow:
     if (m_nextSrvIndex >= 16)
         throw std::runtime_error("SRV texture heap full");
@@ -736,6 +756,7 @@ void DX12Renderer::postRenderSynch()
 
     // remember fence value for this backbuffer
     g_frameFence[m_frameIndex] = v;
+    instanceRing.endFrame(v);
 
     // advance swapchain index
     m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
@@ -758,7 +779,7 @@ DX12Renderer::TempCommandList DX12Renderer::createOneTimeCommandList() {
     return { allocator, cmdList };
 }
 
-void DX12Renderer::doFrame(FrameSubmission frameData) {
+void DX12Renderer::doFrame(const FrameSubmission& frameData) {
     // ComPtr<ID3D12CommandList> cmdList = populateCommandList(frameData);
     // executeCommandList(cmdList);
     // present();
@@ -773,7 +794,7 @@ void DX12Renderer::executeCommandList(ComPtr<ID3D12CommandList> commandList)
     m_commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
 }
 
-ComPtr<ID3D12CommandList> DX12Renderer::populateCommandList(FrameSubmission frameDataItems) {
+ComPtr<ID3D12CommandList> DX12Renderer::populateCommandList(const FrameSubmission& frameDataItems) {
 
      const UINT idx = m_frameIndex;                   // current back buffer
             const UINT64 last = g_frameFence[idx];
@@ -782,6 +803,25 @@ ComPtr<ID3D12CommandList> DX12Renderer::populateCommandList(FrameSubmission fram
                 WaitForSingleObject(m_fenceEvent, INFINITE);
             }
 
+    instanceRing.reclaim(m_fence->GetCompletedValue());
+
+    // With twice the instances of the frame in the ring, every draw fits once the
+    // older frames gave their ranges back, even with the end skipped when wrapping.
+    // Growing waits for the GPU to finish all frames, nothing is recorded yet.
+    UINT64 frameInstanceBytes = 0;
+    for (auto& view : frameDataItems.viewSubmissions) {
+        for (auto& obj : view.objectRenderData) {
+            frameInstanceBytes += obj.worldMatrices.size() * sizeof(InstanceDataCPU);
+        }
+    }
+    if (frameInstanceBytes * 2 > instanceRing.capacity()) {
+        if (m_fence->GetCompletedValue() < m_fenceValue) {
+            m_fence->SetEventOnCompletion(m_fenceValue, m_fenceEvent);
+            WaitForSingleObject(m_fenceEvent, INFINITE);
+        }
+        createInstanceUpload(frameInstanceBytes * std::max<UINT64>(2, frameCount));
+    }
+
     // Reset before refill. Allocator and list itself:
     ThrowIfFailed(g_alloc[idx]->Reset());
     ThrowIfFailed(m_commandList->Reset(g_alloc[idx].Get(), m_pipelineState.Get()));
@@ -812,61 +852,57 @@ ComPtr<ID3D12CommandList> DX12Renderer::populateCommandList(FrameSubmission fram
     m_commandList->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
     m_commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-    for (auto& frameData : frameDataItems) {
+    for (auto& frameData : frameDataItems.viewSubmissions) {
         
             
         // mappedCameraCB->View = frameData.viewMatrix;
             // mappedCameraCB->Proj = frameData.projectionMatrix;
 
-            m_commandList->SetPipelineState(psos["ui"].Get());
-
             m_commandList->SetGraphicsRoot32BitConstants(1, 16, &frameData.viewMatrix, 0);
             
-            for (auto obj : frameData.objectRenderData) {
+            for (auto& obj : frameData.objectRenderData) {
         
+                m_commandList->SetPipelineState(psos[obj.pipeline.index].Get());
+
                 uint32_t instanceCount = obj.worldMatrices.size();
-                // 1) Fill per-frame upload buffer
-                {
-                    
-                    auto* inst = reinterpret_cast<InstanceDataCPU*>(m_instanceUploadMapped[m_frameIndex]);
-                    for (UINT i = 0; i < instanceCount; ++i) {
-                        inst[i].World = obj.worldMatrices[i];
-                        // DirectX::XMMATRIX W = S * DirectX::XMMatrixTranslation(32 + (i * 67), 200, 0.2f);
-                        // DirectX::XMStoreFloat4x4(&inst[i].World, W); // transpose if your HLSL expects it
-                    }
-                    UINT64 copyBytes = instanceCount * sizeof(InstanceDataCPU);
-                    // 2) Transition DEFAULT to COPY_DEST, do the copy, transition to SRV
-                    {
-                        auto toCopy = CD3DX12_RESOURCE_BARRIER::Transition(
-                            m_instanceDefault.Get(),
-                            D3D12_RESOURCE_STATE_GENERIC_READ,
-                            D3D12_RESOURCE_STATE_COPY_DEST);
-                        m_commandList->ResourceBarrier(1, &toCopy);
-        
-                        m_commandList->CopyBufferRegion(
-                            m_instanceDefault.Get(), 0,
-                            m_instanceUploadBuffer[m_frameIndex].Get(), 0,
-                            copyBytes);
-        
-                        auto toSRV = CD3DX12_RESOURCE_BARRIER::Transition(
-                            m_instanceDefault.Get(),
-                            D3D12_RESOURCE_STATE_COPY_DEST,
-                            D3D12_RESOURCE_STATE_GENERIC_READ); 
-                        m_commandList->ResourceBarrier(1, &toSRV);
-                        m_commandList->SetGraphicsRootDescriptorTable(5, gpuDescriptorHandle(16));
+                UINT64 instanceBytes = instanceCount * sizeof(InstanceDataCPU);
+
+                // Append the instances to the ring. When it is full, 
+                // wait for the oldest frame in flight to give its range back.
+                // The ring was sized for the frame above, so this always ends with a range.
+                auto offset = instanceRing.allocate(instanceBytes, sizeof(InstanceDataCPU));
+                while (offset == UploadRing::invalidOffset && instanceRing.oldestFence() != 0) {
+                    auto oldest = instanceRing.oldestFence();
+                    if (m_fence->GetCompletedValue() < oldest) {
+                        m_fence->SetEventOnCompletion(oldest, m_fenceEvent);
+                        WaitForSingleObject(m_fenceEvent, INFINITE);
                     }
+                    instanceRing.reclaim(oldest);
+                    offset = instanceRing.allocate(instanceBytes, sizeof(InstanceDataCPU));
+                }
+                assert(offset != UploadRing::invalidOffset);
+
+                auto* inst = reinterpret_cast<InstanceDataCPU*>(m_instanceUploadMapped + offset);
+                for (UINT i = 0; i < instanceCount; ++i) {
+                    inst[i].World = obj.worldMatrices[i];
                 }
+                // No instance pools or attributes here, the draw reads its instances directly
+                // and gets the slice of its texture for all of them.
+                auto& textureSlot = textureSlots[obj.texture.index];
+                UINT instanceOffsets[] = { UINT(offset / sizeof(InstanceDataCPU)), 0xFFFFFFFF, 0xFFFFFFFF, textureSlot.slice };
+                m_commandList->SetGraphicsRoot32BitConstants(6, 4, instanceOffsets, 0);
+                m_commandList->SetGraphicsRootDescriptorTable(5, gpuDescriptorHandle(16));
         
                 XMStoreFloat4(&materialCBMapped->tint, DirectX::XMVectorSet(1, 0, 1, 1));   
                 m_commandList->SetGraphicsRootConstantBufferView(2, m_materialCB->GetGPUVirtualAddress());
         
                 // Diffuse texture SRV table (root param 2) -> points at t0 in m_srvHeap
-                auto texture = textureMap[obj.textureId];
+                auto& texture = textureArrays[textureSlot.array];
                 m_commandList->SetGraphicsRootDescriptorTable(3, gpuDescriptorHandle(texture.srvIndex));
         
                 // Here we must select the correct vertex buffer according to the current 
                 // objects mesh-object-id
-                auto meshObject = meshMap[obj.meshId];
+                auto& meshObject = meshes[obj.mesh.index];
                 m_commandList->IASetVertexBuffers(0, 1, &meshObject.vbView);
                 m_commandList->IASetIndexBuffer(&meshObject.ibView);
                 m_commandList->DrawIndexedInstanced(meshObject.indexCount, instanceCount, 0, 0, 0);
@@ -4,18 +4,19 @@
 #include <d3d12.h>
 #include <map>
 #include <wrl.h>
+#include "upload_ring.h"
 using namespace Microsoft::WRL;
 
 class DX12Renderer : public Renderer {
 
     public:
         void initialize(RenderInitData initData) override;
-        void doFrame(FrameSubmission frameData) override;
+        void doFrame(const FrameSubmission& frameData) override;
         void postRenderSynch();
         void present();
         void shutdown();
         void executeCommandList(ComPtr<ID3D12CommandList> commandList);
-        ComPtr<ID3D12CommandList> populateCommandList(FrameSubmission frameData);
+        ComPtr<ID3D12CommandList> populateCommandList(const FrameSubmission& frameData);
         
     private:
         
@@ -67,6 +68,7 @@ class DX12Renderer : public Renderer {
         void createTextures();
         void createVertexBuffers();
         void WaitForPreviousFrame();
+        void createInstanceUpload(UINT64 capacity);
         void GetHardwareAdapter(IDXGIFactory1 *pFactory, IDXGIAdapter1 **ppAdapter, bool requestHighPerformanceAdapter);
         void uploadBufferData(size_t size, void *data, ComPtr<ID3D12Resource> targetBuffer, D3D12_RESOURCE_STATES finalState);
         
@@ -75,7 +77,7 @@ class DX12Renderer : public Renderer {
         D3D12_GPU_DESCRIPTOR_HANDLE gpuDescriptorHandle(UINT idx);
         TempCommandList createOneTimeCommandList();
 
-        Texture loadTextureFromFile(const std::wstring &fileName);
+        Texture loadTextureArray(std::span<const std::wstring> fileNames);
 
     private:
         uint8_t frameCount = 0;
@@ -87,8 +89,12 @@ class DX12Renderer : public Renderer {
         std::vector<ComPtr<ID3D12Resource>> m_renderTargets;
         std::vector<UINT64> g_frameFence = {};
         std::vector<ComPtr<ID3D12CommandAllocator>> g_alloc;
-        std::vector<ComPtr<ID3D12Resource>> m_instanceUploadBuffer;
-        std::vector<uint8_t*> m_instanceUploadMapped;
+        // Instances of all frames in flight, persistently mapped and 
+        // read by the shaders in place. instanceRing hands out the ranges
+        // and gets them back once the fence of their frame has passed.
+        ComPtr<ID3D12Resource> m_instanceUpload;
+        uint8_t* m_instanceUploadMapped = nullptr;
+        UploadRing instanceRing;
 
         ComPtr<ID3D12CommandAllocator> m_commandAllocator;
         ComPtr<ID3D12CommandQueue> m_commandQueue;
@@ -103,10 +109,10 @@ class DX12Renderer : public Renderer {
         ComPtr<ID3D12Resource> m_objectCB;
         ComPtr<ID3D12Resource> m_materialCB;
 
-        std::map<std::string, ComPtr<ID3D12PipelineState>> psos;
+        // Indexed by PipelineHandle
+        std::vector<ComPtr<ID3D12PipelineState>> psos;
         
         UINT m_nextSrvIndex = 0;
-        ComPtr<ID3D12Resource> m_instanceDefault;
         static const UINT MaxInstances = 50000;
         const UINT instBytes = MaxInstances * sizeof(InstanceDataCPU);
         
@@ -116,12 +122,13 @@ class DX12Renderer : public Renderer {
         UINT m_rtvDescriptorSize;
         ComPtr<ID3D12Resource> m_depthTex;
 
-        // Stores textures with an id as defined by 
-        // the game. 
-        // This allows the game to reference the
-        // textures during frame rendering.
-        std::map<std::string, Texture> textureMap;
-        std::map<std::string, Mesh> meshMap;
+        // Stores textures and meshes in descriptor order,
+        // so the handles of the game index them directly
+        // during frame rendering.
+        // One resource and view per texture array, see texture_arrays.h.
+        std::vector<Texture> textureArrays;
+        std::vector<TextureSlot> textureSlots;
+        std::vector<Mesh> meshes;
         
         
         UINT m_srvDescriptorSize = 0;
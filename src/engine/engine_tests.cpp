@@ -0,0 +1,21 @@
+#include "engine_tests.h"
+
+int failedChecks = 0;
+
+// Runs the tests of all modules, fails if any check failed.
+int main() {
+
+    testUploadRing();
+    testRenderGraph();
+    testStateCache();
+    testShaderCache();
+    testFrameCapture();
+    testOcclusionCuller();
+
+    if (failedChecks) {
+        std::cerr << failedChecks << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <iostream>
+
+// Checks for the engine_tests executable, no test framework needed.
+// A failed CHECK is reported and counted, the remaining checks still run.
+extern int failedChecks;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            failedChecks++; \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl; \
+        } \
+    } while (0)
+
+// One function per module, each in its <module>_test.cpp.
+void testUploadRing();
+void testRenderGraph();
+void testStateCache();
+void testShaderCache();
+void testFrameCapture();
+void testOcclusionCuller();
@@ -0,0 +1,80 @@
+#include "frame_arena.h"
+#include <algorithm>
+
+static size_t alignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+LinearArena::LinearArena(size_t initialCapacity)
+    : block(new std::byte[initialCapacity]), blockSize(initialCapacity)
+{
+}
+
+void LinearArena::reset()
+{
+    // Grow the main block so next time everything fits into it.
+    // Some headroom is added, as alignment padding differs from frame to frame.
+    if (!overflowBlocks.empty()) {
+        blockSize = alignUp(highWater + highWater / 4, 4096);
+        block.reset(new std::byte[blockSize]);
+        overflowBlocks.clear();
+        overflowSize = 0;
+        overflowOffset = 0;
+    }
+
+    offset = 0;
+    used = 0;
+}
+
+void* LinearArena::do_allocate(size_t bytes, size_t alignment)
+{
+    auto base = reinterpret_cast<uintptr_t>(block.get());
+    auto alignedOffset = alignUp(base + offset, alignment) - base;
+    if (overflowBlocks.empty() && alignedOffset + bytes <= blockSize) {
+        offset = alignedOffset + bytes;
+        used = offset;
+        highWater = std::max(highWater, used);
+        return block.get() + alignedOffset;
+    }
+
+    return allocateOverflow(bytes, alignment);
+}
+
+void* LinearArena::allocateOverflow(size_t bytes, size_t alignment)
+{
+    // Conservative, as we don't know the padding the main block would need.
+    used += bytes + alignment;
+    highWater = std::max(highWater, used);
+
+    if (!overflowBlocks.empty()) {
+        auto base = reinterpret_cast<uintptr_t>(overflowBlocks.back().get());
+        auto alignedOffset = alignUp(base + overflowOffset, alignment) - base;
+        if (alignedOffset + bytes <= overflowSize) {
+            overflowOffset = alignedOffset + bytes;
+            return overflowBlocks.back().get() + alignedOffset;
+        }
+    }
+
+    overflowSize = std::max(blockSize, bytes + alignment);
+    overflowBlocks.emplace_back(new std::byte[overflowSize]);
+    auto base = reinterpret_cast<uintptr_t>(overflowBlocks.back().get());
+    auto alignedOffset = alignUp(base, alignment) - base;
+    overflowOffset = alignedOffset + bytes;
+    return overflowBlocks.back().get() + alignedOffset;
+}
+
+FrameArena::FrameArena(size_t bytesPerFrame, uint32_t numBuffers)
+{
+    for (uint32_t i = 0; i < numBuffers; i++) {
+        arenas.push_back(std::make_unique<LinearArena>(bytesPerFrame));
+    }
+    currentIndex = numBuffers - 1;
+}
+
+LinearArena& FrameArena::beginFrame()
+{
+    currentIndex = (currentIndex + 1) % arenas.size();
+    arenas[currentIndex]->reset();
+    return *arenas[currentIndex];
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+// Linear (bump) allocator for everything that only lives for one frame.
+// Deallocation is a no-op, the whole arena is released in one step by reset().
+// If a frame needs more memory than the arena holds, overflow blocks are
+// taken from the heap and the arena grows to the high water mark on the
+// next reset, so in steady state a frame does not touch the heap at all.
+class LinearArena : public std::pmr::memory_resource
+{
+    public:
+        explicit LinearArena(size_t initialCapacity);
+
+        void reset();
+
+        // Constructs a T inside the arena, passing the arena on as
+        // allocator to T and all its allocator aware members.
+        template <typename T, typename... Args>
+        T* create(Args&&... args)
+        {
+            return std::pmr::polymorphic_allocator<>(this).new_object<T>(std::forward<Args>(args)...);
+        }
+
+        size_t bytesUsed() const { return used; }
+        size_t capacity() const { return blockSize; }
+        size_t highWaterMark() const { return highWater; }
+
+    protected:
+        void* do_allocate(size_t bytes, size_t alignment) override;
+        void do_deallocate(void*, size_t, size_t) override {}
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    private:
+        void* allocateOverflow(size_t bytes, size_t alignment);
+
+        std::unique_ptr<std::byte[]> block;
+        size_t blockSize = 0;
+        size_t offset = 0;
+
+        // Blocks which were needed on top of the main block this frame.
+        std::vector<std::unique_ptr<std::byte[]>> overflowBlocks;
+        size_t overflowSize = 0;
+        size_t overflowOffset = 0;
+
+        size_t used = 0;
+        size_t highWater = 0;
+};
+
+// A ring of LinearArenas, one per frame in flight.
+// beginFrame() moves on to the next arena and resets it, which retires
+// the frame that was built in it numBuffers frames ago.
+class FrameArena
+{
+    public:
+        explicit FrameArena(size_t bytesPerFrame = 4 * 1024 * 1024, uint32_t numBuffers = 2);
+
+        LinearArena& beginFrame();
+        LinearArena& current() { return *arenas[currentIndex]; }
+        LinearArena& buffer(uint32_t index) { return *arenas[index]; }
+        uint32_t bufferCount() const { return arenas.size(); }
+
+    private:
+        std::vector<std::unique_ptr<LinearArena>> arenas;
+        uint32_t currentIndex = 0;
+};
@@ -0,0 +1,594 @@
+#include "frame_capture.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+
+using namespace DirectX::SimpleMath;
+
+static constexpr char captureMagic[8] = {'R', 'T', 'S', 'C', 'A', 'P', 0, 0};
+static constexpr uint32_t captureVersion = 8;
+
+enum ResourceKind 
+{
+    MeshKind,
+    TextureKind,
+    PipelineKind,
+    SnippetKind,
+};
+
+// --------------------------------------------------------------------------------------------
+// Encoding
+// --------------------------------------------------------------------------------------------
+
+static void putVarint(std::vector<uint8_t>& out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out.push_back((uint8_t) (value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t) value);
+}
+
+static void putString(std::vector<uint8_t>& out, std::string_view s)
+{
+    putVarint(out, s.size());
+    out.insert(out.end(), s.begin(), s.end());
+}
+
+// Invalid handles become 0.
+template <typename Handle>
+static void putHandle(std::vector<uint8_t>& out, Handle handle)
+{
+    putVarint(out, handle.isValid() ? handle.index + 1 : 0);
+}
+
+static void putMatrix(std::vector<uint8_t>& out, const Matrix& m, uint32_t previous[16])
+{
+    uint32_t words[16];
+    memcpy(words, &m, sizeof(words));
+
+    uint16_t mask = 0;
+    for (int i = 0; i < 16; i++) {
+        if (words[i] != previous[i]) mask |= 1 << i;
+    }
+    out.push_back(mask & 0xFF);
+    out.push_back(mask >> 8);
+    for (int i = 0; i < 16; i++) {
+        if (mask & (1 << i)) {
+            uint32_t delta = words[i] ^ previous[i];
+            out.insert(out.end(), (uint8_t*) &delta, (uint8_t*) &delta + 4);
+        }
+    }
+    memcpy(previous, words, sizeof(words));
+}
+
+template <typename Matrices>
+static void putMatrices(std::vector<uint8_t>& out, const Matrices& matrices, uint32_t previous[16])
+{
+    putVarint(out, matrices.size());
+    for (auto& m : matrices) {
+        putMatrix(out, m, previous);
+    }
+}
+
+// Attributes are stored as they are, like sprite records.
+static void putAttributes(std::vector<uint8_t>& out, std::span<const InstanceAttributes> attributes)
+{
+    putVarint(out, attributes.size());
+    auto bytes = reinterpret_cast<const uint8_t*>(attributes.data());
+    out.insert(out.end(), bytes, bytes + attributes.size_bytes());
+}
+
+FrameCaptureWriter::~FrameCaptureWriter()
+{
+    close();
+}
+
+bool FrameCaptureWriter::open(const std::string& path, const RenderInitData& initData)
+{
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "Failed to open capture file " << path << std::endl;
+        return false;
+    }
+
+    CaptureHeader header = {};
+    memcpy(header.magic, captureMagic, sizeof(captureMagic));
+    header.version = captureVersion;
+    header.stringTableOffset = sizeof(CaptureHeader);
+    file.write((const char*) &header, sizeof(header));
+
+    std::vector<uint8_t> strings;
+    putVarint(strings, initData.meshDescriptors.size());
+    for (auto& d : initData.meshDescriptors) putString(strings, d.id);
+    putVarint(strings, initData.textureDescriptors.size());
+    for (auto& d : initData.textureDescriptors) putString(strings, d.id);
+    putVarint(strings, initData.pipelineStates.size());
+    for (auto& d : initData.pipelineStates) putString(strings, d.id);
+    putVarint(strings, initData.snippetDescriptors.size());
+    for (auto& d : initData.snippetDescriptors) putString(strings, d.snippetId);
+    file.write((const char*) strings.data(), strings.size());
+
+    frameOffsets.clear();
+    return true;
+}
+
+void FrameCaptureWriter::writeFrame(const FrameSubmission& frame)
+{
+    if (!file.is_open()) return;
+
+    auto& out = frameBuffer;
+    out.clear();
+    uint32_t previous[16] = {};
+
+    putVarint(out, frame.viewSubmissions.size());
+    for (auto& vs : frame.viewSubmissions) {
+        putMatrix(out, vs.viewMatrix, previous);
+        putMatrix(out, vs.projectionMatrix, previous);
+
+        putVarint(out, vs.objectRenderData.size());
+        for (auto& ord : vs.objectRenderData) {
+            putHandle(out, ord.mesh);
+            putHandle(out, ord.texture);
+            putHandle(out, ord.pipeline);
+            putMatrices(out, ord.worldMatrices, previous);
+            putAttributes(out, ord.attributes);
+        }
+
+        putVarint(out, vs.retainedDraws.size());
+        for (auto& draw : vs.retainedDraws) {
+            putVarint(out, draw.batch);
+            putHandle(out, draw.mesh);
+            putHandle(out, draw.texture);
+            putHandle(out, draw.pipeline);
+            putVarint(out, draw.instanceCount);
+        }
+
+        putVarint(out, vs.textRenderData.size());
+        for (auto& text : vs.textRenderData) {
+            putHandle(out, text.snippet);
+            putString(out, text.updatedText);
+            putMatrices(out, text.worldMatrices, previous);
+        }
+
+        putVarint(out, vs.pooledDraws.size());
+        for (auto& draw : vs.pooledDraws) {
+            putVarint(out, draw.pool);
+            putVarint(out, draw.firstInstance);
+            putVarint(out, draw.instanceCount);
+            putHandle(out, draw.mesh);
+            putHandle(out, draw.texture);
+            putHandle(out, draw.pipeline);
+        }
+        putVarint(out, vs.instanceMask);
+
+        // Sprite records are small and rarely repeat, they are stored as they are.
+        putVarint(out, vs.sprites.size());
+        for (auto& sprite : vs.sprites) {
+            putHandle(out, sprite.texture);
+            auto record = reinterpret_cast<const uint8_t*>(&sprite.record);
+            out.insert(out.end(), record, record + sizeof(SpriteRecord));
+        }
+
+        // So are the point lights.
+        putVarint(out, vs.pointLights.size());
+        for (auto& light : vs.pointLights) {
+            auto bytes = reinterpret_cast<const uint8_t*>(&light);
+            out.insert(out.end(), bytes, bytes + sizeof(PointLight));
+        }
+
+        putVarint(out, vs.staticDraws.size());
+        for (auto& draw : vs.staticDraws) {
+            putVarint(out, draw.batch);
+            putHandle(out, draw.texture);
+            putHandle(out, draw.pipeline);
+            putVarint(out, draw.indexCount);
+            auto bounds = reinterpret_cast<const uint8_t*>(&draw.boundsMin);
+            out.insert(out.end(), bounds, bounds + sizeof(Vector3));
+            bounds = reinterpret_cast<const uint8_t*>(&draw.boundsMax);
+            out.insert(out.end(), bounds, bounds + sizeof(Vector3));
+        }
+    }
+
+    putVarint(out, frame.retainedUpdates.size());
+    for (auto& update : frame.retainedUpdates) {
+        putVarint(out, update.batch);
+        putHandle(out, update.pipeline);
+        putVarint(out, update.capacity);
+        putVarint(out, update.firstInstance);
+        putMatrices(out, update.transforms, previous);
+    }
+
+    putVarint(out, frame.instancePools.size());
+    for (auto& pool : frame.instancePools) {
+        putMatrices(out, pool.worldMatrices, previous);
+        putVarint(out, pool.masks.size());
+        for (auto mask : pool.masks) {
+            putVarint(out, mask);
+        }
+        putAttributes(out, pool.attributes);
+    }
+
+    // The merged geometry of rebuilt static batches, vertices as they are.
+    putVarint(out, frame.staticUpdates.size());
+    for (auto& update : frame.staticUpdates) {
+        putVarint(out, update.batch);
+        putVarint(out, update.vertices.size());
+        auto vertices = reinterpret_cast<const uint8_t*>(update.vertices.data());
+        out.insert(out.end(), vertices, vertices + update.vertices.size_bytes());
+        putVarint(out, update.indices.size());
+        for (auto index : update.indices) {
+            putVarint(out, index);
+        }
+        putVarint(out, update.occluders.size());
+        for (auto& occluder : update.occluders) {
+            putHandle(out, occluder.mesh);
+            putMatrix(out, occluder.transform, previous);
+        }
+    }
+
+    putVarint(out, frame.resizeWidth);
+    putVarint(out, frame.resizeHeight);
+
+    frameOffsets.push_back(file.tellp());
+    uint32_t size = out.size();
+    file.write((const char*) &size, sizeof(size));
+    file.write((const char*) out.data(), out.size());
+}
+
+void FrameCaptureWriter::close()
+{
+    if (!file.is_open()) return;
+
+    uint64_t indexOffset = file.tellp();
+    file.write((const char*) frameOffsets.data(), frameOffsets.size() * sizeof(uint64_t));
+
+    // Now that everything is known, complete the header.
+    file.seekp(offsetof(CaptureHeader, frameCount));
+    uint32_t frameCount = frameOffsets.size();
+    file.write((const char*) &frameCount, sizeof(frameCount));
+    file.seekp(offsetof(CaptureHeader, frameIndexOffset));
+    file.write((const char*) &indexOffset, sizeof(indexOffset));
+    file.close();
+}
+
+// --------------------------------------------------------------------------------------------
+// Decoding
+// --------------------------------------------------------------------------------------------
+
+// Reads from a byte range. Reading past its end flags the cursor 
+// as broken and returns zeros from then on.
+struct ByteCursor
+{
+    const uint8_t* p;
+    const uint8_t* end;
+    bool ok = true;
+
+    bool has(size_t bytes)
+    {
+        if (ok && (size_t) (end - p) >= bytes) return true;
+        ok = false;
+        return false;
+    }
+
+    uint64_t varint()
+    {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (!has(1)) return 0;
+            uint8_t byte = *p++;
+            value |= (uint64_t) (byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        ok = false;
+        return 0;
+    }
+
+    std::string_view string()
+    {
+        auto size = varint();
+        if (!has(size)) return {};
+        std::string_view s((const char*) p, size);
+        p += size;
+        return s;
+    }
+
+    Matrix matrix(uint32_t previous[16])
+    {
+        if (!has(2)) return {};
+        uint16_t mask = p[0] | (p[1] << 8);
+        p += 2;
+        for (int i = 0; i < 16; i++) {
+            if (mask & (1 << i)) {
+                uint32_t delta;
+                if (!has(4)) return {};
+                memcpy(&delta, p, 4);
+                p += 4;
+                previous[i] ^= delta;
+            }
+        }
+        std::array<uint32_t, 16> words;
+        std::copy_n(previous, 16, words.begin());
+        return std::bit_cast<Matrix>(words);
+    }
+
+    // Bounds the count of a following array, so corrupt data
+    // can't make us allocate huge amounts of memory.
+    uint32_t count(size_t minBytesPerElement)
+    {
+        auto n = varint();
+        if (n * minBytesPerElement > (size_t) (end - p)) {
+            ok = false;
+            return 0;
+        }
+        return n;
+    }
+};
+
+template <typename Handle>
+static Handle readHandle(ByteCursor& c, const std::vector<uint32_t>& remapTable)
+{
+    auto value = c.varint();
+    if (value == 0 || value > remapTable.size()) return Handle{};
+    return Handle{remapTable[value - 1]};
+}
+
+template <typename Matrices>
+static void readMatrices(ByteCursor& c, Matrices& matrices, uint32_t previous[16])
+{
+    auto n = c.count(2);
+    matrices.reserve(n);
+    for (uint32_t i = 0; i < n; i++) {
+        matrices.push_back(c.matrix(previous));
+    }
+}
+
+static void readAttributes(ByteCursor& c, FrameVector<InstanceAttributes>& attributes)
+{
+    auto n = c.count(sizeof(InstanceAttributes));
+    if (n == 0) return;
+    attributes.resize(n);
+    memcpy(attributes.data(), c.p, n * sizeof(InstanceAttributes));
+    c.p += n * sizeof(InstanceAttributes);
+}
+
+bool FrameReplayer::open(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to open capture file " << path << std::endl;
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+    CaptureHeader header;
+    if (data.size() < sizeof(header)) {
+        std::cerr << "Not a frame capture: " << path << std::endl;
+        return false;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    if (memcmp(header.magic, captureMagic, sizeof(captureMagic)) != 0 || header.version != captureVersion) {
+        std::cerr << "Not a frame capture or unsupported version: " << path << std::endl;
+        return false;
+    }
+    if (header.frameIndexOffset == 0 || header.frameIndexOffset + header.frameCount * sizeof(uint64_t) > data.size()) {
+        std::cerr << "Incomplete frame capture, was it closed? " << path << std::endl;
+        return false;
+    }
+
+    ByteCursor c = {data.data() + header.stringTableOffset, data.data() + data.size()};
+    for (auto& kindIds : ids) {
+        auto n = c.count(1);
+        kindIds.clear();
+        for (uint32_t i = 0; i < n; i++) {
+            kindIds.emplace_back(c.string());
+        }
+    }
+    if (!c.ok) {
+        std::cerr << "Corrupt string table in " << path << std::endl;
+        return false;
+    }
+
+    frameOffsets.resize(header.frameCount);
+    memcpy(frameOffsets.data(), data.data() + header.frameIndexOffset, header.frameCount * sizeof(uint64_t));
+
+    // Without remap() the handles are replayed as they were captured.
+    for (int kind = 0; kind < 4; kind++) {
+        remapTables[kind].resize(ids[kind].size());
+        for (uint32_t i = 0; i < ids[kind].size(); i++) {
+            remapTables[kind][i] = i;
+        }
+    }
+    return true;
+}
+
+bool FrameReplayer::remap(const RenderInitData& initData)
+{
+    bool complete = true;
+    auto resolve = [&](int kind, auto find) {
+        for (uint32_t i = 0; i < ids[kind].size(); i++) {
+            auto handle = find(ids[kind][i]);
+            if (!handle.isValid()) {
+                std::cerr << "Captured resource " << ids[kind][i] << " is unknown" << std::endl;
+                complete = false;
+            }
+            remapTables[kind][i] = handle.index;
+        }
+    };
+    resolve(MeshKind, [&](const std::string& id) { return initData.findMesh(id); });
+    resolve(TextureKind, [&](const std::string& id) { return initData.findTexture(id); });
+    resolve(PipelineKind, [&](const std::string& id) { return initData.findPipelineState(id); });
+    resolve(SnippetKind, [&](const std::string& id) { return initData.findSnippet(id); });
+    return complete;
+}
+
+FrameSubmission* FrameReplayer::decodeFrame(uint32_t index, LinearArena& arena) const
+{
+    auto offset = frameOffsets[index];
+    if (offset + sizeof(uint32_t) > data.size()) return nullptr;
+    uint32_t size;
+    memcpy(&size, data.data() + offset, sizeof(size));
+    if (offset + sizeof(uint32_t) + size > data.size()) return nullptr;
+
+    ByteCursor c = {data.data() + offset + sizeof(uint32_t), data.data() + offset + sizeof(uint32_t) + size};
+    uint32_t previous[16] = {};
+
+    auto frame = arena.create<FrameSubmission>();
+    auto numViews = c.count(1);
+    frame->viewSubmissions.resize(numViews);
+    for (auto& vs : frame->viewSubmissions) {
+        vs.viewMatrix = c.matrix(previous);
+        vs.projectionMatrix = c.matrix(previous);
+
+        auto numObjects = c.count(4);
+        vs.objectRenderData.resize(numObjects);
+        for (auto& ord : vs.objectRenderData) {
+            ord.mesh = readHandle<MeshHandle>(c, remapTables[MeshKind]);
+            ord.texture = readHandle<TextureHandle>(c, remapTables[TextureKind]);
+            ord.pipeline = readHandle<PipelineHandle>(c, remapTables[PipelineKind]);
+            readMatrices(c, ord.worldMatrices, previous);
+            readAttributes(c, ord.attributes);
+        }
+
+        auto numRetained = c.count(5);
+        vs.retainedDraws.resize(numRetained);
+        for (auto& draw : vs.retainedDraws) {
+            draw.batch = c.varint();
+            draw.mesh = readHandle<MeshHandle>(c, remapTables[MeshKind]);
+            draw.texture = readHandle<TextureHandle>(c, remapTables[TextureKind]);
+            draw.pipeline = readHandle<PipelineHandle>(c, remapTables[PipelineKind]);
+            draw.instanceCount = c.varint();
+        }
+
+        auto numTexts = c.count(3);
+        vs.textRenderData.resize(numTexts);
+        for (auto& text : vs.textRenderData) {
+            text.snippet = readHandle<SnippetHandle>(c, remapTables[SnippetKind]);
+            text.updatedText = c.string();
+            readMatrices(c, text.worldMatrices, previous);
+        }
+
+        auto numPooled = c.count(6);
+        vs.pooledDraws.resize(numPooled);
+        for (auto& draw : vs.pooledDraws) {
+            draw.pool = c.varint();
+            draw.firstInstance = c.varint();
+            draw.instanceCount = c.varint();
+            draw.mesh = readHandle<MeshHandle>(c, remapTables[MeshKind]);
+            draw.texture = readHandle<TextureHandle>(c, remapTables[TextureKind]);
+            draw.pipeline = readHandle<PipelineHandle>(c, remapTables[PipelineKind]);
+        }
+        vs.instanceMask = c.varint();
+
+        auto numSprites = c.count(1 + sizeof(SpriteRecord));
+        vs.sprites.resize(numSprites);
+        for (auto& sprite : vs.sprites) {
+            sprite.texture = readHandle<TextureHandle>(c, remapTables[TextureKind]);
+            if (!c.has(sizeof(SpriteRecord))) break;
+            memcpy(&sprite.record, c.p, sizeof(SpriteRecord));
+            c.p += sizeof(SpriteRecord);
+        }
+
+        auto numLights = c.count(sizeof(PointLight));
+        vs.pointLights.resize(numLights);
+        for (auto& light : vs.pointLights) {
+            if (!c.has(sizeof(PointLight))) break;
+            memcpy(&light, c.p, sizeof(PointLight));
+            c.p += sizeof(PointLight);
+        }
+
+        auto numStatic = c.count(4 + 2 * sizeof(Vector3));
+        vs.staticDraws.resize(numStatic);
+        for (auto& draw : vs.staticDraws) {
+            draw.batch = c.varint();
+            draw.texture = readHandle<TextureHandle>(c, remapTables[TextureKind]);
+            draw.pipeline = readHandle<PipelineHandle>(c, remapTables[PipelineKind]);
+            draw.indexCount = c.varint();
+            if (!c.has(2 * sizeof(Vector3))) break;
+            memcpy(&draw.boundsMin, c.p, sizeof(Vector3));
+            memcpy(&draw.boundsMax, c.p + sizeof(Vector3), sizeof(Vector3));
+            c.p += 2 * sizeof(Vector3);
+        }
+    }
+
+    auto numUpdates = c.count(5);
+    frame->retainedUpdates.resize(numUpdates);
+    for (auto& update : frame->retainedUpdates) {
+        update.batch = c.varint();
+        update.pipeline = readHandle<PipelineHandle>(c, remapTables[PipelineKind]);
+        update.capacity = c.varint();
+        update.firstInstance = c.varint();
+        auto n = c.count(2);
+        auto transforms = static_cast<Matrix*>(arena.allocate(n * sizeof(Matrix), alignof(Matrix)));
+        for (uint32_t i = 0; i < n; i++) {
+            transforms[i] = c.matrix(previous);
+        }
+        update.transforms = {transforms, n};
+    }
+
+    auto numPools = c.count(2);
+    frame->instancePools.resize(numPools);
+    for (auto& pool : frame->instancePools) {
+        readMatrices(c, pool.worldMatrices, previous);
+        auto numMasks = c.count(1);
+        pool.masks.reserve(numMasks);
+        for (uint32_t i = 0; i < numMasks; i++) {
+            pool.masks.push_back(c.varint());
+        }
+        readAttributes(c, pool.attributes);
+    }
+
+    auto numStaticUpdates = c.count(3);
+    frame->staticUpdates.resize(numStaticUpdates);
+    for (auto& update : frame->staticUpdates) {
+        update.batch = c.varint();
+        auto numFloats = c.count(sizeof(float));
+        auto vertices = static_cast<float*>(arena.allocate(numFloats * sizeof(float), alignof(float)));
+        if (!c.has(numFloats * sizeof(float))) break;
+        memcpy(vertices, c.p, numFloats * sizeof(float));
+        c.p += numFloats * sizeof(float);
+        update.vertices = {vertices, numFloats};
+
+        auto numIndices = c.count(1);
+        auto indices = static_cast<uint32_t*>(arena.allocate(numIndices * sizeof(uint32_t), alignof(uint32_t)));
+        for (uint32_t i = 0; i < numIndices; i++) {
+            indices[i] = c.varint();
+        }
+        update.indices = {indices, numIndices};
+
+        auto numOccluders = c.count(3);
+        auto occluders = static_cast<StaticOccluder*>(arena.allocate(numOccluders * sizeof(StaticOccluder), 
+                                                                     alignof(StaticOccluder)));
+        for (uint32_t i = 0; i < numOccluders; i++) {
+            occluders[i].mesh = readHandle<MeshHandle>(c, remapTables[MeshKind]);
+            occluders[i].transform = c.matrix(previous);
+        }
+        update.occluders = {occluders, numOccluders};
+    }
+
+    // A replayed resize changes the swap chain like the captured one did,
+    // so the captured projections keep their aspect ratio.
+    frame->resizeWidth = c.varint();
+    frame->resizeHeight = c.varint();
+
+    return c.ok ? frame : nullptr;
+}
+
+uint32_t FrameReplayer::replay(Renderer& renderer, FrameArena& frameArena) const
+{
+    uint32_t rendered = 0;
+    for (uint32_t i = 0; i < frameCount(); i++) {
+        auto frame = decodeFrame(i, frameArena.beginFrame());
+        if (!frame) {
+            std::cerr << "Corrupt frame " << i << " in capture, stopping replay" << std::endl;
+            break;
+        }
+        renderer.doFrame(*frame);
+        rendered++;
+    }
+    return rendered;
+}
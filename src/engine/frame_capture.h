@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "renderer.h"
+#include "frame_arena.h"
+
+// Binary capture of a FrameSubmission stream.
+//
+// File layout, all numbers little endian:
+//   CaptureHeader
+//   string table: for meshes, textures, pipelines and snippets each
+//                 a varint count followed by the ids as varint length + bytes
+//   frames:       one self contained block per frame
+//   frame index:  uint64 file offset of every frame
+//
+// Handles are stored as the index into the string table, so a capture can be
+// replayed against any RenderInitData which registers resources with the same ids.
+// Frames only refer to the string table and the frame index refers to the frames 
+// by offset, so the file can be read in place, e.g. memory mapped.
+// Matrices are XOR delta coded against the previous matrix of the frame:
+// a 16 bit mask of the changed floats followed by the changed ones.
+struct CaptureHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t frameCount;
+    uint64_t stringTableOffset;
+    uint64_t frameIndexOffset;
+};
+
+class FrameCaptureWriter
+{
+    public:
+        ~FrameCaptureWriter();
+
+        bool open(const std::string& path, const RenderInitData& initData);
+        void writeFrame(const FrameSubmission& frame);
+        // Writes the frame index, the file is incomplete before.
+        void close();
+
+        bool isOpen() const { return file.is_open(); }
+        uint32_t frameCount() const { return frameOffsets.size(); }
+
+    private:
+        std::ofstream file;
+        std::vector<uint64_t> frameOffsets;
+        // Reused for every frame, so capturing does not allocate in steady state.
+        std::vector<uint8_t> frameBuffer;
+};
+
+class FrameReplayer
+{
+    public:
+        bool open(const std::string& path);
+
+        // Resolves the captured resource ids against the resources of initData.
+        // Returns false if some id is unknown, its handles are replayed as invalid.
+        bool remap(const RenderInitData& initData);
+
+        uint32_t frameCount() const { return frameOffsets.size(); }
+
+        // Decodes one frame into the arena, nullptr for a corrupt frame.
+        FrameSubmission* decodeFrame(uint32_t index, LinearArena& arena) const;
+
+        // Feeds every frame to the renderer as fast as possible, 
+        // returns the number of frames rendered.
+        uint32_t replay(Renderer& renderer, FrameArena& frameArena) const;
+
+    private:
+        std::vector<uint8_t> data;
+        std::vector<uint64_t> frameOffsets;
+
+        // Captured ids and their index in the replaying RenderInitData, 
+        // per resource kind.
+        std::vector<std::string> ids[4];
+        std::vector<uint32_t> remapTables[4];
+};
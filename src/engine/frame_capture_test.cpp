@@ -0,0 +1,378 @@
+#include "engine_tests.h"
+#include "frame_capture.h"
+#include "recording_renderer.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+namespace fs = std::filesystem;
+using namespace DirectX::SimpleMath;
+
+// Registers the resources the test frames refer to, in the given order,
+// so a replay can remap them to other handles.
+static RenderInitData captureInitData(bool reversed)
+{
+    RenderInitData initData;
+    initData.screenWidth = 800;
+    initData.screenHeight = 600;
+
+    MeshDescriptor house = {"house", GeometryFactory::getQuadGeometry()};
+    house.occluder = true;
+    MeshDescriptor unit = {"unit", GeometryFactory::getQuadGeometry()};
+    PipelineState pipeline;
+    pipeline.id = "textured";
+    pipeline.inputLayout.addElement({InputElementType::POSITION}).addElement({InputElementType::UV});
+    pipeline.instanceAttributes = instanceAttributeBit(InstanceAttribute::TeamColor);
+
+    if (reversed) {
+        initData.addMesh(unit);
+        initData.addMesh(house);
+        initData.addTexture({"atlas", "atlas.png"});
+        initData.addTexture({"hero", "hero.png"});
+    } else {
+        initData.addMesh(house);
+        initData.addMesh(unit);
+        initData.addTexture({"hero", "hero.png"});
+        initData.addTexture({"atlas", "atlas.png"});
+    }
+    initData.addPipelineState(pipeline);
+    initData.addFont({"arial", "arial.ttf", 16});
+    initData.addSnippet({"arial", "title", "Hello"});
+    return initData;
+}
+
+template <typename T>
+static std::span<const T> arenaCopy(LinearArena& arena, std::initializer_list<T> values)
+{
+    auto copy = static_cast<T*>(arena.allocate(values.size() * sizeof(T), alignof(T)));
+    std::copy(values.begin(), values.end(), copy);
+    return {copy, values.size()};
+}
+
+// A frame which fills every field of the submission. The second frame
+// draws the batches the first one uploaded, like a running game does.
+static FrameSubmission* buildFrame(LinearArena& arena, const RenderInitData& initData, uint32_t index)
+{
+    auto house = initData.findMesh("house");
+    auto unit = initData.findMesh("unit");
+    auto hero = initData.findTexture("hero");
+    auto atlas = initData.findTexture("atlas");
+    auto pipeline = initData.findPipelineState("textured");
+
+    auto frame = arena.create<FrameSubmission>();
+    frame->viewSubmissions.resize(2);
+    auto& view3D = frame->viewSubmissions[0];
+    auto& view2D = frame->viewSubmissions[1];
+
+    view3D.viewMatrix = Matrix(DirectX::XMMatrixLookAtLH({0, 30, -15}, {0, 0, 0}, {0, 1, 0}));
+    view3D.projectionMatrix = Matrix(DirectX::XMMatrixPerspectiveFovLH(45, 800.0f / 600.0f, 0.1f, 200));
+    view3D.instanceMask = 0x5;
+
+    auto& units = view3D.objectRenderData.emplace_back();
+    units.mesh = unit;
+    units.texture = hero;
+    units.pipeline = pipeline;
+    for (uint32_t i = 0; i < 3; i++) {
+        units.worldMatrices.push_back(Matrix::CreateScale(2, 2, 2) * Matrix::CreateTranslation(i * 3.0f, 0, index));
+        units.attributes.push_back({0xFF0000FF, 0xFFFFFFFF, 0.25f * (i + 1), i, i & 1});
+    }
+
+    view3D.retainedDraws.push_back({7, house, atlas, pipeline, 2});
+    view3D.pooledDraws.push_back({0, 1, 2, unit, hero, pipeline});
+    view3D.pointLights.push_back({{1, 2, 3}, 5, {1, 0.5f, 0}, 2});
+    view3D.pointLights.push_back({{-4, 1, 0}, 8});
+    view3D.staticDraws.push_back({3, atlas, pipeline, 6, {-10, 0, -10}, {10, 4, 10}});
+
+    view2D.projectionMatrix = Matrix(DirectX::XMMatrixOrthographicOffCenterLH(0, 800, 0, 600, 0.1f, 100));
+    auto& title = view2D.textRenderData.emplace_back();
+    title.snippet = initData.findSnippet("title");
+    title.updatedText = index ? "Frame 1" : "";
+    title.worldMatrices.push_back(Matrix::CreateTranslation(100, 500, 1));
+    view2D.sprites.push_back({{{64, 64}, {32, 32}, 0, 0xFFFF8000, 0xFF00FF00, 0.5f}, atlas});
+    view2D.sprites.push_back({{{128, 64}, {16, 48}}, hero});
+
+    auto& pool = frame->instancePools.emplace_back();
+    for (uint32_t i = 0; i < 4; i++) {
+        pool.worldMatrices.push_back(Matrix::CreateTranslation(0, i, -5.0f * i));
+        pool.masks.push_back(1u << i);
+        pool.attributes.push_back({0xFF00FF00, 0xFF808080, 1, index, 0});
+    }
+
+    if (index == 0) {
+        frame->retainedUpdates.push_back({7, pipeline, 16, 0,
+                                          arenaCopy(arena, {Matrix::CreateTranslation(5, 0, 5),
+                                                            Matrix::CreateTranslation(-5, 0, 5)})});
+        StaticBatchUpdate update;
+        update.batch = 3;
+        update.vertices = arenaCopy(arena, {-10.0f, 0.0f, -10.0f, 0.0f, 0.0f,
+                                            10.0f, 0.0f, -10.0f, 1.0f, 0.0f,
+                                            10.0f, 4.0f, 10.0f, 1.0f, 1.0f,
+                                            -10.0f, 4.0f, 10.0f, 0.0f, 1.0f});
+        update.indices = arenaCopy(arena, {0u, 1u, 2u, 0u, 2u, 3u});
+        update.occluders = arenaCopy(arena, {StaticOccluder{house, Matrix::CreateScale(4, 4, 4)},
+                                             StaticOccluder{house, Matrix::CreateTranslation(8, 0, 0)}});
+        frame->staticUpdates.push_back(update);
+        frame->resizeWidth = 1024;
+        frame->resizeHeight = 768;
+    } else {
+        frame->retainedUpdates.push_back({7, pipeline, 16, 1, arenaCopy(arena, {Matrix::CreateTranslation(-5, 1, 5)})});
+    }
+    return frame;
+}
+
+template <typename A, typename B>
+static bool sameBytes(const A& a, const B& b)
+{
+    return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(a[0])) == 0);
+}
+
+static bool sameFrame(const FrameSubmission& a, const FrameSubmission& b)
+{
+    if (a.viewSubmissions.size() != b.viewSubmissions.size()) return false;
+    for (uint32_t v = 0; v < a.viewSubmissions.size(); v++) {
+        auto& x = a.viewSubmissions[v];
+        auto& y = b.viewSubmissions[v];
+        if (x.viewMatrix != y.viewMatrix || x.projectionMatrix != y.projectionMatrix) return false;
+        if (x.instanceMask != y.instanceMask) return false;
+
+        if (x.objectRenderData.size() != y.objectRenderData.size()) return false;
+        for (uint32_t i = 0; i < x.objectRenderData.size(); i++) {
+            auto& p = x.objectRenderData[i];
+            auto& q = y.objectRenderData[i];
+            if (p.mesh != q.mesh || p.texture != q.texture || p.pipeline != q.pipeline) return false;
+            if (!sameBytes(p.worldMatrices, q.worldMatrices) || !sameBytes(p.attributes, q.attributes)) return false;
+        }
+
+        if (x.textRenderData.size() != y.textRenderData.size()) return false;
+        for (uint32_t i = 0; i < x.textRenderData.size(); i++) {
+            auto& p = x.textRenderData[i];
+            auto& q = y.textRenderData[i];
+            if (p.snippet != q.snippet || p.updatedText != q.updatedText) return false;
+            if (!sameBytes(p.worldMatrices, q.worldMatrices)) return false;
+        }
+
+        // Plain records without padding, they compare as bytes.
+        if (!sameBytes(x.retainedDraws, y.retainedDraws) || !sameBytes(x.pooledDraws, y.pooledDraws)) return false;
+        if (!sameBytes(x.sprites, y.sprites) || !sameBytes(x.pointLights, y.pointLights)) return false;
+        if (!sameBytes(x.staticDraws, y.staticDraws)) return false;
+    }
+
+    if (a.retainedUpdates.size() != b.retainedUpdates.size()) return false;
+    for (uint32_t i = 0; i < a.retainedUpdates.size(); i++) {
+        auto& p = a.retainedUpdates[i];
+        auto& q = b.retainedUpdates[i];
+        if (p.batch != q.batch || p.pipeline != q.pipeline || p.capacity != q.capacity) return false;
+        if (p.firstInstance != q.firstInstance || !sameBytes(p.transforms, q.transforms)) return false;
+    }
+
+    if (a.instancePools.size() != b.instancePools.size()) return false;
+    for (uint32_t i = 0; i < a.instancePools.size(); i++) {
+        auto& p = a.instancePools[i];
+        auto& q = b.instancePools[i];
+        if (!sameBytes(p.worldMatrices, q.worldMatrices) || !sameBytes(p.masks, q.masks)) return false;
+        if (!sameBytes(p.attributes, q.attributes)) return false;
+    }
+
+    if (a.staticUpdates.size() != b.staticUpdates.size()) return false;
+    for (uint32_t i = 0; i < a.staticUpdates.size(); i++) {
+        auto& p = a.staticUpdates[i];
+        auto& q = b.staticUpdates[i];
+        if (p.batch != q.batch || !sameBytes(p.vertices, q.vertices) || !sameBytes(p.indices, q.indices)) return false;
+        if (!sameBytes(p.occluders, q.occluders)) return false;
+    }
+
+    return a.resizeWidth == b.resizeWidth && a.resizeHeight == b.resizeHeight;
+}
+
+// A capture of the test frames in a scratch file, removed again at the end.
+struct CaptureFixture
+{
+    fs::path path = fs::temp_directory_path() / "engine_tests_capture.bin";
+    RenderInitData initData = captureInitData(false);
+    LinearArena arena{64 * 1024};
+    FrameSubmission* frames[2];
+
+    CaptureFixture()
+    {
+        FrameCaptureWriter writer;
+        writer.open(path.string(), initData);
+        for (uint32_t i = 0; i < 2; i++) {
+            frames[i] = buildFrame(arena, initData, i);
+            writer.writeFrame(*frames[i]);
+        }
+        writer.close();
+    }
+
+    ~CaptureFixture()
+    {
+        std::error_code error;
+        fs::remove(path, error);
+    }
+
+    std::vector<uint8_t> bytes() const
+    {
+        std::ifstream file(path, std::ios::binary);
+        return {std::istreambuf_iterator<char>(file), {}};
+    }
+
+    void write(const std::vector<uint8_t>& bytes) const
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write((const char*) bytes.data(), bytes.size());
+    }
+};
+
+// Every field of a frame comes back as it was written.
+static void testRoundTrip()
+{
+    CaptureFixture fixture;
+    FrameReplayer replayer;
+    CHECK(replayer.open(fixture.path.string()));
+    CHECK(replayer.frameCount() == 2);
+
+    LinearArena arena(64 * 1024);
+    for (uint32_t i = 0; i < replayer.frameCount(); i++) {
+        auto frame = replayer.decodeFrame(i, arena);
+        CHECK(frame);
+        CHECK(frame && sameFrame(*frame, *fixture.frames[i]));
+    }
+}
+
+// Handles are replayed by id, unknown ids become invalid handles.
+static void testRemap()
+{
+    CaptureFixture fixture;
+    FrameReplayer replayer;
+    CHECK(replayer.open(fixture.path.string()));
+
+    auto reversed = captureInitData(true);
+    CHECK(replayer.remap(reversed));
+    LinearArena arena(64 * 1024);
+    auto frame = replayer.decodeFrame(0, arena);
+    CHECK(frame);
+    if (frame) {
+        auto& view3D = frame->viewSubmissions[0];
+        CHECK(view3D.objectRenderData[0].mesh == reversed.findMesh("unit"));
+        CHECK(view3D.objectRenderData[0].texture == reversed.findTexture("hero"));
+        CHECK(view3D.retainedDraws[0].mesh == reversed.findMesh("house"));
+        CHECK(frame->staticUpdates[0].occluders[0].mesh == reversed.findMesh("house"));
+        CHECK(frame->viewSubmissions[1].sprites[0].texture == reversed.findTexture("atlas"));
+    }
+
+    RenderInitData withoutSnippet = captureInitData(false);
+    withoutSnippet.snippetDescriptors.clear();
+    CHECK(!replayer.remap(withoutSnippet));
+    frame = replayer.decodeFrame(0, arena);
+    CHECK(frame && !frame->viewSubmissions[1].textRenderData[0].snippet.isValid());
+    CHECK(frame && frame->viewSubmissions[0].objectRenderData[0].mesh == withoutSnippet.findMesh("unit"));
+}
+
+// A replay costs the RecordingRenderer what the captured frames did.
+static void testReplay()
+{
+    CaptureFixture fixture;
+    RecordingRenderer original;
+    original.initialize(fixture.initData);
+    for (auto frame : fixture.frames) {
+        original.doFrame(*frame);
+    }
+    CHECK(original.totals().validationErrors == 0);
+
+    FrameReplayer replayer;
+    CHECK(replayer.open(fixture.path.string()));
+    RecordingRenderer replayed;
+    replayed.initialize(fixture.initData);
+    FrameArena frameArena(64 * 1024);
+    CHECK(replayer.replay(replayed, frameArena) == 2);
+    CHECK(replayed.totals().validationErrors == 0);
+
+    auto& a = original.totals();
+    auto& b = replayed.totals();
+    CHECK(a.drawCalls == b.drawCalls && a.drawCalls > 0);
+    CHECK(a.instances == b.instances);
+    CHECK(a.sprites == b.sprites);
+    CHECK(a.pointLights == b.pointLights);
+    CHECK(a.retainedUpdates == b.retainedUpdates);
+    CHECK(a.staticUpdates == b.staticUpdates);
+    CHECK(a.stateCalls == b.stateCalls);
+    CHECK(a.uploadBytes == b.uploadBytes);
+}
+
+// Cut short or overwritten frames are reported as corrupt,
+// decoding never reads past the end of a frame.
+static void testDamagedFrames()
+{
+    CaptureFixture fixture;
+    auto bytes = fixture.bytes();
+    CaptureHeader header;
+    memcpy(&header, bytes.data(), sizeof(header));
+    uint64_t offset;
+    memcpy(&offset, bytes.data() + header.frameIndexOffset, sizeof(offset));
+    uint32_t size;
+    memcpy(&size, bytes.data() + offset, sizeof(size));
+
+    // Every shorter size of the first frame lacks some of its fields.
+    LinearArena arena(64 * 1024);
+    for (uint32_t cut = 0; cut < size; cut++) {
+        auto damaged = bytes;
+        memcpy(damaged.data() + offset, &cut, sizeof(cut));
+        fixture.write(damaged);
+        FrameReplayer replayer;
+        CHECK(replayer.open(fixture.path.string()));
+        arena.reset();
+        CHECK(replayer.decodeFrame(0, arena) == nullptr);
+    }
+
+    // A frame reaching past the end of the file.
+    {
+        auto damaged = bytes;
+        uint32_t tooLarge = bytes.size() - offset;
+        memcpy(damaged.data() + offset, &tooLarge, sizeof(tooLarge));
+        fixture.write(damaged);
+        FrameReplayer replayer;
+        CHECK(replayer.open(fixture.path.string()));
+        CHECK(replayer.decodeFrame(0, arena) == nullptr);
+        CHECK(replayer.decodeFrame(1, arena));
+    }
+
+    // A huge count up front, the frame has no room for its elements.
+    {
+        auto damaged = bytes;
+        for (int i = 0; i < 5; i++) damaged[offset + sizeof(uint32_t) + i] = 0xFF;
+        fixture.write(damaged);
+        FrameReplayer replayer;
+        CHECK(replayer.open(fixture.path.string()));
+        arena.reset();
+        CHECK(replayer.decodeFrame(0, arena) == nullptr);
+        CHECK(arena.bytesUsed() < size);
+    }
+
+    // Overwritten bytes may still decode, but only within the frame.
+    for (uint32_t i = 0; i < size; i++) {
+        auto damaged = bytes;
+        damaged[offset + sizeof(uint32_t) + i] ^= 0xFF;
+        fixture.write(damaged);
+        FrameReplayer replayer;
+        CHECK(replayer.open(fixture.path.string()));
+        arena.reset();
+        replayer.decodeFrame(0, arena);
+    }
+
+    // A capture which was never closed has no frame index.
+    {
+        auto damaged = bytes;
+        damaged.resize(header.frameIndexOffset);
+        fixture.write(damaged);
+        FrameReplayer replayer;
+        CHECK(!replayer.open(fixture.path.string()));
+    }
+}
+
+void testFrameCapture()
+{
+    testRoundTrip();
+    testRemap();
+    testReplay();
+    testDamagedFrames();
+}
@@ -0,0 +1,57 @@
+#include "frame_mailbox.h"
+#include <cassert>
+
+FrameMailbox::FrameMailbox(size_t bytesPerFrame) : arenas(bytesPerFrame, numSlots)
+{
+}
+
+LinearArena& FrameMailbox::beginWrite()
+{
+    // The slot of this frame was last used numSlots frames ago,
+    // the renderer must be done with that one.
+    auto done = released.load(std::memory_order_acquire);
+    while (writeFrame - done >= numSlots) {
+        released.wait(done, std::memory_order_acquire);
+        done = released.load(std::memory_order_acquire);
+    }
+
+    auto& arena = arenas.buffer(writeFrame % numSlots);
+    arena.reset();
+    return arena;
+}
+
+void FrameMailbox::publish(FrameSubmission* frame)
+{
+    assert(!(published.load(std::memory_order_relaxed) & closedBit));
+    frames[writeFrame % numSlots] = frame;
+    writeFrame++;
+    published.store(writeFrame, std::memory_order_release);
+    published.notify_one();
+}
+
+void FrameMailbox::close()
+{
+    published.fetch_or(closedBit, std::memory_order_release);
+    published.notify_all();
+}
+
+FrameSubmission* FrameMailbox::acquire()
+{
+    auto p = published.load(std::memory_order_acquire);
+    while ((p & ~closedBit) == readFrame) {
+        if (p & closedBit) {
+            return nullptr;
+        }
+        published.wait(p, std::memory_order_acquire);
+        p = published.load(std::memory_order_acquire);
+    }
+
+    return frames[readFrame % numSlots];
+}
+
+void FrameMailbox::release()
+{
+    readFrame++;
+    released.store(readFrame, std::memory_order_release);
+    released.notify_one();
+}
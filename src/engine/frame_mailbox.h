@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include "frame_arena.h"
+#include "renderer.h"
+
+// Hands FrameSubmissions from the game thread to the render thread.
+// There are three slots, each with its own LinearArena: the game builds a frame 
+// in one of them, at most one finished frame waits in the next and the renderer 
+// draws from the third.
+// Frames are never dropped, as the RetainedBatchUpdates of every frame must 
+// reach the renderer. Instead the game waits in beginWrite() when it got 
+// two frames ahead of the renderer, which bounds the latency.
+// Only two atomic counters are shared, there are no locks.
+class FrameMailbox
+{
+    public:
+        explicit FrameMailbox(size_t bytesPerFrame = 4 * 1024 * 1024);
+
+        // Game thread:
+        // Waits for a free slot and returns its (reset) arena.
+        LinearArena& beginWrite();
+        // Hands the frame built in the arena of beginWrite() to the renderer.
+        void publish(FrameSubmission* frame);
+        // No more frames will be published, wakes up the render thread.
+        void close();
+
+        // Render thread:
+        // Waits for the next frame, nullptr once the mailbox is closed
+        // and every published frame was acquired.
+        FrameSubmission* acquire();
+        // The acquired frame was rendered, its slot may be reused.
+        void release();
+
+        static constexpr uint32_t numSlots = 3;
+
+    private:
+        static constexpr uint64_t closedBit = 1ull << 63;
+
+        FrameArena arenas;
+        FrameSubmission* frames[numSlots] = {};
+
+        // Frames published by the game, plus closedBit. 
+        std::atomic<uint64_t> published = 0;
+        // Frames the renderer is done with.
+        std::atomic<uint64_t> released = 0;
+
+        // Only touched by their own thread.
+        uint64_t writeFrame = 0;
+        uint64_t readFrame = 0;
+};
@@ -0,0 +1,251 @@
+#include "frustum_culler.h"
+#include "occlusion_culler.h"
+#include "simd_util.h"
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+using namespace DirectX::SimpleMath;
+
+BoundingSphere computeBoundingSphere(const Geometry& geometry)
+{
+    if (geometry.positions.empty()) return {};
+
+    Vector3 minimum = geometry.positions[0];
+    Vector3 maximum = geometry.positions[0];
+    for (auto& p : geometry.positions) {
+        minimum = Vector3::Min(minimum, p);
+        maximum = Vector3::Max(maximum, p);
+    }
+
+    BoundingSphere sphere;
+    sphere.center = (minimum + maximum) * 0.5f;
+    sphere.radius = 0;
+    for (auto& p : geometry.positions) {
+        sphere.radius = std::max(sphere.radius, Vector3::DistanceSquared(sphere.center, p));
+    }
+    sphere.radius = std::sqrt(sphere.radius);
+    return sphere;
+}
+
+Frustum Frustum::fromViewProjection(const Matrix& m)
+{
+    Vector4 column1(m._11, m._21, m._31, m._41);
+    Vector4 column2(m._12, m._22, m._32, m._42);
+    Vector4 column3(m._13, m._23, m._33, m._43);
+    Vector4 column4(m._14, m._24, m._34, m._44);
+
+    Frustum frustum;
+    frustum.planes[0] = column4 + column1;  // left
+    frustum.planes[1] = column4 - column1;  // right
+    frustum.planes[2] = column4 + column2;  // bottom
+    frustum.planes[3] = column4 - column2;  // top
+    frustum.planes[4] = column3;            // near
+    frustum.planes[5] = column4 - column3;  // far
+    for (auto& plane : frustum.planes) {
+        float length = Vector3(plane.x, plane.y, plane.z).Length();
+        if (length > 0) plane /= length;
+    }
+    return frustum;
+}
+
+uint32_t cullSpheres(const Frustum& frustum, const float* x, const float* y, const float* z, const float* radius,
+                        uint32_t count, uint32_t* visible)
+{
+    assert(count % cullBlockSize == 0);
+    uint32_t numVisible = 0;
+
+#if defined(ENGINE_SSE2)
+    for (uint32_t i = 0; i < count; i += 4) {
+        auto px = _mm_loadu_ps(x + i);
+        auto py = _mm_loadu_ps(y + i);
+        auto pz = _mm_loadu_ps(z + i);
+        auto negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+
+        auto inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (auto& plane : frustum.planes) {
+            auto distance = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(plane.x)), _mm_set1_ps(plane.w));
+            distance = _mm_add_ps(_mm_mul_ps(py, _mm_set1_ps(plane.y)), distance);
+            distance = _mm_add_ps(_mm_mul_ps(pz, _mm_set1_ps(plane.z)), distance);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+        }
+
+        uint32_t mask = _mm_movemask_ps(inside);
+        while (mask) {
+            visible[numVisible++] = i + std::countr_zero(mask);
+            mask &= mask - 1;
+        }
+    }
+#else
+    for (uint32_t i = 0; i < count; i++) {
+        bool inside = true;
+        for (auto& plane : frustum.planes) {
+            inside &= x[i] * plane.x + y[i] * plane.y + z[i] * plane.z + plane.w >= -radius[i];
+        }
+        if (inside) visible[numVisible++] = i;
+    }
+#endif
+
+    return numVisible;
+}
+
+void FrustumCuller::initialize(const RenderInitData& initData)
+{
+    meshBounds.clear();
+    for (auto& mesh : initData.meshDescriptors) {
+        meshBounds.push_back(computeBoundingSphere(mesh.geometry));
+    }
+}
+
+void FrustumCuller::beginFrame(size_t maxInstances, size_t maxPooledInstances)
+{
+    visibleMatrices.clear();
+    visibleObjectIndices.clear();
+    if (visibleMatrices.capacity() < maxInstances) {
+        visibleMatrices.reserve(maxInstances);
+        visibleObjectIndices.reserve(maxInstances);
+    }
+    visiblePoolIndices.clear();
+    if (visiblePoolIndices.capacity() < maxPooledInstances) {
+        visiblePoolIndices.reserve(maxPooledInstances);
+    }
+    std::fill(std::begin(stats), std::end(stats), CullStats{});
+}
+
+void FrustumCuller::beginView(uint32_t view, const Matrix& viewMatrix, const Matrix& projectionMatrix)
+{
+    assert(view < maxViews);
+    currentView = view;
+    frustum = Frustum::fromViewProjection(viewMatrix * projectionMatrix);
+}
+
+bool FrustumCuller::cullable(MeshHandle mesh) const
+{
+    return enabled && mesh.index < meshBounds.size() && meshBounds[mesh.index].radius >= 0;
+}
+
+// Writes the indices of the instances inside the frustum to visibleIndices.
+// The scale of the radius is the largest axis scale of the instance.
+uint32_t FrustumCuller::testInstances(const BoundingSphere& bounds, std::span<const Matrix> worldMatrices)
+{
+    uint32_t count = worldMatrices.size();
+    uint32_t padded = (count + cullBlockSize - 1) / cullBlockSize * cullBlockSize;
+    sphereX.resize(padded);
+    sphereY.resize(padded);
+    sphereZ.resize(padded);
+    sphereRadius.resize(padded);
+    visibleIndices.resize(padded);
+    for (uint32_t i = 0; i < count; i++) {
+        auto& w = worldMatrices[i];
+        auto c = Vector3::Transform(bounds.center, w);
+        float scaleSquared = std::max({w._11 * w._11 + w._12 * w._12 + w._13 * w._13,
+                                        w._21 * w._21 + w._22 * w._22 + w._23 * w._23,
+                                        w._31 * w._31 + w._32 * w._32 + w._33 * w._33});
+        sphereX[i] = c.x;
+        sphereY[i] = c.y;
+        sphereZ[i] = c.z;
+        sphereRadius[i] = bounds.radius * std::sqrt(scaleSquared);
+    }
+    for (uint32_t i = count; i < padded; i++) {
+        sphereX[i] = sphereY[i] = sphereZ[i] = 0;
+        sphereRadius[i] = -std::numeric_limits<float>::infinity();
+    }
+
+    return cullSpheres(frustum, sphereX.data(), sphereY.data(), sphereZ.data(),
+                        sphereRadius.data(), padded, visibleIndices.data());
+}
+
+// Drops the instances of visibleIndices[0, numInside) which are behind the occluders.
+uint32_t FrustumCuller::testOcclusion(MeshHandle mesh, std::span<const Matrix> worldMatrices, uint32_t numInside)
+{
+    if (!occlusion) return numInside;
+
+    uint32_t numVisible = occlusion->testInstances(mesh, worldMatrices, visibleIndices.data(), numInside);
+    stats[currentView].occludedInstances += numInside - numVisible;
+    return numVisible;
+}
+
+std::span<const Matrix> FrustumCuller::cull(MeshHandle mesh, std::span<const Matrix> worldMatrices)
+{
+    auto& viewStats = stats[currentView];
+    viewStats.objects++;
+    viewStats.instances += worldMatrices.size();
+    lastIndices = {};
+
+    if (!cullable(mesh)) {
+        viewStats.visibleInstances += worldMatrices.size();
+        return worldMatrices;
+    }
+
+    uint32_t count = worldMatrices.size();
+    uint32_t numVisible = testOcclusion(mesh, worldMatrices, testInstances(meshBounds[mesh.index], worldMatrices));
+    viewStats.visibleInstances += numVisible;
+    if (numVisible == 0) viewStats.culledObjects++;
+    if (numVisible == count) return worldMatrices;
+
+    // Compact the survivors, the storage was reserved in beginFrame so the
+    // spans handed out before stay valid.
+    assert(visibleMatrices.size() + numVisible <= visibleMatrices.capacity());
+    auto first = visibleMatrices.size();
+    for (uint32_t i = 0; i < numVisible; i++) {
+        visibleMatrices.push_back(worldMatrices[visibleIndices[i]]);
+        visibleObjectIndices.push_back(visibleIndices[i]);
+    }
+    lastIndices = std::span<const uint32_t>(visibleObjectIndices).subspan(first, numVisible);
+    return std::span<const Matrix>(visibleMatrices).subspan(first, numVisible);
+}
+
+bool FrustumCuller::cullBox(const Vector3& boundsMin, const Vector3& boundsMax)
+{
+    auto& viewStats = stats[currentView];
+    viewStats.objects++;
+    viewStats.instances++;
+
+    // Outside once the corner furthest along the normal of a plane is behind it.
+    bool visible = true;
+    for (int i = 0; i < 6 && enabled; i++) {
+        auto& plane = frustum.planes[i];
+        float x = plane.x >= 0 ? boundsMax.x : boundsMin.x;
+        float y = plane.y >= 0 ? boundsMax.y : boundsMin.y;
+        float z = plane.z >= 0 ? boundsMax.z : boundsMin.z;
+        if (plane.x * x + plane.y * y + plane.z * z + plane.w < 0) {
+            visible = false;
+            break;
+        }
+    }
+
+    if (visible) {
+        viewStats.visibleInstances++;
+    } else {
+        viewStats.culledObjects++;
+    }
+    return visible;
+}
+
+std::span<const uint32_t> FrustumCuller::cullPooled(MeshHandle mesh, std::span<const Matrix> worldMatrices,
+                                                    std::span<const uint32_t> masks, uint32_t viewMask,
+                                                    uint32_t firstInstance)
+{
+    auto& viewStats = stats[currentView];
+    viewStats.objects++;
+    viewStats.instances += worldMatrices.size();
+
+    bool allInside = !cullable(mesh);
+    uint32_t numInside = allInside ? worldMatrices.size()
+                                   : testOcclusion(mesh, worldMatrices, testInstances(meshBounds[mesh.index], worldMatrices));
+
+    assert(visiblePoolIndices.size() + numInside <= visiblePoolIndices.capacity());
+    auto first = visiblePoolIndices.size();
+    for (uint32_t i = 0; i < numInside; i++) {
+        uint32_t instance = allInside ? i : visibleIndices[i];
+        if (!masks.empty() && !(masks[instance] & viewMask)) continue;
+        visiblePoolIndices.push_back(firstInstance + instance);
+    }
+
+    uint32_t numVisible = visiblePoolIndices.size() - first;
+    viewStats.visibleInstances += numVisible;
+    if (numVisible == 0) viewStats.culledObjects++;
+    return std::span<const uint32_t>(visiblePoolIndices).subspan(first, numVisible);
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "renderer.h"
+
+class OcclusionCuller;
+
+// Object space bounds of a mesh.
+// A negative radius marks a mesh which is never culled.
+struct BoundingSphere
+{
+    DirectX::SimpleMath::Vector3 center;
+    float radius = -1;
+};
+
+// Sphere around the positions of the geometry, centered on their bounding box.
+BoundingSphere computeBoundingSphere(const Geometry& geometry);
+
+// The six planes of a view frustum, normals pointing inwards and normalized,
+// so the plane equation gives the signed distance.
+struct Frustum
+{
+    DirectX::SimpleMath::Vector4 planes[6];
+
+    // Extracts the planes from viewMatrix * projectionMatrix
+    // (row vectors, clip space z in [0, w] as in D3D).
+    static Frustum fromViewProjection(const DirectX::SimpleMath::Matrix& viewProjection);
+};
+
+// Tests count spheres, given as SoA arrays, against the frustum and writes
+// the indices of the ones which are at least partially inside to visible.
+// The arrays must be padded to a multiple of cullBlockSize, padding needs
+// a radius of -infinity so it is never visible.
+// Returns the number of visible spheres.
+// Uses SSE2 when the build targets it, plain C++ otherwise.
+constexpr uint32_t cullBlockSize = 4;
+uint32_t cullSpheres(const Frustum& frustum, const float* x, const float* y, const float* z, const float* radius,
+                        uint32_t count, uint32_t* visible);
+
+struct CullStats
+{
+    uint32_t objects = 0;
+    uint32_t culledObjects = 0;
+    uint32_t instances = 0;
+    uint32_t visibleInstances = 0;
+    // Inside the frustum but behind occluders, part of culledInstances().
+    uint32_t occludedInstances = 0;
+
+    uint32_t culledInstances() const { return instances - visibleInstances; }
+};
+
+// Drops the instances of ObjectRenderData and PooledDraws which are outside the frustum of their view.
+// The world matrices of the survivors are compacted into storage owned by the culler,
+// so the backend uploads only what is visible. Pools are uploaded as a whole,
+// their survivors are compacted as indices into the pool instead.
+class FrustumCuller
+{
+    public:
+        static constexpr uint32_t maxViews = 16;
+
+        void initialize(const RenderInitData& initData);
+
+        // Reserves room for maxInstances visible instances and maxPooledInstances
+        // visible pool indices, so the spans handed out by cull() and cullPooled() 
+        // stay valid until the next beginFrame().
+        void beginFrame(size_t maxInstances, size_t maxPooledInstances = 0);
+        void beginView(uint32_t view, const DirectX::SimpleMath::Matrix& viewMatrix,
+                        const DirectX::SimpleMath::Matrix& projectionMatrix);
+
+        // The visible world matrices of one ObjectRenderData of the current view.
+        // If all of them are visible, or the mesh has no bounds,
+        // worldMatrices is returned as it is instead of being copied.
+        std::span<const DirectX::SimpleMath::Matrix> cull(MeshHandle mesh,
+                                                           std::span<const DirectX::SimpleMath::Matrix> worldMatrices);
+        // Where the matrices returned by the last cull() are in its worldMatrices,
+        // empty if worldMatrices was returned as it is. Valid until the next beginFrame().
+        std::span<const uint32_t> lastVisibleIndices() const { return lastIndices; }
+
+        // The visible instances of a PooledDraw of the current view, as indices into the pool.
+        // worldMatrices and masks are the range of the draw, masks may be empty;
+        // instances whose mask shares no bit with viewMask count as culled.
+        std::span<const uint32_t> cullPooled(MeshHandle mesh, std::span<const DirectX::SimpleMath::Matrix> worldMatrices,
+                                             std::span<const uint32_t> masks, uint32_t viewMask, uint32_t firstInstance);
+
+        // Whether a world space box, e.g. of a StaticBatchDraw, is at least partially inside 
+        // the frustum of the current view. Counted as an object with one instance.
+        bool cullBox(const DirectX::SimpleMath::Vector3& boundsMin, const DirectX::SimpleMath::Vector3& boundsMax);
+
+        const CullStats& viewStats(uint32_t view) const { return stats[view]; }
+
+        // Instances inside the frustum are also tested against the occluders
+        // of the current view, until it is reset to nullptr.
+        void setOcclusion(const OcclusionCuller* occlusion) { this->occlusion = occlusion; }
+
+        // Everything is visible when disabled, the stats are still counted.
+        bool enabled = true;
+
+    private:
+        bool cullable(MeshHandle mesh) const;
+        uint32_t testInstances(const BoundingSphere& bounds, std::span<const DirectX::SimpleMath::Matrix> worldMatrices);
+        uint32_t testOcclusion(MeshHandle mesh, std::span<const DirectX::SimpleMath::Matrix> worldMatrices, uint32_t numInside);
+
+        std::vector<BoundingSphere> meshBounds;
+
+        Frustum frustum;
+        const OcclusionCuller* occlusion = nullptr;
+        uint32_t currentView = 0;
+        CullStats stats[maxViews];
+
+        // SoA world space spheres of the ObjectRenderData being culled.
+        std::vector<float> sphereX;
+        std::vector<float> sphereY;
+        std::vector<float> sphereZ;
+        std::vector<float> sphereRadius;
+        std::vector<uint32_t> visibleIndices;
+        std::span<const uint32_t> lastIndices;
+
+        std::vector<DirectX::SimpleMath::Matrix> visibleMatrices;
+        // Where each of visibleMatrices came from in its worldMatrices.
+        std::vector<uint32_t> visibleObjectIndices;
+        std::vector<uint32_t> visiblePoolIndices;
+};
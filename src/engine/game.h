@@ -1,5 +1,6 @@
 #pragma once
 #include "renderer.h"
+#include "frame_arena.h"
 
 
  struct CommandLine
@@ -15,7 +16,10 @@ class Game {
 
     public:
         virtual RenderInitData getInitData(CommandLine cmdline, Window* window) = 0;
-        virtual FrameSubmission getFrameData() = 0;
+        // The FrameSubmission and everything it references should be
+        // allocated from frameArena, which stays alive until the
+        // renderer has consumed the frame.
+        virtual FrameSubmission* getFrameData(LinearArena& frameArena) = 0;
         void setEvents(std::vector<Event*> events);
 
     protected:
@@ -1,18 +1,20 @@
 #include "game_util.h"
 #include "renderer.h"
+#include "sprite_batcher.h"
 
 
 using namespace DirectX::SimpleMath;
-ObjectRenderData createObjectRenderData(const std::string textureId, const std::string meshId, 
-        const std::string inputLayoutId, std::vector<Vector3> positions, Vector3 scale) {
+ObjectRenderData& createObjectRenderData(ViewSubmission& view, TextureHandle texture, MeshHandle mesh, 
+        PipelineHandle pipeline, std::span<const Vector3> positions, Vector3 scale) {
 
 
-    auto objData = ObjectRenderData();
-    objData.textureId = textureId;
-    objData.meshId = meshId;
-    objData.inputLayoutId = inputLayoutId;
+    auto& objData = view.objectRenderData.emplace_back();
+    objData.texture = texture;
+    objData.mesh = mesh;
+    objData.pipeline = pipeline;
     
     auto S = Matrix::CreateScale(scale.x, scale.y, scale.z);
+    objData.worldMatrices.reserve(positions.size());
     for (auto& p : positions) {
         auto T= Matrix::CreateTranslation(p.x, p.y, p.z);
         auto W = S * T;
@@ -22,3 +24,17 @@ ObjectRenderData createObjectRenderData(const std::string textureId, const std::
     return objData;
         
 }
+
+Sprite& addSprite(ViewSubmission& view, Vector2 position, Vector2 size, Vector4 uvRect, 
+        Vector4 color, float layer, TextureHandle texture) {
+
+    auto& sprite = view.sprites.emplace_back();
+    sprite.record.position = position;
+    sprite.record.size = size;
+    sprite.record.uvMin = packUnorm16x2(uvRect.x, uvRect.y);
+    sprite.record.uvMax = packUnorm16x2(uvRect.z, uvRect.w);
+    sprite.record.color = packColor(color);
+    sprite.record.layer = layer;
+    sprite.texture = texture;
+    return sprite;
+}
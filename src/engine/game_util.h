@@ -1,11 +1,25 @@
 #pragma once
-#include <d3d11.h>
 #include <string>
-#include <DirectXTK/SimpleMath.h>
+#include <span>
+#include <directxtk/SimpleMath.h>
+#include "renderer.h"
 
-struct ObjectRenderData;
-ObjectRenderData createObjectRenderData(const std::string textureId, 
-                                    const std::string meshId, 
-                                    const std::string inputLayoutId, 
-                                    std::vector<DirectX::SimpleMath::Vector3> positions, 
-                                    DirectX::SimpleMath::Vector3 scale);
\ No newline at end of file
+// Appends a new ObjectRenderData to the view, 
+// with one instance per position.
+ObjectRenderData& createObjectRenderData(ViewSubmission& view,
+                                    TextureHandle texture, 
+                                    MeshHandle mesh, 
+                                    PipelineHandle pipeline, 
+                                    std::span<const DirectX::SimpleMath::Vector3> positions, 
+                                    DirectX::SimpleMath::Vector3 scale);
+
+// Appends a sprite to the view.
+// uvRect is (u0, v0, u1, v1) on the atlas page texture, color multiplies the texel.
+// Lower layers are in front, they are drawn later.
+Sprite& addSprite(ViewSubmission& view, 
+                    DirectX::SimpleMath::Vector2 position, 
+                    DirectX::SimpleMath::Vector2 size, 
+                    DirectX::SimpleMath::Vector4 uvRect, 
+                    DirectX::SimpleMath::Vector4 color, 
+                    float layer, 
+                    TextureHandle texture);
\ No newline at end of file
@@ -1,4 +1,7 @@
 #include "geometry.h"
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
 
 Geometry GeometryFactory::getQuadGeometry()
 {
@@ -21,5 +24,210 @@ Geometry GeometryFactory::getQuadGeometry()
 
     };
 
-    return Geometry {vertices, indices};
-}
\ No newline at end of file
+    std::vector<DirectX::SimpleMath::Vector3> positions = {
+        {-0.5f, -0.5f, 0.0f}, {0.5f, -0.5f, 0.0f}, {-0.5f, 0.5f, 0.0f}, {0.5f, 0.5f, 0.0f}
+    };
+
+    std::vector<DirectX::SimpleMath::Vector2> uvs = {
+        {0.0f, 0.0f}, {1.0f, 0.0f}, {0.0f, 1.0f}, {1.0f, 1.0f}
+    };
+
+    return Geometry {.vertices = vertices, .indices = indices, .positions = positions, .uvs = uvs};
+}
+
+Geometry GeometryFactory::simplify(const Geometry& geometry, uint32_t cellsPerAxis)
+{
+    using namespace DirectX::SimpleMath;
+    if (geometry.positions.empty() || cellsPerAxis == 0) return geometry;
+
+    // The position is the start of every vertex, whatever follows is kept as it is.
+    size_t floatsPerVertex = geometry.vertices.size() / geometry.positions.size();
+    bool hasUvs = geometry.uvs.size() == geometry.positions.size();
+
+    Vector3 minimum = geometry.positions[0];
+    Vector3 maximum = geometry.positions[0];
+    for (auto& p : geometry.positions) {
+        minimum = Vector3::Min(minimum, p);
+        maximum = Vector3::Max(maximum, p);
+    }
+    Vector3 extent = maximum - minimum;
+
+    auto cell = [cellsPerAxis](float value, float low, float size) -> uint64_t {
+        if (size <= 0) return 0;
+        return std::min<uint32_t>((uint32_t) ((value - low) / size * cellsPerAxis), cellsPerAxis - 1);
+    };
+
+    Geometry result;
+    std::unordered_map<uint64_t, uint32_t> cellVertices;
+    std::vector<uint32_t> remap(geometry.positions.size());
+    for (uint32_t v = 0; v < geometry.positions.size(); v++) {
+        auto& p = geometry.positions[v];
+        uint64_t key = cell(p.x, minimum.x, extent.x) + 
+                        (cell(p.y, minimum.y, extent.y) + cell(p.z, minimum.z, extent.z) * cellsPerAxis) * cellsPerAxis;
+        auto [it, inserted] = cellVertices.try_emplace(key, (uint32_t) result.positions.size());
+        if (inserted) {
+            result.positions.push_back(p);
+            if (hasUvs) result.uvs.push_back(geometry.uvs[v]);
+            auto first = geometry.vertices.begin() + v * floatsPerVertex;
+            result.vertices.insert(result.vertices.end(), first, first + floatsPerVertex);
+        }
+        remap[v] = it->second;
+    }
+
+    for (size_t i = 0; i + 2 < geometry.indices.size(); i += 3) {
+        uint32_t a = remap[geometry.indices[i]];
+        uint32_t b = remap[geometry.indices[i + 1]];
+        uint32_t c = remap[geometry.indices[i + 2]];
+        if (a == b || b == c || a == c) continue;
+        result.indices.insert(result.indices.end(), {a, b, c});
+    }
+    return result;
+}
+
+using DirectX::SimpleMath::Vector3;
+
+static float dot(const Vector3& a, const Vector3& b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+// Squared distance from p to the triangle abc, see Ericson, Real-Time Collision Detection, 5.1.5.
+static float distanceSquaredToTriangle(const Vector3& p, const Vector3& a, const Vector3& b, const Vector3& c)
+{
+    Vector3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = dot(ab, ap), d2 = dot(ac, ap);
+    if (d1 <= 0 && d2 <= 0) return Vector3::DistanceSquared(p, a);
+
+    Vector3 bp = p - b;
+    float d3 = dot(ab, bp), d4 = dot(ac, bp);
+    if (d3 >= 0 && d4 <= d3) return Vector3::DistanceSquared(p, b);
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0) return Vector3::DistanceSquared(p, a + ab * (d1 / (d1 - d3)));
+
+    Vector3 cp = p - c;
+    float d5 = dot(ab, cp), d6 = dot(ac, cp);
+    if (d6 >= 0 && d5 <= d6) return Vector3::DistanceSquared(p, c);
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0) return Vector3::DistanceSquared(p, a + ac * (d2 / (d2 - d6)));
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) {
+        return Vector3::DistanceSquared(p, b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6))));
+    }
+
+    float denominator = 1.0f / (va + vb + vc);
+    return Vector3::DistanceSquared(p, a + ab * (vb * denominator) + ac * (vc * denominator));
+}
+
+// Whether the ray from p along +axis (sign 1) or -axis (sign -1) passes through the triangle.
+static bool rayCrosses(const Vector3& p, int axis, float sign, const Vector3& a, const Vector3& b, const Vector3& c)
+{
+    int u = (axis + 1) % 3, v = (axis + 2) % 3;
+    auto at = [](const Vector3& q, int i) { return i == 0 ? q.x : (i == 1 ? q.y : q.z); };
+
+    // Barycentric coordinates of p in the triangle projected along the axis.
+    float au = at(a, u) - at(p, u), av = at(a, v) - at(p, v);
+    float bu = at(b, u) - at(p, u), bv = at(b, v) - at(p, v);
+    float cu = at(c, u) - at(p, u), cv = at(c, v) - at(p, v);
+    float wa = bu * cv - bv * cu;
+    float wb = cu * av - cv * au;
+    float wc = au * bv - av * bu;
+    bool inside = (wa > 0 && wb > 0 && wc > 0) || (wa < 0 && wb < 0 && wc < 0);
+    if (!inside) return false;
+
+    float hit = (wa * at(a, axis) + wb * at(b, axis) + wc * at(c, axis)) / (wa + wb + wc);
+    return (hit - at(p, axis)) * sign > 0;
+}
+
+Geometry GeometryFactory::occluderBox(const Geometry& geometry, uint32_t cellsPerAxis)
+{
+    if (geometry.positions.empty() || geometry.indices.size() < 3 || cellsPerAxis == 0) return {};
+
+    Vector3 minimum = geometry.positions[0];
+    Vector3 maximum = geometry.positions[0];
+    for (auto& p : geometry.positions) {
+        minimum = Vector3::Min(minimum, p);
+        maximum = Vector3::Max(maximum, p);
+    }
+    Vector3 cellSize = (maximum - minimum) * (1.0f / cellsPerAxis);
+    if (cellSize.x <= 0 || cellSize.y <= 0 || cellSize.z <= 0) return {};
+
+    // A cell lies inside when its centre is inside, which for a closed mesh every ray
+    // from the centre agrees on, and no triangle comes closer than its corners.
+    // The rays start a little off the centre, so they don't run along the edges of symmetric meshes.
+    float halfDiagonalSquared = dot(cellSize, cellSize) * 0.25f;
+    uint32_t n = cellsPerAxis;
+    std::vector<uint32_t> insideCount((n + 1) * (n + 1) * (n + 1), 0);
+    auto count = [&](uint32_t x, uint32_t y, uint32_t z) -> uint32_t& { return insideCount[(z * (n + 1) + y) * (n + 1) + x]; };
+
+    for (uint32_t z = 0; z < n; z++) {
+        for (uint32_t y = 0; y < n; y++) {
+            for (uint32_t x = 0; x < n; x++) {
+                Vector3 centre(minimum.x + (x + 0.5f) * cellSize.x, minimum.y + (y + 0.5f) * cellSize.y,
+                               minimum.z + (z + 0.5f) * cellSize.z);
+                Vector3 probe(centre.x + 0.0123f * cellSize.x, centre.y + 0.0071f * cellSize.y, centre.z + 0.0037f * cellSize.z);
+                uint32_t crossings[6] = {};
+                bool inside = true;
+                for (size_t i = 0; inside && i + 2 < geometry.indices.size(); i += 3) {
+                    auto& a = geometry.positions[geometry.indices[i]];
+                    auto& b = geometry.positions[geometry.indices[i + 1]];
+                    auto& c = geometry.positions[geometry.indices[i + 2]];
+                    if (distanceSquaredToTriangle(centre, a, b, c) < halfDiagonalSquared) inside = false;
+                    for (int ray = 0; ray < 6; ray++) {
+                        crossings[ray] += rayCrosses(probe, ray / 2, (ray & 1) ? -1.0f : 1.0f, a, b, c);
+                    }
+                }
+                for (auto crossing : crossings) {
+                    inside = inside && (crossing & 1);
+                }
+                // Summed over all cells below and left of this one, so any box is counted in O(1).
+                count(x + 1, y + 1, z + 1) = inside + count(x, y + 1, z + 1) + count(x + 1, y, z + 1) + count(x + 1, y + 1, z)
+                                           - count(x, y, z + 1) - count(x, y + 1, z) - count(x + 1, y, z) + count(x, y, z);
+            }
+        }
+    }
+
+    // The box with the most cells of which every cell is inside,
+    // from all cell ranges [first, last) along each axis.
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    for (uint32_t first = 0; first < n; first++) {
+        for (uint32_t last = first + 1; last <= n; last++) {
+            ranges.push_back({first, last});
+        }
+    }
+    uint32_t best = 0;
+    std::pair<uint32_t, uint32_t> bestX, bestY, bestZ;
+    for (auto [x0, x1] : ranges) {
+        for (auto [y0, y1] : ranges) {
+            for (auto [z0, z1] : ranges) {
+                uint32_t cells = (x1 - x0) * (y1 - y0) * (z1 - z0);
+                if (cells <= best) continue;
+                uint32_t inside = count(x1, y1, z1) - count(x0, y1, z1) - count(x1, y0, z1) - count(x1, y1, z0)
+                                + count(x0, y0, z1) + count(x0, y1, z0) + count(x1, y0, z0) - count(x0, y0, z0);
+                if (inside == cells) {
+                    best = cells;
+                    bestX = {x0, x1};
+                    bestY = {y0, y1};
+                    bestZ = {z0, z1};
+                }
+            }
+        }
+    }
+    if (best == 0) return {};
+
+    Geometry result;
+    for (int corner = 0; corner < 8; corner++) {
+        result.positions.emplace_back(minimum.x + ((corner & 1) ? bestX.second : bestX.first) * cellSize.x,
+                                      minimum.y + ((corner & 2) ? bestY.second : bestY.first) * cellSize.y,
+                                      minimum.z + ((corner & 4) ? bestZ.second : bestZ.first) * cellSize.z);
+    }
+    // Corner bit 0 is x, bit 1 y and bit 2 z. The occlusion culler draws both windings.
+    result.indices = {
+        0, 2, 3, 0, 3, 1,   4, 5, 7, 4, 7, 6,
+        0, 4, 6, 0, 6, 2,   1, 3, 7, 1, 7, 5,
+        0, 1, 5, 0, 5, 4,   2, 6, 7, 2, 7, 3,
+    };
+    return result;
+}
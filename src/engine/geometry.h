@@ -1,12 +1,15 @@
 
 #pragma once
 #include <vector>
+#include <cstdint>
 #include <directxtk/SimpleMath.h>
 
 struct Geometry
 {
     std::vector<float> vertices;
     std::vector<uint32_t> indices;
+    // Object space vertex positions, also used for the culling bounds.
+    // A mesh without them is never frustum culled.
     std::vector<DirectX::SimpleMath::Vector3> positions;
     std::vector<DirectX::SimpleMath::Vector2> uvs;
 
@@ -19,5 +22,16 @@ class GeometryFactory {
     public:
         static Geometry getQuadGeometry();
 
+        // Coarser version of the geometry, e.g. for a MeshLod.
+        // The vertices are snapped to a grid of cellsPerAxis^3 cells over the bounds,
+        // all vertices of a cell merge into the first of them, collapsed triangles are dropped.
+        static Geometry simplify(const Geometry& geometry, uint32_t cellsPerAxis);
+
+        // Cheap occluder for a closed mesh (see MeshDescriptor::occluderGeometry): the largest box
+        // of cells of a cellsPerAxis^3 grid over the bounds which lie completely inside the mesh.
+        // Seen from anywhere, the box covers nothing the mesh does not cover, and lies behind it.
+        // Empty if no cell is inside, e.g. for a flat or an open mesh. Only positions and indices are set.
+        static Geometry occluderBox(const Geometry& geometry, uint32_t cellsPerAxis);
+
 
 };
\ No newline at end of file
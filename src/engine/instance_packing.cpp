@@ -0,0 +1,127 @@
+#include "instance_packing.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <DirectXPackedVector.h>
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+uint32_t instanceStride(InstanceFormat format)
+{
+    switch (format) {
+        case InstanceFormat::Affine: return sizeof(InstanceAffine);
+        case InstanceFormat::PositionRotationScale: return sizeof(InstancePositionRotationScale);
+        case InstanceFormat::PositionYawScale: return sizeof(InstancePositionYawScale);
+        default: return sizeof(Matrix);
+    }
+}
+
+// Transposing puts the columns into the rows, the fourth is dropped.
+static void packAffine(std::span<const Matrix> worldMatrices, InstanceAffine* out)
+{
+    for (size_t i = 0; i < worldMatrices.size(); i++) {
+        XMMATRIX columns = XMMatrixTranspose(XMLoadFloat4x4(&worldMatrices[i]));
+        XMStoreFloat4(&out[i].columns[0], columns.r[0]);
+        XMStoreFloat4(&out[i].columns[1], columns.r[1]);
+        XMStoreFloat4(&out[i].columns[2], columns.r[2]);
+    }
+}
+
+// The scale is the length of the first row, the rotation
+// is what remains of the upper 3x3 once it is divided out.
+static void packPositionRotationScale(std::span<const Matrix> worldMatrices, InstancePositionRotationScale* out)
+{
+    for (size_t i = 0; i < worldMatrices.size(); i++) {
+        XMMATRIX m = XMLoadFloat4x4(&worldMatrices[i]);
+        XMVECTOR scale = XMVector3Length(m.r[0]);
+        XMVECTOR rotation = XMQuaternionIdentity();
+        if (XMVectorGetX(scale) > 0) {
+            XMVECTOR inverseScale = XMVectorReciprocal(scale);
+            XMMATRIX r(XMVectorMultiply(m.r[0], inverseScale), XMVectorMultiply(m.r[1], inverseScale),
+                        XMVectorMultiply(m.r[2], inverseScale), g_XMIdentityR3);
+            rotation = XMQuaternionNormalize(XMQuaternionRotationMatrix(r));
+        }
+        XMStoreFloat3(&out[i].position, m.r[3]);
+        out[i].scale = XMVectorGetX(scale);
+        XMStoreFloat4(&out[i].rotation, rotation);
+    }
+}
+
+// Four instances at a time: the yaw is atan2(_31, _33) of the rotation around y,
+// the scale the length of the first row, both converted to halfs in one go.
+static void packPositionYawScale(std::span<const Matrix> worldMatrices, InstancePositionYawScale* out)
+{
+    for (size_t i = 0; i < worldMatrices.size(); i += 4) {
+        size_t n = std::min<size_t>(4, worldMatrices.size() - i);
+
+        XMFLOAT4 m11 = {}, m12 = {}, m13 = {}, m31 = {}, m33 = {};
+        float* lanes[] = {&m11.x, &m12.x, &m13.x, &m31.x, &m33.x};
+        for (size_t k = 0; k < n; k++) {
+            auto& w = worldMatrices[i + k];
+            lanes[0][k] = w._11;
+            lanes[1][k] = w._12;
+            lanes[2][k] = w._13;
+            lanes[3][k] = w._31;
+            lanes[4][k] = w._33;
+        }
+
+        XMVECTOR x = XMLoadFloat4(&m11);
+        XMVECTOR y = XMLoadFloat4(&m12);
+        XMVECTOR z = XMLoadFloat4(&m13);
+        XMVECTOR scaleSquared = XMVectorMultiplyAdd(x, x, XMVectorMultiplyAdd(y, y, XMVectorMultiply(z, z)));
+        XMVECTOR yaw = XMVectorATan2(XMLoadFloat4(&m31), XMLoadFloat4(&m33));
+
+        PackedVector::XMHALF4 yaws, scales;
+        PackedVector::XMStoreHalf4(&yaws, yaw);
+        PackedVector::XMStoreHalf4(&scales, XMVectorSqrt(scaleSquared));
+        const PackedVector::HALF* yawLanes = &yaws.x;
+        const PackedVector::HALF* scaleLanes = &scales.x;
+
+        for (size_t k = 0; k < n; k++) {
+            auto& w = worldMatrices[i + k];
+            out[i + k].position = {w._41, w._42, w._43};
+            out[i + k].yawScale = yawLanes[k] | ((uint32_t) scaleLanes[k] << 16);
+        }
+    }
+}
+
+void packInstances(InstanceFormat format, std::span<const Matrix> worldMatrices, void* out)
+{
+    switch (format) {
+        case InstanceFormat::Affine:
+            packAffine(worldMatrices, static_cast<InstanceAffine*>(out));
+            break;
+        case InstanceFormat::PositionRotationScale:
+            packPositionRotationScale(worldMatrices, static_cast<InstancePositionRotationScale*>(out));
+            break;
+        case InstanceFormat::PositionYawScale:
+            packPositionYawScale(worldMatrices, static_cast<InstancePositionYawScale*>(out));
+            break;
+        default:
+            memcpy(out, worldMatrices.data(), worldMatrices.size_bytes());
+            break;
+    }
+}
+
+uint32_t instanceAttributeStride(uint32_t attributes)
+{
+    return std::popcount(attributes) * sizeof(uint32_t);
+}
+
+void packInstanceAttributes(uint32_t attributes, std::span<const InstanceAttributes> source,
+                            std::span<const uint32_t> indices, uint32_t count, void* out,
+                            uint32_t textureSlice)
+{
+    auto words = static_cast<uint32_t*>(out);
+    const InstanceAttributes defaults;
+    for (uint32_t i = 0; i < count; i++) {
+        auto& a = source.empty() ? defaults : source[indices.empty() ? i : indices[i]];
+        if (attributes & instanceAttributeBit(InstanceAttribute::TeamColor)) *words++ = a.teamColor;
+        if (attributes & instanceAttributeBit(InstanceAttribute::Tint)) *words++ = a.tint;
+        if (attributes & instanceAttributeBit(InstanceAttribute::Health)) *words++ = std::bit_cast<uint32_t>(a.health);
+        if (attributes & instanceAttributeBit(InstanceAttribute::AnimationFrame)) *words++ = a.animationFrame;
+        if (attributes & instanceAttributeBit(InstanceAttribute::Selection)) *words++ = a.selection;
+        if (attributes & instanceAttributeBit(InstanceAttribute::TextureSlice)) *words++ = textureSlice;
+    }
+}
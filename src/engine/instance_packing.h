@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <DirectXMath.h>
+#include "renderer.h"
+
+// GPU layouts of the InstanceFormats,
+// they must match the structs in shaders/instance_data.hlsli.
+
+// The first three columns of the world matrix.
+struct InstanceAffine
+{
+    DirectX::XMFLOAT4 columns[3];
+};
+
+struct InstancePositionRotationScale
+{
+    DirectX::XMFLOAT3 position;
+    float scale;
+    DirectX::XMFLOAT4 rotation;
+};
+
+// yaw in the low and scale in the high 16 bits, both as halfs.
+struct InstancePositionYawScale
+{
+    DirectX::XMFLOAT3 position;
+    uint32_t yawScale;
+};
+
+static_assert(sizeof(InstanceAffine) == 48);
+static_assert(sizeof(InstancePositionRotationScale) == 32);
+static_assert(sizeof(InstancePositionYawScale) == 16);
+
+constexpr uint32_t instanceFormatCount = 4;
+
+uint32_t instanceStride(InstanceFormat format);
+
+// Converts the world matrices into the format,
+// out must have room for worldMatrices.size() * instanceStride(format) bytes.
+void packInstances(InstanceFormat format, std::span<const DirectX::SimpleMath::Matrix> worldMatrices, void* out);
+
+// Bytes per instance of the attributes a pipeline declares, see InstanceAttribute.
+uint32_t instanceAttributeStride(uint32_t attributes);
+
+// Writes the declared attributes of count instances, instance i taken from
+// source[indices[i]], or source[i] if indices is empty. An empty source gives the defaults.
+// InstanceAttribute::TextureSlice is textureSlice for all of them.
+// out must have room for count * instanceAttributeStride(attributes) bytes.
+void packInstanceAttributes(uint32_t attributes, std::span<const InstanceAttributes> source,
+                            std::span<const uint32_t> indices, uint32_t count, void* out,
+                            uint32_t textureSlice = 0);
@@ -0,0 +1,82 @@
+#include "job_system.h"
+#include <algorithm>
+
+uint32_t JobSystem::defaultWorkerCount()
+{
+    // Keep one core for the render thread.
+    auto cores = std::thread::hardware_concurrency();
+    return cores > 2 ? cores - 2 : 0;
+}
+
+JobSystem::JobSystem(uint32_t numWorkers)
+{
+    for (uint32_t i = 0; i < numWorkers; i++) {
+        workers.emplace_back(&JobSystem::workerLoop, this, i + 1);
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    stopping.store(true, std::memory_order_release);
+    generation.fetch_add(1, std::memory_order_release);
+    generation.notify_all();
+    for (auto& w : workers) {
+        w.join();
+    }
+}
+
+void JobSystem::parallelFor(uint32_t numTasks, const TaskFunction& fn)
+{
+    if (numTasks == 0) return;
+
+    if (workers.empty() || numTasks == 1) {
+        for (uint32_t i = 0; i < numTasks; i++) {
+            fn(i, 0);
+        }
+        return;
+    }
+
+    std::lock_guard lock(callerMutex);
+    task = &fn;
+    taskCount = numTasks;
+    nextTask.store(0, std::memory_order_relaxed);
+    finishedWorkers.store(0, std::memory_order_relaxed);
+    generation.fetch_add(1, std::memory_order_release);
+    generation.notify_all();
+
+    runTasks(0);
+
+    // Every worker has to check in, not only the ones which got a task,
+    // so none of them can still be looking at this parallelFor when
+    // the next one is set up.
+    auto finished = finishedWorkers.load(std::memory_order_acquire);
+    while (finished != workers.size()) {
+        finishedWorkers.wait(finished, std::memory_order_acquire);
+        finished = finishedWorkers.load(std::memory_order_acquire);
+    }
+}
+
+void JobSystem::runTasks(uint32_t threadIndex)
+{
+    uint32_t taskIndex;
+    while ((taskIndex = nextTask.fetch_add(1, std::memory_order_relaxed)) < taskCount) {
+        (*task)(taskIndex, threadIndex);
+    }
+}
+
+void JobSystem::workerLoop(uint32_t threadIndex)
+{
+    uint32_t seen = 0;
+    while (true) {
+        generation.wait(seen, std::memory_order_acquire);
+        seen = generation.load(std::memory_order_acquire);
+        if (stopping.load(std::memory_order_acquire)) {
+            return;
+        }
+
+        runTasks(threadIndex);
+
+        finishedWorkers.fetch_add(1, std::memory_order_release);
+        finishedWorkers.notify_one();
+    }
+}
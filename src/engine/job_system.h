@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads which live as long as the JobSystem.
+// parallelFor() is the only way to hand them work: the tasks are claimed 
+// through an atomic counter, the calling thread helps out and 
+// waits until every task is done. Calls from different threads take turns,
+// so the game and the render thread can share one JobSystem.
+class JobSystem
+{
+    public:
+        // Gets called with the task index and the index of the thread running it.
+        // The calling thread has threadIndex 0, the workers 1 to threadCount() - 1.
+        using TaskFunction = std::function<void(uint32_t taskIndex, uint32_t threadIndex)>;
+
+        explicit JobSystem(uint32_t numWorkers = defaultWorkerCount());
+        ~JobSystem();
+
+        JobSystem(const JobSystem&) = delete;
+        JobSystem& operator=(const JobSystem&) = delete;
+
+        // Runs fn for every task index in [0, numTasks) and returns 
+        // once all of them are finished. Must not be called from within a task.
+        void parallelFor(uint32_t numTasks, const TaskFunction& fn);
+
+        uint32_t threadCount() const { return workers.size() + 1; }
+
+        static uint32_t defaultWorkerCount();
+
+    private:
+        void workerLoop(uint32_t threadIndex);
+        void runTasks(uint32_t threadIndex);
+
+        std::vector<std::thread> workers;
+
+        // Held for a whole parallelFor, one caller at a time.
+        std::mutex callerMutex;
+        // The current parallelFor. Only written while all workers are idle.
+        const TaskFunction* task = nullptr;
+        uint32_t taskCount = 0;
+        std::atomic<uint32_t> nextTask = 0;
+
+        // Bumped for every parallelFor, wakes up the workers.
+        std::atomic<uint32_t> generation = 0;
+        // Workers done with the current generation.
+        std::atomic<uint32_t> finishedWorkers = 0;
+        std::atomic<bool> stopping = false;
+};
@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "frame_arena.h"
+#include "light_binner.h"
+
+using namespace DirectX::SimpleMath;
+
+// Measures the LightBinner on the CPU: the point lights of one view, spread over
+// the battlefield and moving every frame, binned at the game's camera.
+// Usage: light_bench [lights=<n>] [frames=<n>] [threads=<n>] [radius=<world units>]
+int main(int argc, char ** args) {
+
+    uint32_t numLights = 1000;
+    uint32_t numFrames = 500;
+    uint32_t numThreads = JobSystem::defaultWorkerCount() + 1;
+    float radius = 6;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(args[i], "lights=", 7) == 0) {
+            numLights = atoi(args[i] + 7);
+        } else if (strncmp(args[i], "frames=", 7) == 0) {
+            numFrames = std::max(1, atoi(args[i] + 7));
+        } else if (strncmp(args[i], "threads=", 8) == 0) {
+            numThreads = std::max(1, atoi(args[i] + 8));
+        } else if (strncmp(args[i], "radius=", 7) == 0) {
+            radius = atof(args[i] + 7);
+        }
+    }
+
+    constexpr uint32_t screenWidth = 1920;
+    constexpr uint32_t screenHeight = 1080;
+    JobSystem jobSystem(numThreads - 1);
+    LightBinner binner;
+    binner.initialize(&jobSystem);
+
+    auto frameArena = FrameArena();
+    double binMs = 0;
+    uint64_t lightIndices = 0;
+    uint64_t litClusters = 0;
+    uint32_t maxClusterLights = 0;
+    uint64_t droppedLights = 0;
+    for (uint32_t f = 0; f < numFrames; f++) {
+        auto& frameMemory = frameArena.beginFrame();
+        auto frame = frameMemory.create<FrameSubmission>();
+        auto& view = frame->viewSubmissions.emplace_back();
+        view.viewMatrix = Matrix(DirectX::XMMatrixLookAtLH({0, 30, -15}, {0, 0, 0}, {0, 1, 0}));
+        view.projectionMatrix = Matrix(DirectX::XMMatrixPerspectiveFovLH(45, (float) screenWidth / screenHeight, 0.1f, 200));
+
+        // On a square grid over the ground, circling around their spot.
+        uint32_t side = (uint32_t) std::ceil(std::sqrt((float) numLights));
+        float spacing = 100.0f / std::max(side, 1u);
+        view.pointLights.reserve(numLights);
+        for (uint32_t i = 0; i < numLights; i++) {
+            auto& light = view.pointLights.emplace_back();
+            float angle = f * 0.05f + i;
+            light.position = Vector3(-50 + (i % side) * spacing + std::cos(angle), 1.5f,
+                                     -30 + (i / side) * spacing + std::sin(angle));
+            light.radius = radius;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        binner.build(*frame, screenWidth, screenHeight);
+        auto end = std::chrono::steady_clock::now();
+
+        binMs += std::chrono::duration<double, std::milli>(end - start).count();
+        auto& stats = binner.stats();
+        lightIndices += stats.lightIndices;
+        litClusters += stats.litClusters;
+        maxClusterLights = std::max(maxClusterLights, stats.maxClusterLights);
+        droppedLights += stats.droppedLights;
+    }
+
+    std::cout << "threads:           " << numThreads << std::endl;
+    std::cout << "lights/frame:      " << numLights << std::endl;
+    std::cout << "bin ms/frame:      " << binMs / numFrames << std::endl;
+    std::cout << "lit clusters:      " << litClusters / numFrames << " of " << LightBinner::viewClusters << std::endl;
+    std::cout << "indices/frame:     " << lightIndices / numFrames << std::endl;
+    std::cout << "max lights/cluster: " << maxClusterLights << " (" << droppedLights / numFrames
+              << " dropped/frame)" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,226 @@
+#include "light_binner.h"
+#include "simd_util.h"
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX::SimpleMath;
+
+static_assert(LightBinner::sliceClusters % 4 == 0, "the clusters of a slice are tested four at a time");
+
+void LightBinner::initialize(JobSystem* jobSystem)
+{
+    bins.resize(slices);
+    bounds.resize(slices);
+    this->jobSystem = jobSystem;
+}
+
+const ClusterConstants& LightBinner::viewConstants(uint32_t view) const
+{
+    static const ClusterConstants noClusters;
+    return view < views.size() ? views[view] : noClusters;
+}
+
+// The view space x (or y) at depth z of a point at ndc, for the projection
+// columns scale, zScale and offset (_11, _31, _41 for x).
+static float unproject(const Matrix& projection, float ndc, float z, float scale, float zScale, float offset)
+{
+    float w = z * projection._34 + projection._44;
+    return (ndc * w - z * zScale - offset) / scale;
+}
+
+void LightBinner::computeBounds(const Matrix& projection, uint32_t screenWidth, uint32_t screenHeight,
+                                float nearZ, float farZ)
+{
+    boundsProjection = projection;
+    boundsWidth = screenWidth;
+    boundsHeight = screenHeight;
+
+    // The tiles are whole pixels, as the pixel shader finds them, the last ones may be cut off.
+    uint32_t tileWidth = (screenWidth + tilesX - 1) / tilesX;
+    uint32_t tileHeight = (screenHeight + tilesY - 1) / tilesY;
+    float depthRatio = farZ / nearZ;
+
+    for (uint32_t k = 0; k < slices; k++) {
+        auto& slice = bounds[k];
+        slice.nearZ = nearZ * std::pow(depthRatio, (float) k / slices);
+        slice.farZ = nearZ * std::pow(depthRatio, (float) (k + 1) / slices);
+        float depths[] = {slice.nearZ, slice.farZ};
+
+        for (uint32_t y = 0; y < tilesY; y++) {
+            // Pixel rows go down, ndc y goes up.
+            float top = 1 - 2.0f * std::min(y * tileHeight, screenHeight) / screenHeight;
+            float bottom = 1 - 2.0f * std::min((y + 1) * tileHeight, screenHeight) / screenHeight;
+            for (uint32_t x = 0; x < tilesX; x++) {
+                float left = -1 + 2.0f * std::min(x * tileWidth, screenWidth) / screenWidth;
+                float right = -1 + 2.0f * std::min((x + 1) * tileWidth, screenWidth) / screenWidth;
+
+                uint32_t c = y * tilesX + x;
+                slice.minX[c] = slice.minY[c] = INFINITY;
+                slice.maxX[c] = slice.maxY[c] = -INFINITY;
+                for (float z : depths) {
+                    for (float ndc : {left, right}) {
+                        float viewX = unproject(projection, ndc, z, projection._11, projection._31, projection._41);
+                        slice.minX[c] = std::min(slice.minX[c], viewX);
+                        slice.maxX[c] = std::max(slice.maxX[c], viewX);
+                    }
+                    for (float ndc : {top, bottom}) {
+                        float viewY = unproject(projection, ndc, z, projection._22, projection._32, projection._42);
+                        slice.minY[c] = std::min(slice.minY[c], viewY);
+                        slice.maxY[c] = std::max(slice.maxY[c], viewY);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void LightBinner::binSlice(uint32_t k)
+{
+    auto& slice = bounds[k];
+    auto& out = bins[k];
+    memset(out.counts, 0, sizeof(out.counts));
+    out.dropped = 0;
+
+    auto add = [&](uint32_t cluster, uint32_t light) {
+        if (out.counts[cluster] < maxClusterLights) {
+            out.lights[cluster * maxClusterLights + out.counts[cluster]++] = light;
+        } else {
+            out.dropped++;
+        }
+    };
+
+    uint32_t numLights = viewLights.x.size();
+    for (uint32_t i = 0; i < numLights; i++) {
+        float x = viewLights.x[i];
+        float y = viewLights.y[i];
+        float z = viewLights.z[i];
+        float r = viewLights.radius[i];
+        if (z + r < slice.nearZ || z - r > slice.farZ) continue;
+
+        // All clusters of the slice share their depth range.
+        float dz = std::max({0.0f, slice.nearZ - z, z - slice.farZ});
+        float reach = r * r - dz * dz;
+
+#if defined(ENGINE_SSE2)
+        __m128 x4 = _mm_set1_ps(x);
+        __m128 y4 = _mm_set1_ps(y);
+        __m128 reach4 = _mm_set1_ps(reach);
+        __m128 zero = _mm_setzero_ps();
+        for (uint32_t c = 0; c < sliceClusters; c += 4) {
+            __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(slice.minX + c), x4),
+                                              _mm_sub_ps(x4, _mm_loadu_ps(slice.maxX + c))), zero);
+            __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(slice.minY + c), y4),
+                                              _mm_sub_ps(y4, _mm_loadu_ps(slice.maxY + c))), zero);
+            __m128 distance = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+            int mask = _mm_movemask_ps(_mm_cmple_ps(distance, reach4));
+            while (mask) {
+                int lane = std::countr_zero((uint32_t) mask);
+                add(c + lane, i);
+                mask &= mask - 1;
+            }
+        }
+#else
+        for (uint32_t c = 0; c < sliceClusters; c++) {
+            float dx = std::max({0.0f, slice.minX[c] - x, x - slice.maxX[c]});
+            float dy = std::max({0.0f, slice.minY[c] - y, y - slice.maxY[c]});
+            if (dx * dx + dy * dy <= reach) add(c, i);
+        }
+#endif
+    }
+}
+
+void LightBinner::build(const FrameSubmission& frame, uint32_t screenWidth, uint32_t screenHeight)
+{
+    assert(!bins.empty() && "initialize() first");
+
+    binStats = {};
+    views.assign(frame.viewSubmissions.size(), {});
+    frameLights.clear();
+    clusters.clear();
+    lightIndices.clear();
+    if (screenWidth == 0 || screenHeight == 0) return;
+
+    for (uint32_t v = 0; v < frame.viewSubmissions.size(); v++) {
+        auto& vs = frame.viewSubmissions[v];
+        auto& projection = vs.projectionMatrix;
+        // Orthographic projections have no w to divide by.
+        if (vs.pointLights.empty() || projection._34 == 0) continue;
+
+        // Near and far plane of a D3D style projection, depth 0 at near and 1 at far.
+        float nearZ = -projection._43 / projection._33;
+        float farZ = projection._43 / (1 - projection._33);
+        if (!(nearZ > 0)) continue;
+        if (!std::isfinite(farZ) || farZ <= nearZ) farZ = nearZ * 10000;
+
+        if (memcmp(&projection, &boundsProjection, sizeof(Matrix)) != 0 ||
+            screenWidth != boundsWidth || screenHeight != boundsHeight) {
+            computeBounds(projection, screenWidth, screenHeight, nearZ, farZ);
+        }
+
+        auto& view = vs.viewMatrix;
+        uint32_t numLights = vs.pointLights.size();
+        viewLights.x.resize(numLights);
+        viewLights.y.resize(numLights);
+        viewLights.z.resize(numLights);
+        viewLights.radius.resize(numLights);
+        for (uint32_t i = 0; i < numLights; i++) {
+            auto& p = vs.pointLights[i].position;
+            viewLights.x[i] = p.x * view._11 + p.y * view._21 + p.z * view._31 + view._41;
+            viewLights.y[i] = p.x * view._12 + p.y * view._22 + p.z * view._32 + view._42;
+            viewLights.z[i] = p.x * view._13 + p.y * view._23 + p.z * view._33 + view._43;
+            viewLights.radius[i] = vs.pointLights[i].radius;
+        }
+
+        if (jobSystem) {
+            jobSystem->parallelFor(slices, [this](uint32_t k, uint32_t) { binSlice(k); });
+        } else {
+            for (uint32_t k = 0; k < slices; k++) binSlice(k);
+        }
+
+        auto& constants = views[v];
+        constants.firstCluster = clusters.size();
+        constants.tilesX = tilesX;
+        constants.tilesY = tilesY;
+        constants.slices = slices;
+        constants.tileScaleX = 1.0f / ((screenWidth + tilesX - 1) / tilesX);
+        constants.tileScaleY = 1.0f / ((screenHeight + tilesY - 1) / tilesY);
+        constants.sliceScale = slices / std::log(farZ / nearZ);
+        constants.sliceBias = -std::log(nearZ) * constants.sliceScale;
+
+        // The lights of the view follow those of the views before.
+        uint32_t base = frameLights.size();
+        frameLights.insert(frameLights.end(), vs.pointLights.begin(), vs.pointLights.end());
+        binStats.lights += numLights;
+
+        for (auto& slice : bins) {
+            for (uint32_t c = 0; c < sliceClusters; c++) {
+                uint32_t count = slice.counts[c];
+                clusters.push_back({(uint32_t) lightIndices.size(), count});
+                for (uint32_t j = 0; j < count; j++) {
+                    lightIndices.push_back(base + slice.lights[c * maxClusterLights + j]);
+                }
+                if (count > 0) binStats.litClusters++;
+                binStats.maxClusterLights = std::max(binStats.maxClusterLights, count);
+            }
+            binStats.droppedLights += slice.dropped;
+        }
+    }
+    binStats.lightIndices = lightIndices.size();
+}
+
+void LightBinner::writeClusters(LightCluster* out, uint32_t firstLightIndex) const
+{
+    for (auto& cluster : clusters) {
+        *out++ = {cluster.firstLight + firstLightIndex, cluster.lightCount};
+    }
+}
+
+void LightBinner::writeLightIndices(uint32_t* out, uint32_t firstLight) const
+{
+    for (auto index : lightIndices) {
+        *out++ = index + firstLight;
+    }
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "renderer.h"
+#include "job_system.h"
+
+// firstCluster of the views without clusters, see shaders/clustered_lights.hlsli.
+constexpr uint32_t noLightClusters = 0xFFFFFFFF;
+
+// The lights of one cluster are lightCount entries of the light index list.
+struct LightCluster
+{
+    uint32_t firstLight;
+    uint32_t lightCount;
+};
+
+// Per view constants of the pixel shaders, how a pixel finds its cluster.
+struct ClusterConstants
+{
+    uint32_t firstCluster = noLightClusters;
+    uint32_t tilesX = 0;
+    uint32_t tilesY = 0;
+    uint32_t slices = 0;
+    // 1 / the tile size in pixels.
+    float tileScaleX = 0;
+    float tileScaleY = 0;
+    // slice = log(view z) * sliceScale + sliceBias
+    float sliceScale = 0;
+    float sliceBias = 0;
+};
+
+struct LightBinStats
+{
+    uint32_t lights = 0;
+    // Clusters with at least one light.
+    uint32_t litClusters = 0;
+    uint32_t lightIndices = 0;
+    // The longest light loop a pixel runs.
+    uint32_t maxClusterLights = 0;
+    // Cluster entries dropped because the cluster was full.
+    uint32_t droppedLights = 0;
+};
+
+// Clustered lighting, the CPU part: sorts the point lights of every view into
+// a grid of froxels, so a pixel only loops over the lights which can reach it.
+//
+// The grid has tilesX * tilesY screen tiles and slices depth slices between the near
+// and far plane of the view's projection, exponentially spaced so clusters stay roughly
+// cubic. The view space bounding box of every cluster is derived from the projection
+// and only recomputed when it or the screen size changes. Lights are tested as spheres
+// against these boxes, four clusters at a time with SSE when the build targets it.
+// The slices are binned side by side on the threads of a JobSystem.
+//
+// The result of a frame are three arrays for the GPU, all views concatenated: the lights,
+// one LightCluster per cluster and the light index list the clusters point into.
+// A cluster holds at most maxClusterLights lights, in the order of the view's pointLights,
+// which bounds the loop in the pixel shader no matter how many lights there are.
+// Views without lights or without a perspective projection get no clusters.
+class LightBinner
+{
+    public:
+        static constexpr uint32_t tilesX = 16;
+        static constexpr uint32_t tilesY = 9;
+        static constexpr uint32_t slices = 24;
+        static constexpr uint32_t sliceClusters = tilesX * tilesY;
+        static constexpr uint32_t viewClusters = sliceClusters * slices;
+        static constexpr uint32_t maxClusterLights = 32;
+
+        // Bins on the threads of jobSystem if there is one, it is not owned.
+        void initialize(JobSystem* jobSystem = nullptr);
+
+        void build(const FrameSubmission& frame, uint32_t screenWidth, uint32_t screenHeight);
+
+        // firstCluster is relative to clusterCount(), add where the clusters are uploaded to.
+        const ClusterConstants& viewConstants(uint32_t view) const;
+
+        std::span<const PointLight> lights() const { return frameLights; }
+        uint32_t clusterCount() const { return static_cast<uint32_t>(clusters.size()); }
+        uint32_t lightIndexCount() const { return static_cast<uint32_t>(lightIndices.size()); }
+
+        // Write the clusters and the index list for the GPU, firstLightIndex and firstLight
+        // are where the index list and the lights start in their buffers.
+        void writeClusters(LightCluster* out, uint32_t firstLightIndex) const;
+        void writeLightIndices(uint32_t* out, uint32_t firstLight) const;
+
+        const LightBinStats& stats() const { return binStats; }
+
+    private:
+        // Bounding boxes of the clusters of one slice, one array per component.
+        struct SliceBounds
+        {
+            float minX[sliceClusters];
+            float maxX[sliceClusters];
+            float minY[sliceClusters];
+            float maxY[sliceClusters];
+            float nearZ;
+            float farZ;
+        };
+
+        // Lights of the current view in view space, one array per component.
+        struct ViewLights
+        {
+            std::vector<float> x, y, z, radius;
+        };
+
+        // Where the binning of one slice puts its results.
+        struct SliceBins
+        {
+            uint32_t counts[sliceClusters];
+            uint32_t lights[sliceClusters * maxClusterLights];
+            uint32_t dropped;
+        };
+
+        void computeBounds(const DirectX::SimpleMath::Matrix& projection, uint32_t screenWidth, uint32_t screenHeight,
+                           float nearZ, float farZ);
+        void binSlice(uint32_t slice);
+
+        std::vector<ClusterConstants> views;
+        std::vector<PointLight> frameLights;
+        std::vector<LightCluster> clusters;
+        std::vector<uint32_t> lightIndices;
+
+        std::vector<SliceBounds> bounds;
+        DirectX::SimpleMath::Matrix boundsProjection;
+        uint32_t boundsWidth = 0;
+        uint32_t boundsHeight = 0;
+
+        ViewLights viewLights;
+        std::vector<SliceBins> bins;
+        LightBinStats binStats;
+
+        JobSystem* jobSystem = nullptr;
+};
@@ -13,6 +13,93 @@
 #include "dx11renderer.h"
 #include "engine.h"
 #include "game.h"
+#include "frame_arena.h"
+#include "frame_mailbox.h"
+#include "frame_capture.h"
+#include <cstring>
+#include <thread>
+
+// Forwards the window events to the game and sets resized
+// when the window got a new size. Returns false once the window was closed.
+static bool processWindowEvents(Window& window, Game* game, bool& resized)
+{
+    auto running = true;
+    resized = false;
+    auto events = pollWindowMessages(window);
+    game->setEvents(events);
+    for (auto &e : events) 
+    {
+        if (e->name == "quit") {
+            running = false;
+        }
+
+        if (e->name == "resized") {
+            auto newDimension = (DirectX::SimpleMath::Vector2*) e->data;
+            window.width = newDimension->x;
+            window.height= newDimension->y;
+            resized = true;
+        }
+    }
+    return running;
+}
+
+// The renderer learns about a new window size only through the frame,
+// whichever game built it.
+static void stampWindowSize(const Window& window, bool resized, FrameSubmission& frameData)
+{
+    if (resized) {
+        frameData.resizeWidth = window.width;
+        frameData.resizeHeight = window.height;
+    }
+}
+
+static bool hasArgument(int argc, char** args, const char* argument)
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(args[i], argument) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns what follows the prefix for an argument like "capture=frames.bin".
+static const char* argumentValue(int argc, char** args, const char* prefix)
+{
+    auto length = strlen(prefix);
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(args[i], prefix, length) == 0) {
+            return args[i] + length;
+        }
+    }
+    return nullptr;
+}
+
+// The window and the game stay on the main thread, 
+// while a render thread draws the previous frame.
+static void runThreaded(Window& window, Game* game, Renderer& renderer, FrameCaptureWriter& capture)
+{
+    FrameMailbox mailbox;
+    std::thread renderThread([&mailbox, &renderer]() {
+        while (auto frameData = mailbox.acquire()) {
+            renderer.doFrame(*frameData);
+            mailbox.release();
+        }
+    });
+
+    auto resized = false;
+    while (processWindowEvents(window, game, resized)) {
+        auto& frameMemory = mailbox.beginWrite();
+        auto frameData = game->getFrameData(frameMemory);
+        stampWindowSize(window, resized, *frameData);
+        capture.writeFrame(*frameData);
+        mailbox.publish(frameData);
+    }
+
+    // The render thread finishes the frames already published and exits.
+    mailbox.close();
+    renderThread.join();
+}
 
 int main(int argc, char ** args) {
 
@@ -23,28 +110,39 @@ int main(int argc, char ** args) {
     auto renderer = DX11Renderer();
     renderer.initialize(initData);
 
-    auto running = true;
-    while (running) {
-        auto events = pollWindowMessages(window);
-        game->setEvents(events);
-        for (auto &e : events) 
-        {
-            if (e->name == "quit") {
-                running = false;
-            }
-
-            if (e->name == "resized") {
-                auto newDimension = (DirectX::SimpleMath::Vector2*) e->data;
-                window.width = newDimension->x;
-                window.height= newDimension->y;
-           }
+    // Replays a capture instead of running the game, see frame_capture.h.
+    if (auto replayPath = argumentValue(argc, args, "replay=")) {
+        FrameReplayer replayer;
+        if (!replayer.open(replayPath)) {
+            return 1;
         }
-        auto frameData = game->getFrameData();
-        renderer.doFrame({frameData});
-       
-       
-        
+        replayer.remap(initData);
+        auto frameArena = FrameArena();
+        replayer.replay(renderer, frameArena);
+        return 0;
+    }
+
+    FrameCaptureWriter capture;
+    if (auto capturePath = argumentValue(argc, args, "capture=")) {
+        capture.open(capturePath, initData);
+    }
+
+    if (hasArgument(argc, args, "threaded")) {
+        runThreaded(window, game, renderer, capture);
+        return 0;
+    }
 
+    // Double buffered, so the frame the renderer just consumed
+    // is only retired once the next one is being built.
+    auto frameArena = FrameArena();
+
+    auto resized = false;
+    while (processWindowEvents(window, game, resized)) {
+        auto& frameMemory = frameArena.beginFrame();
+        auto frameData = game->getFrameData(frameMemory);
+        stampWindowSize(window, resized, *frameData);
+        capture.writeFrame(*frameData);
+        renderer.doFrame(*frameData);
     }
 
 }
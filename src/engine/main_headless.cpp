@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "appwindow.h"
+#include "engine.h"
+#include "game.h"
+#include "frame_arena.h"
+#include "recording_renderer.h"
+#include "frame_capture.h"
+
+// Runs the game against the RecordingRenderer, without window or GPU,
+// and prints what the frames would have cost.
+// Usage: headless_rts [frames=<n>] [capture=<file>] [replay=<file>]
+// With replay the frames of the capture are used instead of the game's.
+int main(int argc, char ** args) {
+
+    uint32_t numFrames = 1000;
+    const char* capturePath = nullptr;
+    const char* replayPath = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(args[i], "frames=", 7) == 0) {
+            numFrames = atoi(args[i] + 7);
+        } else if (strncmp(args[i], "capture=", 8) == 0) {
+            capturePath = args[i] + 8;
+        } else if (strncmp(args[i], "replay=", 7) == 0) {
+            replayPath = args[i] + 7;
+        }
+    }
+
+    Window window = {800, 600, nullptr};
+    auto game = getGame();
+    auto initData = game->getInitData({argc, args}, &window);
+    auto renderer = RecordingRenderer();
+    renderer.initialize(initData);
+
+    auto frameArena = FrameArena();
+
+    FrameReplayer replayer;
+    if (replayPath) {
+        if (!replayer.open(replayPath)) {
+            return 1;
+        }
+        replayer.remap(initData);
+    }
+
+    FrameCaptureWriter capture;
+    if (capturePath) {
+        capture.open(capturePath, initData);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    if (replayPath) {
+        replayer.replay(renderer, frameArena);
+    } else {
+        for (uint32_t i = 0; i < numFrames; i++) {
+            game->setEvents({});
+            auto& frameMemory = frameArena.beginFrame();
+            auto frameData = game->getFrameData(frameMemory);
+            capture.writeFrame(*frameData);
+            renderer.doFrame(*frameData);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    capture.close();
+
+    auto& totals = renderer.totals();
+    double frames = std::max<uint64_t>(renderer.frameCount(), 1);
+    double cpuMs = std::chrono::duration<double, std::milli>(end - start).count();
+    std::cout << "frames:            " << renderer.frameCount() << std::endl;
+    std::cout << "cpu ms/frame:      " << cpuMs / frames << std::endl;
+    std::cout << "draw calls/frame:  " << totals.drawCalls / frames << std::endl;
+    std::cout << "instances/frame:   " << totals.instances / frames << std::endl;
+    std::cout << "culled/frame:      " << totals.culledInstances / frames << std::endl;
+    std::cout << "occluded/frame:    " << totals.occludedInstances / frames << std::endl;
+    std::cout << "coarser LOD/frame: " << totals.reducedLodInstances / frames << std::endl;
+    std::cout << "glyphs/frame:      " << totals.glyphs / frames << std::endl;
+    std::cout << "sprites/frame:     " << totals.sprites / frames 
+              << " (" << totals.spriteDraws / frames << " draws)" << std::endl;
+    std::cout << "lights/frame:      " << totals.pointLights / frames 
+              << " (" << totals.lightIndices / frames << " cluster entries, at most " 
+              << totals.maxClusterLights << " per cluster)" << std::endl;
+    std::cout << "upload KB/frame:   " << totals.uploadBytes / frames / 1024.0 << std::endl;
+    std::cout << "pipeline changes:  " << totals.pipelineChanges / frames << std::endl;
+    std::cout << "texture changes:   " << totals.textureChanges / frames << std::endl;
+    std::cout << "mesh changes:      " << totals.meshChanges / frames << std::endl;
+    std::cout << "state calls:       " << totals.stateCalls / frames 
+              << " (" << totals.filteredStateCalls / frames << " filtered)" << std::endl;
+    std::cout << "validation errors: " << totals.validationErrors << std::endl;
+
+    return totals.validationErrors == 0 ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+#include "mesh_lod.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+using namespace DirectX::SimpleMath;
+
+void LodSelector::initialize(const RenderInitData& initData)
+{
+    chains.clear();
+    uint32_t nextLodMesh = initData.meshDescriptors.size();
+    for (auto& md : initData.meshDescriptors) {
+        assert(md.lods.size() < maxLevels);
+
+        LodChain chain;
+        chain.firstLodMesh = nextLodMesh;
+        chain.hysteresis = md.lodHysteresis;
+        chain.bounds = computeBoundingSphere(md.geometry);
+        nextLodMesh += md.lods.size();
+
+        // Without bounds there is no size to select by, the mesh is always drawn in full.
+        if (chain.bounds.radius >= 0) {
+            chain.levels = 1 + std::min<uint32_t>(md.lods.size(), maxLevels - 1);
+        }
+        for (uint32_t level = 1; level < chain.levels; level++) {
+            chain.screenSizes[level] = md.lods[level - 1].screenSize;
+        }
+        chains.push_back(chain);
+    }
+}
+
+MeshHandle LodSelector::lodMesh(MeshHandle mesh, uint32_t level) const
+{
+    if (level == 0) return mesh;
+    return MeshHandle{chains[mesh.index].firstLodMesh + level - 1};
+}
+
+void LodSelector::beginFrame(size_t maxInstances)
+{
+    lodMatrices.clear();
+    lodIndices.clear();
+    if (lodMatrices.capacity() < maxInstances) {
+        lodMatrices.reserve(maxInstances);
+        lodIndices.reserve(maxInstances);
+    }
+    std::fill(std::begin(stats), std::end(stats), LodStats{});
+}
+
+void LodSelector::beginView(uint32_t view, const Matrix& viewMatrix, const Matrix& projectionMatrix)
+{
+    assert(view < FrustumCuller::maxViews);
+    currentView = view;
+    this->viewMatrix = viewMatrix;
+    this->projectionMatrix = projectionMatrix;
+}
+
+// How much of the screen height the sphere covers,
+// taken from the (left handed) projection matrix.
+static float screenSize(const Matrix& view, const Matrix& projection, const Vector3& center, float radius)
+{
+    if (projection._34 != 0) {
+        // Perspective, spheres around the camera cover all of it.
+        float z = center.x * view._13 + center.y * view._23 + center.z * view._33 + view._43;
+        if (z <= radius) return std::numeric_limits<float>::max();
+        return radius * projection._22 / z;
+    }
+
+    // Orthographic, the size does not depend on the distance.
+    return radius * projection._22;
+}
+
+std::span<const LodRange> LodSelector::select(MeshHandle mesh, uint32_t object, uint32_t instanceCount,
+                                              std::span<const Matrix> visible, std::span<const uint32_t> instanceIndices)
+{
+    auto& chain = chains[mesh.index];
+    auto& viewObjects = previousLevels[currentView];
+    if (viewObjects.size() <= object) {
+        viewObjects.resize(object + 1);
+    }
+    auto& previous = viewObjects[object];
+    if (previous.size() != instanceCount) {
+        previous.assign(instanceCount, unknownLevel);
+    }
+
+    // Coarser levels are taken below their threshold. An instance which had a level
+    // last frame has to get past the threshold by the hysteresis to change it.
+    uint32_t counts[maxLevels] = {};
+    levels.resize(visible.size());
+    for (uint32_t i = 0; i < visible.size(); i++) {
+        auto& w = visible[i];
+        auto center = Vector3::Transform(chain.bounds.center, w);
+        float scaleSquared = std::max({w._11 * w._11 + w._12 * w._12 + w._13 * w._13,
+                                        w._21 * w._21 + w._22 * w._22 + w._23 * w._23,
+                                        w._31 * w._31 + w._32 * w._32 + w._33 * w._33});
+        float size = screenSize(viewMatrix, projectionMatrix, center, chain.bounds.radius * std::sqrt(scaleSquared));
+
+        uint32_t instance = instanceIndices.empty() ? i : instanceIndices[i];
+        uint8_t last = previous[instance];
+        uint32_t level = 0;
+        for (uint32_t k = 1; k < chain.levels; k++) {
+            float threshold = chain.screenSizes[k];
+            if (last != unknownLevel) {
+                threshold *= last >= k ? 1 + chain.hysteresis : 1 - chain.hysteresis;
+            }
+            if (size < threshold) level = k;
+        }
+
+        previous[instance] = level;
+        levels[i] = level;
+        counts[level]++;
+    }
+
+    auto& viewStats = stats[currentView];
+    viewStats.instances += visible.size();
+    viewStats.reducedInstances += visible.size() - counts[0];
+
+    ranges.clear();
+    if (counts[0] == visible.size()) {
+        ranges.push_back({0, mesh, visible, instanceIndices});
+        return ranges;
+    }
+
+    // Group the instances by level, keeping their order inside a level.
+    // The storage was reserved in beginFrame, so the ranges handed out before stay valid.
+    assert(lodMatrices.size() + visible.size() <= lodMatrices.capacity());
+    auto first = lodMatrices.size();
+    lodMatrices.resize(first + visible.size());
+    lodIndices.resize(first + visible.size());
+    uint32_t offsets[maxLevels];
+    uint32_t sum = 0;
+    for (uint32_t level = 0; level < maxLevels; level++) {
+        offsets[level] = sum;
+        sum += counts[level];
+    }
+    for (uint32_t level = 0; level < chain.levels; level++) {
+        if (counts[level] == 0) continue;
+        auto instances = std::span<const Matrix>(lodMatrices).subspan(first + offsets[level], counts[level]);
+        auto indices = std::span<const uint32_t>(lodIndices).subspan(first + offsets[level], counts[level]);
+        ranges.push_back({level, lodMesh(mesh, level), instances, indices});
+    }
+    for (uint32_t i = 0; i < visible.size(); i++) {
+        auto slot = first + offsets[levels[i]]++;
+        lodMatrices[slot] = visible[i];
+        lodIndices[slot] = instanceIndices.empty() ? i : instanceIndices[i];
+    }
+    return ranges;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "renderer.h"
+#include "frustum_culler.h"
+
+// The instances of one ObjectRenderData which are drawn with the same LOD level.
+struct LodRange
+{
+    uint32_t level;
+    MeshHandle mesh;
+    std::span<const DirectX::SimpleMath::Matrix> instances;
+    // Where each instance is in the worldMatrices of the ObjectRenderData,
+    // empty if they are all of them in order.
+    std::span<const uint32_t> instanceIndices;
+};
+
+struct LodStats
+{
+    // Visible instances of meshes with LODs, and how many of them got a coarser level.
+    uint32_t instances = 0;
+    uint32_t reducedInstances = 0;
+};
+
+// Picks the LOD level of every visible instance by how much of the
+// screen height its bounding sphere covers, see MeshDescriptor::lods.
+//
+// The meshes of the levels live behind the meshes registered by the game,
+// the levels of every descriptor in descriptor order, backends create them that way.
+// So level 1 of the first mesh with LODs is mesh meshDescriptors.size().
+//
+// For the hysteresis the level of every instance is remembered per view and
+// ObjectRenderData, by its index in worldMatrices. Games which submit their
+// instances in the same order every frame, as immediate mode submissions do,
+// get stable levels. When the instance count of an ObjectRenderData changes,
+// its instances start over without hysteresis.
+class LodSelector
+{
+    public:
+        static constexpr uint32_t maxLevels = 8;
+
+        void initialize(const RenderInitData& initData);
+
+        bool hasLods(MeshHandle mesh) const { return mesh.index < chains.size() && chains[mesh.index].levels > 1; }
+        // Level 0 is the mesh itself.
+        MeshHandle lodMesh(MeshHandle mesh, uint32_t level) const;
+
+        // Reserves room for maxInstances regrouped instances,
+        // so the ranges handed out by select() stay valid until the next beginFrame().
+        void beginFrame(size_t maxInstances);
+        void beginView(uint32_t view, const DirectX::SimpleMath::Matrix& viewMatrix,
+                        const DirectX::SimpleMath::Matrix& projectionMatrix);
+
+        // Splits the visible instances of ObjectRenderData object of the current view
+        // into one range per level, finest first. instanceIndices are the indices of the
+        // visible instances in its worldMatrices, empty if all of them are visible,
+        // they must stay valid until the next beginFrame(). The ranges are valid until the next select().
+        std::span<const LodRange> select(MeshHandle mesh, uint32_t object, uint32_t instanceCount,
+                                         std::span<const DirectX::SimpleMath::Matrix> visible,
+                                         std::span<const uint32_t> instanceIndices);
+
+        const LodStats& viewStats(uint32_t view) const { return stats[view]; }
+
+    private:
+        struct LodChain
+        {
+            uint32_t firstLodMesh = 0;
+            uint32_t levels = 1;
+            float hysteresis = 0;
+            BoundingSphere bounds;
+            // Threshold of every level, screenSizes[0] is unused.
+            float screenSizes[maxLevels] = {};
+        };
+
+        static constexpr uint8_t unknownLevel = 0xFF;
+
+        std::vector<LodChain> chains;
+
+        uint32_t currentView = 0;
+        DirectX::SimpleMath::Matrix viewMatrix;
+        DirectX::SimpleMath::Matrix projectionMatrix;
+        LodStats stats[FrustumCuller::maxViews];
+
+        // Level of every instance in the last frame, per view and ObjectRenderData.
+        std::vector<std::vector<uint8_t>> previousLevels[FrustumCuller::maxViews];
+
+        std::vector<uint8_t> levels;
+        std::vector<DirectX::SimpleMath::Matrix> lodMatrices;
+        std::vector<uint32_t> lodIndices;
+        std::vector<LodRange> ranges;
+};
@@ -0,0 +1,248 @@
+#include "occlusion_culler.h"
+#include "simd_util.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace DirectX::SimpleMath;
+
+static_assert(OcclusionCuller::width % 4 == 0, "rows are rasterized four pixels at a time");
+static_assert(OcclusionCuller::width % OcclusionCuller::tileSize == 0 &&
+              OcclusionCuller::height % OcclusionCuller::tileSize == 0, "the buffer must consist of whole tiles");
+
+BoundingBox computeBoundingBox(const Geometry& geometry)
+{
+    if (geometry.positions.empty()) return {};
+
+    BoundingBox box = {geometry.positions[0], geometry.positions[0], true};
+    for (auto& p : geometry.positions) {
+        box.minimum = Vector3::Min(box.minimum, p);
+        box.maximum = Vector3::Max(box.maximum, p);
+    }
+    return box;
+}
+
+// Row vector times matrix, with w = 1.
+static Vector4 toClip(const Vector3& p, const Matrix& m)
+{
+    return Vector4(p.x * m._11 + p.y * m._21 + p.z * m._31 + m._41,
+                   p.x * m._12 + p.y * m._22 + p.z * m._32 + m._42,
+                   p.x * m._13 + p.y * m._23 + p.z * m._33 + m._43,
+                   p.x * m._14 + p.y * m._24 + p.z * m._34 + m._44);
+}
+
+void OcclusionCuller::initialize(const RenderInitData& initData)
+{
+    meshOccluders.clear();
+    occluderMeshes.clear();
+    meshBoxes.clear();
+    for (auto& md : initData.meshDescriptors) {
+        meshBoxes.push_back(computeBoundingBox(md.geometry));
+        if (!md.occluder) {
+            meshOccluders.push_back(-1);
+            continue;
+        }
+
+        // Descriptors which did not go through addMesh(), or have no box inside, occlude as they are.
+        auto& geometry = md.occluderGeometry.indices.empty() ? md.geometry : md.occluderGeometry;
+        meshOccluders.push_back(occluderMeshes.size());
+        occluderMeshes.push_back({geometry.positions, geometry.indices});
+    }
+
+    depth.assign(width * height, 1.0f);
+    tileMaxDepth.assign(tilesX * tilesY, 1.0f);
+    jobSystem = initData.jobSystem;
+}
+
+bool OcclusionCuller::isOccluder(MeshHandle mesh) const
+{
+    return mesh.index < meshOccluders.size() && meshOccluders[mesh.index] >= 0;
+}
+
+void OcclusionCuller::beginView(const Matrix& viewMatrix, const Matrix& projectionMatrix)
+{
+    viewProjection = viewMatrix * projectionMatrix;
+    triangles.clear();
+    empty = true;
+}
+
+void OcclusionCuller::addOccluders(MeshHandle mesh, std::span<const Matrix> worldMatrices)
+{
+    assert(isOccluder(mesh));
+    auto& occluder = occluderMeshes[meshOccluders[mesh.index]];
+
+    for (auto& world : worldMatrices) {
+        auto m = world * viewProjection;
+        for (size_t i = 0; i + 2 < occluder.indices.size(); i += 3) {
+            ScreenTriangle t;
+            bool usable = true;
+            for (int v = 0; v < 3; v++) {
+                auto clip = toClip(occluder.positions[occluder.indices[i + v]], m);
+                // Reaches behind the near plane, leaving it out is the conservative choice.
+                if (clip.z < 0 || clip.w <= 0) {
+                    usable = false;
+                    break;
+                }
+                t.x[v] = (clip.x / clip.w * 0.5f + 0.5f) * width;
+                t.y[v] = (clip.y / clip.w * 0.5f + 0.5f) * height;
+                t.z[v] = std::min(clip.z / clip.w, 1.0f);
+            }
+            if (!usable) continue;
+
+            // Entirely off screen.
+            if (std::max({t.x[0], t.x[1], t.x[2]}) < 0 || std::min({t.x[0], t.x[1], t.x[2]}) > width ||
+                std::max({t.y[0], t.y[1], t.y[2]}) < 0 || std::min({t.y[0], t.y[1], t.y[2]}) > height) {
+                continue;
+            }
+            triangles.push_back(t);
+        }
+    }
+}
+
+void OcclusionCuller::rasterize()
+{
+    empty = triangles.empty();
+    if (empty) return;
+
+    if (jobSystem) {
+        jobSystem->parallelFor(tilesY, [this](uint32_t band, uint32_t) { rasterizeBand(band); });
+    } else {
+        for (uint32_t band = 0; band < tilesY; band++) {
+            rasterizeBand(band);
+        }
+    }
+}
+
+// Rasterizes all triangles into one row of tiles and updates the farthest depth of those tiles.
+// Each band only touches its own rows, so bands can run in parallel.
+void OcclusionCuller::rasterizeBand(uint32_t band)
+{
+    uint32_t firstRow = band * tileSize;
+    uint32_t lastRow = firstRow + tileSize - 1;
+    std::fill(depth.begin() + firstRow * width, depth.begin() + (lastRow + 1) * width, 1.0f);
+
+    for (auto& t : triangles) {
+        int minX = std::max(0, (int) std::floor(std::min({t.x[0], t.x[1], t.x[2]})));
+        int maxX = std::min((int) width - 1, (int) std::ceil(std::max({t.x[0], t.x[1], t.x[2]})));
+        int minY = std::max((int) firstRow, (int) std::floor(std::min({t.y[0], t.y[1], t.y[2]})));
+        int maxY = std::min((int) lastRow, (int) std::ceil(std::max({t.y[0], t.y[1], t.y[2]})));
+        if (minX > maxX || minY > maxY) continue;
+
+        float dx1 = t.x[1] - t.x[0], dy1 = t.y[1] - t.y[0], dz1 = t.z[1] - t.z[0];
+        float dx2 = t.x[2] - t.x[0], dy2 = t.y[2] - t.y[0], dz2 = t.z[2] - t.z[0];
+        float area = dx1 * dy2 - dx2 * dy1;
+        if (std::abs(area) < 1e-6f) continue;
+
+        // Edge functions e = a * x + b * y + c, positive inside for either winding.
+        // Moved inwards by half a pixel, so they are positive at the pixel centre
+        // only if the whole pixel is inside, like the depth plane below.
+        float sign = area > 0 ? 1.0f : -1.0f;
+        float a[3], b[3], c[3];
+        for (int e = 0; e < 3; e++) {
+            int n = (e + 1) % 3;
+            a[e] = -(t.y[n] - t.y[e]) * sign;
+            b[e] = (t.x[n] - t.x[e]) * sign;
+            c[e] = -(a[e] * t.x[e] + b[e] * t.y[e]) - 0.5f * (std::abs(a[e]) + std::abs(b[e]));
+        }
+
+        // Depth plane, pushed back to the farthest depth inside each pixel.
+        float zA = (dz1 * dy2 - dz2 * dy1) / area;
+        float zB = (dx1 * dz2 - dx2 * dz1) / area;
+        float zC = t.z[0] - zA * t.x[0] - zB * t.y[0] + 0.5f * (std::abs(zA) + std::abs(zB));
+
+        int startX = minX & ~3;
+        for (int y = minY; y <= maxY; y++) {
+            float py = y + 0.5f;
+            float* row = depth.data() + y * width;
+            float rowE0 = b[0] * py + c[0];
+            float rowE1 = b[1] * py + c[1];
+            float rowE2 = b[2] * py + c[2];
+            float rowZ = zB * py + zC;
+#if defined(ENGINE_SSE2)
+            const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 one = _mm_set1_ps(1.0f);
+            for (int x = startX; x <= maxX; x += 4) {
+                auto px = _mm_add_ps(_mm_set1_ps((float) x), offsets);
+                auto e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[0]), px), _mm_set1_ps(rowE0));
+                auto e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[1]), px), _mm_set1_ps(rowE1));
+                auto e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[2]), px), _mm_set1_ps(rowE2));
+                auto inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+                if (_mm_movemask_ps(inside) == 0) continue;
+
+                auto z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(zA), px), _mm_set1_ps(rowZ));
+                z = _mm_min_ps(_mm_max_ps(z, zero), one);
+                auto old = _mm_loadu_ps(row + x);
+                auto closer = _mm_min_ps(old, z);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, closer), _mm_andnot_ps(inside, old)));
+            }
+#else
+            for (int x = startX; x <= maxX; x++) {
+                float px = x + 0.5f;
+                if (a[0] * px + rowE0 < 0 || a[1] * px + rowE1 < 0 || a[2] * px + rowE2 < 0) continue;
+                float z = std::clamp(zA * px + rowZ, 0.0f, 1.0f);
+                row[x] = std::min(row[x], z);
+            }
+#endif
+        }
+    }
+
+    for (uint32_t tx = 0; tx < tilesX; tx++) {
+        float farthest = 0;
+        for (uint32_t y = firstRow; y <= lastRow; y++) {
+            auto row = depth.data() + y * width + tx * tileSize;
+            farthest = std::max(farthest, *std::max_element(row, row + tileSize));
+        }
+        tileMaxDepth[band * tilesX + tx] = farthest;
+    }
+}
+
+bool OcclusionCuller::isVisible(const BoundingBox& box, const Matrix& world) const
+{
+    auto m = world * viewProjection;
+    float minX = 1, maxX = -1, minY = 1, maxY = -1;
+    float nearest = 1;
+    for (int corner = 0; corner < 8; corner++) {
+        Vector3 p((corner & 1) ? box.maximum.x : box.minimum.x,
+                  (corner & 2) ? box.maximum.y : box.minimum.y,
+                  (corner & 4) ? box.maximum.z : box.minimum.z);
+        auto clip = toClip(p, m);
+        // Crosses the near plane, can't be behind anything.
+        if (clip.z < 0 || clip.w <= 0) return true;
+        float x = clip.x / clip.w;
+        float y = clip.y / clip.w;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        nearest = std::min(nearest, clip.z / clip.w);
+    }
+
+    auto tile = [](float ndc, uint32_t pixels, uint32_t tiles) {
+        int t = (int) std::floor((ndc * 0.5f + 0.5f) * pixels / tileSize);
+        return std::clamp(t, 0, (int) tiles - 1);
+    };
+    int tx0 = tile(minX, width, tilesX), tx1 = tile(maxX, width, tilesX);
+    int ty0 = tile(minY, height, tilesY), ty1 = tile(maxY, height, tilesY);
+    for (int ty = ty0; ty <= ty1; ty++) {
+        for (int tx = tx0; tx <= tx1; tx++) {
+            if (nearest <= tileMaxDepth[ty * tilesX + tx]) return true;
+        }
+    }
+    return false;
+}
+
+uint32_t OcclusionCuller::testInstances(MeshHandle mesh, std::span<const Matrix> worldMatrices,
+                                        uint32_t* indices, uint32_t count) const
+{
+    if (empty || isOccluder(mesh) || mesh.index >= meshBoxes.size() || !meshBoxes[mesh.index].valid) return count;
+
+    auto& box = meshBoxes[mesh.index];
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (isVisible(box, worldMatrices[indices[i]])) {
+            indices[kept++] = indices[i];
+        }
+    }
+    return kept;
+}
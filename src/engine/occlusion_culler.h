@@ -0,0 +1,98 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "renderer.h"
+#include "job_system.h"
+
+// Object space bounding box of a mesh.
+struct BoundingBox
+{
+    DirectX::SimpleMath::Vector3 minimum;
+    DirectX::SimpleMath::Vector3 maximum;
+    bool valid = false;
+};
+
+BoundingBox computeBoundingBox(const Geometry& geometry);
+
+// Software occlusion culling on the CPU, no GPU involved.
+//
+// The occluder meshes (MeshDescriptor::occluder) of a view are rasterized into
+// a small depth buffer, depth as z / w in [0, 1] like D3D. The buffer has a second,
+// coarse level with the farthest depth of every tile. Instances are tested by
+// projecting the corners of their bounding box: when the nearest corner is behind
+// the farthest occluder depth of every tile the box touches, nothing of it can be seen.
+//
+// Occluders are drawn conservatively: a triangle only writes the pixels it covers
+// completely, each with the farthest depth it has inside the pixel, and triangles
+// which reach behind the near plane are skipped. Occluders must lie inside the mesh
+// they stand for, like the box RenderInitData::addMesh() generates. Without
+// a MeshDescriptor::occluderGeometry the mesh itself is drawn.
+//
+// The buffer is split into bands of tile rows, which the threads of a JobSystem
+// rasterize side by side, each band on its own. The inner loop covers four pixels
+// at a time with SSE when the build targets it.
+class OcclusionCuller
+{
+    public:
+        static constexpr uint32_t width = 256;
+        static constexpr uint32_t height = 128;
+        static constexpr uint32_t tileSize = 8;
+        static constexpr uint32_t tilesX = width / tileSize;
+        static constexpr uint32_t tilesY = height / tileSize;
+
+        // Rasterizes on the threads of RenderInitData::jobSystem if there is one.
+        void initialize(const RenderInitData& initData);
+
+        bool hasOccluders() const { return !occluderMeshes.empty(); }
+        bool isOccluder(MeshHandle mesh) const;
+
+        // Starts a view with an empty depth buffer.
+        void beginView(const DirectX::SimpleMath::Matrix& viewMatrix, const DirectX::SimpleMath::Matrix& projectionMatrix);
+        void addOccluders(MeshHandle mesh, std::span<const DirectX::SimpleMath::Matrix> worldMatrices);
+        // Rasterizes the occluders added since beginView().
+        void rasterize();
+
+        // Keeps the indices of the instances which may be visible,
+        // indices refer to worldMatrices. Returns how many are kept.
+        // Occluders and meshes without bounds are always kept.
+        uint32_t testInstances(MeshHandle mesh, std::span<const DirectX::SimpleMath::Matrix> worldMatrices,
+                                uint32_t* indices, uint32_t count) const;
+
+        // Triangles rasterized for the current view.
+        uint32_t occluderTriangles() const { return static_cast<uint32_t>(triangles.size()); }
+
+        const float* depthBuffer() const { return depth.data(); }
+        const float* tileDepths() const { return tileMaxDepth.data(); }
+
+    private:
+        // A triangle in pixel coordinates, y up, and its depth.
+        struct ScreenTriangle
+        {
+            float x[3];
+            float y[3];
+            float z[3];
+        };
+
+        struct OccluderMesh
+        {
+            std::vector<DirectX::SimpleMath::Vector3> positions;
+            std::vector<uint32_t> indices;
+        };
+
+        bool isVisible(const BoundingBox& box, const DirectX::SimpleMath::Matrix& world) const;
+        void rasterizeBand(uint32_t band);
+
+        // Occluder of every mesh, -1 for the others.
+        std::vector<int32_t> meshOccluders;
+        std::vector<OccluderMesh> occluderMeshes;
+        std::vector<BoundingBox> meshBoxes;
+
+        DirectX::SimpleMath::Matrix viewProjection;
+        std::vector<ScreenTriangle> triangles;
+        std::vector<float> depth;
+        std::vector<float> tileMaxDepth;
+        bool empty = true;
+
+        JobSystem* jobSystem = nullptr;
+};
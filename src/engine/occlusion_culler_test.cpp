@@ -0,0 +1,160 @@
+#include "engine_tests.h"
+#include "occlusion_culler.h"
+#include <algorithm>
+
+using namespace DirectX::SimpleMath;
+
+// Appends a closed box.
+static void addBox(Geometry& geometry, Vector3 minimum, Vector3 maximum)
+{
+    uint32_t base = geometry.positions.size();
+    for (int corner = 0; corner < 8; corner++) {
+        geometry.positions.emplace_back((corner & 1) ? maximum.x : minimum.x, (corner & 2) ? maximum.y : minimum.y,
+                                        (corner & 4) ? maximum.z : minimum.z);
+    }
+    for (uint32_t index : {0, 2, 3, 0, 3, 1, 4, 5, 7, 4, 7, 6, 0, 4, 6, 0, 6, 2,
+                           1, 3, 7, 1, 7, 5, 0, 1, 5, 0, 5, 4, 2, 6, 7, 2, 7, 3}) {
+        geometry.indices.push_back(base + index);
+    }
+}
+
+// Appends a closed roof, a prism along z with its ridge at the top.
+static void addRoof(Geometry& geometry, Vector3 minimum, Vector3 maximum)
+{
+    uint32_t base = geometry.positions.size();
+    float ridge = (minimum.x + maximum.x) * 0.5f;
+    for (float z : {minimum.z, maximum.z}) {
+        geometry.positions.emplace_back(minimum.x, minimum.y, z);
+        geometry.positions.emplace_back(maximum.x, minimum.y, z);
+        geometry.positions.emplace_back(ridge, maximum.y, z);
+    }
+    for (uint32_t index : {0, 1, 2, 3, 5, 4, 0, 3, 4, 0, 4, 1, 0, 2, 5, 0, 5, 3, 1, 4, 5, 1, 5, 2}) {
+        geometry.indices.push_back(base + index);
+    }
+}
+
+// A house like the ones of the game: a body with a roof on top, closed but not convex.
+static Geometry houseGeometry()
+{
+    Geometry geometry;
+    addBox(geometry, {-2, 0, -3}, {2, 3, 3});
+    addRoof(geometry, {-2.5f, 3, -3.5f}, {2.5f, 5, 3.5f});
+    return geometry;
+}
+
+// Pixel coordinates and depth of a point, like OcclusionCuller::addOccluders().
+static Vector3 toScreen(const Vector3& p, const Matrix& viewProjection)
+{
+    auto& m = viewProjection;
+    float x = p.x * m._11 + p.y * m._21 + p.z * m._31 + m._41;
+    float y = p.x * m._12 + p.y * m._22 + p.z * m._32 + m._42;
+    float z = p.x * m._13 + p.y * m._23 + p.z * m._33 + m._43;
+    float w = p.x * m._14 + p.y * m._24 + p.z * m._34 + m._44;
+    return {(x / w * 0.5f + 0.5f) * OcclusionCuller::width, (y / w * 0.5f + 0.5f) * OcclusionCuller::height, z / w};
+}
+
+// Nearest depth of the mesh at the centre of the pixel, 1 where it covers nothing.
+static float meshDepth(const Geometry& geometry, const Matrix& viewProjection, float px, float py)
+{
+    float nearest = 1;
+    for (size_t i = 0; i + 2 < geometry.indices.size(); i += 3) {
+        auto a = toScreen(geometry.positions[geometry.indices[i]], viewProjection);
+        auto b = toScreen(geometry.positions[geometry.indices[i + 1]], viewProjection);
+        auto c = toScreen(geometry.positions[geometry.indices[i + 2]], viewProjection);
+        float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+        if (area == 0) continue;
+        float wa = ((b.x - px) * (c.y - py) - (c.x - px) * (b.y - py)) / area;
+        float wb = ((c.x - px) * (a.y - py) - (a.x - px) * (c.y - py)) / area;
+        float wc = 1 - wa - wb;
+        if (wa < 0 || wb < 0 || wc < 0) continue;
+        nearest = std::min(nearest, wa * a.z + wb * b.z + wc * c.z);
+    }
+    return nearest;
+}
+
+// Rasterizes the occluder of the mesh from around it and counts the pixels it covers,
+// and the ones among them the mesh does not cover, or covers only behind the occluder.
+static void rasterizeAround(const MeshDescriptor& descriptor, uint32_t& covered, uint32_t& outside)
+{
+    RenderInitData initData;
+    auto mesh = initData.addMesh(descriptor);
+    auto& geometry = initData.meshDescriptors[mesh.index].geometry;
+    OcclusionCuller culler;
+    culler.initialize(initData);
+
+    covered = 0;
+    outside = 0;
+    auto projection = Matrix(DirectX::XMMatrixPerspectiveFovLH(0.8f, 2.0f, 0.1f, 100));
+    Vector3 eyes[] = {{0, 30, -15}, {12, 4, -9}, {-10, 2, 6}, {0, 25, 0.5f}, {7, 9, 11}, {-14, 1, -1}};
+    for (auto& eye : eyes) {
+        auto view = Matrix(DirectX::XMMatrixLookAtLH({eye.x, eye.y, eye.z}, {0, 2, 0}, {0, 1, 0}));
+        culler.beginView(view, projection);
+        Matrix world;
+        culler.addOccluders(mesh, {&world, 1});
+        culler.rasterize();
+
+        auto depth = culler.depthBuffer();
+        for (uint32_t y = 0; y < OcclusionCuller::height; y++) {
+            for (uint32_t x = 0; x < OcclusionCuller::width; x++) {
+                float occluder = depth[y * OcclusionCuller::width + x];
+                if (occluder >= 1) continue;
+                covered++;
+                if (meshDepth(geometry, view * projection, x + 0.5f, y + 0.5f) > occluder) outside++;
+            }
+        }
+    }
+}
+
+// addMesh() gives occluders a box which lies inside the mesh.
+static void testOccluderBox()
+{
+    auto house = houseGeometry();
+    auto box = GeometryFactory::occluderBox(house, 8);
+    CHECK(box.positions.size() == 8);
+    CHECK(box.indices.size() == 36);
+    auto bounds = computeBoundingBox(box);
+    CHECK(bounds.minimum.x >= -2 && bounds.maximum.x <= 2);
+    CHECK(bounds.minimum.y >= 0 && bounds.maximum.y <= 5);
+    CHECK(bounds.minimum.z >= -3 && bounds.maximum.z <= 3);
+    // Still a good part of the body.
+    CHECK(bounds.maximum.x - bounds.minimum.x >= 2);
+    CHECK(bounds.maximum.z - bounds.minimum.z >= 3);
+
+    RenderInitData initData;
+    MeshDescriptor descriptor = {"house", house};
+    descriptor.occluder = true;
+    auto mesh = initData.addMesh(descriptor);
+    CHECK(initData.meshDescriptors[mesh.index].occluderGeometry.indices.size() == 36);
+
+    // Flat or open meshes, like a house without a floor, have nothing inside.
+    // They occlude with their geometry.
+    CHECK(GeometryFactory::occluderBox(GeometryFactory::getQuadGeometry(), 8).indices.empty());
+    Geometry open;
+    addBox(open, {-2, 0, -3}, {2, 3, 3});
+    open.indices.erase(open.indices.begin() + 24, open.indices.begin() + 30);
+    CHECK(GeometryFactory::occluderBox(open, 8).indices.empty());
+}
+
+// From any direction, the generated occluder covers only pixels
+// the mesh covers, and lies behind it there.
+static void testOccluderInsideMesh()
+{
+    MeshDescriptor descriptor = {"house", houseGeometry()};
+    descriptor.occluder = true;
+    uint32_t covered, outside;
+    rasterizeAround(descriptor, covered, outside);
+    CHECK(covered > 1000);
+    CHECK(outside == 0);
+
+    // An occluder sticking out of the mesh is caught.
+    descriptor.occluderGeometry = {};
+    addBox(descriptor.occluderGeometry, {-2.5f, 0, -3}, {2, 3, 3});
+    rasterizeAround(descriptor, covered, outside);
+    CHECK(outside > 0);
+}
+
+void testOcclusionCuller()
+{
+    testOccluderBox();
+    testOccluderInsideMesh();
+}
@@ -0,0 +1,198 @@
+#include "overlay_batcher.h"
+#include "sprite_batcher.h"
+#include "simd_util.h"
+#include <algorithm>
+#include <bit>
+
+using namespace DirectX::SimpleMath;
+
+// Positions closer to the camera plane than this are behind it.
+static constexpr float minW = 1e-4f;
+
+// Per channel from a (at 0) to b (at 256).
+static uint32_t lerpColor(uint32_t a, uint32_t b, uint32_t t)
+{
+    uint32_t result = 0;
+    for (uint32_t shift = 0; shift < 32; shift += 8) {
+        uint32_t ca = (a >> shift) & 0xFF;
+        uint32_t cb = (b >> shift) & 0xFF;
+        result |= ((ca * (256 - t) + cb * t) >> 8) << shift;
+    }
+    return result;
+}
+
+void OverlayBatcher::setStyle(OverlayType type, const OverlayStyle& style)
+{
+    styles[(uint32_t) type] = style;
+}
+
+void OverlayBatcher::beginFrame(const ViewSubmission& view3D, float screenWidth, float screenHeight)
+{
+    viewProjection = view3D.viewMatrix * view3D.projectionMatrix;
+    width = screenWidth;
+    height = screenHeight;
+    for (auto& typeRecords : records) typeRecords.clear();
+    culled = 0;
+}
+
+void OverlayBatcher::project(OverlayType type, const float* x, const float* y, const float* z, uint32_t count)
+{
+    auto& style = styles[(uint32_t) type];
+    auto& m = viewProjection;
+    // The world offset is the same for all, it goes into the translation.
+    auto& o = style.worldOffset;
+    float tx = o.x * m._11 + o.y * m._21 + o.z * m._31 + m._41;
+    float ty = o.x * m._12 + o.y * m._22 + o.z * m._32 + m._42;
+    float tw = o.x * m._14 + o.y * m._24 + o.z * m._34 + m._44;
+
+    // ndc to pixels, y up like the 2D view.
+    float scaleX = width * 0.5f;
+    float scaleY = height * 0.5f;
+    float offsetX = scaleX + style.screenOffset.x;
+    float offsetY = scaleY + style.screenOffset.y;
+    // Dropped once nothing of the sprite is on screen.
+    float marginX = style.size.x * 0.5f;
+    float marginY = style.size.y * 0.5f;
+
+    visible.resize(count);
+    screenX.resize(count);
+    screenY.resize(count);
+    uint32_t kept = 0;
+    uint32_t i = 0;
+
+#if defined(ENGINE_SSE2)
+    __m128 m11 = _mm_set1_ps(m._11), m21 = _mm_set1_ps(m._21), m31 = _mm_set1_ps(m._31), tx4 = _mm_set1_ps(tx);
+    __m128 m12 = _mm_set1_ps(m._12), m22 = _mm_set1_ps(m._22), m32 = _mm_set1_ps(m._32), ty4 = _mm_set1_ps(ty);
+    __m128 m14 = _mm_set1_ps(m._14), m24 = _mm_set1_ps(m._24), m34 = _mm_set1_ps(m._34), tw4 = _mm_set1_ps(tw);
+    __m128 scaleX4 = _mm_set1_ps(scaleX), scaleY4 = _mm_set1_ps(scaleY);
+    __m128 offsetX4 = _mm_set1_ps(offsetX), offsetY4 = _mm_set1_ps(offsetY);
+    __m128 minX4 = _mm_set1_ps(-marginX), maxX4 = _mm_set1_ps(width + marginX);
+    __m128 minY4 = _mm_set1_ps(-marginY), maxY4 = _mm_set1_ps(height + marginY);
+    __m128 minW4 = _mm_set1_ps(minW);
+    for (; i + 4 <= count; i += 4) {
+        __m128 px = _mm_loadu_ps(x + i);
+        __m128 py = _mm_loadu_ps(y + i);
+        __m128 pz = _mm_loadu_ps(z + i);
+        __m128 cx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, m11), _mm_mul_ps(py, m21)), _mm_add_ps(_mm_mul_ps(pz, m31), tx4));
+        __m128 cy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, m12), _mm_mul_ps(py, m22)), _mm_add_ps(_mm_mul_ps(pz, m32), ty4));
+        __m128 cw = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, m14), _mm_mul_ps(py, m24)), _mm_add_ps(_mm_mul_ps(pz, m34), tw4));
+
+        // Lanes behind the camera divide by a safe w, their mask is cleared below.
+        __m128 front = _mm_cmpgt_ps(cw, minW4);
+        __m128 inverseW = _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(cw, minW4));
+        __m128 sx = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(cx, inverseW), scaleX4), offsetX4);
+        __m128 sy = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(cy, inverseW), scaleY4), offsetY4);
+
+        __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(sx, minX4), _mm_cmple_ps(sx, maxX4)),
+                                   _mm_and_ps(_mm_cmpge_ps(sy, minY4), _mm_cmple_ps(sy, maxY4)));
+        int mask = _mm_movemask_ps(_mm_and_ps(front, inside));
+        if (mask == 0) continue;
+
+        alignas(16) float lanesX[4];
+        alignas(16) float lanesY[4];
+        _mm_store_ps(lanesX, sx);
+        _mm_store_ps(lanesY, sy);
+        while (mask) {
+            int lane = std::countr_zero((uint32_t) mask);
+            visible[kept] = i + lane;
+            screenX[kept] = lanesX[lane];
+            screenY[kept] = lanesY[lane];
+            kept++;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        float cw = x[i] * m._14 + y[i] * m._24 + z[i] * m._34 + tw;
+        if (cw <= minW) continue;
+        float cx = x[i] * m._11 + y[i] * m._21 + z[i] * m._31 + tx;
+        float cy = x[i] * m._12 + y[i] * m._22 + z[i] * m._32 + ty;
+        float sx = cx / cw * scaleX + offsetX;
+        float sy = cy / cw * scaleY + offsetY;
+        if (sx < -marginX || sx > width + marginX || sy < -marginY || sy > height + marginY) continue;
+        visible[kept] = i;
+        screenX[kept] = sx;
+        screenY[kept] = sy;
+        kept++;
+    }
+
+    visible.resize(kept);
+    screenX.resize(kept);
+    screenY.resize(kept);
+    culled += count - kept;
+}
+
+void OverlayBatcher::appendVisible(OverlayType type)
+{
+    auto& style = styles[(uint32_t) type];
+    auto& out = records[(uint32_t) type];
+    uint32_t uvMin = packUnorm16x2(style.uvRect.x, style.uvRect.y);
+    uint32_t uvMax = packUnorm16x2(style.uvRect.z, style.uvRect.w);
+    for (uint32_t v = 0; v < visible.size(); v++) {
+        out.push_back({Vector2(screenX[v], screenY[v]), style.size, uvMin, uvMax, style.color, style.layer});
+    }
+}
+
+void OverlayBatcher::addUnits(const OverlayUnits& units)
+{
+    if (units.health) {
+        auto& style = styles[(uint32_t) OverlayType::HealthBar];
+        project(OverlayType::HealthBar, units.x, units.y, units.z, units.count);
+        auto& out = records[(uint32_t) OverlayType::HealthBar];
+        uint32_t uvMin = packUnorm16x2(style.uvRect.x, style.uvRect.y);
+        uint32_t uvMax = packUnorm16x2(style.uvRect.z, style.uvRect.w);
+        for (uint32_t v = 0; v < visible.size(); v++) {
+            float health = std::clamp(units.health[visible[v]], 0.0f, 1.0f);
+            // Left aligned, the bar gets shorter from the right.
+            float barWidth = style.size.x * health;
+            auto& record = out.emplace_back();
+            record.position = Vector2(screenX[v] - (style.size.x - barWidth) * 0.5f, screenY[v]);
+            record.size = Vector2(barWidth, style.size.y);
+            record.uvMin = uvMin;
+            record.uvMax = uvMax;
+            record.color = lerpColor(style.emptyColor, style.color, (uint32_t) (health * 256));
+            record.layer = style.layer;
+        }
+    }
+
+    if (units.selected) {
+        gatherX.clear();
+        gatherY.clear();
+        gatherZ.clear();
+        for (uint32_t i = 0; i < units.count; i++) {
+            if (!units.selected[i]) continue;
+            gatherX.push_back(units.x[i]);
+            gatherY.push_back(units.y[i]);
+            gatherZ.push_back(units.z[i]);
+        }
+        project(OverlayType::SelectionRing, gatherX.data(), gatherY.data(), gatherZ.data(), gatherX.size());
+        appendVisible(OverlayType::SelectionRing);
+    }
+}
+
+void OverlayBatcher::addRallyMarkers(std::span<const Vector3> positions)
+{
+    gatherX.clear();
+    gatherY.clear();
+    gatherZ.clear();
+    for (auto& p : positions) {
+        gatherX.push_back(p.x);
+        gatherY.push_back(p.y);
+        gatherZ.push_back(p.z);
+    }
+    project(OverlayType::RallyMarker, gatherX.data(), gatherY.data(), gatherZ.data(), gatherX.size());
+    appendVisible(OverlayType::RallyMarker);
+}
+
+void OverlayBatcher::writeSprites(ViewSubmission& view2D) const
+{
+    size_t total = view2D.sprites.size();
+    for (auto& typeRecords : records) total += typeRecords.size();
+    view2D.sprites.reserve(total);
+
+    for (uint32_t t = 0; t < overlayTypeCount; t++) {
+        for (auto& record : records[t]) {
+            view2D.sprites.push_back({record, styles[t].texture});
+        }
+    }
+}
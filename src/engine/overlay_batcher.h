@@ -0,0 +1,101 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "renderer.h"
+
+enum class OverlayType : uint8_t
+{
+    HealthBar,
+    SelectionRing,
+    RallyMarker,
+};
+
+constexpr uint32_t overlayTypeCount = 3;
+
+// How the overlays of one type look on screen.
+struct OverlayStyle
+{
+    TextureHandle texture;
+    // (u0, v0, u1, v1) on the atlas page.
+    DirectX::SimpleMath::Vector4 uvRect = {0, 0, 1, 1};
+    // In pixels, health bars shrink to the left with the health.
+    DirectX::SimpleMath::Vector2 size = {32, 4};
+    // Added to the world position before it is projected, e.g. to put the bars above the heads.
+    DirectX::SimpleMath::Vector3 worldOffset;
+    // In pixels, added after the projection.
+    DirectX::SimpleMath::Vector2 screenOffset;
+    // Layer of the sprites, lower is in front. Types on neighbouring layers with
+    // the same texture share their draw.
+    float layer = 5;
+    // RGBA8, red in the low byte. Health bars go from emptyColor to color with the health.
+    uint32_t color = 0xFF40D040;
+    uint32_t emptyColor = 0xFF2020E0;
+};
+
+// The units which get overlays, one array per component, count elements each.
+struct OverlayUnits
+{
+    const float* x = nullptr;
+    const float* y = nullptr;
+    const float* z = nullptr;
+    // Health in [0, 1], nullptr for no health bars.
+    const float* health = nullptr;
+    // Non zero for the selected units, which get a selection ring. nullptr if none is selected.
+    const uint8_t* selected = nullptr;
+    uint32_t count = 0;
+};
+
+// Turns world space overlays of units, like health bars, selection rings and
+// rally markers, into sprites of a 2D view.
+//
+// The positions are projected with the camera of the 3D view, four at a time with
+// SSE when the build targets it, and overlays which end up off screen or behind the
+// camera are dropped. Each overlay is a 32 byte SpriteRecord and every overlay type
+// costs at most one instanced sprite draw when it has its own layer, see sprite_batcher.h.
+// The 2D view is expected to map pixels with y up, like an orthographic
+// projection from (0, 0) to (screenWidth, screenHeight).
+class OverlayBatcher
+{
+    public:
+        void setStyle(OverlayType type, const OverlayStyle& style);
+
+        // Starts a frame with the camera of view3D.
+        void beginFrame(const ViewSubmission& view3D, float screenWidth, float screenHeight);
+
+        void addUnits(const OverlayUnits& units);
+        void addRallyMarkers(std::span<const DirectX::SimpleMath::Vector3> positions);
+
+        // Appends the overlays of the frame to the sprites of view2D, grouped by type.
+        void writeSprites(ViewSubmission& view2D) const;
+
+        // Overlays of the frame which were on screen, of a type.
+        uint32_t visibleCount(OverlayType type) const { return static_cast<uint32_t>(records[(uint32_t) type].size()); }
+        // Overlays of the frame dropped as off screen.
+        uint32_t culledCount() const { return culled; }
+
+    private:
+        // Projects count positions with the style of type and keeps the visible ones
+        // in visible, screenX and screenY.
+        void project(OverlayType type, const float* x, const float* y, const float* z, uint32_t count);
+        // A sprite of the style of type for every position project() kept.
+        void appendVisible(OverlayType type);
+
+        OverlayStyle styles[overlayTypeCount];
+        DirectX::SimpleMath::Matrix viewProjection;
+        float width = 0;
+        float height = 0;
+
+        // Results of project().
+        std::vector<uint32_t> visible;
+        std::vector<float> screenX;
+        std::vector<float> screenY;
+
+        // Positions of the selected units and the rally markers, gathered for project().
+        std::vector<float> gatherX;
+        std::vector<float> gatherY;
+        std::vector<float> gatherZ;
+
+        std::vector<SpriteRecord> records[overlayTypeCount];
+        uint32_t culled = 0;
+};
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "frame_arena.h"
+#include "overlay_batcher.h"
+#include "sprite_batcher.h"
+
+using namespace DirectX::SimpleMath;
+
+// Measures the OverlayBatcher on the CPU: health bars of all units, rings of the
+// selected ones and a few rally markers, projected with the game's camera and
+// batched into sprite draws by the SpriteBatcher.
+// Usage: overlay_bench [units=<n>] [frames=<n>]
+int main(int argc, char ** args) {
+
+    uint32_t numUnits = 10000;
+    uint32_t numFrames = 1000;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(args[i], "units=", 6) == 0) {
+            numUnits = atoi(args[i] + 6);
+        } else if (strncmp(args[i], "frames=", 7) == 0) {
+            numFrames = std::max(1, atoi(args[i] + 7));
+        }
+    }
+
+    constexpr float screenWidth = 1920;
+    constexpr float screenHeight = 1080;
+
+    // A square army around the origin, some of it off screen.
+    std::vector<float> x(numUnits), y(numUnits), z(numUnits), health(numUnits);
+    std::vector<uint8_t> selected(numUnits);
+    uint32_t side = std::max<uint32_t>(1, (uint32_t) std::sqrt((float) numUnits));
+    for (uint32_t i = 0; i < numUnits; i++) {
+        x[i] = -60 + 120.0f * (i % side) / side;
+        y[i] = 0;
+        z[i] = -40 + 100.0f * (i / side) / side;
+        health[i] = (i * 37 % 100) / 100.0f;
+        selected[i] = i % 10 == 0;
+    }
+    std::vector<Vector3> rallyPoints;
+    for (int i = 0; i < 16; i++) rallyPoints.push_back(Vector3(-30.0f + i * 4, 0, 10));
+
+    OverlayBatcher overlays;
+    OverlayStyle bar;
+    bar.texture = {0};
+    bar.worldOffset = Vector3(0, 2.5f, 0);
+    bar.layer = 3;
+    overlays.setStyle(OverlayType::HealthBar, bar);
+    OverlayStyle ring;
+    ring.texture = {0};
+    ring.size = Vector2(24, 12);
+    ring.layer = 4;
+    overlays.setStyle(OverlayType::SelectionRing, ring);
+    OverlayStyle marker;
+    marker.texture = {1};
+    marker.size = Vector2(16, 16);
+    overlays.setStyle(OverlayType::RallyMarker, marker);
+
+    SpriteBatcher spriteBatcher;
+    auto frameArena = FrameArena();
+    double overlayMs = 0;
+    double batchMs = 0;
+    uint64_t sprites = 0;
+    uint64_t draws = 0;
+    uint64_t culled = 0;
+    for (uint32_t f = 0; f < numFrames; f++) {
+        auto& frameMemory = frameArena.beginFrame();
+        auto frame = frameMemory.create<FrameSubmission>();
+        frame->viewSubmissions.resize(2);
+        auto& view3D = frame->viewSubmissions[0];
+        auto& view2D = frame->viewSubmissions[1];
+        view3D.viewMatrix = Matrix(DirectX::XMMatrixLookAtLH({0, 30, -15}, {0, 0, 0}, {0, 1, 0}));
+        view3D.projectionMatrix = Matrix(DirectX::XMMatrixPerspectiveFovLH(45, screenWidth / screenHeight, 0.1f, 200));
+
+        auto start = std::chrono::steady_clock::now();
+        overlays.beginFrame(view3D, screenWidth, screenHeight);
+        overlays.addUnits({x.data(), y.data(), z.data(), health.data(), selected.data(), numUnits});
+        overlays.addRallyMarkers(rallyPoints);
+        overlays.writeSprites(view2D);
+        auto projected = std::chrono::steady_clock::now();
+        spriteBatcher.build(*frame);
+        auto batched = std::chrono::steady_clock::now();
+
+        overlayMs += std::chrono::duration<double, std::milli>(projected - start).count();
+        batchMs += std::chrono::duration<double, std::milli>(batched - projected).count();
+        sprites += spriteBatcher.spriteCount();
+        draws += spriteBatcher.viewBatches(1).size();
+        culled += overlays.culledCount();
+    }
+
+    std::cout << "units:             " << numUnits << std::endl;
+    std::cout << "overlays/frame:    " << sprites / numFrames << " (" << culled / numFrames << " off screen)" << std::endl;
+    std::cout << "draws/frame:       " << draws / numFrames << std::endl;
+    std::cout << "overlay ms/frame:  " << overlayMs / numFrames << std::endl;
+    std::cout << "batching ms/frame: " << batchMs / numFrames << std::endl;
+
+    return 0;
+}
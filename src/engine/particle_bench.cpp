@@ -0,0 +1,92 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "frame_arena.h"
+#include "job_system.h"
+#include "particle_system.h"
+
+using namespace DirectX::SimpleMath;
+
+// Measures the ParticleSystem on the CPU: update() and writeDraws() of every frame,
+// with all emitters full, as during a large battle.
+// Usage: particle_bench [particles=<n>] [emitters=<n>] [frames=<n>] [threads=<n>]
+// threads=0 updates on the calling thread only.
+int main(int argc, char ** args) {
+
+    uint32_t numParticles = 500000;
+    uint32_t numEmitters = 64;
+    uint32_t numFrames = 200;
+    uint32_t numWorkers = JobSystem::defaultWorkerCount();
+    bool useJobs = true;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(args[i], "particles=", 10) == 0) {
+            numParticles = atoi(args[i] + 10);
+        } else if (strncmp(args[i], "emitters=", 9) == 0) {
+            numEmitters = std::max(1, atoi(args[i] + 9));
+        } else if (strncmp(args[i], "frames=", 7) == 0) {
+            numFrames = std::max(1, atoi(args[i] + 7));
+        } else if (strncmp(args[i], "threads=", 8) == 0) {
+            int threads = atoi(args[i] + 8);
+            useJobs = threads > 0;
+            numWorkers = std::max(threads, 1) - 1;
+        }
+    }
+
+    constexpr float dt = 1.0f / 60.0f;
+    ParticleSystem particles;
+    uint32_t perEmitter = (numParticles + numEmitters - 1) / numEmitters;
+    for (uint32_t e = 0; e < numEmitters; e++) {
+        ParticleEmitterDesc desc;
+        // Four atlas pages, as a few kinds of effects would use.
+        desc.atlas = {e % 4};
+        desc.capacity = perEmitter;
+        desc.lifetime = 2;
+        desc.lifetimeSpread = 0.5f;
+        // Enough to keep the pool full.
+        desc.spawnRate = perEmitter / (desc.lifetime - desc.lifetimeSpread);
+        desc.velocity = {0, 6, 0};
+        desc.velocitySpread = {3, 2, 3};
+        desc.drag = 0.5f;
+        desc.startSize = 0.3f;
+        desc.endSize = 0.1f;
+        desc.color = 0xFF40A0FF;
+        auto emitter = particles.createEmitter(desc, Vector3((float) (e % 8) * 4 - 16, 0, (float) (e / 8) * 4 - 16));
+        particles.emit(emitter, perEmitter);
+    }
+
+    JobSystem jobSystem(numWorkers);
+    auto frameArena = FrameArena(64 * 1024 * 1024);
+    Matrix viewMatrix = Matrix(DirectX::XMMatrixLookAtLH({0, 30, -15}, {0, 0, 0}, {0, 1, 0}));
+    MeshHandle quad = {0};
+    PipelineHandle pipeline = {0};
+
+    double updateMs = 0;
+    double drawMs = 0;
+    uint64_t drawnParticles = 0;
+    uint64_t batches = 0;
+    for (uint32_t i = 0; i < numFrames; i++) {
+        auto& frameMemory = frameArena.beginFrame();
+        auto view = frameMemory.create<ViewSubmission>();
+
+        auto start = std::chrono::steady_clock::now();
+        particles.update(dt, useJobs ? &jobSystem : nullptr);
+        auto updated = std::chrono::steady_clock::now();
+        particles.writeDraws(*view, viewMatrix, quad, pipeline);
+        auto written = std::chrono::steady_clock::now();
+
+        updateMs += std::chrono::duration<double, std::milli>(updated - start).count();
+        drawMs += std::chrono::duration<double, std::milli>(written - updated).count();
+        for (auto& batch : view->objectRenderData) drawnParticles += batch.worldMatrices.size();
+        batches += view->objectRenderData.size();
+    }
+
+    std::cout << "threads:           " << (useJobs ? jobSystem.threadCount() : 1) << std::endl;
+    std::cout << "particles/frame:   " << drawnParticles / numFrames << std::endl;
+    std::cout << "batches/frame:     " << batches / numFrames << std::endl;
+    std::cout << "update ms/frame:   " << updateMs / numFrames << std::endl;
+    std::cout << "draws ms/frame:    " << drawMs / numFrames << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,225 @@
+#include "particle_system.h"
+#include "simd_util.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace DirectX::SimpleMath;
+
+// The sort key holds the atlas, the depth and the pool.
+static constexpr uint32_t atlasBits = 12;
+static constexpr uint32_t poolBits = 20;
+
+// xorshift32, in [-1, 1].
+static float randomSigned(uint32_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return (state >> 8) * (2.0f / 16777216.0f) - 1.0f;
+}
+
+EmitterHandle ParticleSystem::createEmitter(const ParticleEmitterDesc& desc, const Vector3& position)
+{
+    assert(pools.size() < (1u << poolBits));
+    assert(!desc.atlas.isValid() || desc.atlas.index < (1u << atlasBits));
+
+    auto& pool = pools.emplace_back();
+    pool.desc = desc;
+    pool.position = position;
+    pool.random = 0x9E3779B9u * (uint32_t) pools.size();
+
+    uint32_t padded = (desc.capacity + 3) & ~3u;
+    for (auto* component : {&pool.x, &pool.y, &pool.z, &pool.vx, &pool.vy, &pool.vz, &pool.fade, &pool.fadeRate}) {
+        component->resize(padded);
+    }
+    return {(uint32_t) pools.size() - 1};
+}
+
+void ParticleSystem::setPosition(EmitterHandle emitter, const Vector3& position)
+{
+    assert(emitter.index < pools.size());
+    pools[emitter.index].position = position;
+}
+
+void ParticleSystem::emit(EmitterHandle emitter, uint32_t count)
+{
+    assert(emitter.index < pools.size());
+    spawn(pools[emitter.index], count);
+}
+
+void ParticleSystem::spawn(Pool& pool, uint32_t count)
+{
+    auto& desc = pool.desc;
+    count = std::min(count, desc.capacity - pool.alive);
+    for (uint32_t i = pool.alive; i < pool.alive + count; i++) {
+        pool.x[i] = pool.position.x;
+        pool.y[i] = pool.position.y;
+        pool.z[i] = pool.position.z;
+        pool.vx[i] = desc.velocity.x + desc.velocitySpread.x * randomSigned(pool.random);
+        pool.vy[i] = desc.velocity.y + desc.velocitySpread.y * randomSigned(pool.random);
+        pool.vz[i] = desc.velocity.z + desc.velocitySpread.z * randomSigned(pool.random);
+        float lifetime = std::max(0.001f, desc.lifetime + desc.lifetimeSpread * randomSigned(pool.random));
+        pool.fade[i] = 1;
+        pool.fadeRate[i] = 1 / lifetime;
+    }
+    pool.alive += count;
+}
+
+// Runs over whole groups of 4, the padding of the arrays makes room for that.
+// Lanes past the living particles compute garbage which spawn() overwrites.
+void ParticleSystem::integrate(Pool& pool, uint32_t begin, uint32_t end, float dt)
+{
+    float gravityStep = pool.desc.gravity * dt;
+    float damping = std::max(0.0f, 1 - pool.desc.drag * dt);
+
+    float* x = pool.x.data();
+    float* y = pool.y.data();
+    float* z = pool.z.data();
+    float* vx = pool.vx.data();
+    float* vy = pool.vy.data();
+    float* vz = pool.vz.data();
+    float* fade = pool.fade.data();
+    const float* fadeRate = pool.fadeRate.data();
+
+#if defined(ENGINE_SSE2)
+    __m128 dt4 = _mm_set1_ps(dt);
+    __m128 gravity4 = _mm_set1_ps(gravityStep);
+    __m128 damping4 = _mm_set1_ps(damping);
+    for (uint32_t i = begin; i < end; i += 4) {
+        __m128 velX = _mm_mul_ps(_mm_loadu_ps(vx + i), damping4);
+        __m128 velY = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(vy + i), gravity4), damping4);
+        __m128 velZ = _mm_mul_ps(_mm_loadu_ps(vz + i), damping4);
+        _mm_storeu_ps(vx + i, velX);
+        _mm_storeu_ps(vy + i, velY);
+        _mm_storeu_ps(vz + i, velZ);
+        _mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(x + i), _mm_mul_ps(velX, dt4)));
+        _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(velY, dt4)));
+        _mm_storeu_ps(z + i, _mm_add_ps(_mm_loadu_ps(z + i), _mm_mul_ps(velZ, dt4)));
+        _mm_storeu_ps(fade + i, _mm_sub_ps(_mm_loadu_ps(fade + i), _mm_mul_ps(_mm_loadu_ps(fadeRate + i), dt4)));
+    }
+#else
+    for (uint32_t i = begin; i < end; i++) {
+        vx[i] *= damping;
+        vy[i] = (vy[i] + gravityStep) * damping;
+        vz[i] *= damping;
+        x[i] += vx[i] * dt;
+        y[i] += vy[i] * dt;
+        z[i] += vz[i] * dt;
+        fade[i] -= fadeRate[i] * dt;
+    }
+#endif
+}
+
+void ParticleSystem::removeDead(Pool& pool)
+{
+    uint32_t i = 0;
+    while (i < pool.alive) {
+        if (pool.fade[i] > 0) {
+            i++;
+            continue;
+        }
+        uint32_t last = --pool.alive;
+        pool.x[i] = pool.x[last];
+        pool.y[i] = pool.y[last];
+        pool.z[i] = pool.z[last];
+        pool.vx[i] = pool.vx[last];
+        pool.vy[i] = pool.vy[last];
+        pool.vz[i] = pool.vz[last];
+        pool.fade[i] = pool.fade[last];
+        pool.fadeRate[i] = pool.fadeRate[last];
+    }
+}
+
+void ParticleSystem::update(float dt, JobSystem* jobSystem)
+{
+    chunks.clear();
+    for (uint32_t p = 0; p < pools.size(); p++) {
+        auto& pool = pools[p];
+        pool.spawnDebt += pool.desc.spawnRate * dt;
+        auto count = (uint32_t) pool.spawnDebt;
+        pool.spawnDebt -= count;
+        spawn(pool, count);
+
+        uint32_t end = (pool.alive + 3) & ~3u;
+        for (uint32_t begin = 0; begin < end; begin += chunkSize) {
+            chunks.push_back({p, begin, std::min(end, begin + chunkSize)});
+        }
+    }
+
+    if (!jobSystem) {
+        for (auto& chunk : chunks) integrate(pools[chunk.pool], chunk.begin, chunk.end, dt);
+        for (auto& pool : pools) removeDead(pool);
+        return;
+    }
+
+    jobSystem->parallelFor(chunks.size(), [&](uint32_t c, uint32_t) {
+        integrate(pools[chunks[c].pool], chunks[c].begin, chunks[c].end, dt);
+    });
+    // Removal reorders a pool, so it gets one task per pool.
+    jobSystem->parallelFor(pools.size(), [&](uint32_t p, uint32_t) {
+        removeDead(pools[p]);
+    });
+}
+
+void ParticleSystem::writeDraws(ViewSubmission& view, const Matrix& viewMatrix, MeshHandle quad, PipelineHandle pipeline)
+{
+    // By atlas, inside an atlas far particles first (the cameras are left handed,
+    // a larger view z is further away).
+    entries.clear();
+    for (uint32_t p = 0; p < pools.size(); p++) {
+        auto& pool = pools[p];
+        uint64_t atlas = pool.desc.atlas.index & ((1u << atlasBits) - 1);
+        for (uint32_t i = 0; i < pool.alive; i++) {
+            float viewZ = pool.x[i] * viewMatrix._13 + pool.y[i] * viewMatrix._23 + pool.z[i] * viewMatrix._33 + viewMatrix._43;
+            uint64_t inverseDepth = ~sortableFloat(viewZ);
+            entries.push_back({atlas << (64 - atlasBits) | inverseDepth << poolBits | p, i});
+        }
+    }
+    if (entries.empty()) return;
+    radixSort(entries, scratch);
+
+    // The columns of the view matrix are the camera axes in world space.
+    Vector3 right(viewMatrix._11, viewMatrix._21, viewMatrix._31);
+    Vector3 up(viewMatrix._12, viewMatrix._22, viewMatrix._32);
+    Vector3 forward(viewMatrix._13, viewMatrix._23, viewMatrix._33);
+
+    uint32_t runBegin = 0;
+    while (runBegin < entries.size()) {
+        uint64_t atlasKey = entries[runBegin].key >> (64 - atlasBits);
+        uint32_t runEnd = runBegin + 1;
+        while (runEnd < entries.size() && entries[runEnd].key >> (64 - atlasBits) == atlasKey) runEnd++;
+
+        auto& batch = view.objectRenderData.emplace_back();
+        batch.texture = pools[entries[runBegin].key & ((1u << poolBits) - 1)].desc.atlas;
+        batch.mesh = quad;
+        batch.pipeline = pipeline;
+        batch.worldMatrices.reserve(runEnd - runBegin);
+        batch.attributes.reserve(runEnd - runBegin);
+
+        for (uint32_t e = runBegin; e < runEnd; e++) {
+            auto& pool = pools[entries[e].key & ((1u << poolBits) - 1)];
+            uint32_t i = entries[e].index;
+            float fade = std::clamp(pool.fade[i], 0.0f, 1.0f);
+            float size = pool.desc.endSize + (pool.desc.startSize - pool.desc.endSize) * fade;
+
+            auto& world = batch.worldMatrices.emplace_back();
+            world._11 = right.x * size;   world._12 = right.y * size;   world._13 = right.z * size;
+            world._21 = up.x * size;      world._22 = up.y * size;      world._23 = up.z * size;
+            world._31 = forward.x * size; world._32 = forward.y * size; world._33 = forward.z * size;
+            world._41 = pool.x[i];        world._42 = pool.y[i];        world._43 = pool.z[i];
+
+            auto& attributes = batch.attributes.emplace_back();
+            uint32_t alpha = (uint32_t) std::lround((pool.desc.color >> 24) * fade);
+            attributes.tint = (pool.desc.color & 0x00FFFFFF) | alpha << 24;
+        }
+        runBegin = runEnd;
+    }
+}
+
+uint32_t ParticleSystem::aliveCount() const
+{
+    uint32_t count = 0;
+    for (auto& pool : pools) count += pool.alive;
+    return count;
+}
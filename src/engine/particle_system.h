@@ -0,0 +1,100 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "renderer.h"
+#include "render_queue.h"
+#include "job_system.h"
+
+using EmitterHandle = ResourceHandle<struct EmitterTag>;
+
+struct ParticleEmitterDesc
+{
+    // Atlas page of the particles, the emitters of a page are drawn as one batch.
+    TextureHandle atlas;
+    // The emitter never holds more particles, new ones are dropped while it is full.
+    uint32_t capacity = 1024;
+    // Particles per second, spawned at the position of the emitter. Bursts come from emit().
+    float spawnRate = 0;
+    float lifetime = 1;
+    // Every particle lives lifetime +- lifetimeSpread seconds.
+    float lifetimeSpread = 0;
+    // Start velocity, each axis varied by +- velocitySpread.
+    DirectX::SimpleMath::Vector3 velocity;
+    DirectX::SimpleMath::Vector3 velocitySpread;
+    // Acceleration along y.
+    float gravity = -9.81f;
+    // Fraction of the velocity lost per second.
+    float drag = 0;
+    // Edge length of the quad, it changes linearly over the life of a particle.
+    float startSize = 1;
+    float endSize = 1;
+    // RGBA8, red in the low byte. Alpha fades out over the life of a particle.
+    uint32_t color = 0xFFFFFFFF;
+};
+
+// CPU particles for effects like sparks, smoke and dust.
+//
+// Every emitter has a fixed pool of capacity particles, stored as one array per
+// component (SoA), so updating never allocates and the integration runs four
+// particles at a time with SSE when the build targets it. Dead particles are
+// replaced by the last living one, the order inside a pool does not matter.
+// update() splits the pools into chunks which the threads of a JobSystem
+// integrate side by side. Once the emitters exist nothing allocates anymore.
+//
+// writeDraws() emits one ObjectRenderData per atlas page with a camera facing
+// quad per particle, back to front, so they blend correctly in a translucent
+// pipeline. The pipeline should declare InstanceAttribute::Tint, it carries
+// the color and the fade.
+class ParticleSystem
+{
+    public:
+        EmitterHandle createEmitter(const ParticleEmitterDesc& desc, const DirectX::SimpleMath::Vector3& position);
+        void setPosition(EmitterHandle emitter, const DirectX::SimpleMath::Vector3& position);
+        // Spawns count particles at once, e.g. for an impact.
+        void emit(EmitterHandle emitter, uint32_t count);
+
+        // Advances all particles by dt seconds, on the threads of jobSystem if there is one.
+        // jobSystem must not be running another parallelFor.
+        void update(float dt, JobSystem* jobSystem = nullptr);
+
+        // Appends the particles as billboards facing the camera of viewMatrix.
+        void writeDraws(ViewSubmission& view, const DirectX::SimpleMath::Matrix& viewMatrix,
+                        MeshHandle quad, PipelineHandle pipeline);
+
+        uint32_t aliveCount() const;
+
+    private:
+        struct Pool
+        {
+            ParticleEmitterDesc desc;
+            DirectX::SimpleMath::Vector3 position;
+            float spawnDebt = 0;
+            uint32_t random = 0;
+            uint32_t alive = 0;
+            // Padded to a multiple of 4 for the SIMD kernel.
+            std::vector<float> x, y, z;
+            std::vector<float> vx, vy, vz;
+            // 1 at spawn, the particle dies at 0. fadeRate is 1 / lifetime.
+            std::vector<float> fade;
+            std::vector<float> fadeRate;
+        };
+
+        // A range of one pool which a task integrates.
+        struct Chunk
+        {
+            uint32_t pool;
+            uint32_t begin;
+            uint32_t end;
+        };
+
+        static constexpr uint32_t chunkSize = 16384;
+
+        void spawn(Pool& pool, uint32_t count);
+        static void integrate(Pool& pool, uint32_t begin, uint32_t end, float dt);
+        static void removeDead(Pool& pool);
+
+        std::vector<Pool> pools;
+        std::vector<Chunk> chunks;
+        std::vector<SortEntry> entries;
+        std::vector<SortEntry> scratch;
+};
@@ -0,0 +1,438 @@
+#include "recording_renderer.h"
+#include "instance_packing.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace DirectX::SimpleMath;
+
+// Sizes of what DX11Renderer uploads.
+static constexpr uint64_t cameraCBSize = 2 * sizeof(Matrix);
+static constexpr uint64_t objectCBSize = sizeof(Matrix);
+static constexpr uint64_t glyphVertexBytes = 4 * 20;
+static constexpr uint64_t glyphIndexBytes = 6 * sizeof(uint32_t);
+
+// Stand-ins for the device objects DX11Renderer binds, handle indices
+// of the game's resources are used as they are, the renderer's own live above.
+static constexpr uint64_t internalObject = 1ull << 32;
+static constexpr uint64_t cameraBuffer = internalObject;
+static constexpr uint64_t objectTransformBuffer = internalObject + 1;
+static constexpr uint64_t instanceOffsetBuffer = internalObject + 2;
+static constexpr uint64_t textPipeline = internalObject + 3;
+static constexpr uint64_t spritePipeline = internalObject + 4;
+static constexpr uint64_t clusterBuffer = internalObject + 5;
+static constexpr uint64_t fontAtlases = 2 * internalObject;
+static constexpr uint64_t snippetMeshes = 3 * internalObject;
+static constexpr uint64_t instanceStreams = 4 * internalObject;
+static constexpr uint64_t retainedBatches = 5 * internalObject;
+static constexpr uint64_t instanceIndexStream = 6 * internalObject;
+static constexpr uint64_t spriteStream = 7 * internalObject;
+static constexpr uint64_t attributeStream = 8 * internalObject;
+static constexpr uint64_t lightStream = 9 * internalObject;
+static constexpr uint64_t lightClusterStream = 10 * internalObject;
+static constexpr uint64_t lightIndexStream = 11 * internalObject;
+static constexpr uint64_t staticBatches = 12 * internalObject;
+static constexpr uint64_t identityInstances = 13 * internalObject;
+static constexpr uint32_t textVertexStride = 20;
+
+FrameStats& FrameStats::operator+=(const FrameStats& other)
+{
+    views += other.views;
+    drawCalls += other.drawCalls;
+    instances += other.instances;
+    culledInstances += other.culledInstances;
+    occludedInstances += other.occludedInstances;
+    reducedLodInstances += other.reducedLodInstances;
+    textDraws += other.textDraws;
+    glyphs += other.glyphs;
+    spriteDraws += other.spriteDraws;
+    sprites += other.sprites;
+    pointLights += other.pointLights;
+    lightIndices += other.lightIndices;
+    maxClusterLights = std::max(maxClusterLights, other.maxClusterLights);
+    pipelineChanges += other.pipelineChanges;
+    textureChanges += other.textureChanges;
+    meshChanges += other.meshChanges;
+    stateCalls += other.stateCalls;
+    filteredStateCalls += other.filteredStateCalls;
+    retainedUpdates += other.retainedUpdates;
+    staticUpdates += other.staticUpdates;
+    uploadBytes += other.uploadBytes;
+    validationErrors += other.validationErrors;
+    return *this;
+}
+
+void RecordingRenderer::initialize(RenderInitData initData)
+{
+    numMeshes = initData.meshDescriptors.size();
+    numTextures = initData.textureDescriptors.size();
+    numPipelines = initData.pipelineStates.size();
+    numSnippets = initData.snippetDescriptors.size();
+    pipelineInstanceStrides.clear();
+    pipelineVertexStrides.clear();
+    pipelineInstanceFormats.clear();
+    pipelineAttributes.clear();
+    textureSlots.clear();
+    for (auto& td : initData.textureDescriptors) {
+        textureSlots.push_back(td.slot);
+    }
+    for (auto& pso : initData.pipelineStates) {
+        pipelineAttributes.push_back(pso.instanceAttributes);
+        pipelineInstanceStrides.push_back(instanceStride(pso.instanceFormat));
+        pipelineVertexStrides.push_back(pso.inputLayout.stride());
+        pipelineInstanceFormats.push_back(pso.instanceFormat);
+    }
+    snippetFonts.clear();
+    for (auto& sd : initData.snippetDescriptors) {
+        uint32_t font = 0;
+        while (font < initData.fontDescriptors.size() && initData.fontDescriptors[font].id != sd.fontId) font++;
+        snippetFonts.push_back(font);
+    }
+    renderQueue.initialize(initData);
+    lightBinner.initialize(initData.jobSystem);
+    screenWidth = initData.screenWidth;
+    screenHeight = initData.screenHeight;
+}
+
+void RecordingRenderer::error(std::string message)
+{
+    if (printErrors) {
+        std::cerr << "RecordingRenderer, frame " << frames << ": " << message << std::endl;
+    }
+    frameErrors.push_back(std::move(message));
+}
+
+bool RecordingRenderer::validate(const FrameSubmission& frameData)
+{
+    if (frameData.viewSubmissions.size() > RenderQueue::maxViews) {
+        error("more than " + std::to_string(RenderQueue::maxViews) + " views");
+    }
+
+    for (auto& update : frameData.retainedUpdates) {
+        if (update.batch >= retainedCapacities.size()) {
+            retainedCapacities.resize(update.batch + 1, 0);
+        }
+        retainedCapacities[update.batch] = update.capacity;
+        if (update.pipeline.index >= numPipelines) {
+            error("retained update of batch " + std::to_string(update.batch) + " has an unknown pipeline");
+        }
+        if (update.firstInstance + update.transforms.size() > update.capacity) {
+            error("retained update of batch " + std::to_string(update.batch) + " exceeds its capacity");
+        }
+    }
+
+    for (auto& update : frameData.staticUpdates) {
+        if (update.batch >= staticBatchSizes.size()) {
+            staticBatchSizes.resize(update.batch + 1);
+        }
+        auto& size = staticBatchSizes[update.batch];
+        size.vertexFloats = update.vertices.size();
+        size.indices = update.indices.size();
+        size.referencedVertices = update.indices.empty() ? 0 : *std::max_element(update.indices.begin(), update.indices.end()) + 1;
+        if (update.indices.size() % 3 != 0) {
+            error("static update of batch " + std::to_string(update.batch) + " has no whole triangles");
+        }
+        for (auto& occluder : update.occluders) {
+            if (occluder.mesh.index >= numMeshes) {
+                error("static update of batch " + std::to_string(update.batch) + " has an occluder with an unknown mesh");
+            }
+        }
+    }
+
+    for (uint32_t p = 0; p < frameData.instancePools.size(); p++) {
+        auto& pool = frameData.instancePools[p];
+        if (!pool.masks.empty() && pool.masks.size() != pool.worldMatrices.size()) {
+            error("instance pool " + std::to_string(p) + " needs one mask per instance");
+        }
+    }
+
+    for (uint32_t v = 0; v < frameData.viewSubmissions.size(); v++) {
+        auto& vs = frameData.viewSubmissions[v];
+        auto where = [v](const char* what, uint32_t index) {
+            return "view " + std::to_string(v) + ", " + what + " " + std::to_string(index) + ": ";
+        };
+
+        for (uint32_t i = 0; i < vs.objectRenderData.size(); i++) {
+            auto& ord = vs.objectRenderData[i];
+            if (ord.mesh.index >= numMeshes) error(where("object", i) + "unknown mesh");
+            if (ord.texture.index >= numTextures) error(where("object", i) + "unknown texture");
+            if (ord.pipeline.index >= numPipelines) error(where("object", i) + "unknown pipeline");
+            if (ord.worldMatrices.empty()) error(where("object", i) + "no world matrices");
+            if (ord.worldMatrices.size() > maxInstances) {
+                error(where("object", i) + std::to_string(ord.worldMatrices.size()) + " instances exceed maxInstances");
+            }
+            if (!ord.attributes.empty() && ord.attributes.size() != ord.worldMatrices.size()) {
+                error(where("object", i) + "attributes don't match the world matrices");
+            }
+        }
+
+        for (uint32_t i = 0; i < vs.retainedDraws.size(); i++) {
+            auto& draw = vs.retainedDraws[i];
+            if (draw.mesh.index >= numMeshes) error(where("retained draw", i) + "unknown mesh");
+            if (draw.texture.index >= numTextures) error(where("retained draw", i) + "unknown texture");
+            if (draw.pipeline.index >= numPipelines) error(where("retained draw", i) + "unknown pipeline");
+            if (draw.batch >= retainedCapacities.size() || draw.instanceCount > retainedCapacities[draw.batch]) {
+                error(where("retained draw", i) + "batch was never uploaded with enough capacity");
+            }
+        }
+
+        for (uint32_t i = 0; i < vs.staticDraws.size(); i++) {
+            auto& draw = vs.staticDraws[i];
+            if (draw.texture.index >= numTextures) error(where("static draw", i) + "unknown texture");
+            if (draw.pipeline.index >= numPipelines) {
+                error(where("static draw", i) + "unknown pipeline");
+                continue;
+            }
+            if (draw.batch >= staticBatchSizes.size() || draw.indexCount > staticBatchSizes[draw.batch].indices) {
+                error(where("static draw", i) + "batch was never uploaded with enough indices");
+                continue;
+            }
+            auto& size = staticBatchSizes[draw.batch];
+            auto vertexFloats = pipelineVertexStrides[draw.pipeline.index] / sizeof(float);
+            if (vertexFloats == 0 || size.referencedVertices * vertexFloats > size.vertexFloats) {
+                error(where("static draw", i) + "indices exceed the vertices of its batch");
+            }
+        }
+
+        for (uint32_t i = 0; i < vs.pooledDraws.size(); i++) {
+            auto& draw = vs.pooledDraws[i];
+            if (draw.mesh.index >= numMeshes) error(where("pooled draw", i) + "unknown mesh");
+            if (draw.texture.index >= numTextures) error(where("pooled draw", i) + "unknown texture");
+            if (draw.pipeline.index >= numPipelines) error(where("pooled draw", i) + "unknown pipeline");
+            if (draw.pool >= frameData.instancePools.size()) {
+                error(where("pooled draw", i) + "unknown instance pool");
+                continue;
+            }
+            auto& pool = frameData.instancePools[draw.pool];
+            if (draw.firstInstance + draw.instanceCount > pool.worldMatrices.size()) {
+                error(where("pooled draw", i) + "range exceeds its instance pool");
+            } else if (!pool.attributes.empty() && pool.attributes.size() != pool.worldMatrices.size()) {
+                error(where("pooled draw", i) + "attributes of its pool don't match the world matrices");
+            }
+        }
+
+        for (uint32_t i = 0; i < vs.sprites.size(); i++) {
+            if (vs.sprites[i].texture.index >= numTextures) error(where("sprite", i) + "unknown texture");
+        }
+
+        for (uint32_t i = 0; i < vs.pointLights.size(); i++) {
+            float radius = vs.pointLights[i].radius;
+            if (!(radius > 0) || !std::isfinite(radius)) error(where("point light", i) + "radius must be positive");
+        }
+
+        for (uint32_t i = 0; i < vs.textRenderData.size(); i++) {
+            auto& text = vs.textRenderData[i];
+            if (text.snippet.index >= numSnippets) error(where("text", i) + "unknown snippet");
+            if (text.worldMatrices.empty()) error(where("text", i) + "no world matrix");
+        }
+    }
+
+    return frameErrors.empty();
+}
+
+// The binds of DX11Renderer::drawInstanced, counted where the cache lets them through.
+void RecordingRenderer::recordDraw(uint64_t texture, uint64_t pipeline, uint64_t mesh, uint32_t vertexStride)
+{
+    if (stateCache.bind(StateKind::PixelResource, 0, texture)) frameStats.textureChanges++;
+    stateCache.bind(StateKind::Sampler, 0, internalObject);
+    stateCache.bind(StateKind::InputLayout, 0, pipeline);
+    stateCache.bind(StateKind::PixelShader, 0, pipeline);
+    if (stateCache.bind(StateKind::VertexShader, 0, pipeline)) frameStats.pipelineChanges++;
+    stateCache.bind(StateKind::IndexBuffer, 0, mesh);
+    if (stateCache.bind(StateKind::VertexBuffer, 0, mesh, vertexStride)) frameStats.meshChanges++;
+}
+
+void RecordingRenderer::doFrame(const FrameSubmission& frameData)
+{
+    frameStats = {};
+    frameErrors.clear();
+
+    // Invalid frames are counted but not recorded, 
+    // a GPU backend would read out of bounds on them.
+    if (!validate(frameData)) {
+        frameStats.validationErrors = frameErrors.size();
+        totalStats += frameStats;
+        frames++;
+        return;
+    }
+
+    for (auto& update : frameData.retainedUpdates) {
+        frameStats.retainedUpdates++;
+        frameStats.uploadBytes += update.transforms.size() * pipelineInstanceStrides[update.pipeline.index];
+    }
+    for (auto& update : frameData.staticUpdates) {
+        frameStats.staticUpdates++;
+        frameStats.uploadBytes += update.vertices.size_bytes() + update.indices.size_bytes();
+    }
+
+    renderQueue.build(frameData);
+    spriteBatcher.build(frameData);
+    frameStats.sprites = spriteBatcher.spriteCount();
+    frameStats.uploadBytes += spriteBatcher.spriteCount() * sizeof(SpriteRecord);
+    lightBinner.build(frameData, screenWidth, screenHeight);
+    frameStats.pointLights = lightBinner.stats().lights;
+    frameStats.lightIndices = lightBinner.stats().lightIndices;
+    frameStats.maxClusterLights = lightBinner.stats().maxClusterLights;
+    frameStats.uploadBytes += lightBinner.lights().size_bytes() + lightBinner.clusterCount() * sizeof(LightCluster) +
+                              lightBinner.lightIndexCount() * sizeof(uint32_t);
+
+    // Like the clear pass of DX11Renderer.
+    stateCache.invalidate();
+    stateCache.resetStats();
+    stateCache.bind(StateKind::RenderTargets, 0, internalObject);
+    stateCache.bind(StateKind::Viewport, 0, internalObject);
+    stateCache.bind(StateKind::Topology, 0, internalObject);
+    stateCache.bind(StateKind::VertexConstantBuffer, 2, instanceOffsetBuffer);
+
+    // Where the object batches start in their instance stream,
+    // relative to the frame, as uploadFrameInstances() appends them.
+    // Pools are uploaded once for every format they are drawn with.
+    constexpr uint32_t notPacked = 0xFFFFFFFF;
+    uint32_t nextInstance[instanceFormatCount] = {};
+    uint32_t nextIndex = 0;
+    uint32_t nextAttribute = 0;
+    poolFirstInstances.assign(frameData.instancePools.size() * instanceFormatCount, notPacked);
+    poolFirstAttributes.clear();
+    for (uint32_t v = 0; v < frameData.viewSubmissions.size(); v++) {
+        auto& vs = frameData.viewSubmissions[v];
+        frameStats.views++;
+        if (v < RenderQueue::maxViews) {
+            frameStats.culledInstances += renderQueue.cullStats(v).culledInstances();
+            frameStats.occludedInstances += renderQueue.cullStats(v).occludedInstances;
+            frameStats.reducedLodInstances += renderQueue.lodStats(v).reducedInstances;
+        }
+
+        Matrix camera[] = { vs.viewMatrix, vs.projectionMatrix };
+        if (stateCache.updateConstants(cameraBuffer, camera, sizeof(camera))) {
+            frameStats.uploadBytes += cameraCBSize;
+        }
+        stateCache.bind(StateKind::VertexConstantBuffer, 0, cameraBuffer);
+
+        // Like DX11Renderer::bindViewLights.
+        auto clusters = lightBinner.viewConstants(v);
+        if (clusters.firstCluster != noLightClusters) {
+            stateCache.bind(StateKind::PixelResource, 1, lightStream);
+            stateCache.bind(StateKind::PixelResource, 2, lightClusterStream);
+            stateCache.bind(StateKind::PixelResource, 3, lightIndexStream);
+        }
+        if (stateCache.updateConstants(clusterBuffer, &clusters, sizeof(clusters))) {
+            frameStats.uploadBytes += sizeof(clusters);
+        }
+        stateCache.bind(StateKind::PixelConstantBuffer, 1, clusterBuffer);
+
+        for (auto& batch : renderQueue.viewBatches(v)) {
+            uint32_t instanceOffsets[] = { 0, notPacked, notPacked, 0 };
+            if (batch.type == DrawItemType::Static) {
+                // Like DX11Renderer::drawStatic, the merged geometry with an identity instance.
+                auto& draw = vs.staticDraws[renderQueue.batchItems(batch)[0].index];
+                auto format = (uint32_t) pipelineInstanceFormats[draw.pipeline.index];
+                auto& slot = textureSlots[draw.texture.index];
+                instanceOffsets[3] = slot.slice;
+                stateCache.updateConstants(instanceOffsetBuffer, instanceOffsets, sizeof(instanceOffsets));
+                stateCache.bind(StateKind::VertexResource, 0, identityInstances + format);
+                recordDraw(slot.array, draw.pipeline.index, staticBatches + draw.batch,
+                           pipelineVertexStrides[draw.pipeline.index]);
+                frameStats.drawCalls++;
+                frameStats.instances++;
+                continue;
+            }
+
+            auto stride = pipelineInstanceStrides[batch.pipeline.index];
+            auto format = (uint32_t) pipelineInstanceFormats[batch.pipeline.index];
+            auto attributes = pipelineAttributes[batch.pipeline.index];
+            auto attributeStride = instanceAttributeStride(attributes);
+            if (batch.type == DrawItemType::Object) {
+                frameStats.uploadBytes += batch.instanceCount * (stride + attributeStride);
+                instanceOffsets[0] = nextInstance[format];
+                nextInstance[format] += batch.instanceCount;
+                if (attributes) {
+                    instanceOffsets[2] = nextAttribute;
+                    nextAttribute += batch.instanceCount * attributeStride / sizeof(uint32_t);
+                }
+                stateCache.bind(StateKind::VertexResource, 0, instanceStreams + format);
+            } else if (batch.type == DrawItemType::Pooled) {
+                auto& first = poolFirstInstances[batch.pool * instanceFormatCount + format];
+                if (first == notPacked) {
+                    auto poolSize = frameData.instancePools[batch.pool].worldMatrices.size();
+                    frameStats.uploadBytes += poolSize * stride;
+                    first = nextInstance[format];
+                    nextInstance[format] += poolSize;
+                }
+                if (attributes) {
+                    auto packed = std::find_if(poolFirstAttributes.begin(), poolFirstAttributes.end(), [&](auto& p) {
+                        return p[0] == batch.pool && p[1] == attributes;
+                    });
+                    if (packed == poolFirstAttributes.end()) {
+                        auto poolSize = frameData.instancePools[batch.pool].worldMatrices.size();
+                        frameStats.uploadBytes += poolSize * attributeStride;
+                        packed = poolFirstAttributes.insert(packed, {batch.pool, attributes, nextAttribute});
+                        nextAttribute += poolSize * attributeStride / sizeof(uint32_t);
+                    }
+                    instanceOffsets[2] = (*packed)[2];
+                }
+                frameStats.uploadBytes += batch.instanceCount * sizeof(uint32_t);
+                instanceOffsets[0] = first;
+                instanceOffsets[1] = nextIndex;
+                nextIndex += batch.instanceCount;
+                stateCache.bind(StateKind::VertexResource, 0, instanceStreams + format);
+                stateCache.bind(StateKind::VertexResource, 1, instanceIndexStream);
+            } else {
+                auto& draw = vs.retainedDraws[renderQueue.batchItems(batch)[0].index];
+                stateCache.bind(StateKind::VertexResource, 0, retainedBatches + draw.batch);
+            }
+            if (attributes) {
+                stateCache.bind(StateKind::VertexResource, 2, attributeStream);
+            }
+            // Like DX11Renderer::drawView, only Object batches which read the slice per instance get 0.
+            auto& slot = textureSlots[batch.texture.index];
+            bool slicePerInstance = batch.type == DrawItemType::Object &&
+                                    (attributes & instanceAttributeBit(InstanceAttribute::TextureSlice));
+            instanceOffsets[3] = slicePerInstance ? 0 : slot.slice;
+            stateCache.updateConstants(instanceOffsetBuffer, instanceOffsets, sizeof(instanceOffsets));
+
+            recordDraw(slot.array, batch.pipeline.index, batch.mesh.index, 
+                       pipelineVertexStrides[batch.pipeline.index]);
+            frameStats.drawCalls++;
+            frameStats.instances += batch.instanceCount;
+        }
+
+        // Like DX11Renderer::drawSprites, there are no vertex or index buffers to bind.
+        auto spriteBatches = spriteBatcher.viewBatches(v);
+        if (!spriteBatches.empty()) {
+            stateCache.bind(StateKind::InputLayout, 0, spritePipeline);
+            stateCache.bind(StateKind::PixelShader, 0, spritePipeline);
+            if (stateCache.bind(StateKind::VertexShader, 0, spritePipeline)) frameStats.pipelineChanges++;
+            stateCache.bind(StateKind::VertexResource, 0, spriteStream);
+        }
+        for (auto& batch : spriteBatches) {
+            auto& slot = textureSlots[batch.texture.index];
+            uint32_t instanceOffsets[] = { batch.firstSprite, notPacked, notPacked, slot.slice };
+            stateCache.updateConstants(instanceOffsetBuffer, instanceOffsets, sizeof(instanceOffsets));
+            if (stateCache.bind(StateKind::PixelResource, 0, slot.array)) frameStats.textureChanges++;
+            stateCache.bind(StateKind::Sampler, 0, internalObject);
+            frameStats.spriteDraws++;
+            frameStats.drawCalls++;
+        }
+
+        for (auto& text : vs.textRenderData) {
+            if (text.worldMatrices.empty()) continue;
+            uint32_t glyphs = text.updatedText.size();
+            frameStats.textDraws++;
+            frameStats.drawCalls++;
+            frameStats.glyphs += glyphs;
+            frameStats.uploadBytes += glyphs * (glyphVertexBytes + glyphIndexBytes);
+            if (stateCache.updateConstants(objectTransformBuffer, &text.worldMatrices[0], sizeof(Matrix))) {
+                frameStats.uploadBytes += objectCBSize;
+            }
+            stateCache.bind(StateKind::VertexConstantBuffer, 1, objectTransformBuffer);
+
+            auto snippet = text.snippet.index;
+            recordDraw(fontAtlases + snippetFonts[snippet], textPipeline, snippetMeshes + snippet, textVertexStride);
+        }
+    }
+
+    frameStats.stateCalls = stateCache.stats().issuedCalls();
+    frameStats.filteredStateCalls = stateCache.stats().filteredCalls();
+    totalStats += frameStats;
+    frames++;
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <array>
+#include <string>
+#include <vector>
+#include "renderer.h"
+#include "render_queue.h"
+#include "state_cache.h"
+#include "sprite_batcher.h"
+#include "light_binner.h"
+
+// What a frame would have cost a GPU backend.
+// The state changes are counted the way DX11Renderer skips redundant binds,
+// through the same StateCache with handles in place of device objects.
+struct FrameStats
+{
+    uint32_t views = 0;
+    uint32_t drawCalls = 0;
+    uint32_t instances = 0;
+    // Instances of ObjectRenderData dropped by frustum culling.
+    uint32_t culledInstances = 0;
+    // The part of culledInstances hidden behind occluders.
+    uint32_t occludedInstances = 0;
+    // Visible instances drawn with a coarser LOD level.
+    uint32_t reducedLodInstances = 0;
+    uint32_t textDraws = 0;
+    uint32_t glyphs = 0;
+    uint32_t spriteDraws = 0;
+    uint32_t sprites = 0;
+    uint32_t pointLights = 0;
+    // Entries of the cluster light lists, and the longest list (not summed up in the totals).
+    uint32_t lightIndices = 0;
+    uint32_t maxClusterLights = 0;
+    uint32_t pipelineChanges = 0;
+    uint32_t textureChanges = 0;
+    uint32_t meshChanges = 0;
+    // All device calls for state and constants, issued and dropped as redundant.
+    uint32_t stateCalls = 0;
+    uint32_t filteredStateCalls = 0;
+    uint32_t retainedUpdates = 0;
+    // Rebuilt static batches, see static_batcher.h.
+    uint32_t staticUpdates = 0;
+    // Instance data, sprites, lights, constant buffers, retained and static updates and text geometry.
+    uint64_t uploadBytes = 0;
+    uint32_t validationErrors = 0;
+
+    FrameStats& operator+=(const FrameStats& other);
+};
+
+// Renderer without any GPU or window behind it.
+// It validates every FrameSubmission and records what the frame would 
+// have cost, which gives a deterministic and hardware free way to 
+// measure and test the CPU side of the engine.
+class RecordingRenderer : public Renderer 
+{
+    public:
+        void initialize(RenderInitData initData) override;
+        void doFrame(const FrameSubmission& frameData) override;
+
+        const FrameStats& lastFrame() const { return frameStats; }
+        const FrameStats& totals() const { return totalStats; }
+        uint64_t frameCount() const { return frames; }
+
+        // Validation errors of the last frame.
+        const std::vector<std::string>& errors() const { return frameErrors; }
+
+        // Print validation errors to stderr as they occur.
+        bool printErrors = true;
+
+        // Upper bound for the instances of one ObjectRenderData,
+        // the initial size of the DX11 instance streams.
+        uint32_t maxInstances = 50000;
+
+    private:
+        bool validate(const FrameSubmission& frameData);
+        void error(std::string message);
+        void recordDraw(uint64_t texture, uint64_t pipeline, uint64_t mesh, uint32_t vertexStride);
+
+        uint32_t numMeshes = 0;
+        uint32_t numTextures = 0;
+        uint32_t numPipelines = 0;
+        uint32_t numSnippets = 0;
+
+        // Bytes per instance of every pipeline, see InstanceFormat.
+        std::vector<uint32_t> pipelineInstanceStrides;
+        std::vector<uint32_t> pipelineVertexStrides;
+        std::vector<InstanceFormat> pipelineInstanceFormats;
+        std::vector<uint32_t> pipelineAttributes;
+        // Array and slice of every texture, draws bind the array.
+        std::vector<TextureSlot> textureSlots;
+        // Font of every snippet, the text draws bind its atlas.
+        std::vector<uint32_t> snippetFonts;
+
+        // Where the pools of the frame start in the instance stream of each format.
+        std::vector<uint32_t> poolFirstInstances;
+        // Pool, attribute set and where its attributes start in the attribute stream.
+        std::vector<std::array<uint32_t, 3>> poolFirstAttributes;
+
+        // Instance capacity of each retained batch, as the updates announced it.
+        std::vector<uint32_t> retainedCapacities;
+        // Floats and indices of each static batch as last uploaded, and how many 
+        // vertices its indices reach.
+        struct StaticBatchSize
+        {
+            size_t vertexFloats = 0;
+            uint32_t indices = 0;
+            uint32_t referencedVertices = 0;
+        };
+        std::vector<StaticBatchSize> staticBatchSizes;
+
+        RenderQueue renderQueue;
+        SpriteBatcher spriteBatcher;
+        LightBinner lightBinner;
+        uint32_t screenWidth = 0;
+        uint32_t screenHeight = 0;
+        StateCache stateCache;
+        FrameStats frameStats;
+        FrameStats totalStats;
+        uint64_t frames = 0;
+        std::vector<std::string> frameErrors;
+};
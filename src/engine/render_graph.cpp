@@ -0,0 +1,256 @@
+#include "render_graph.h"
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <queue>
+
+PassBuilder& PassBuilder::read(GraphResource resource)
+{
+    assert(resource.index < graph.resources.size());
+    auto& reads = graph.passes[pass].reads;
+    if (std::find(reads.begin(), reads.end(), resource.index) == reads.end()) {
+        reads.push_back(resource.index);
+    }
+    return *this;
+}
+
+PassBuilder& PassBuilder::write(GraphResource resource)
+{
+    assert(resource.index < graph.resources.size());
+    auto& writes = graph.passes[pass].writes;
+    if (std::find(writes.begin(), writes.end(), resource.index) == writes.end()) {
+        writes.push_back(resource.index);
+    }
+    return *this;
+}
+
+PassBuilder& PassBuilder::sideEffect()
+{
+    graph.passes[pass].sideEffect = true;
+    return *this;
+}
+
+void RenderGraph::beginFrame()
+{
+    // The passes stay allocated, so their reads and writes keep their capacity.
+    numPasses = 0;
+    resources.clear();
+}
+
+GraphResource RenderGraph::importResource(const char* name, const GraphTextureDesc& desc)
+{
+    resources.push_back({name, desc, true});
+    return {static_cast<uint32_t>(resources.size() - 1)};
+}
+
+GraphResource RenderGraph::createResource(const char* name, const GraphTextureDesc& desc)
+{
+    resources.push_back({name, desc, false});
+    return {static_cast<uint32_t>(resources.size() - 1)};
+}
+
+void RenderGraph::markOutput(GraphResource resource)
+{
+    resources[resource.index].output = true;
+}
+
+PassBuilder RenderGraph::addPass(const char* name, ExecuteFunction execute)
+{
+    if (numPasses == passes.size()) {
+        passes.emplace_back();
+    }
+    auto& pass = passes[numPasses];
+    pass.name = name;
+    pass.execute = std::move(execute);
+    pass.reads.clear();
+    pass.writes.clear();
+    pass.sideEffect = false;
+    pass.kept = false;
+    return PassBuilder(*this, numPasses++);
+}
+
+// Everything the compiled result depends on; the names and
+// execute functions may change from frame to frame.
+void RenderGraph::buildSignature(std::vector<uint32_t>& out) const
+{
+    out.clear();
+    out.push_back(static_cast<uint32_t>(resources.size()));
+    for (auto& r : resources) {
+        out.push_back(r.desc.width);
+        out.push_back(r.desc.height);
+        out.push_back(static_cast<uint32_t>(r.desc.format) | r.imported << 8 | r.output << 9);
+    }
+    out.push_back(numPasses);
+    for (uint32_t i = 0; i < numPasses; i++) {
+        auto& p = passes[i];
+        out.push_back(static_cast<uint32_t>(p.reads.size()) | p.sideEffect << 31);
+        out.insert(out.end(), p.reads.begin(), p.reads.end());
+        out.push_back(static_cast<uint32_t>(p.writes.size()));
+        out.insert(out.end(), p.writes.begin(), p.writes.end());
+    }
+}
+
+// Walks the passes backwards, starting with the outputs as the needed resources.
+// A pass is kept if it has side effects or writes something still needed.
+// What it only writes is needed no more before it, what it reads is.
+void RenderGraph::cullPasses()
+{
+    std::vector<bool> needed(resources.size());
+    for (size_t i = 0; i < resources.size(); i++) {
+        needed[i] = resources[i].output;
+    }
+
+    for (uint32_t i = numPasses; i-- > 0;) {
+        auto& pass = passes[i];
+        pass.kept = pass.sideEffect ||
+            std::any_of(pass.writes.begin(), pass.writes.end(), [&](uint32_t r) { return needed[r]; });
+        if (!pass.kept) continue;
+
+        for (uint32_t r : pass.writes) {
+            needed[r] = false;
+        }
+        for (uint32_t r : pass.reads) {
+            needed[r] = true;
+        }
+    }
+}
+
+// Orders the kept passes after the ones they depend on: the last writer of what
+// they read or write, and the readers of what they overwrite since that writer.
+// Among the passes that are ready, the one added first runs first.
+void RenderGraph::sortPasses()
+{
+    std::vector<std::vector<uint32_t>> successors(numPasses);
+    std::vector<uint32_t> predecessorCount(numPasses);
+    auto addEdge = [&](uint32_t from, uint32_t to) {
+        if (from == to) return;
+        auto& s = successors[from];
+        if (std::find(s.begin(), s.end(), to) != s.end()) return;
+        s.push_back(to);
+        predecessorCount[to]++;
+    };
+
+    constexpr uint32_t none = 0xFFFFFFFF;
+    std::vector<uint32_t> lastWriter(resources.size(), none);
+    std::vector<std::vector<uint32_t>> readers(resources.size());
+    for (uint32_t p = 0; p < numPasses; p++) {
+        auto& pass = passes[p];
+        if (!pass.kept) continue;
+
+        for (uint32_t r : pass.reads) {
+            if (lastWriter[r] != none) addEdge(lastWriter[r], p);
+        }
+        for (uint32_t w : pass.writes) {
+            if (lastWriter[w] != none) addEdge(lastWriter[w], p);
+            for (uint32_t reader : readers[w]) {
+                addEdge(reader, p);
+            }
+            readers[w].clear();
+            lastWriter[w] = p;
+        }
+        for (uint32_t r : pass.reads) {
+            if (lastWriter[r] != p) readers[r].push_back(p);
+        }
+    }
+
+    std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<>> ready;
+    for (uint32_t p = 0; p < numPasses; p++) {
+        if (passes[p].kept && predecessorCount[p] == 0) ready.push(p);
+    }
+
+    order.clear();
+    while (!ready.empty()) {
+        uint32_t p = ready.top();
+        ready.pop();
+        order.push_back(p);
+        for (uint32_t s : successors[p]) {
+            if (--predecessorCount[s] == 0) ready.push(s);
+        }
+    }
+}
+
+// A transient lives from the first to the last kept pass using it.
+// Going by first use, each one takes the first physical resource with the
+// same description that is free by then, or gets a new one.
+void RenderGraph::assignPhysicalResources()
+{
+    for (auto& r : resources) {
+        r.physical = noPhysicalResource;
+        r.firstUse = 0xFFFFFFFF;
+        r.lastUse = 0;
+    }
+    for (uint32_t position = 0; position < order.size(); position++) {
+        auto& pass = passes[order[position]];
+        auto use = [&](uint32_t index) {
+            auto& r = resources[index];
+            r.firstUse = std::min(r.firstUse, position);
+            r.lastUse = std::max(r.lastUse, position);
+        };
+        std::for_each(pass.reads.begin(), pass.reads.end(), use);
+        std::for_each(pass.writes.begin(), pass.writes.end(), use);
+    }
+
+    std::vector<uint32_t> transients;
+    for (uint32_t i = 0; i < resources.size(); i++) {
+        if (!resources[i].imported && resources[i].firstUse != 0xFFFFFFFF) transients.push_back(i);
+    }
+    std::stable_sort(transients.begin(), transients.end(), [&](uint32_t a, uint32_t b) {
+        return resources[a].firstUse < resources[b].firstUse;
+    });
+
+    physicalDescs.clear();
+    std::vector<uint32_t> physicalLastUse;
+    for (uint32_t i : transients) {
+        auto& r = resources[i];
+        for (uint32_t p = 0; p < physicalDescs.size(); p++) {
+            if (physicalDescs[p] == r.desc && physicalLastUse[p] < r.firstUse) {
+                r.physical = p;
+                break;
+            }
+        }
+        if (r.physical == noPhysicalResource) {
+            r.physical = static_cast<uint32_t>(physicalDescs.size());
+            physicalDescs.push_back(r.desc);
+            physicalLastUse.push_back(0);
+        }
+        physicalLastUse[r.physical] = r.lastUse;
+    }
+}
+
+bool RenderGraph::compile()
+{
+    buildSignature(nextSignature);
+    if (nextSignature == signature && compiles > 0) {
+        // Same topology as last time, only the per frame declaration needs the result.
+        for (uint32_t i = 0; i < numPasses; i++) {
+            passes[i].kept = keptPasses[i];
+        }
+        for (size_t i = 0; i < resources.size(); i++) {
+            resources[i].physical = physicalOfResource[i];
+        }
+        return false;
+    }
+
+    cullPasses();
+    sortPasses();
+    assignPhysicalResources();
+
+    keptPasses.resize(numPasses);
+    for (uint32_t i = 0; i < numPasses; i++) {
+        keptPasses[i] = passes[i].kept;
+    }
+    physicalOfResource.resize(resources.size());
+    for (size_t i = 0; i < resources.size(); i++) {
+        physicalOfResource[i] = resources[i].physical;
+    }
+    std::swap(signature, nextSignature);
+    compiles++;
+    return true;
+}
+
+void RenderGraph::execute()
+{
+    for (uint32_t p : order) {
+        if (passes[p].execute) passes[p].execute();
+    }
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+#include "renderer.h"
+
+using GraphResource = ResourceHandle<struct GraphResourceTag>;
+
+enum class GraphFormat : uint8_t
+{
+    Color,
+    Depth,
+};
+
+struct GraphTextureDesc
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    GraphFormat format = GraphFormat::Color;
+
+    bool operator==(const GraphTextureDesc&) const = default;
+};
+
+class RenderGraph;
+
+// Declares what a pass reads and writes, handed out by RenderGraph::addPass.
+class PassBuilder
+{
+    public:
+        PassBuilder(RenderGraph& graph, uint32_t pass) : graph(graph), pass(pass) {}
+
+        PassBuilder& read(GraphResource resource);
+        // Overwrites the resource completely, earlier content is not needed.
+        PassBuilder& write(GraphResource resource);
+        // Draws on top of the earlier content.
+        PassBuilder& readWrite(GraphResource resource) { return read(resource).write(resource); }
+        // The pass is never culled, e.g. because it reads back to the CPU.
+        PassBuilder& sideEffect();
+
+    private:
+        RenderGraph& graph;
+        uint32_t pass;
+};
+
+// The passes of a frame and the resources they use.
+// The backend declares the graph anew every frame, compile() then
+// - drops the passes whose writes nobody reads, unless they have side effects,
+// - orders the remaining ones so every pass runs after what it depends on,
+//   otherwise keeping the order they were added in,
+// - works out when each transient resource is first and last used and lets
+//   transients with the same description and disjoint lifetimes share
+//   one physical resource.
+// The result is kept until a frame declares a different topology,
+// so in steady state compile() only compares the declaration with the last one.
+// Imported resources, e.g. the back buffer, belong to the backend;
+// the graph only orders the passes using them.
+class RenderGraph
+{
+    public:
+        using ExecuteFunction = std::function<void()>;
+        static constexpr uint32_t noPhysicalResource = 0xFFFFFFFF;
+
+        // Forgets the passes and resources of the previous frame, not its compiled result.
+        void beginFrame();
+
+        GraphResource importResource(const char* name, const GraphTextureDesc& desc = {});
+        GraphResource createResource(const char* name, const GraphTextureDesc& desc);
+        // Something outside of the graph consumes the resource, e.g. present.
+        void markOutput(GraphResource resource);
+
+        PassBuilder addPass(const char* name, ExecuteFunction execute);
+
+        // Returns true if the graph had to be recompiled,
+        // the backend then (re)creates the physicalResources().
+        bool compile();
+        // Runs the passes in execution order.
+        void execute();
+
+        std::span<const uint32_t> executionOrder() const { return order; }
+        bool isCulled(uint32_t pass) const { return !passes[pass].kept; }
+        const char* passName(uint32_t pass) const { return passes[pass].name; }
+
+        // The physical resource a transient uses, noPhysicalResource for imported ones.
+        uint32_t physicalIndex(GraphResource resource) const { return resources[resource.index].physical; }
+        std::span<const GraphTextureDesc> physicalResources() const { return physicalDescs; }
+
+        uint32_t compileCount() const { return compiles; }
+
+    private:
+        friend class PassBuilder;
+
+        struct Pass
+        {
+            const char* name;
+            ExecuteFunction execute;
+            std::vector<uint32_t> reads;
+            std::vector<uint32_t> writes;
+            bool sideEffect = false;
+            bool kept = false;
+        };
+
+        struct Resource
+        {
+            const char* name;
+            GraphTextureDesc desc;
+            bool imported = false;
+            bool output = false;
+            uint32_t physical = noPhysicalResource;
+            uint32_t firstUse = 0;
+            uint32_t lastUse = 0;
+        };
+
+        void buildSignature(std::vector<uint32_t>& out) const;
+        void cullPasses();
+        void sortPasses();
+        void assignPhysicalResources();
+
+        // The first numPasses are the ones of this frame,
+        // the rest are kept from earlier frames for reuse.
+        std::vector<Pass> passes;
+        uint32_t numPasses = 0;
+        std::vector<Resource> resources;
+
+        // Compiled state, kept across frames.
+        std::vector<uint32_t> signature;
+        std::vector<uint32_t> nextSignature;
+        std::vector<uint32_t> order;
+        std::vector<bool> keptPasses;
+        std::vector<uint32_t> physicalOfResource;
+        std::vector<GraphTextureDesc> physicalDescs;
+        uint32_t compiles = 0;
+};
@@ -0,0 +1,147 @@
+#include "engine_tests.h"
+#include "render_graph.h"
+#include <string>
+#include <vector>
+
+// Stands in for the backend: the passes only log that they ran.
+struct MockBackend
+{
+    std::vector<std::string> executed;
+
+    RenderGraph::ExecuteFunction pass(const char* name)
+    {
+        return [this, name]() { executed.push_back(name); };
+    }
+};
+
+static const GraphTextureDesc screenColor = {800, 600, GraphFormat::Color};
+static const GraphTextureDesc screenDepth = {800, 600, GraphFormat::Depth};
+
+// Passes whose writes nobody reads are dropped, unless they have side effects.
+static void testCulling()
+{
+    MockBackend backend;
+    RenderGraph graph;
+    graph.beginFrame();
+    auto backBuffer = graph.importResource("backBuffer", screenColor);
+    auto unused = graph.createResource("unused", screenColor);
+    auto picking = graph.createResource("picking", screenColor);
+    graph.markOutput(backBuffer);
+
+    graph.addPass("debug", backend.pass("debug")).write(unused);
+    graph.addPass("picking", backend.pass("picking")).write(picking).sideEffect();
+    graph.addPass("scene", backend.pass("scene")).write(backBuffer);
+
+    CHECK(graph.compile());
+    CHECK(graph.isCulled(0));
+    CHECK(!graph.isCulled(1));
+    CHECK(!graph.isCulled(2));
+    CHECK(graph.physicalIndex(unused) == RenderGraph::noPhysicalResource);
+
+    graph.execute();
+    CHECK((backend.executed == std::vector<std::string>{"picking", "scene"}));
+}
+
+// A pass runs after the writer of what it reads and before
+// the next pass overwriting it, culled passes don't run.
+static void testOrdering()
+{
+    MockBackend backend;
+    RenderGraph graph;
+    graph.beginFrame();
+    auto backBuffer = graph.importResource("backBuffer", screenColor);
+    auto depth = graph.createResource("depth", screenDepth);
+    auto shadow = graph.createResource("shadow", screenDepth);
+    graph.markOutput(backBuffer);
+
+    graph.addPass("depthPrepass", backend.pass("depthPrepass")).write(depth);
+    graph.addPass("shadows", backend.pass("shadows")).write(shadow);
+    graph.addPass("opaque", backend.pass("opaque")).read(depth).read(shadow).write(backBuffer);
+    graph.addPass("unusedShadows", backend.pass("unusedShadows")).write(shadow);
+    graph.addPass("overlay", backend.pass("overlay")).readWrite(backBuffer);
+
+    graph.compile();
+    auto order = graph.executionOrder();
+    CHECK((std::vector<uint32_t>(order.begin(), order.end()) == std::vector<uint32_t>{0, 1, 2, 4}));
+
+    graph.execute();
+    CHECK((backend.executed == std::vector<std::string>{"depthPrepass", "shadows", "opaque", "overlay"}));
+}
+
+// Transients with the same description share a physical resource
+// when their lifetimes don't overlap.
+static void testTransientAliasing()
+{
+    RenderGraph graph;
+    graph.beginFrame();
+    auto backBuffer = graph.importResource("backBuffer", screenColor);
+    auto first = graph.createResource("first", screenColor);
+    auto second = graph.createResource("second", screenColor);
+    auto overlapping = graph.createResource("overlapping", screenColor);
+    auto depth = graph.createResource("depth", screenDepth);
+    graph.markOutput(backBuffer);
+
+    graph.addPass("writeFirst", nullptr).write(first);
+    graph.addPass("readFirst", nullptr).read(first).write(backBuffer);
+    graph.addPass("writeSecond", nullptr).write(second).write(depth);
+    graph.addPass("writeOverlapping", nullptr).read(second).write(overlapping);
+    graph.addPass("readBoth", nullptr).read(second).read(overlapping).read(depth).readWrite(backBuffer);
+
+    graph.compile();
+    CHECK(graph.physicalIndex(backBuffer) == RenderGraph::noPhysicalResource);
+    CHECK(graph.physicalIndex(first) == graph.physicalIndex(second));
+    CHECK(graph.physicalIndex(overlapping) != graph.physicalIndex(second));
+    CHECK(graph.physicalIndex(depth) != graph.physicalIndex(second));
+    CHECK(graph.physicalIndex(depth) != graph.physicalIndex(overlapping));
+    CHECK(graph.physicalResources().size() == 3);
+}
+
+// Declares the same graph every frame, the shadow map size may change.
+static void declareFrame(RenderGraph& graph, MockBackend& backend, uint32_t shadowSize)
+{
+    graph.beginFrame();
+    auto backBuffer = graph.importResource("backBuffer", screenColor);
+    auto shadow = graph.createResource("shadow", {shadowSize, shadowSize, GraphFormat::Depth});
+    auto unused = graph.createResource("unused", screenColor);
+    graph.markOutput(backBuffer);
+
+    graph.addPass("shadows", backend.pass("shadows")).write(shadow);
+    graph.addPass("debug", backend.pass("debug")).write(unused);
+    graph.addPass("opaque", backend.pass("opaque")).read(shadow).write(backBuffer);
+}
+
+// The compiled result is reused while the topology stays the same,
+// the execute functions of the current frame still run.
+static void testRecompile()
+{
+    MockBackend backend;
+    RenderGraph graph;
+
+    declareFrame(graph, backend, 1024);
+    CHECK(graph.compile());
+    CHECK(graph.compileCount() == 1);
+
+    for (int frame = 0; frame < 3; frame++) {
+        MockBackend frameBackend;
+        declareFrame(graph, frameBackend, 1024);
+        CHECK(!graph.compile());
+        CHECK(graph.isCulled(1));
+        CHECK(graph.physicalResources().size() == 1);
+        graph.execute();
+        CHECK((frameBackend.executed == std::vector<std::string>{"shadows", "opaque"}));
+    }
+    CHECK(graph.compileCount() == 1);
+
+    declareFrame(graph, backend, 2048);
+    CHECK(graph.compile());
+    CHECK(graph.compileCount() == 2);
+    CHECK(graph.physicalResources()[0].width == 2048);
+}
+
+void testRenderGraph()
+{
+    testCulling();
+    testOrdering();
+    testTransientAliasing();
+    testRecompile();
+}
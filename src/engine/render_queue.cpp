@@ -0,0 +1,395 @@
+#include "render_queue.h"
+#include <algorithm>
+#include <cassert>
+
+using namespace DirectX::SimpleMath;
+
+static constexpr uint32_t pipelineBits = 9;
+static constexpr uint32_t textureBits = 12;
+static constexpr uint32_t meshBits = 14;
+static constexpr uint32_t depthBits = 24;
+static constexpr uint32_t sequenceBits = 35;
+
+static uint64_t field(uint32_t value, uint32_t bits)
+{
+    // Invalid handles end up with all bits set, 
+    // everything else must fit.
+    assert(value == 0xFFFFFFFF || value < (1ull << bits));
+    return value & ((1ull << bits) - 1);
+}
+
+static uint64_t quantizeDepth(float depth01)
+{
+    depth01 = std::clamp(depth01, 0.0f, 1.0f);
+    return (uint64_t) (depth01 * (float) ((1u << depthBits) - 1));
+}
+
+uint64_t RenderQueue::makeOpaqueKey(uint32_t view, PipelineHandle pipeline, TextureHandle texture, 
+                                    MeshHandle mesh, float depth01)
+{
+    uint64_t key = (uint64_t) view << 60;
+    key |= field(pipeline.index, pipelineBits) << (textureBits + meshBits + depthBits);
+    key |= field(texture.index, textureBits) << (meshBits + depthBits);
+    key |= field(mesh.index, meshBits) << depthBits;
+    key |= quantizeDepth(depth01);
+    return key;
+}
+
+uint64_t RenderQueue::makeTranslucentKey(uint32_t view, float depth01, uint64_t sequence)
+{
+    uint64_t inverseDepth = ((1u << depthBits) - 1) - quantizeDepth(depth01);
+    uint64_t key = (uint64_t) view << 60;
+    key |= 1ull << 59;
+    key |= inverseDepth << sequenceBits;
+    key |= sequence & ((1ull << sequenceBits) - 1);
+    return key;
+}
+
+void radixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch)
+{
+    scratch.resize(entries.size());
+    if (entries.size() < 2) return;
+
+    // All 8 histograms in one pass over the data.
+    uint32_t counts[8][256] = {};
+    for (auto& e : entries) {
+        for (int pass = 0; pass < 8; pass++) {
+            counts[pass][(e.key >> (pass * 8)) & 0xFF]++;
+        }
+    }
+
+    auto* src = &entries;
+    auto* dst = &scratch;
+    for (int pass = 0; pass < 8; pass++) {
+        auto& count = counts[pass];
+        uint32_t shift = pass * 8;
+
+        // Nothing to do if every key has the same digit here.
+        if (count[((*src)[0].key >> shift) & 0xFF] == src->size()) continue;
+
+        uint32_t offsets[256];
+        uint32_t sum = 0;
+        for (int i = 0; i < 256; i++) {
+            offsets[i] = sum;
+            sum += count[i];
+        }
+
+        for (auto& e : *src) {
+            (*dst)[offsets[(e.key >> shift) & 0xFF]++] = e;
+        }
+        std::swap(src, dst);
+    }
+
+    if (src != &entries) {
+        entries.swap(scratch);
+    }
+}
+
+void RenderQueue::initialize(const RenderInitData& initData)
+{
+    culler.initialize(initData);
+    lodSelector.initialize(initData);
+    occlusion.initialize(initData);
+    retainedTransforms.clear();
+    staticOccluders.clear();
+    translucentPipelines.clear();
+    slicedPipelines.clear();
+    for (auto& pso : initData.pipelineStates) {
+        translucentPipelines.push_back(pso.translucent);
+        slicedPipelines.push_back(pso.instanceAttributes & instanceAttributeBit(InstanceAttribute::TextureSlice));
+    }
+    textureArrays.clear();
+    for (auto& td : initData.textureDescriptors) {
+        textureArrays.push_back(td.slot.array);
+    }
+}
+
+bool RenderQueue::mergesTextureArray(const DrawItem& item) const
+{
+    return item.type == DrawItemType::Object && item.texture.index < textureArrays.size() &&
+           item.pipeline.index < slicedPipelines.size() && slicedPipelines[item.pipeline.index];
+}
+
+// Maps the view space depth to [0, 1] between the near and far plane,
+// which are taken from the (left handed) projection matrix.
+static float normalizedDepth(const Matrix& world, const Matrix& view, const Matrix& projection)
+{
+    auto t = world.Translation();
+    float z = t.x * view._13 + t.y * view._23 + t.z * view._33 + view._43;
+
+    if (projection._34 != 0) {
+        // Perspective
+        float nearPlane = -projection._43 / projection._33;
+        float farPlane = projection._43 / (1.0f - projection._33);
+        return (z - nearPlane) / (farPlane - nearPlane);
+    }
+
+    // Orthographic, clip space z is already linear.
+    return z * projection._33 + projection._43;
+}
+
+void RenderQueue::addItem(const DrawItem& item, float depth01)
+{
+    uint64_t key;
+    bool translucent = item.pipeline.index < translucentPipelines.size() && translucentPipelines[item.pipeline.index];
+    if (translucent) {
+        key = makeTranslucentKey(item.view, depth01, unsortedItems.size());
+    } else {
+        // Draws which may share an array are grouped by it, so they end up next to each other.
+        auto texture = mergesTextureArray(item) ? TextureHandle{textureArrays[item.texture.index]} : item.texture;
+        key = makeOpaqueKey(item.view, item.pipeline, texture, item.mesh, depth01);
+    }
+
+    entries.push_back({key, (uint32_t) unsortedItems.size()});
+    unsortedItems.push_back(item);
+}
+
+void RenderQueue::updateRetainedTransforms(const FrameSubmission& frame)
+{
+    for (auto& update : frame.retainedUpdates) {
+        if (retainedTransforms.size() <= update.batch) {
+            retainedTransforms.resize(update.batch + 1);
+        }
+        auto& transforms = retainedTransforms[update.batch];
+        if (transforms.size() < update.capacity) {
+            transforms.resize(update.capacity);
+        }
+        assert(update.firstInstance + update.transforms.size() <= transforms.size());
+        std::copy(update.transforms.begin(), update.transforms.end(), transforms.begin() + update.firstInstance);
+    }
+}
+
+void RenderQueue::updateStaticOccluders(const FrameSubmission& frame)
+{
+    for (auto& update : frame.staticUpdates) {
+        if (staticOccluders.size() <= update.batch) {
+            staticOccluders.resize(update.batch + 1);
+        }
+        staticOccluders[update.batch].assign(update.occluders.begin(), update.occluders.end());
+    }
+}
+
+// Rasterizes the occluder meshes of the view, returns false if it has none on screen.
+bool RenderQueue::rasterizeOccluders(const FrameSubmission& frame, const ViewSubmission& view)
+{
+    occlusion.beginView(view.viewMatrix, view.projectionMatrix);
+    for (auto& ord : view.objectRenderData) {
+        if (occlusion.isOccluder(ord.mesh)) {
+            occlusion.addOccluders(ord.mesh, ord.worldMatrices);
+        }
+    }
+    for (auto& draw : view.pooledDraws) {
+        if (!occlusion.isOccluder(draw.mesh) || draw.pool >= frame.instancePools.size()) continue;
+        auto& pool = frame.instancePools[draw.pool];
+        auto range = std::span<const Matrix>(pool.worldMatrices).subspan(draw.firstInstance, draw.instanceCount);
+        if (pool.masks.empty()) {
+            occlusion.addOccluders(draw.mesh, range);
+            continue;
+        }
+        for (uint32_t i = 0; i < range.size(); i++) {
+            if (pool.masks[draw.firstInstance + i] & view.instanceMask) {
+                occlusion.addOccluders(draw.mesh, range.subspan(i, 1));
+            }
+        }
+    }
+    for (auto& draw : view.retainedDraws) {
+        if (!occlusion.isOccluder(draw.mesh) || draw.batch >= retainedTransforms.size()) continue;
+        auto& transforms = retainedTransforms[draw.batch];
+        auto count = std::min<size_t>(draw.instanceCount, transforms.size());
+        occlusion.addOccluders(draw.mesh, std::span<const Matrix>(transforms).first(count));
+    }
+    for (auto& draw : view.staticDraws) {
+        if (draw.batch >= staticOccluders.size()) continue;
+        for (auto& occluder : staticOccluders[draw.batch]) {
+            occlusion.addOccluders(occluder.mesh, std::span<const Matrix>(&occluder.transform, 1));
+        }
+    }
+
+    occlusion.rasterize();
+    return occlusion.occluderTriangles() > 0;
+}
+
+void RenderQueue::build(const FrameSubmission& frame)
+{
+    assert(frame.viewSubmissions.size() <= maxViews);
+
+    unsortedItems.clear();
+    entries.clear();
+
+    uint32_t numViews = std::min<uint32_t>(frame.viewSubmissions.size(), maxViews);
+
+    // At most every instance survives culling.
+    size_t numInstances = 0;
+    size_t numPooledInstances = 0;
+    for (uint32_t v = 0; v < numViews; v++) {
+        for (auto& ord : frame.viewSubmissions[v].objectRenderData) {
+            numInstances += ord.worldMatrices.size();
+        }
+        for (auto& draw : frame.viewSubmissions[v].pooledDraws) {
+            numPooledInstances += draw.instanceCount;
+        }
+    }
+    culler.beginFrame(numInstances, numPooledInstances);
+    lodSelector.beginFrame(numInstances);
+
+    bool occlusionCulling = occlusionEnabled && culler.enabled && occlusion.hasOccluders();
+    if (occlusion.hasOccluders()) {
+        updateRetainedTransforms(frame);
+        updateStaticOccluders(frame);
+    }
+
+    for (uint32_t v = 0; v < numViews; v++) {
+        auto& vs = frame.viewSubmissions[v];
+        culler.beginView(v, vs.viewMatrix, vs.projectionMatrix);
+        culler.setOcclusion(occlusionCulling && rasterizeOccluders(frame, vs) ? &occlusion : nullptr);
+        lodSelector.beginView(v, vs.viewMatrix, vs.projectionMatrix);
+
+        for (uint32_t i = 0; i < vs.objectRenderData.size(); i++) {
+            auto& ord = vs.objectRenderData[i];
+            if (ord.worldMatrices.empty()) continue;
+
+            auto visible = culler.cull(ord.mesh, ord.worldMatrices);
+            if (visible.empty()) continue;
+
+            auto visibleIndices = culler.lastVisibleIndices();
+            if (!lodSelector.hasLods(ord.mesh)) {
+                float depth = normalizedDepth(visible[0], vs.viewMatrix, vs.projectionMatrix);
+                addItem({DrawItemType::Object, v, i, ord.pipeline, ord.texture, ord.mesh, 
+                            (uint32_t) visible.size(), visible.data(), nullptr, 0, 
+                            visibleIndices.empty() ? nullptr : visibleIndices.data()}, depth);
+                continue;
+            }
+
+            auto lodRanges = lodSelector.select(ord.mesh, i, ord.worldMatrices.size(), visible, visibleIndices);
+            for (auto& range : lodRanges) {
+                float depth = normalizedDepth(range.instances[0], vs.viewMatrix, vs.projectionMatrix);
+                addItem({DrawItemType::Object, v, i, ord.pipeline, ord.texture, range.mesh, 
+                            (uint32_t) range.instances.size(), range.instances.data(), nullptr, 0, 
+                            range.instanceIndices.empty() ? nullptr : range.instanceIndices.data()}, depth);
+            }
+        }
+
+        for (uint32_t i = 0; i < vs.pooledDraws.size(); i++) {
+            auto& draw = vs.pooledDraws[i];
+            if (draw.instanceCount == 0) continue;
+            assert(draw.pool < frame.instancePools.size());
+            auto& pool = frame.instancePools[draw.pool];
+            assert(draw.firstInstance + draw.instanceCount <= pool.worldMatrices.size());
+
+            auto range = std::span<const Matrix>(pool.worldMatrices).subspan(draw.firstInstance, draw.instanceCount);
+            std::span<const uint32_t> masks;
+            if (!pool.masks.empty()) {
+                masks = std::span<const uint32_t>(pool.masks).subspan(draw.firstInstance, draw.instanceCount);
+            }
+            auto visible = culler.cullPooled(draw.mesh, range, masks, vs.instanceMask, draw.firstInstance);
+            if (visible.empty()) continue;
+
+            float depth = normalizedDepth(pool.worldMatrices[visible[0]], vs.viewMatrix, vs.projectionMatrix);
+            addItem({DrawItemType::Pooled, v, i, draw.pipeline, draw.texture, draw.mesh, 
+                        (uint32_t) visible.size(), nullptr, visible.data(), draw.pool}, depth);
+        }
+
+        // Retained batches are spread over the scene, they sort as if at the near plane.
+        for (uint32_t i = 0; i < vs.retainedDraws.size(); i++) {
+            auto& draw = vs.retainedDraws[i];
+            if (draw.instanceCount == 0) continue;
+
+            addItem({DrawItemType::Retained, v, i, draw.pipeline, draw.texture, draw.mesh, draw.instanceCount, 
+                        nullptr, nullptr, 0}, 0.0f);
+        }
+
+        // A static batch is one draw of its merged geometry, sorted by the center of its bounds.
+        for (uint32_t i = 0; i < vs.staticDraws.size(); i++) {
+            auto& draw = vs.staticDraws[i];
+            if (draw.indexCount == 0 || !culler.cullBox(draw.boundsMin, draw.boundsMax)) continue;
+
+            auto center = Matrix::CreateTranslation((draw.boundsMin + draw.boundsMax) * 0.5f);
+            float depth = normalizedDepth(center, vs.viewMatrix, vs.projectionMatrix);
+            addItem({DrawItemType::Static, v, i, draw.pipeline, draw.texture, MeshHandle{}, 1, 
+                        nullptr, nullptr, 0}, depth);
+        }
+    }
+
+    radixSort(entries, scratch);
+
+    items.clear();
+    std::fill(std::begin(viewBegin), std::end(viewBegin), 0);
+    for (auto& e : entries) {
+        items.push_back(unsortedItems[e.index]);
+        viewBegin[items.back().view + 1]++;
+    }
+    for (uint32_t v = 0; v < maxViews; v++) {
+        viewBegin[v + 1] += viewBegin[v];
+    }
+
+    mergeBatches();
+}
+
+void RenderQueue::mergeBatches()
+{
+    batches.clear();
+    std::fill(std::begin(viewBatchBegin), std::end(viewBatchBegin), 0);
+
+    for (uint32_t i = 0; i < items.size(); i++) {
+        auto& item = items[i];
+
+        // Merging only ever joins neighbours of the sorted stream, 
+        // so the draw order (and with it back to front blending) is kept.
+        if (!batches.empty() && item.type != DrawItemType::Retained && item.type != DrawItemType::Static) {
+            auto& last = batches.back();
+            bool sameTexture = last.texture == item.texture || 
+                                (mergesTextureArray(item) && last.texture.index < textureArrays.size() &&
+                                 textureArrays[last.texture.index] == textureArrays[item.texture.index]);
+            bool compatible = last.type == item.type && items[last.firstItem].view == item.view &&
+                                last.pipeline == item.pipeline && sameTexture && last.mesh == item.mesh &&
+                                last.pool == item.pool;
+            if (compatible) {
+                last.itemCount++;
+                last.instanceCount += item.instanceCount;
+                continue;
+            }
+        }
+
+        batches.push_back({item.type, item.pipeline, item.texture, item.mesh, item.pool, i, 1, item.instanceCount});
+        viewBatchBegin[item.view + 1]++;
+    }
+
+    for (uint32_t v = 0; v < maxViews; v++) {
+        viewBatchBegin[v + 1] += viewBatchBegin[v];
+    }
+}
+
+std::span<const DrawItem> RenderQueue::viewItems(uint32_t view) const
+{
+    if (view >= maxViews) return {};
+    return std::span<const DrawItem>(items).subspan(viewBegin[view], viewBegin[view + 1] - viewBegin[view]);
+}
+
+std::span<const DrawBatch> RenderQueue::viewBatches(uint32_t view) const
+{
+    if (view >= maxViews) return {};
+    return std::span<const DrawBatch>(batches).subspan(viewBatchBegin[view], viewBatchBegin[view + 1] - viewBatchBegin[view]);
+}
+
+std::span<const DrawItem> RenderQueue::batchItems(const DrawBatch& batch) const
+{
+    return std::span<const DrawItem>(items).subspan(batch.firstItem, batch.itemCount);
+}
+
+std::span<const Matrix> RenderQueue::itemInstances(const DrawItem& item) const
+{
+    if (item.type != DrawItemType::Object) return {};
+    return {item.instances, item.instanceCount};
+}
+
+std::span<const uint32_t> RenderQueue::itemInstanceIndices(const DrawItem& item) const
+{
+    if (item.type != DrawItemType::Object || !item.instanceIndices) return {};
+    return {item.instanceIndices, item.instanceCount};
+}
+
+std::span<const uint32_t> RenderQueue::itemPoolIndices(const DrawItem& item) const
+{
+    if (item.type != DrawItemType::Pooled) return {};
+    return {item.poolIndices, item.instanceCount};
+}
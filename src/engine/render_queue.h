@@ -0,0 +1,162 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "renderer.h"
+#include "frustum_culler.h"
+#include "mesh_lod.h"
+#include "occlusion_culler.h"
+
+// Radix sort entry: a 64 bit key plus the index of whatever it belongs to.
+struct SortEntry
+{
+    uint64_t key;
+    uint32_t index;
+};
+
+// Stable LSD radix sort over the 64 bit keys, 8 bits per pass.
+// Passes in which all keys share the same digit are skipped.
+// scratch is resized as needed, keep it around so sorting 
+// does not allocate in steady state.
+void radixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch);
+
+enum class DrawItemType : uint8_t
+{
+    Object,     // ViewSubmission::objectRenderData
+    Retained,   // ViewSubmission::retainedDraws
+    Pooled,     // ViewSubmission::pooledDraws
+    Static,     // ViewSubmission::staticDraws
+};
+
+// One draw of the sorted stream, pointing back into the FrameSubmission.
+struct DrawItem
+{
+    DrawItemType type;
+    uint32_t view;
+    uint32_t index;
+    PipelineHandle pipeline;
+    TextureHandle texture;
+    MeshHandle mesh;
+    uint32_t instanceCount;
+    // The world matrices which survived culling, only set for Object draws.
+    // An ObjectRenderData of a mesh with LODs becomes one item per level, mesh is the level's mesh.
+    const DirectX::SimpleMath::Matrix* instances;
+    // The instances of the pool which survived culling, only set for Pooled draws.
+    const uint32_t* poolIndices;
+    uint32_t pool;
+    // Where the instances of an Object draw are in the worldMatrices (and attributes)
+    // of its ObjectRenderData, nullptr if they are all of them in order.
+    const uint32_t* instanceIndices = nullptr;
+};
+
+// Consecutive sorted draws which share mesh, texture and pipeline.
+// The ObjectRenderData of such a batch are drawn as one instance stream,
+// so are the PooledDraws of the same pool, through their indices.
+// Retained and static draws have their own buffers and are never merged.
+// ObjectRenderData of pipelines which declare InstanceAttribute::TextureSlice
+// only need to share the texture array (see texture_arrays.h), not the texture.
+struct DrawBatch
+{
+    DrawItemType type;
+    PipelineHandle pipeline;
+    // The texture of the first item.
+    TextureHandle texture;
+    MeshHandle mesh;
+    uint32_t pool;
+    uint32_t firstItem;
+    uint32_t itemCount;
+    uint32_t instanceCount;
+};
+
+// Brings all draws of a FrameSubmission into the order the backend
+// should issue them in, so the game does not have to care about it.
+//
+// Key layout, most significant bit first:
+//   opaque:      view(4) | 0 | pipeline(9) | texture(12) | mesh(14) | depth(24)
+//   translucent: view(4) | 1 | inverse depth(24) | submission order(35)
+// ObjectRenderData which may merge across the textures of an array use the array as texture.
+//
+// Inside a view all opaque draws come first, grouped by state and
+// front to back inside each state. The translucent ones follow back to front,
+// draws at the same depth keep the order the game submitted them in.
+// The depth of an ObjectRenderData or PooledDraw is taken from its first visible instance.
+//
+// Before sorting, the instances of every ObjectRenderData and PooledDraw are 
+// frustum culled against their view (see frustum_culler.h). Draws without visible
+// instances are dropped, the others only carry their visible instances.
+// Static draws are culled as a whole by their bounds, retained draws and text are not culled.
+//
+// Views which contain occluder meshes (MeshDescriptor::occluder) first rasterize
+// them, from every kind of draw, into the depth buffer of an OcclusionCuller.
+// Instances inside the frustum are then also dropped when they are hidden behind them.
+// To know where retained instances are, the queue keeps a copy of the transforms
+// of the retained batches and the occluders of the static batches, but only if 
+// there are occluder meshes at all. Static batches themselves are not occlusion tested.
+//
+// The visible instances of every ObjectRenderData of a mesh with LODs are then
+// split by LOD level (see mesh_lod.h), so each level becomes a draw of its own.
+// Pooled and retained draws always use the full mesh.
+class RenderQueue
+{
+    public:
+        static constexpr uint32_t maxViews = 16;
+
+        void initialize(const RenderInitData& initData);
+        void build(const FrameSubmission& frame);
+
+        // The sorted draws of one view.
+        std::span<const DrawItem> viewItems(uint32_t view) const;
+
+        // The sorted draws of one view, compatible neighbours merged.
+        std::span<const DrawBatch> viewBatches(uint32_t view) const;
+        std::span<const DrawItem> batchItems(const DrawBatch& batch) const;
+
+        // The visible instances of an Object draw.
+        std::span<const DirectX::SimpleMath::Matrix> itemInstances(const DrawItem& item) const;
+        // Where the instances of an Object draw are in its ObjectRenderData, empty if in order.
+        std::span<const uint32_t> itemInstanceIndices(const DrawItem& item) const;
+        // The visible instances of a Pooled draw, as indices into its pool.
+        std::span<const uint32_t> itemPoolIndices(const DrawItem& item) const;
+
+        // What culling did to one view of the last frame.
+        const CullStats& cullStats(uint32_t view) const { return culler.viewStats(view); }
+        void setCulling(bool enabled) { culler.enabled = enabled; }
+        void setOcclusionCulling(bool enabled) { occlusionEnabled = enabled; }
+
+        // What LOD selection did to one view of the last frame.
+        const LodStats& lodStats(uint32_t view) const { return lodSelector.viewStats(view); }
+
+        // depth01 is 0 at the near and 1 at the far plane.
+        static uint64_t makeOpaqueKey(uint32_t view, PipelineHandle pipeline, TextureHandle texture, 
+                                        MeshHandle mesh, float depth01);
+        static uint64_t makeTranslucentKey(uint32_t view, float depth01, uint64_t sequence);
+
+    private:
+        void addItem(const DrawItem& item, float depth01);
+        bool mergesTextureArray(const DrawItem& item) const;
+        void mergeBatches();
+        void updateRetainedTransforms(const FrameSubmission& frame);
+        void updateStaticOccluders(const FrameSubmission& frame);
+        bool rasterizeOccluders(const FrameSubmission& frame, const ViewSubmission& view);
+
+        FrustumCuller culler;
+        OcclusionCuller occlusion;
+        bool occlusionEnabled = true;
+        // Transforms of every retained batch, only kept when there are occluders.
+        std::vector<std::vector<DirectX::SimpleMath::Matrix>> retainedTransforms;
+        // Occluders of every static batch, as retainedTransforms.
+        std::vector<std::vector<StaticOccluder>> staticOccluders;
+        LodSelector lodSelector;
+        std::vector<bool> translucentPipelines;
+        // Pipelines which declare InstanceAttribute::TextureSlice.
+        std::vector<bool> slicedPipelines;
+        // The array of every texture.
+        std::vector<uint32_t> textureArrays;
+        std::vector<DrawItem> unsortedItems;
+        std::vector<DrawItem> items;
+        std::vector<SortEntry> entries;
+        std::vector<SortEntry> scratch;
+        std::vector<DrawBatch> batches;
+        uint32_t viewBegin[maxViews + 1] = {};
+        uint32_t viewBatchBegin[maxViews + 1] = {};
+};
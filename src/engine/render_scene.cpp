@@ -0,0 +1,146 @@
+#include "render_scene.h"
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+using namespace DirectX::SimpleMath;
+
+uint32_t RenderScene::findOrCreateBatch(const RenderProxyDesc& desc)
+{
+    for (uint32_t i = 0; i < batches.size(); i++) {
+        auto& b = batches[i];
+        if (b.mesh == desc.mesh && b.texture == desc.texture && b.pipeline == desc.pipeline) {
+            return i;
+        }
+    }
+
+    auto& batch = batches.emplace_back();
+    batch.mesh = desc.mesh;
+    batch.texture = desc.texture;
+    batch.pipeline = desc.pipeline;
+    return batches.size() - 1;
+}
+
+void RenderScene::markDirty(Batch& batch, uint32_t instance)
+{
+    auto page = instance / pageSize;
+    if (page >= batch.dirtyPages.size()) {
+        batch.dirtyPages.resize(page + 1, false);
+    }
+    batch.dirtyPages[page] = true;
+    batch.dirty = true;
+}
+
+ProxyHandle RenderScene::createProxy(const RenderProxyDesc& desc)
+{
+    uint32_t proxyIndex;
+    if (!freeProxies.empty()) {
+        proxyIndex = freeProxies.back();
+        freeProxies.pop_back();
+    } else {
+        proxyIndex = proxies.size();
+        proxies.emplace_back();
+    }
+
+    auto batchIndex = findOrCreateBatch(desc);
+    auto& batch = batches[batchIndex];
+    uint32_t instance = batch.transforms.size();
+    batch.transforms.push_back(desc.transform);
+    batch.owners.push_back(proxyIndex);
+    markDirty(batch, instance);
+
+    proxies[proxyIndex] = {batchIndex, instance, true};
+    return ProxyHandle{proxyIndex};
+}
+
+void RenderScene::updateTransform(ProxyHandle proxy, const Matrix& transform)
+{
+    auto& p = proxies[proxy.index];
+    assert(p.alive);
+    auto& batch = batches[p.batch];
+    batch.transforms[p.instance] = transform;
+    markDirty(batch, p.instance);
+}
+
+void RenderScene::destroyProxy(ProxyHandle proxy)
+{
+    auto& p = proxies[proxy.index];
+    assert(p.alive);
+    auto& batch = batches[p.batch];
+
+    // Swap the last instance into the hole, so the batch stays dense.
+    uint32_t last = batch.transforms.size() - 1;
+    if (p.instance != last) {
+        batch.transforms[p.instance] = batch.transforms[last];
+        batch.owners[p.instance] = batch.owners[last];
+        proxies[batch.owners[p.instance]].instance = p.instance;
+        markDirty(batch, p.instance);
+    }
+    batch.transforms.pop_back();
+    batch.owners.pop_back();
+
+    // The instance count changed, which is picked up by the next draw,
+    // but we still need the batch to be looked at.
+    batch.dirty = true;
+
+    p.alive = false;
+    freeProxies.push_back(proxy.index);
+}
+
+void RenderScene::writeUpdates(FrameSubmission& frame, LinearArena& frameArena)
+{
+    for (uint32_t b = 0; b < batches.size(); b++) {
+        auto& batch = batches[b];
+        if (!batch.dirty) continue;
+
+        uint32_t count = batch.transforms.size();
+
+        // Grow the GPU side in powers of two. A resized buffer
+        // has no valid content, so the whole batch is resent.
+        if (count > batch.capacity) {
+            batch.capacity = std::max<uint32_t>(pageSize, std::bit_ceil(count));
+            batch.dirtyPages.assign((count + pageSize - 1) / pageSize, true);
+        }
+
+        // Coalesce neighbouring dirty pages into one update each.
+        uint32_t numPages = std::min<uint32_t>(batch.dirtyPages.size(), (count + pageSize - 1) / pageSize);
+        uint32_t page = 0;
+        while (page < numPages) {
+            if (!batch.dirtyPages[page]) {
+                page++;
+                continue;
+            }
+
+            uint32_t firstPage = page;
+            while (page < numPages && batch.dirtyPages[page]) {
+                page++;
+            }
+
+            uint32_t first = firstPage * pageSize;
+            uint32_t end = std::min(page * pageSize, count);
+            auto* transforms = static_cast<Matrix*>(frameArena.allocate((end - first) * sizeof(Matrix), alignof(Matrix)));
+            std::copy(batch.transforms.begin() + first, batch.transforms.begin() + end, transforms);
+
+            auto& update = frame.retainedUpdates.emplace_back();
+            update.batch = b;
+            update.pipeline = batch.pipeline;
+            update.capacity = batch.capacity;
+            update.firstInstance = first;
+            update.transforms = {transforms, end - first};
+        }
+
+        std::fill(batch.dirtyPages.begin(), batch.dirtyPages.end(), false);
+        batch.dirty = false;
+    }
+}
+
+void RenderScene::writeDraws(ViewSubmission& view) const
+{
+    for (uint32_t b = 0; b < batches.size(); b++) {
+        auto& batch = batches[b];
+        if (batch.transforms.empty()) continue;
+
+        view.retainedDraws.push_back({b, batch.mesh, batch.texture, batch.pipeline,
+                                        (uint32_t) batch.transforms.size()});
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <vector>
+#include <directxtk/SimpleMath.h>
+#include "renderer.h"
+#include "frame_arena.h"
+
+using ProxyHandle = ResourceHandle<struct ProxyTag>;
+
+struct RenderProxyDesc
+{
+    MeshHandle mesh;
+    TextureHandle texture;
+    PipelineHandle pipeline;
+    DirectX::SimpleMath::Matrix transform;
+};
+
+// Retained counterpart to the per frame ObjectRenderData.
+// The game creates a proxy once per object and only touches it again
+// when it moves. Proxies sharing mesh, texture and pipeline are kept
+// in one batch, whose instance data the renderer keeps on the GPU.
+// Only the pages of a batch which changed since the last frame
+// are sent as RetainedBatchUpdates.
+class RenderScene
+{
+    public:
+        ProxyHandle createProxy(const RenderProxyDesc& desc);
+        void updateTransform(ProxyHandle proxy, const DirectX::SimpleMath::Matrix& transform);
+        void destroyProxy(ProxyHandle proxy);
+
+        // Copies all dirty instance ranges into the frame and
+        // clears the dirty state. Must be called exactly once per frame.
+        void writeUpdates(FrameSubmission& frame, LinearArena& frameArena);
+
+        // Adds one draw per non-empty batch to the view.
+        void writeDraws(ViewSubmission& view) const;
+
+        uint32_t proxyCount() const { return proxies.size() - freeProxies.size(); }
+
+        // Granularity of the dirty tracking in instances.
+        static constexpr uint32_t pageSize = 64;
+
+    private:
+        struct Batch
+        {
+            MeshHandle mesh;
+            TextureHandle texture;
+            PipelineHandle pipeline;
+            std::vector<DirectX::SimpleMath::Matrix> transforms;
+            // Proxy index of every instance, needed to fix up
+            // the proxy which gets swapped in on removal.
+            std::vector<uint32_t> owners;
+            std::vector<bool> dirtyPages;
+            bool dirty = false;
+            uint32_t capacity = 0;
+        };
+
+        struct Proxy
+        {
+            uint32_t batch = 0;
+            uint32_t instance = 0;
+            bool alive = false;
+        };
+
+        uint32_t findOrCreateBatch(const RenderProxyDesc& desc);
+        void markDirty(Batch& batch, uint32_t instance);
+
+        std::vector<Batch> batches;
+        std::vector<Proxy> proxies;
+        std::vector<uint32_t> freeProxies;
+};
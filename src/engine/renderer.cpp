@@ -6,4 +6,99 @@ InputLayout &InputLayout::addElement(InputLayoutElement element)
 {
     elements.push_back(element);
     return *this;
-}
\ No newline at end of file
+}
+
+uint32_t InputLayout::stride() const
+{
+    uint32_t str = 0;
+    for (auto& e : elements) {
+         switch (e.type) {
+            case InputElementType::POSITION: str += 12; break;
+            case InputElementType::UV: str += 8;  break;
+            case InputElementType::NORMAL: str += 12; break;
+         }
+    }
+
+    return str;
+}
+
+uint32_t InputLayout::elementOffset(InputElementType type) const
+{
+    uint32_t offset = 0;
+    for (auto& e : elements) {
+        if (e.type == type) return offset;
+        switch (e.type) {
+            case InputElementType::POSITION: offset += 12; break;
+            case InputElementType::UV: offset += 8;  break;
+            case InputElementType::NORMAL: offset += 12; break;
+        }
+    }
+
+    return invalidElementOffset;
+}
+
+template <typename Handle, typename Descriptor, typename IdOf>
+static Handle findByIdInternal(const std::vector<Descriptor>& descriptors, const std::string& id, IdOf idOf)
+{
+    for (uint32_t i = 0; i < descriptors.size(); i++) {
+        if (idOf(descriptors[i]) == id) {
+            return Handle{i};
+        }
+    }
+    return Handle{};
+}
+
+MeshHandle RenderInitData::addMesh(MeshDescriptor descriptor)
+{
+    if (descriptor.occluder && descriptor.occluderGeometry.indices.empty()) {
+        descriptor.occluderGeometry = GeometryFactory::occluderBox(descriptor.geometry, 8);
+    }
+    meshDescriptors.push_back(std::move(descriptor));
+    return MeshHandle{(uint32_t) meshDescriptors.size() - 1};
+}
+
+TextureHandle RenderInitData::addTexture(TextureDescriptor descriptor)
+{
+    TextureHandle handle{(uint32_t) textureDescriptors.size()};
+    descriptor.slot = {(uint32_t) textureArrays.size(), 0};
+    textureArrays.push_back({0, 0, {handle}});
+    textureDescriptors.push_back(std::move(descriptor));
+    return handle;
+}
+
+PipelineHandle RenderInitData::addPipelineState(PipelineState pipelineState)
+{
+    pipelineStates.push_back(std::move(pipelineState));
+    return PipelineHandle{(uint32_t) pipelineStates.size() - 1};
+}
+
+SnippetHandle RenderInitData::addSnippet(SnippetDescriptor descriptor)
+{
+    snippetDescriptors.push_back(std::move(descriptor));
+    return SnippetHandle{(uint32_t) snippetDescriptors.size() - 1};
+}
+
+void RenderInitData::addFont(FontDescriptor descriptor)
+{
+    fontDescriptors.push_back(std::move(descriptor));
+}
+
+MeshHandle RenderInitData::findMesh(const std::string &id) const
+{
+    return findByIdInternal<MeshHandle>(meshDescriptors, id, [](auto& d) -> auto& { return d.id; });
+}
+
+TextureHandle RenderInitData::findTexture(const std::string &id) const
+{
+    return findByIdInternal<TextureHandle>(textureDescriptors, id, [](auto& d) -> auto& { return d.id; });
+}
+
+PipelineHandle RenderInitData::findPipelineState(const std::string &id) const
+{
+    return findByIdInternal<PipelineHandle>(pipelineStates, id, [](auto& d) -> auto& { return d.id; });
+}
+
+SnippetHandle RenderInitData::findSnippet(const std::string &id) const
+{
+    return findByIdInternal<SnippetHandle>(snippetDescriptors, id, [](auto& d) -> auto& { return d.snippetId; });
+}
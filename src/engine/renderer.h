@@ -1,13 +1,22 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <memory_resource>
+#include <span>
+#ifdef _WIN32
 #include <Windows.h>
-#include <DirectXMath.h>
 #include <d3d12.h>
 #include <d3d11.h>
-#include <DirectXTK/SimpleMath.h>
+#else
+// Headless builds, e.g. with the RecordingRenderer, have no window.
+using HWND = void*;
+#endif
+#include <DirectXMath.h>
+#include <directxtk/SimpleMath.h>
 #include "geometry.h"
 
+class JobSystem;
+
 
 enum class InputElementType
 {
@@ -18,6 +27,25 @@ enum class InputElementType
 };
 
 
+// Compact handle into one of the dense resource arrays of a backend.
+// The index is the position of the descriptor inside RenderInitData,
+// so the game and every backend agree on it without any string lookups
+// during frame submission.
+template <typename Tag>
+struct ResourceHandle
+{
+    static constexpr uint32_t invalidIndex = 0xFFFFFFFF;
+    uint32_t index = invalidIndex;
+
+    bool isValid() const { return index != invalidIndex; }
+    bool operator==(const ResourceHandle&) const = default;
+};
+
+using MeshHandle = ResourceHandle<struct MeshTag>;
+using TextureHandle = ResourceHandle<struct TextureTag>;
+using PipelineHandle = ResourceHandle<struct PipelineTag>;
+using SnippetHandle = ResourceHandle<struct SnippetTag>;
+
 struct InputLayoutElement {
     InputElementType type;
 };
@@ -26,20 +54,56 @@ class InputLayout
 {
     public:
         InputLayout& addElement(InputLayoutElement element);
+#ifdef _WIN32
         std::vector<D3D12_INPUT_ELEMENT_DESC> asDX12InputLayout();
         std::vector<D3D11_INPUT_ELEMENT_DESC> asDX11InputLayout();
-        uint32_t stride();
+#endif
+        uint32_t stride() const;
+        // Byte offset of the first element of type inside a vertex, 
+        // invalidElementOffset if the layout has none.
+        uint32_t elementOffset(InputElementType type) const;
+
+        static constexpr uint32_t invalidElementOffset = 0xFFFFFFFF;
 
     private:
         std::vector<InputLayoutElement> elements;
 
 };
 
+// A coarser version of a mesh. It is drawn instead of the finer levels
+// once an instance covers less than screenSize of the screen height.
+struct MeshLod
+{
+    Geometry geometry;
+    float screenSize = 0;
+};
+
 struct MeshDescriptor 
 {
     std::string id;
     Geometry geometry;
 
+    // Optional, coarsest last, so with decreasing screenSize.
+    std::vector<MeshLod> lods = {};
+    // An instance keeps its level until its size is this fraction
+    // past the threshold, so it does not flicker between two levels.
+    float lodHysteresis = 0.1f;
+
+    // Large meshes, like buildings, which hide what is behind them (see OcclusionCuller).
+    // Their occluderGeometry is a cheaper version which must lie completely inside the mesh,
+    // addMesh() generates a box inside it if it is left empty, see GeometryFactory::occluderBox().
+    // Without one, e.g. for an open mesh, they occlude with their geometry.
+    bool occluder = false;
+    Geometry occluderGeometry = {};
+
+};
+
+// Where a texture lives on the GPU: one slice of one of
+// the RenderInitData::textureArrays, see texture_arrays.h.
+struct TextureSlot
+{
+    uint32_t array = 0;
+    uint32_t slice = 0;
 };
 
 // Describes a texture which is created on the GPU
@@ -49,9 +113,23 @@ struct TextureDescriptor
 {
     std::string id;
     std::string filePath;
+    // Set by RenderInitData::addTexture() and groupTextureArrays().
+    TextureSlot slot = {};
 
 };
 
+// Textures of the same size which share one texture array on the GPU,
+// so draws which only differ in them can be merged.
+// Every texture is loaded as RGBA8, so the size is all that has to match.
+struct TextureArrayDescriptor
+{
+    // 0 while the size is not known, the backends then take it from the images.
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // In slice order.
+    std::vector<TextureHandle> textures;
+};
+
 struct FontDescriptor
 {
     std::string id;
@@ -59,18 +137,69 @@ struct FontDescriptor
     float size;
 };
 
+// How the instanced draws of a pipeline send their world matrices to the GPU.
+// The compact formats are decoded in shaders/instance_data.hlsli and
+// assume a uniform scale, PositionYawScale also only a rotation around y,
+// as for units standing on the ground.
+enum class InstanceFormat : uint8_t
+{
+    Matrix,                 // 64 bytes, the full matrix
+    Affine,                 // 48 bytes, 3x4 without the constant last column
+    PositionRotationScale,  // 32 bytes, position, quaternion and scale
+    PositionYawScale,       // 16 bytes, position plus yaw and scale as halfs
+};
+
+// Per instance values next to the world matrix, so instances which only differ
+// in them, like the units of different players, still share a draw.
+// A pipeline declares the ones its shader reads (PipelineState::instanceAttributes),
+// only those are uploaded, 4 bytes each in the order of this enum.
+// See instanceAttributes() in shaders/instance_data.hlsli.
+enum class InstanceAttribute : uint8_t
+{
+    TeamColor,
+    Tint,
+    Health,
+    AnimationFrame,
+    Selection,
+    // The slice of the draw's texture in its array. Not filled in by the game, 
+    // the backend writes it for every instance. Object draws whose textures 
+    // share an array are then merged, see RenderQueue.
+    TextureSlice,
+};
+
+constexpr uint32_t instanceAttributeBit(InstanceAttribute attribute) { return 1u << (uint32_t) attribute; }
+
+// All attributes of one instance, as the game fills them in.
+struct InstanceAttributes
+{
+    // RGBA8, red in the low byte, see packColor() in sprite_batcher.h.
+    uint32_t teamColor = 0xFFFFFFFF;
+    uint32_t tint = 0xFFFFFFFF;
+    // Fraction in [0, 1].
+    float health = 1;
+    uint32_t animationFrame = 0;
+    // Flag bits defined by the game, e.g. selected or hovered.
+    uint32_t selection = 0;
+};
+
 // PipelineState contains 
 // all needed shaders and 
 // rasterstates etc.
 struct PipelineState {
 
-    // This is the id which we will refer to in the FrameData,
-    // so the renderer knows which PSO to bind:
+    // Human readable id, only used during initialization.
+    // The FrameData refers to the PSO by its PipelineHandle.
     std::string id;         
     std::wstring shader;
     bool useDepthBuffer = true;
     bool useStencilBuffer = false;
     bool wireframe = false;
+    // Translucent pipelines are alpha blended and 
+    // therefore drawn back to front after all opaque ones.
+    bool translucent = false;
+    InstanceFormat instanceFormat = InstanceFormat::Matrix;
+    // InstanceAttribute bits, see instanceAttributeBit().
+    uint32_t instanceAttributes = 0;
     InputLayout inputLayout;
 
 };
@@ -83,8 +212,24 @@ struct SnippetDescriptor
 
 };
 
+// Descriptors should be registered through the add* methods,
+// which hand out the handles the game uses in its FrameSubmissions.
 struct RenderInitData {
 
+    MeshHandle addMesh(MeshDescriptor descriptor);
+    // Every texture starts out in an array of its own.
+    TextureHandle addTexture(TextureDescriptor descriptor);
+    PipelineHandle addPipelineState(PipelineState pipelineState);
+    SnippetHandle addSnippet(SnippetDescriptor descriptor);
+    void addFont(FontDescriptor descriptor);
+
+    // Init-time lookups by id, e.g. for tools or data driven setups.
+    // Invalid handles are returned for unknown ids.
+    MeshHandle findMesh(const std::string& id) const;
+    TextureHandle findTexture(const std::string& id) const;
+    PipelineHandle findPipelineState(const std::string& id) const;
+    SnippetHandle findSnippet(const std::string& id) const;
+
     std::vector<PipelineState> pipelineStates;
     uint32_t numFrames = 0;
     uint32_t screenWidth = 0;
@@ -92,48 +237,299 @@ struct RenderInitData {
     bool fullscreen = false;
     HWND hwnd;
     bool ide = false;
+    // Optional, the threads the renderer shares with the game for its CPU work,
+    // e.g. binning lights and rasterizing occluders.
+    JobSystem* jobSystem = nullptr;
     std::vector<TextureDescriptor> textureDescriptors;
+    std::vector<TextureArrayDescriptor> textureArrays;
     std::vector<MeshDescriptor> meshDescriptors;
     std::vector<FontDescriptor> fontDescriptors;
     std::vector<SnippetDescriptor> snippetDescriptors;
 
 };
 
+// Per frame containers.
+// They take their memory from the allocator they are created with,
+// normally the LinearArena of the current frame (see frame_arena.h).
+template <typename T>
+using FrameVector = std::pmr::vector<T>;
+using FrameString = std::pmr::string;
+using FrameAllocator = std::pmr::polymorphic_allocator<>;
+
 struct TextRenderData 
 {
-    std::vector<DirectX::SimpleMath::Matrix> worldMatrices;
-    std::string snippetId;
-    std::string updatedText = "";
+    using allocator_type = FrameAllocator;
+
+    TextRenderData() : TextRenderData(allocator_type{}) {}
+    explicit TextRenderData(const allocator_type& alloc) : worldMatrices(alloc), updatedText(alloc) {}
+    TextRenderData(const TextRenderData& other, const allocator_type& alloc) 
+        : worldMatrices(other.worldMatrices, alloc), snippet(other.snippet), updatedText(other.updatedText, alloc) {}
+    TextRenderData(TextRenderData&& other, const allocator_type& alloc) 
+        : worldMatrices(std::move(other.worldMatrices), alloc), snippet(other.snippet), 
+          updatedText(std::move(other.updatedText), alloc) {}
+    TextRenderData(const TextRenderData&) = default;
+    TextRenderData(TextRenderData&&) = default;
+    TextRenderData& operator=(const TextRenderData&) = default;
+    TextRenderData& operator=(TextRenderData&&) = default;
+
+    FrameVector<DirectX::SimpleMath::Matrix> worldMatrices;
+    SnippetHandle snippet;
+    FrameString updatedText;
   
 };
 
 struct ObjectRenderData 
 {
+    using allocator_type = FrameAllocator;
+
+    ObjectRenderData() : ObjectRenderData(allocator_type{}) {}
+    explicit ObjectRenderData(const allocator_type& alloc) : worldMatrices(alloc), attributes(alloc) {}
+    ObjectRenderData(const ObjectRenderData& other, const allocator_type& alloc) 
+        : worldMatrices(other.worldMatrices, alloc), attributes(other.attributes, alloc), 
+          texture(other.texture), mesh(other.mesh), pipeline(other.pipeline) {}
+    ObjectRenderData(ObjectRenderData&& other, const allocator_type& alloc) 
+        : worldMatrices(std::move(other.worldMatrices), alloc), attributes(std::move(other.attributes), alloc), 
+          texture(other.texture), mesh(other.mesh), pipeline(other.pipeline) {}
+    ObjectRenderData(const ObjectRenderData&) = default;
+    ObjectRenderData(ObjectRenderData&&) = default;
+    ObjectRenderData& operator=(const ObjectRenderData&) = default;
+    ObjectRenderData& operator=(ObjectRenderData&&) = default;
+
     // The count of world matrices 
     // decides how many instances we have of this object.
     // So if you want 1000 instances of this object, 
     // you must add 1000 world matrices. 
     // The engine will instance-batch all those objects.
-    std::vector<DirectX::SimpleMath::Matrix> worldMatrices;
-    std::string textureId;
-    std::string meshId;
-    std::string inputLayoutId;
+    FrameVector<DirectX::SimpleMath::Matrix> worldMatrices;
+    // Optional, one per world matrix. Without them every instance gets the defaults.
+    FrameVector<InstanceAttributes> attributes;
+    TextureHandle texture;
+    MeshHandle mesh;
+    PipelineHandle pipeline;
+
+
+};
+
+// Instances shared by several views of a frame, e.g. the units of the main
+// view which the minimap or a shadow view draws as well. Views reference ranges
+// of a pool through PooledDraws, so the world matrices exist and are uploaded
+// only once per frame no matter how many views draw them.
+struct InstancePool
+{
+    using allocator_type = FrameAllocator;
+
+    InstancePool() : InstancePool(allocator_type{}) {}
+    explicit InstancePool(const allocator_type& alloc) : worldMatrices(alloc), masks(alloc), attributes(alloc) {}
+    InstancePool(const InstancePool& other, const allocator_type& alloc) 
+        : worldMatrices(other.worldMatrices, alloc), masks(other.masks, alloc), attributes(other.attributes, alloc) {}
+    InstancePool(InstancePool&& other, const allocator_type& alloc) 
+        : worldMatrices(std::move(other.worldMatrices), alloc), masks(std::move(other.masks), alloc), 
+          attributes(std::move(other.attributes), alloc) {}
+    InstancePool(const InstancePool&) = default;
+    InstancePool(InstancePool&&) = default;
+    InstancePool& operator=(const InstancePool&) = default;
+    InstancePool& operator=(InstancePool&&) = default;
+
+    FrameVector<DirectX::SimpleMath::Matrix> worldMatrices;
+
+    // Optional, one per instance. A view only draws the instances
+    // whose mask shares a bit with its ViewSubmission::instanceMask.
+    FrameVector<uint32_t> masks;
+
+    // Optional, one per instance, as ObjectRenderData::attributes.
+    FrameVector<InstanceAttributes> attributes;
+};
+
+// Draws the instances [firstInstance, firstInstance + instanceCount) 
+// of FrameSubmission::instancePools[pool], culled against the view like ObjectRenderData.
+struct PooledDraw
+{
+    uint32_t pool = 0;
+    uint32_t firstInstance = 0;
+    uint32_t instanceCount = 0;
+    MeshHandle mesh;
+    TextureHandle texture;
+    PipelineHandle pipeline;
+};
 
+// GPU record of a sprite, shaders/sprite.hlsl expands it to a quad.
+// Like the "quad" mesh the sprite is centered on its position.
+// uvMin and uvMax are u and v as 16 bit unorm, u in the low half, color is RGBA8, 
+// red in the low byte. The layer is the view space depth of the sprite.
+struct SpriteRecord
+{
+    DirectX::SimpleMath::Vector2 position;
+    DirectX::SimpleMath::Vector2 size;
+    uint32_t uvMin = 0;
+    uint32_t uvMax = 0xFFFFFFFF;
+    uint32_t color = 0xFFFFFFFF;
+    float layer = 0;
+};
 
+static_assert(sizeof(SpriteRecord) == 32, "SpriteRecord must match SpriteData of shaders/sprite.hlsl");
+
+// A textured quad of a 2D view, e.g. an icon or a button of the HUD.
+// Sprites are not culled and drawn after the other draws of their view, 
+// see sprite_batcher.h and addSprite() in game_util.h.
+struct Sprite
+{
+    SpriteRecord record;
+    // The atlas page the UVs refer to.
+    TextureHandle texture;
+};
+
+// A light which fades out to nothing at radius, in world space.
+// The renderer bins the lights of a view into clusters, see light_binner.h.
+struct PointLight
+{
+    DirectX::SimpleMath::Vector3 position;
+    float radius = 1;
+    DirectX::SimpleMath::Vector3 color = {1, 1, 1};
+    float intensity = 1;
+};
+
+// Draws all instances of one batch of a RenderScene.
+// The instance data lives on the GPU and is kept up to date
+// through the RetainedBatchUpdates of the FrameSubmission.
+struct RetainedBatchDraw
+{
+    uint32_t batch = 0;
+    MeshHandle mesh;
+    TextureHandle texture;
+    PipelineHandle pipeline;
+    uint32_t instanceCount = 0;
+};
+
+// A range of changed instance transforms of a RenderScene batch.
+// The transforms point into the frame arena.
+struct RetainedBatchUpdate
+{
+    uint32_t batch = 0;
+
+    // The pipeline the batch is drawn with, it decides the instance format.
+    PipelineHandle pipeline;
+
+    // The backend must hold at least this many instances for the batch.
+    // When it grows, the whole batch is sent as one update.
+    uint32_t capacity = 0;
+    uint32_t firstInstance = 0;
+    std::span<const DirectX::SimpleMath::Matrix> transforms;
+};
+
+// A mesh instance merged into a static batch which hides what is behind it,
+// see MeshDescriptor::occluder. The merged geometry itself is no mesh,
+// so the render queue rasterizes the occluders of a static batch from these.
+struct StaticOccluder
+{
+    MeshHandle mesh;
+    DirectX::SimpleMath::Matrix transform;
+};
+
+// The merged geometry of one batch of a StaticBatcher (see static_batcher.h),
+// sent whenever the batch was rebuilt. The backend replaces whatever it 
+// had of the batch with it, an empty update releases the batch.
+// The spans point into the frame arena.
+struct StaticBatchUpdate
+{
+    uint32_t batch = 0;
+    // World space vertices in the input layout of the pipeline the batch is drawn with.
+    std::span<const float> vertices;
+    std::span<const uint32_t> indices;
+    std::span<const StaticOccluder> occluders;
+};
+
+// Draws all objects of a static batch with one draw of its merged geometry.
+// The batch is culled as a whole against the view by its world space bounds.
+struct StaticBatchDraw
+{
+    uint32_t batch = 0;
+    TextureHandle texture;
+    PipelineHandle pipeline;
+    uint32_t indexCount = 0;
+    DirectX::SimpleMath::Vector3 boundsMin;
+    DirectX::SimpleMath::Vector3 boundsMax;
 };
 
 // Every ViewSubmission
 struct ViewSubmission
 {
+    using allocator_type = FrameAllocator;
+
+    ViewSubmission() : ViewSubmission(allocator_type{}) {}
+    explicit ViewSubmission(const allocator_type& alloc) 
+        : objectRenderData(alloc), textRenderData(alloc), retainedDraws(alloc), pooledDraws(alloc), sprites(alloc), 
+          pointLights(alloc), staticDraws(alloc) {}
+    ViewSubmission(const ViewSubmission& other, const allocator_type& alloc) 
+        : viewMatrix(other.viewMatrix), projectionMatrix(other.projectionMatrix), 
+          objectRenderData(other.objectRenderData, alloc), textRenderData(other.textRenderData, alloc), 
+          retainedDraws(other.retainedDraws, alloc), pooledDraws(other.pooledDraws, alloc), 
+          sprites(other.sprites, alloc), pointLights(other.pointLights, alloc), staticDraws(other.staticDraws, alloc), 
+          instanceMask(other.instanceMask) {}
+    ViewSubmission(ViewSubmission&& other, const allocator_type& alloc) 
+        : viewMatrix(other.viewMatrix), projectionMatrix(other.projectionMatrix), 
+          objectRenderData(std::move(other.objectRenderData), alloc), textRenderData(std::move(other.textRenderData), alloc), 
+          retainedDraws(std::move(other.retainedDraws), alloc), pooledDraws(std::move(other.pooledDraws), alloc), 
+          sprites(std::move(other.sprites), alloc), pointLights(std::move(other.pointLights), alloc), 
+          staticDraws(std::move(other.staticDraws), alloc), instanceMask(other.instanceMask) {}
+    ViewSubmission(const ViewSubmission&) = default;
+    ViewSubmission(ViewSubmission&&) = default;
+    ViewSubmission& operator=(const ViewSubmission&) = default;
+    ViewSubmission& operator=(ViewSubmission&&) = default;
+
     DirectX::SimpleMath::Matrix viewMatrix;
     DirectX::SimpleMath::Matrix projectionMatrix;
-    std::vector<ObjectRenderData> objectRenderData;
-    std::vector<TextRenderData> textRenderData;
+    FrameVector<ObjectRenderData> objectRenderData;
+    FrameVector<TextRenderData> textRenderData;
+    FrameVector<RetainedBatchDraw> retainedDraws;
+    FrameVector<PooledDraw> pooledDraws;
+    FrameVector<Sprite> sprites;
+    // Lights the pipelines of the view may use, only perspective views are lit by them.
+    FrameVector<PointLight> pointLights;
+    FrameVector<StaticBatchDraw> staticDraws;
+
+    // Which instances of the pools this view draws, see InstancePool::masks.
+    uint32_t instanceMask = 0xFFFFFFFF;
 
 };
 
+// The game builds one FrameSubmission per frame, normally inside the 
+// LinearArena handed to Game::getFrameData. The renderer only borrows it
+// during doFrame, the memory is retired by resetting the arena.
 struct FrameSubmission {
-    std::vector<ViewSubmission> viewSubmissions;
+    using allocator_type = FrameAllocator;
+
+    FrameSubmission() : FrameSubmission(allocator_type{}) {}
+    explicit FrameSubmission(const allocator_type& alloc) 
+        : viewSubmissions(alloc), retainedUpdates(alloc), instancePools(alloc), staticUpdates(alloc) {}
+    FrameSubmission(const FrameSubmission& other, const allocator_type& alloc) 
+        : viewSubmissions(other.viewSubmissions, alloc), retainedUpdates(other.retainedUpdates, alloc), 
+          instancePools(other.instancePools, alloc), staticUpdates(other.staticUpdates, alloc),
+          resizeWidth(other.resizeWidth), resizeHeight(other.resizeHeight) {}
+    FrameSubmission(FrameSubmission&& other, const allocator_type& alloc) 
+        : viewSubmissions(std::move(other.viewSubmissions), alloc), retainedUpdates(std::move(other.retainedUpdates), alloc), 
+          instancePools(std::move(other.instancePools), alloc), staticUpdates(std::move(other.staticUpdates), alloc),
+          resizeWidth(other.resizeWidth), resizeHeight(other.resizeHeight) {}
+    FrameSubmission(const FrameSubmission&) = default;
+    FrameSubmission(FrameSubmission&&) = default;
+    FrameSubmission& operator=(const FrameSubmission&) = default;
+    FrameSubmission& operator=(FrameSubmission&&) = default;
+
+    FrameVector<ViewSubmission> viewSubmissions;
+
+    // Applied by the renderer before any view is drawn.
+    FrameVector<RetainedBatchUpdate> retainedUpdates;
+
+    // Referenced by the PooledDraws of the views.
+    FrameVector<InstancePool> instancePools;
+
+    // Applied by the renderer before any view is drawn, like the retained updates.
+    FrameVector<StaticBatchUpdate> staticUpdates;
+
+    // The new size of the window when it was resized since the last frame, 0 otherwise.
+    // Stamped by the engine loop from the window events, games leave it alone.
+    // The renderer resizes its swap chain from here, it never reads the window itself.
+    uint32_t resizeWidth = 0;
+    uint32_t resizeHeight = 0;
 
 };
 
@@ -141,6 +537,6 @@ class Renderer {
 
     public:
         virtual void initialize(RenderInitData initData) = 0;
-        virtual void doFrame(FrameSubmission frameData) = 0;
+        virtual void doFrame(const FrameSubmission& frameData) = 0;
 
 };
\ No newline at end of file
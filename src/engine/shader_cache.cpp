@@ -0,0 +1,164 @@
+#include "shader_cache.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+static constexpr char entryMagic[8] = {'R', 'T', 'S', 'S', 'H', 'D', 'R', 0};
+// Bump when the entry layout or the hashed inputs change.
+static constexpr uint32_t entryVersion = 1;
+
+struct ShaderCacheEntryHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t bytecodeSize;
+    uint64_t sourceHash;
+};
+
+// FNV-1a, 64 bit.
+static constexpr uint64_t hashSeed = 0xcbf29ce484222325ull;
+
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+{
+    auto bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Length first, so neighbouring strings can't trade characters.
+static uint64_t hashString(uint64_t hash, const std::string& text)
+{
+    uint64_t size = text.size();
+    hash = hashBytes(hash, &size, sizeof(size));
+    return hashBytes(hash, text.data(), text.size());
+}
+
+uint64_t ShaderCache::requestHash(const ShaderCompileRequest& request)
+{
+    uint64_t hash = hashSeed;
+    hash = hashBytes(hash, &entryVersion, sizeof(entryVersion));
+    hash = hashString(hash, request.sourcePath.lexically_normal().generic_string());
+    hash = hashString(hash, request.entryPoint);
+    hash = hashString(hash, request.profile);
+    for (auto& define : request.defines) {
+        hash = hashString(hash, define.name);
+        hash = hashString(hash, define.value);
+    }
+    return hashBytes(hash, &request.flags, sizeof(request.flags));
+}
+
+static bool readText(const fs::path& path, std::string& text)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// Hashes the file and then the files it includes, depth first in the order they appear.
+// Includes which can't be found only contribute their name, the compile will report them.
+static uint64_t hashSourceTree(uint64_t hash, const fs::path& path, std::set<fs::path>& visited)
+{
+    auto normalized = path.lexically_normal();
+    hash = hashString(hash, normalized.generic_string());
+    if (!visited.insert(normalized).second) return hash;
+
+    std::string text;
+    if (!readText(normalized, text)) return hash;
+    hash = hashString(hash, text);
+
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+        auto directive = line.find_first_not_of(" \t");
+        if (directive == std::string::npos || line.compare(directive, 8, "#include") != 0) continue;
+        auto open = line.find_first_of("\"<", directive + 8);
+        if (open == std::string::npos) continue;
+        auto close = line.find(line[open] == '"' ? '"' : '>', open + 1);
+        if (close == std::string::npos) continue;
+
+        hash = hashSourceTree(hash, normalized.parent_path() / line.substr(open + 1, close - open - 1), visited);
+    }
+    return hash;
+}
+
+uint64_t ShaderCache::sourceHash(const fs::path& sourcePath)
+{
+    std::set<fs::path> visited;
+    return hashSourceTree(hashSeed, sourcePath, visited);
+}
+
+ShaderCache::ShaderCache(std::unique_ptr<ShaderCompiler> compiler, fs::path directory)
+    : compiler(std::move(compiler)), directory(std::move(directory))
+{
+    std::error_code error;
+    fs::create_directories(this->directory, error);
+}
+
+bool ShaderCache::readEntry(const fs::path& path, uint64_t source, std::vector<uint8_t>& bytecode) const
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    ShaderCacheEntryHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+    if (memcmp(header.magic, entryMagic, sizeof(entryMagic)) != 0 || header.version != entryVersion ||
+        header.sourceHash != source || header.bytecodeSize == 0) {
+        return false;
+    }
+
+    bytecode.resize(header.bytecodeSize);
+    if (!file.read(reinterpret_cast<char*>(bytecode.data()), bytecode.size())) return false;
+    // Anything after the bytecode means the entry is not what we wrote.
+    return file.peek() == std::ifstream::traits_type::eof();
+}
+
+void ShaderCache::writeEntry(const fs::path& path, uint64_t source, const std::vector<uint8_t>& bytecode) const
+{
+    ShaderCacheEntryHeader header;
+    memcpy(header.magic, entryMagic, sizeof(entryMagic));
+    header.version = entryVersion;
+    header.bytecodeSize = bytecode.size();
+    header.sourceHash = source;
+
+    auto tempPath = path;
+    tempPath += ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file) return;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(bytecode.data()), bytecode.size());
+        if (!file) return;
+    }
+
+    std::error_code error;
+    fs::rename(tempPath, path, error);
+    if (error) fs::remove(tempPath, error);
+}
+
+bool ShaderCache::load(const ShaderCompileRequest& request, std::vector<uint8_t>& bytecode, std::string& errors)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long) requestHash(request));
+    auto entryPath = directory / name;
+    uint64_t source = sourceHash(request.sourcePath);
+
+    if (readEntry(entryPath, source, bytecode)) {
+        cacheStats.hits++;
+        return true;
+    }
+
+    bytecode.clear();
+    cacheStats.compiles++;
+    if (!compiler->compile(request, bytecode, errors)) return false;
+    writeEntry(entryPath, source, bytecode);
+    return true;
+}
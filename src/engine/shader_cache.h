@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct ShaderDefine
+{
+    std::string name;
+    std::string value;
+};
+
+// Everything which decides the bytecode of one shader stage.
+struct ShaderCompileRequest
+{
+    std::filesystem::path sourcePath;
+    std::string entryPoint;
+    std::string profile;
+    std::vector<ShaderDefine> defines;
+    uint32_t flags = 0;
+};
+
+// Compiles one shader stage from its source file, includes are resolved
+// relative to the including file. The backends use the D3D compiler,
+// anything else can stand in for it, e.g. to run the cache without one.
+class ShaderCompiler
+{
+    public:
+        virtual ~ShaderCompiler() = default;
+
+        // Returns false and fills errors if the source does not compile.
+        virtual bool compile(const ShaderCompileRequest& request, std::vector<uint8_t>& bytecode, std::string& errors) = 0;
+};
+
+struct ShaderCacheStats
+{
+    uint32_t hits = 0;
+    uint32_t compiles = 0;
+};
+
+// Keeps compiled shader bytecode in a directory on disk, so startup only
+// compiles shaders which changed since the last run.
+//
+// Every request has one file, named after the hash of source path, entry point,
+// profile, defines and flags. The file stores a second hash over the text of the
+// source and of all files it includes (#include "..." lines, followed recursively).
+// When the entry is missing, damaged or its source hash differs, the stage is
+// compiled again and the entry rewritten. Entries are replaced through a rename,
+// so an interrupted run leaves no half written ones.
+//
+// Failing to read or write the directory only costs the compile.
+class ShaderCache
+{
+    public:
+        ShaderCache(std::unique_ptr<ShaderCompiler> compiler, std::filesystem::path directory);
+
+        // Returns false and fills errors if the stage is not cached and does not compile.
+        bool load(const ShaderCompileRequest& request, std::vector<uint8_t>& bytecode, std::string& errors);
+
+        const ShaderCacheStats& stats() const { return cacheStats; }
+
+        static uint64_t requestHash(const ShaderCompileRequest& request);
+        // Hash over the source file and its includes.
+        static uint64_t sourceHash(const std::filesystem::path& sourcePath);
+
+    private:
+        bool readEntry(const std::filesystem::path& path, uint64_t source, std::vector<uint8_t>& bytecode) const;
+        void writeEntry(const std::filesystem::path& path, uint64_t source, const std::vector<uint8_t>& bytecode) const;
+
+        std::unique_ptr<ShaderCompiler> compiler;
+        std::filesystem::path directory;
+        ShaderCacheStats cacheStats;
+};
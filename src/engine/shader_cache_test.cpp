@@ -0,0 +1,214 @@
+#include "engine_tests.h"
+#include "shader_cache.h"
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+namespace fs = std::filesystem;
+
+// Stands in for the D3D compiler: the bytecode is the text of the source file,
+// a source containing "error" does not compile.
+class StubCompiler : public ShaderCompiler
+{
+    public:
+        bool compile(const ShaderCompileRequest& request, std::vector<uint8_t>& bytecode, std::string& errors) override
+        {
+            compiles++;
+            std::ifstream file(request.sourcePath, std::ios::binary);
+            std::string text(std::istreambuf_iterator<char>(file), {});
+            if (text.find("error") != std::string::npos) {
+                errors = "stub: error in " + request.sourcePath.string();
+                return false;
+            }
+            bytecode.assign(text.begin(), text.end());
+            return true;
+        }
+
+        uint32_t compiles = 0;
+};
+
+static void writeFile(const fs::path& path, const std::string& text)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << text;
+}
+
+static fs::path entryPath(const fs::path& directory, const ShaderCompileRequest& request)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long) ShaderCache::requestHash(request));
+    return directory / name;
+}
+
+// A scratch directory with a shader including a header, removed again at the end.
+struct ShaderFixture
+{
+    fs::path root = fs::temp_directory_path() / "engine_tests_shader_cache";
+    fs::path cacheDirectory = root / "cache";
+    ShaderCompileRequest request;
+    StubCompiler* compiler = new StubCompiler();
+    ShaderCache cache;
+
+    ShaderFixture() : cache(std::unique_ptr<ShaderCompiler>(compiler), prepare(root, cacheDirectory))
+    {
+        request.sourcePath = root / "shaders.hlsl";
+        request.entryPoint = "VSMain";
+        request.profile = "vs_5_0";
+        writeFile(root / "shaders.hlsl", "#include \"common.hlsli\"\nfloat4 VSMain() : SV_Position { return tint; }\n");
+        writeFile(root / "common.hlsli", "static const float4 tint = 1;\n");
+    }
+
+    ~ShaderFixture()
+    {
+        std::error_code error;
+        fs::remove_all(root, error);
+    }
+
+    // Starts with an empty directory, the cache creates its own below.
+    static const fs::path& prepare(const fs::path& root, const fs::path& cacheDirectory)
+    {
+        std::error_code error;
+        fs::remove_all(root, error);
+        fs::create_directories(root, error);
+        return cacheDirectory;
+    }
+
+    bool load(std::vector<uint8_t>& bytecode)
+    {
+        std::string errors;
+        return cache.load(request, bytecode, errors);
+    }
+};
+
+// The first load compiles, the next ones read the entry.
+static void testHitAndMiss()
+{
+    ShaderFixture fixture;
+    std::vector<uint8_t> compiled, cached;
+    CHECK(fixture.load(compiled));
+    CHECK(!compiled.empty());
+    CHECK(fixture.compiler->compiles == 1);
+    CHECK(fs::exists(entryPath(fixture.cacheDirectory, fixture.request)));
+
+    CHECK(fixture.load(cached));
+    CHECK(cached == compiled);
+    CHECK(fixture.compiler->compiles == 1);
+    CHECK(fixture.cache.stats().hits == 1);
+    CHECK(fixture.cache.stats().compiles == 1);
+
+    // Other defines are another entry.
+    fixture.request.defines.push_back({"SKINNED", "1"});
+    CHECK(fixture.load(cached));
+    CHECK(fixture.compiler->compiles == 2);
+    CHECK(fixture.load(cached));
+    CHECK(fixture.compiler->compiles == 2);
+
+    // A new cache on the same directory, like the next run, finds the entries.
+    auto compiler = new StubCompiler();
+    ShaderCache nextRun(std::unique_ptr<ShaderCompiler>(compiler), fixture.cacheDirectory);
+    std::string errors;
+    CHECK(nextRun.load(fixture.request, cached, errors));
+    CHECK(compiler->compiles == 0);
+    CHECK(nextRun.stats().hits == 1);
+}
+
+// Editing the source or a file it includes compiles the stage again.
+static void testInvalidation()
+{
+    ShaderFixture fixture;
+    std::vector<uint8_t> bytecode;
+    CHECK(fixture.load(bytecode));
+
+    writeFile(fixture.root / "common.hlsli", "static const float4 tint = 0.5;\n");
+    CHECK(fixture.load(bytecode));
+    CHECK(fixture.compiler->compiles == 2);
+    CHECK(fixture.load(bytecode));
+    CHECK(fixture.compiler->compiles == 2);
+
+    writeFile(fixture.request.sourcePath, "float4 VSMain() : SV_Position { return 0; }\n");
+    CHECK(fixture.load(bytecode));
+    CHECK(fixture.compiler->compiles == 3);
+    CHECK(std::string(bytecode.begin(), bytecode.end()).starts_with("float4 VSMain"));
+
+    // A source which does not compile reports it every time,
+    // the entry of its previous version is not taken for it.
+    writeFile(fixture.request.sourcePath, "error\n");
+    std::string errors;
+    CHECK(!fixture.cache.load(fixture.request, bytecode, errors));
+    CHECK(!errors.empty());
+    CHECK(!fixture.load(bytecode));
+    CHECK(fixture.compiler->compiles == 5);
+}
+
+// Truncated or damaged entries are compiled again and rewritten.
+static void testDamagedEntries()
+{
+    ShaderFixture fixture;
+    std::vector<uint8_t> compiled, bytecode;
+    CHECK(fixture.load(compiled));
+    auto entry = entryPath(fixture.cacheDirectory, fixture.request);
+    auto size = fs::file_size(entry);
+
+    fs::resize_file(entry, size - 1);
+    CHECK(fixture.load(bytecode));
+    CHECK(bytecode == compiled);
+    CHECK(fixture.compiler->compiles == 2);
+    CHECK(fs::file_size(entry) == size);
+
+    fs::resize_file(entry, 4);
+    CHECK(fixture.load(bytecode));
+    CHECK(fixture.compiler->compiles == 3);
+
+    // Trailing bytes, e.g. of a longer entry written over.
+    {
+        std::ofstream file(entry, std::ios::binary | std::ios::app);
+        file << "x";
+    }
+    CHECK(fixture.load(bytecode));
+    CHECK(fixture.compiler->compiles == 4);
+
+    // A broken magic.
+    {
+        std::fstream file(entry, std::ios::binary | std::ios::in | std::ios::out);
+        file.write("XXXX", 4);
+    }
+    CHECK(fixture.load(bytecode));
+    CHECK(bytecode == compiled);
+    CHECK(fixture.compiler->compiles == 5);
+
+    CHECK(fixture.load(bytecode));
+    CHECK(fixture.compiler->compiles == 5);
+}
+
+// Entries are written to a temporary file and renamed, a temporary file
+// left by an interrupted run is never taken for the entry.
+static void testAtomicRename()
+{
+    ShaderFixture fixture;
+    auto entry = entryPath(fixture.cacheDirectory, fixture.request);
+    auto tempPath = entry;
+    tempPath += ".tmp";
+    writeFile(tempPath, "RTSSHDR");
+
+    std::vector<uint8_t> compiled, bytecode;
+    CHECK(fixture.load(compiled));
+    CHECK(fixture.compiler->compiles == 1);
+    CHECK(fs::exists(entry));
+    CHECK(!fs::exists(tempPath));
+
+    for (auto& file : fs::directory_iterator(fixture.cacheDirectory)) {
+        CHECK(file.path().extension() == ".bin");
+    }
+
+    CHECK(fixture.load(bytecode));
+    CHECK(bytecode == compiled);
+    CHECK(fixture.compiler->compiles == 1);
+}
+
+void testShaderCache()
+{
+    testHitAndMiss();
+    testInvalidation();
+    testDamagedEntries();
+    testAtomicRename();
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <bit>
+#include <cstdint>
+
+// ENGINE_SSE2 is defined when the build targets SSE2, which every x64 build does.
+// The vector loops of the engine use it, with plain C++ as the fallback.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ENGINE_SSE2 1
+#endif
+
+// Maps the float to an unsigned value of the same order, e.g. for the depth of a sort key.
+inline uint32_t sortableFloat(float value)
+{
+    uint32_t bits = std::bit_cast<uint32_t>(value);
+    return (bits & 0x80000000) ? ~bits : bits | 0x80000000;
+}
@@ -0,0 +1,74 @@
+#include "sprite_batcher.h"
+#include "simd_util.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace DirectX::SimpleMath;
+
+static uint32_t unorm(float value, float scale)
+{
+    return (uint32_t) std::lround(std::clamp(value, 0.0f, 1.0f) * scale);
+}
+
+uint32_t packUnorm16x2(float x, float y)
+{
+    return unorm(x, 65535.0f) | unorm(y, 65535.0f) << 16;
+}
+
+uint32_t packColor(const Vector4& color)
+{
+    return unorm(color.x, 255.0f) | unorm(color.y, 255.0f) << 8 |
+            unorm(color.z, 255.0f) << 16 | unorm(color.w, 255.0f) << 24;
+}
+
+void SpriteBatcher::build(const FrameSubmission& frame)
+{
+    assert(frame.viewSubmissions.size() <= RenderQueue::maxViews);
+
+    order.clear();
+    batches.clear();
+    std::fill(std::begin(viewBatchBegin), std::end(viewBatchBegin), 0);
+
+    uint32_t numViews = std::min<uint32_t>(frame.viewSubmissions.size(), RenderQueue::maxViews);
+    for (uint32_t v = 0; v < numViews; v++) {
+        auto& sprites = frame.viewSubmissions[v].sprites;
+
+        // Far layers first, inside a layer by page.
+        // The sort is stable, so sprites with the same key keep their order.
+        entries.clear();
+        for (uint32_t i = 0; i < sprites.size(); i++) {
+            uint64_t inverseLayer = ~sortableFloat(sprites[i].record.layer);
+            entries.push_back({inverseLayer << 32 | sprites[i].texture.index, i});
+        }
+        radixSort(entries, scratch);
+
+        for (auto& e : entries) {
+            auto& sprite = sprites[e.index];
+            if (viewBatchBegin[v + 1] > 0 && batches.back().texture == sprite.texture) {
+                batches.back().spriteCount++;
+            } else {
+                batches.push_back({sprite.texture, (uint32_t) order.size(), 1});
+                viewBatchBegin[v + 1]++;
+            }
+            order.push_back(&sprite);
+        }
+    }
+
+    for (uint32_t v = 0; v < RenderQueue::maxViews; v++) {
+        viewBatchBegin[v + 1] += viewBatchBegin[v];
+    }
+}
+
+std::span<const SpriteBatch> SpriteBatcher::viewBatches(uint32_t view) const
+{
+    if (view >= RenderQueue::maxViews) return {};
+    return std::span<const SpriteBatch>(batches).subspan(viewBatchBegin[view], viewBatchBegin[view + 1] - viewBatchBegin[view]);
+}
+
+void SpriteBatcher::writeRecords(SpriteRecord* out) const
+{
+    for (auto* sprite : order) {
+        *out++ = sprite->record;
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "renderer.h"
+#include "render_queue.h"
+
+// Packs two values in [0, 1] as 16 bit unorm, x in the low half, e.g. for SpriteRecord::uvMin.
+uint32_t packUnorm16x2(float x, float y);
+// Packs a color with components in [0, 1] as RGBA8, red in the low byte.
+uint32_t packColor(const DirectX::SimpleMath::Vector4& color);
+
+// Consecutive sprites of a view on the same atlas page, drawn as one draw.
+struct SpriteBatch
+{
+    TextureHandle texture;
+    uint32_t firstSprite;
+    uint32_t spriteCount;
+};
+
+// Brings the sprites of a frame into draw order and groups them into batches.
+// Inside a view the sprites are drawn back to front by layer. The sprites of
+// a layer are grouped by atlas page, otherwise they keep the order the game
+// submitted them in. So a HUD costs a draw per page and layer in the worst case,
+// neighbouring layers on the same page share their draw.
+// Like the RenderQueue it only orders, the backend uploads and draws.
+class SpriteBatcher
+{
+    public:
+        void build(const FrameSubmission& frame);
+
+        std::span<const SpriteBatch> viewBatches(uint32_t view) const;
+
+        // All sprites of the frame, the batches of every view index into them.
+        uint32_t spriteCount() const { return static_cast<uint32_t>(order.size()); }
+
+        // Copies the records of all sprites in draw order to out[0, spriteCount()).
+        void writeRecords(SpriteRecord* out) const;
+
+    private:
+        std::vector<const Sprite*> order;
+        std::vector<SortEntry> entries;
+        std::vector<SortEntry> scratch;
+        std::vector<SpriteBatch> batches;
+        uint32_t viewBatchBegin[RenderQueue::maxViews + 1] = {};
+};
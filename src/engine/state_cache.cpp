@@ -0,0 +1,83 @@
+#include "state_cache.h"
+#include <cassert>
+#include <cstring>
+
+// Nothing real is ever bound with this value, so the first bind after invalidate() is issued.
+static constexpr uint64_t unknownBinding = ~uint64_t(0);
+
+uint32_t StateCacheStats::issuedCalls() const
+{
+    uint32_t total = constantUpdatesIssued;
+    for (auto count : issued) total += count;
+    return total;
+}
+
+uint32_t StateCacheStats::filteredCalls() const
+{
+    uint32_t total = constantUpdatesFiltered;
+    for (auto count : filtered) total += count;
+    return total;
+}
+
+StateCacheStats& StateCacheStats::operator+=(const StateCacheStats& other)
+{
+    for (uint32_t i = 0; i < stateKindCount; i++) {
+        issued[i] += other.issued[i];
+        filtered[i] += other.filtered[i];
+    }
+    constantUpdatesIssued += other.constantUpdatesIssued;
+    constantUpdatesFiltered += other.constantUpdatesFiltered;
+    return *this;
+}
+
+bool StateCache::bind(StateKind kind, uint32_t slot, uint64_t object, uint64_t parameter)
+{
+    assert(slot < maxSlots);
+    auto k = static_cast<uint32_t>(kind);
+    auto& binding = bound[k][slot];
+    if (binding.object == object && binding.parameter == parameter) {
+        cacheStats.filtered[k]++;
+        return false;
+    }
+    binding = {object, parameter};
+    cacheStats.issued[k]++;
+    return true;
+}
+
+bool StateCache::updateConstants(uint64_t buffer, const void* data, size_t size)
+{
+    for (auto& content : constants) {
+        if (content.buffer != buffer) continue;
+        if (content.data.size() == size && memcmp(content.data.data(), data, size) == 0) {
+            cacheStats.constantUpdatesFiltered++;
+            return false;
+        }
+        content.data.assign(static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+        cacheStats.constantUpdatesIssued++;
+        return true;
+    }
+
+    auto bytes = static_cast<const uint8_t*>(data);
+    constants.push_back({buffer, std::vector<uint8_t>(bytes, bytes + size)});
+    cacheStats.constantUpdatesIssued++;
+    return true;
+}
+
+void StateCache::forget(StateKind kind, uint32_t slot)
+{
+    bound[static_cast<uint32_t>(kind)][slot] = {unknownBinding, unknownBinding};
+}
+
+void StateCache::invalidate()
+{
+    for (auto& slots : bound) {
+        for (auto& binding : slots) {
+            binding = {unknownBinding, unknownBinding};
+        }
+    }
+}
+
+void StateCache::forgetConstants(uint64_t buffer)
+{
+    std::erase_if(constants, [buffer](const ConstantContent& content) { return content.buffer == buffer; });
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The kinds of device state a StateCache shadows.
+enum class StateKind : uint8_t
+{
+    Topology,
+    InputLayout,
+    VertexShader,
+    PixelShader,
+    VertexBuffer,
+    IndexBuffer,
+    VertexConstantBuffer,
+    PixelConstantBuffer,
+    VertexResource,
+    PixelResource,
+    Sampler,
+    RenderTargets,
+    Viewport,
+    Count
+};
+
+constexpr uint32_t stateKindCount = static_cast<uint32_t>(StateKind::Count);
+
+struct StateCacheStats
+{
+    uint32_t issued[stateKindCount] = {};
+    uint32_t filtered[stateKindCount] = {};
+    // Constant buffer uploads, skipped when the content did not change.
+    uint32_t constantUpdatesIssued = 0;
+    uint32_t constantUpdatesFiltered = 0;
+
+    uint32_t issuedCalls() const;
+    uint32_t filteredCalls() const;
+    StateCacheStats& operator+=(const StateCacheStats& other);
+};
+
+// Shadow copy of what is bound on a device context, so the backend
+// can drop calls that would set what is already set.
+// The cache only compares values, the backend makes the calls,
+// so it works with any API, or no device at all like in the RecordingRenderer.
+// Objects are identified by their address or any other 64 bit value,
+// parameter covers what else belongs to the binding, e.g. the vertex stride.
+class StateCache
+{
+    public:
+        static constexpr uint32_t maxSlots = 16;
+
+        StateCache() { invalidate(); }
+
+        // Returns true if the call has to go to the device.
+        bool bind(StateKind kind, uint32_t slot, uint64_t object, uint64_t parameter = 0);
+        template <typename T>
+        bool bind(StateKind kind, uint32_t slot, T* object, uint64_t parameter = 0)
+        {
+            return bind(kind, slot, reinterpret_cast<uintptr_t>(object), parameter);
+        }
+
+        // Returns true if buffer has to be updated, i.e. the last
+        // update through the cache had a different content.
+        bool updateConstants(uint64_t buffer, const void* data, size_t size);
+        template <typename T>
+        bool updateConstants(T* buffer, const void* data, size_t size)
+        {
+            return updateConstants(reinterpret_cast<uintptr_t>(buffer), data, size);
+        }
+
+        // Something was bound behind the back of the cache.
+        void forget(StateKind kind, uint32_t slot = 0);
+        // Forgets all bindings, e.g. at the start of a frame or after a resize.
+        // The remembered constant buffer contents stay valid.
+        void invalidate();
+        // The buffer was recreated or written without the cache.
+        void forgetConstants(uint64_t buffer);
+
+        const StateCacheStats& stats() const { return cacheStats; }
+        void resetStats() { cacheStats = {}; }
+
+    private:
+        struct Binding
+        {
+            uint64_t object;
+            uint64_t parameter;
+        };
+
+        struct ConstantContent
+        {
+            uint64_t buffer;
+            std::vector<uint8_t> data;
+        };
+
+        Binding bound[stateKindCount][maxSlots];
+        // Only a handful of constant buffers exist, a linear search is fine.
+        std::vector<ConstantContent> constants;
+        StateCacheStats cacheStats;
+};
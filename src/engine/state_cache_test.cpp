@@ -0,0 +1,130 @@
+#include "engine_tests.h"
+#include "state_cache.h"
+
+// Stand-ins for device objects, only their addresses matter.
+static int vertexShader;
+static int otherVertexShader;
+static int vertexBuffer;
+static int constantBuffer;
+
+// Repeated binds of the same object and parameter are filtered, per kind and slot.
+static void testFilter()
+{
+    StateCache cache;
+    CHECK(cache.bind(StateKind::VertexShader, 0, &vertexShader));
+    CHECK(!cache.bind(StateKind::VertexShader, 0, &vertexShader));
+    CHECK(cache.bind(StateKind::VertexShader, 0, &otherVertexShader));
+    CHECK(cache.bind(StateKind::VertexShader, 0, &vertexShader));
+
+    // The same object in another slot or as another kind is a different binding.
+    CHECK(cache.bind(StateKind::PixelResource, 0, &vertexBuffer));
+    CHECK(cache.bind(StateKind::PixelResource, 1, &vertexBuffer));
+    CHECK(cache.bind(StateKind::VertexResource, 0, &vertexBuffer));
+    CHECK(!cache.bind(StateKind::PixelResource, 1, &vertexBuffer));
+
+    // The parameter is part of the binding, e.g. the stride of a vertex buffer.
+    CHECK(cache.bind(StateKind::VertexBuffer, 0, &vertexBuffer, 32));
+    CHECK(!cache.bind(StateKind::VertexBuffer, 0, &vertexBuffer, 32));
+    CHECK(cache.bind(StateKind::VertexBuffer, 0, &vertexBuffer, 16));
+
+    // Plain values work as well as addresses, unbinding included.
+    CHECK(cache.bind(StateKind::Topology, 0, 4));
+    CHECK(!cache.bind(StateKind::Topology, 0, 4));
+    CHECK(cache.bind(StateKind::PixelResource, 1, static_cast<int*>(nullptr)));
+    CHECK(!cache.bind(StateKind::PixelResource, 1, static_cast<int*>(nullptr)));
+}
+
+// The first bind after invalidate() or forget() always goes to the device.
+static void testInvalidate()
+{
+    StateCache cache;
+    cache.bind(StateKind::VertexShader, 0, &vertexShader);
+    cache.bind(StateKind::PixelResource, 0, &vertexBuffer);
+    cache.bind(StateKind::PixelResource, 1, &vertexBuffer);
+
+    cache.forget(StateKind::PixelResource, 1);
+    CHECK(!cache.bind(StateKind::VertexShader, 0, &vertexShader));
+    CHECK(!cache.bind(StateKind::PixelResource, 0, &vertexBuffer));
+    CHECK(cache.bind(StateKind::PixelResource, 1, &vertexBuffer));
+
+    // Nothing bound yet must not be mistaken for a null binding.
+    cache.forget(StateKind::PixelShader);
+    CHECK(cache.bind(StateKind::PixelShader, 0, static_cast<int*>(nullptr)));
+
+    cache.invalidate();
+    CHECK(cache.bind(StateKind::VertexShader, 0, &vertexShader));
+    CHECK(cache.bind(StateKind::PixelResource, 0, &vertexBuffer));
+    CHECK(cache.bind(StateKind::PixelResource, 1, &vertexBuffer));
+}
+
+// Constant updates are compared by content, which survives invalidate().
+static void testConstants()
+{
+    StateCache cache;
+    float tint[4] = {1, 0, 1, 1};
+    CHECK(cache.updateConstants(&constantBuffer, tint, sizeof(tint)));
+    CHECK(!cache.updateConstants(&constantBuffer, tint, sizeof(tint)));
+
+    // Same content from another address is still the same content.
+    float sameTint[4] = {1, 0, 1, 1};
+    CHECK(!cache.updateConstants(&constantBuffer, sameTint, sizeof(sameTint)));
+
+    tint[3] = 0.5f;
+    CHECK(cache.updateConstants(&constantBuffer, tint, sizeof(tint)));
+    CHECK(!cache.updateConstants(&constantBuffer, tint, sizeof(tint)));
+    CHECK(cache.updateConstants(&constantBuffer, tint, sizeof(float) * 3));
+
+    // Each buffer remembers its own content.
+    CHECK(cache.updateConstants(&vertexBuffer, tint, sizeof(float) * 3));
+    CHECK(!cache.updateConstants(&constantBuffer, tint, sizeof(float) * 3));
+
+    cache.invalidate();
+    CHECK(!cache.updateConstants(&constantBuffer, tint, sizeof(float) * 3));
+
+    cache.forgetConstants(reinterpret_cast<uintptr_t>(&constantBuffer));
+    CHECK(cache.updateConstants(&constantBuffer, tint, sizeof(float) * 3));
+    CHECK(!cache.updateConstants(&vertexBuffer, tint, sizeof(float) * 3));
+}
+
+// Every call is counted as issued or filtered, per kind.
+static void testCounts()
+{
+    StateCache cache;
+    for (int i = 0; i < 3; i++) {
+        cache.bind(StateKind::VertexShader, 0, &vertexShader);
+        cache.bind(StateKind::VertexBuffer, 0, &vertexBuffer, 32);
+    }
+    cache.bind(StateKind::VertexShader, 0, &otherVertexShader);
+    float tint[4] = {1, 1, 1, 1};
+    cache.updateConstants(&constantBuffer, tint, sizeof(tint));
+    cache.updateConstants(&constantBuffer, tint, sizeof(tint));
+
+    auto& stats = cache.stats();
+    CHECK(stats.issued[static_cast<uint32_t>(StateKind::VertexShader)] == 2);
+    CHECK(stats.filtered[static_cast<uint32_t>(StateKind::VertexShader)] == 2);
+    CHECK(stats.issued[static_cast<uint32_t>(StateKind::VertexBuffer)] == 1);
+    CHECK(stats.filtered[static_cast<uint32_t>(StateKind::VertexBuffer)] == 2);
+    CHECK(stats.constantUpdatesIssued == 1);
+    CHECK(stats.constantUpdatesFiltered == 1);
+    CHECK(stats.issuedCalls() == 4);
+    CHECK(stats.filteredCalls() == 5);
+
+    StateCacheStats total;
+    total += stats;
+    total += stats;
+    CHECK(total.issuedCalls() == 8);
+    CHECK(total.filteredCalls() == 10);
+
+    cache.resetStats();
+    CHECK(cache.stats().issuedCalls() == 0);
+    CHECK(cache.stats().filteredCalls() == 0);
+    CHECK(!cache.bind(StateKind::VertexShader, 0, &otherVertexShader));
+}
+
+void testStateCache()
+{
+    testFilter();
+    testInvalidate();
+    testConstants();
+    testCounts();
+}
@@ -0,0 +1,220 @@
+#include "static_batcher.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+using namespace DirectX::SimpleMath;
+
+void StaticBatcher::initialize(const RenderInitData& initData, float chunkSize)
+{
+    this->chunkSize = chunkSize;
+
+    meshes.clear();
+    for (auto& md : initData.meshDescriptors) {
+        meshes.push_back({md.geometry.vertices, md.geometry.indices, md.occluder});
+    }
+
+    layouts.clear();
+    for (auto& pso : initData.pipelineStates) {
+        auto& layout = layouts.emplace_back();
+        layout.floatsPerVertex = pso.inputLayout.stride() / sizeof(float);
+        auto position = pso.inputLayout.elementOffset(InputElementType::POSITION);
+        auto normal = pso.inputLayout.elementOffset(InputElementType::NORMAL);
+        if (position != InputLayout::invalidElementOffset) layout.position = position / sizeof(float);
+        if (normal != InputLayout::invalidElementOffset) layout.normal = normal / sizeof(float);
+    }
+
+    batches.clear();
+    batchIndices.clear();
+    objects.clear();
+    freeObjects.clear();
+    batchStats = {};
+}
+
+uint32_t StaticBatcher::findOrCreateBatch(const StaticObjectDesc& desc)
+{
+    auto chunkX = (int32_t) std::floor(desc.transform._41 / chunkSize);
+    auto chunkZ = (int32_t) std::floor(desc.transform._43 / chunkSize);
+    uint64_t key = (uint64_t) (uint16_t) chunkX << 48 | (uint64_t) (uint16_t) chunkZ << 32 |
+                   (uint64_t) (desc.texture.index & 0xFFFF) << 16 | (desc.pipeline.index & 0xFFFF);
+
+    auto [it, created] = batchIndices.try_emplace(key, (uint32_t) batches.size());
+    if (created) {
+        auto& batch = batches.emplace_back();
+        batch.texture = desc.texture;
+        batch.pipeline = desc.pipeline;
+    }
+    return it->second;
+}
+
+void StaticBatcher::updateBounds(Batch& batch)
+{
+    batch.boundsMin = Vector3(std::numeric_limits<float>::max());
+    batch.boundsMax = Vector3(-std::numeric_limits<float>::max());
+    for (auto o : batch.parts) {
+        batch.boundsMin = Vector3::Min(batch.boundsMin, objects[o].boundsMin);
+        batch.boundsMax = Vector3::Max(batch.boundsMax, objects[o].boundsMax);
+    }
+}
+
+StaticObjectHandle StaticBatcher::add(const StaticObjectDesc& desc)
+{
+    assert(desc.mesh.index < meshes.size() && desc.pipeline.index < layouts.size());
+    auto& mesh = meshes[desc.mesh.index];
+    auto& layout = layouts[desc.pipeline.index];
+    assert(layout.floatsPerVertex > 0 && layout.position != InputLayout::invalidElementOffset);
+
+    uint32_t objectIndex;
+    if (!freeObjects.empty()) {
+        objectIndex = freeObjects.back();
+        freeObjects.pop_back();
+    } else {
+        objectIndex = objects.size();
+        objects.emplace_back();
+    }
+
+    auto batchIndex = findOrCreateBatch(desc);
+    auto& batch = batches[batchIndex];
+    auto& object = objects[objectIndex];
+    object.batch = batchIndex;
+    object.part = batch.parts.size();
+    object.firstVertex = batch.vertices.size() / layout.floatsPerVertex;
+    object.vertexCount = mesh.vertices.size() / layout.floatsPerVertex;
+    object.firstIndex = batch.indices.size();
+    object.indexCount = mesh.indices.size();
+    object.mesh = desc.mesh;
+    object.transform = desc.transform;
+    object.alive = true;
+
+    // Into world space, normals only rotate, so they stay correct for uniform scales.
+    auto& w = desc.transform;
+    Vector3 boundsMin(std::numeric_limits<float>::max());
+    Vector3 boundsMax(-std::numeric_limits<float>::max());
+    batch.vertices.insert(batch.vertices.end(), mesh.vertices.begin(),
+                          mesh.vertices.begin() + object.vertexCount * layout.floatsPerVertex);
+    float* vertex = batch.vertices.data() + (size_t) object.firstVertex * layout.floatsPerVertex;
+    for (uint32_t v = 0; v < object.vertexCount; v++, vertex += layout.floatsPerVertex) {
+        float* p = vertex + layout.position;
+        auto position = Vector3::Transform(Vector3(p[0], p[1], p[2]), w);
+        p[0] = position.x;
+        p[1] = position.y;
+        p[2] = position.z;
+        boundsMin = Vector3::Min(boundsMin, position);
+        boundsMax = Vector3::Max(boundsMax, position);
+
+        if (layout.normal == InputLayout::invalidElementOffset) continue;
+        float* n = vertex + layout.normal;
+        auto normal = Vector3::TransformNormal(Vector3(n[0], n[1], n[2]), w);
+        normal.Normalize();
+        n[0] = normal.x;
+        n[1] = normal.y;
+        n[2] = normal.z;
+    }
+    object.boundsMin = boundsMin;
+    object.boundsMax = boundsMax;
+
+    batch.indices.reserve(batch.indices.size() + object.indexCount);
+    for (auto index : mesh.indices) {
+        batch.indices.push_back(object.firstVertex + index);
+    }
+
+    batch.parts.push_back(objectIndex);
+    if (batch.parts.size() == 1) {
+        batch.boundsMin = boundsMin;
+        batch.boundsMax = boundsMax;
+    } else {
+        batch.boundsMin = Vector3::Min(batch.boundsMin, boundsMin);
+        batch.boundsMax = Vector3::Max(batch.boundsMax, boundsMax);
+    }
+    batch.dirty = true;
+
+    return StaticObjectHandle{objectIndex};
+}
+
+void StaticBatcher::remove(StaticObjectHandle handle)
+{
+    auto& object = objects[handle.index];
+    assert(object.alive);
+    auto& batch = batches[object.batch];
+    auto& layout = layouts[batch.pipeline.index];
+
+    // Cut the geometry out, the objects behind it move to the front
+    // and their indices with them.
+    auto vertexBegin = batch.vertices.begin() + (size_t) object.firstVertex * layout.floatsPerVertex;
+    batch.vertices.erase(vertexBegin, vertexBegin + (size_t) object.vertexCount * layout.floatsPerVertex);
+    auto indexBegin = batch.indices.begin() + object.firstIndex;
+    batch.indices.erase(indexBegin, indexBegin + object.indexCount);
+    for (size_t i = object.firstIndex; i < batch.indices.size(); i++) {
+        batch.indices[i] -= object.vertexCount;
+    }
+
+    batch.parts.erase(batch.parts.begin() + object.part);
+    for (uint32_t part = object.part; part < batch.parts.size(); part++) {
+        auto& moved = objects[batch.parts[part]];
+        moved.part = part;
+        moved.firstVertex -= object.vertexCount;
+        moved.firstIndex -= object.indexCount;
+    }
+
+    updateBounds(batch);
+    batch.dirty = true;
+
+    object.alive = false;
+    freeObjects.push_back(handle.index);
+}
+
+void StaticBatcher::writeUpdates(FrameSubmission& frame, LinearArena& frameArena)
+{
+    batchStats.objects = objectCount();
+    batchStats.batches = 0;
+    batchStats.rebuiltBatches = 0;
+    batchStats.rebuiltBytes = 0;
+
+    for (uint32_t b = 0; b < batches.size(); b++) {
+        auto& batch = batches[b];
+        if (!batch.parts.empty()) batchStats.batches++;
+        if (!batch.dirty) continue;
+
+        auto& update = frame.staticUpdates.emplace_back();
+        update.batch = b;
+        batch.dirty = false;
+        batchStats.rebuiltBatches++;
+        if (batch.parts.empty()) continue;
+
+        auto* vertices = static_cast<float*>(frameArena.allocate(batch.vertices.size() * sizeof(float), alignof(float)));
+        std::copy(batch.vertices.begin(), batch.vertices.end(), vertices);
+        auto* indices = static_cast<uint32_t*>(frameArena.allocate(batch.indices.size() * sizeof(uint32_t), alignof(uint32_t)));
+        std::copy(batch.indices.begin(), batch.indices.end(), indices);
+        update.vertices = {vertices, batch.vertices.size()};
+        update.indices = {indices, batch.indices.size()};
+
+        uint32_t numOccluders = 0;
+        for (auto o : batch.parts) {
+            if (meshes[objects[o].mesh.index].occluder) numOccluders++;
+        }
+        if (numOccluders > 0) {
+            auto* occluders = static_cast<StaticOccluder*>(frameArena.allocate(numOccluders * sizeof(StaticOccluder),
+                                                                               alignof(StaticOccluder)));
+            uint32_t next = 0;
+            for (auto o : batch.parts) {
+                auto& object = objects[o];
+                if (meshes[object.mesh.index].occluder) occluders[next++] = {object.mesh, object.transform};
+            }
+            update.occluders = {occluders, numOccluders};
+        }
+
+        batchStats.rebuiltBytes += update.vertices.size_bytes() + update.indices.size_bytes();
+    }
+}
+
+void StaticBatcher::writeDraws(ViewSubmission& view) const
+{
+    for (uint32_t b = 0; b < batches.size(); b++) {
+        auto& batch = batches[b];
+        if (batch.parts.empty()) continue;
+
+        view.staticDraws.push_back({b, batch.texture, batch.pipeline, (uint32_t) batch.indices.size(),
+                                    batch.boundsMin, batch.boundsMax});
+    }
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <directxtk/SimpleMath.h>
+#include "renderer.h"
+#include "frame_arena.h"
+
+using StaticObjectHandle = ResourceHandle<struct StaticObjectTag>;
+
+struct StaticObjectDesc
+{
+    MeshHandle mesh;
+    TextureHandle texture;
+    PipelineHandle pipeline;
+    DirectX::SimpleMath::Matrix transform;
+};
+
+struct StaticBatchStats
+{
+    uint32_t objects = 0;
+    // Batches with any objects in them.
+    uint32_t batches = 0;
+    // Batches rebuilt by the last writeUpdates(), and the bytes of geometry they sent.
+    uint32_t rebuiltBatches = 0;
+    uint64_t rebuiltBytes = 0;
+};
+
+// Merges the geometry of objects which never move, like placed buildings, into
+// one vertex and index buffer per map chunk and material, so a whole base costs
+// a few draws per visible chunk instead of one per building type.
+//
+// The map is cut into squares of chunkSize world units along x and z, an object
+// belongs to the chunk its origin is in. All objects of a chunk with the same
+// texture and pipeline form one batch. Its vertices are transformed into world
+// space once, when the object is added, so they need the input layout of the pipeline
+// and the pipeline is drawn with an identity instance.
+//
+// Adding an object appends its geometry to its batch, removing one cuts it out
+// and shifts the objects behind it, only the changed batches are sent again
+// through the StaticBatchUpdates of the next frame. Batches are culled as a whole
+// by their bounds (see StaticBatchDraw), the occluder meshes among the objects
+// still hide what is behind them.
+class StaticBatcher
+{
+    public:
+        // Keeps a copy of the geometry of the meshes and the vertex layouts of the pipelines.
+        void initialize(const RenderInitData& initData, float chunkSize = 32);
+
+        StaticObjectHandle add(const StaticObjectDesc& desc);
+        void remove(StaticObjectHandle object);
+
+        // Copies the geometry of every batch changed since the last call into the frame.
+        // Must be called exactly once per frame.
+        void writeUpdates(FrameSubmission& frame, LinearArena& frameArena);
+
+        // Adds one draw per non-empty batch to the view.
+        void writeDraws(ViewSubmission& view) const;
+
+        uint32_t objectCount() const { return objects.size() - freeObjects.size(); }
+        const StaticBatchStats& stats() const { return batchStats; }
+
+    private:
+        struct MeshSource
+        {
+            std::vector<float> vertices;
+            std::vector<uint32_t> indices;
+            bool occluder = false;
+        };
+
+        // Where positions and normals are inside a vertex of a pipeline, in floats.
+        struct VertexLayout
+        {
+            uint32_t floatsPerVertex = 0;
+            uint32_t position = InputLayout::invalidElementOffset;
+            uint32_t normal = InputLayout::invalidElementOffset;
+        };
+
+        struct Batch
+        {
+            TextureHandle texture;
+            PipelineHandle pipeline;
+            std::vector<float> vertices;
+            std::vector<uint32_t> indices;
+            // The objects in the order their geometry is stored.
+            std::vector<uint32_t> parts;
+            DirectX::SimpleMath::Vector3 boundsMin;
+            DirectX::SimpleMath::Vector3 boundsMax;
+            bool dirty = false;
+        };
+
+        struct Object
+        {
+            uint32_t batch = 0;
+            // Position in Batch::parts.
+            uint32_t part = 0;
+            uint32_t firstVertex = 0;
+            uint32_t vertexCount = 0;
+            uint32_t firstIndex = 0;
+            uint32_t indexCount = 0;
+            MeshHandle mesh;
+            DirectX::SimpleMath::Matrix transform;
+            DirectX::SimpleMath::Vector3 boundsMin;
+            DirectX::SimpleMath::Vector3 boundsMax;
+            bool alive = false;
+        };
+
+        uint32_t findOrCreateBatch(const StaticObjectDesc& desc);
+        void updateBounds(Batch& batch);
+
+        float chunkSize = 32;
+        std::vector<MeshSource> meshes;
+        std::vector<VertexLayout> layouts;
+
+        std::vector<Batch> batches;
+        // Chunk, texture and pipeline of a batch, packed, to its index.
+        std::unordered_map<uint64_t, uint32_t> batchIndices;
+        std::vector<Object> objects;
+        std::vector<uint32_t> freeObjects;
+        StaticBatchStats batchStats;
+};
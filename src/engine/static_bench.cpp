@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "frame_arena.h"
+#include "render_queue.h"
+#include "static_batcher.h"
+
+using namespace DirectX::SimpleMath;
+
+// A box of size w x h x d standing on the ground, in the POSITION, UV, NORMAL layout.
+static Geometry boxGeometry(float w, float h, float d)
+{
+    Geometry geometry;
+    const Vector3 normals[] = {{1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+    for (auto& n : normals) {
+        // Two axes spanning the face.
+        Vector3 u = n.y != 0 ? Vector3(1, 0, 0) : Vector3(n.z, 0, -n.x);
+        Vector3 v = n.y != 0 ? Vector3(0, 0, n.y) : Vector3(0, 1, 0);
+        uint32_t first = geometry.positions.size();
+        const float corners[4][2] = {{-1, -1}, {1, -1}, {1, 1}, {-1, 1}};
+        for (auto& c : corners) {
+            auto p = n + u * c[0] + v * c[1];
+            Vector3 position(p.x * w * 0.5f, (p.y + 1) * h * 0.5f, p.z * d * 0.5f);
+            geometry.positions.push_back(position);
+            geometry.vertices.insert(geometry.vertices.end(), {position.x, position.y, position.z,
+                                     (c[0] + 1) * 0.5f, (c[1] + 1) * 0.5f, n.x, n.y, n.z});
+        }
+        geometry.indices.insert(geometry.indices.end(), {first, first + 1, first + 2, first, first + 2, first + 3});
+    }
+    return geometry;
+}
+
+// Measures the StaticBatcher on the CPU: a late game map full of buildings of
+// several types, some of them placed and destroyed every frame, drawn with
+// the game's camera through the RenderQueue.
+// Usage: static_bench [buildings=<n>] [types=<n>] [churn=<per frame>] [frames=<n>]
+int main(int argc, char ** args) {
+
+    uint32_t numBuildings = 2000;
+    uint32_t numTypes = 12;
+    uint32_t churn = 2;
+    uint32_t numFrames = 500;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(args[i], "buildings=", 10) == 0) {
+            numBuildings = atoi(args[i] + 10);
+        } else if (strncmp(args[i], "types=", 6) == 0) {
+            numTypes = std::max(1, atoi(args[i] + 6));
+        } else if (strncmp(args[i], "churn=", 6) == 0) {
+            churn = atoi(args[i] + 6);
+        } else if (strncmp(args[i], "frames=", 7) == 0) {
+            numFrames = std::max(1, atoi(args[i] + 7));
+        }
+    }
+
+    // Every type has its own mesh, they share two textures.
+    RenderInitData initData;
+    std::vector<MeshHandle> meshes;
+    for (uint32_t t = 0; t < numTypes; t++) {
+        meshes.push_back(initData.addMesh({"building" + std::to_string(t),
+                                           boxGeometry(2.0f + t % 3, 2.0f + t % 4, 2.0f + t % 5)}));
+    }
+    TextureHandle textures[] = {initData.addTexture({"stone", ""}), initData.addTexture({"wood", ""})};
+    PipelineState pso;
+    pso.id = "static_meshes";
+    pso.instanceFormat = InstanceFormat::PositionYawScale;
+    pso.inputLayout.addElement({InputElementType::POSITION}).addElement({InputElementType::UV})
+                   .addElement({InputElementType::NORMAL});
+    auto pipeline = initData.addPipelineState(pso);
+
+    StaticBatcher batcher;
+    batcher.initialize(initData);
+    RenderQueue renderQueue;
+    renderQueue.initialize(initData);
+
+    // Spread over a 200 x 200 map around the origin.
+    uint32_t seed = 1;
+    auto random = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return seed >> 8;
+    };
+    auto place = [&]() {
+        uint32_t type = random() % numTypes;
+        auto T = Matrix::CreateTranslation(-100.0f + random() % 200, 0, -100.0f + random() % 200);
+        return batcher.add({meshes[type], textures[type % 2], pipeline, T});
+    };
+    std::vector<StaticObjectHandle> buildings;
+    for (uint32_t i = 0; i < numBuildings; i++) {
+        buildings.push_back(place());
+    }
+
+    auto frameArena = FrameArena();
+    double updateMs = 0;
+    double queueMs = 0;
+    uint64_t draws = 0;
+    uint64_t rebuilt = 0;
+    uint64_t rebuiltBytes = 0;
+    for (uint32_t f = 0; f < numFrames; f++) {
+        auto& frameMemory = frameArena.beginFrame();
+        auto frame = frameMemory.create<FrameSubmission>();
+        auto& view = frame->viewSubmissions.emplace_back();
+        view.viewMatrix = Matrix(DirectX::XMMatrixLookAtLH({0, 30, -15}, {0, 0, 0}, {0, 1, 0}));
+        view.projectionMatrix = Matrix(DirectX::XMMatrixPerspectiveFovLH(45, 1920.0f / 1080.0f, 0.1f, 200));
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t c = 0; c < churn && !buildings.empty(); c++) {
+            auto& building = buildings[random() % buildings.size()];
+            batcher.remove(building);
+            building = place();
+        }
+        batcher.writeUpdates(*frame, frameMemory);
+        batcher.writeDraws(view);
+        auto updated = std::chrono::steady_clock::now();
+        renderQueue.build(*frame);
+        auto queued = std::chrono::steady_clock::now();
+
+        updateMs += std::chrono::duration<double, std::milli>(updated - start).count();
+        queueMs += std::chrono::duration<double, std::milli>(queued - updated).count();
+        draws += renderQueue.viewBatches(0).size();
+        rebuilt += batcher.stats().rebuiltBatches;
+        rebuiltBytes += batcher.stats().rebuiltBytes;
+    }
+
+    std::cout << "buildings:         " << batcher.objectCount() << " of " << numTypes << " types" << std::endl;
+    std::cout << "batches:           " << batcher.stats().batches << std::endl;
+    std::cout << "draws/frame:       " << draws / numFrames << std::endl;
+    std::cout << "rebuilt/frame:     " << (double) rebuilt / numFrames << " batches, "
+              << rebuiltBytes / numFrames / 1024.0 << " KB" << std::endl;
+    std::cout << "update ms/frame:   " << updateMs / numFrames << std::endl;
+    std::cout << "queue ms/frame:    " << queueMs / numFrames << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,46 @@
+#include "texture_arrays.h"
+#include <cassert>
+#include <unordered_map>
+#include "../lib/include/stb_image.h"
+
+std::vector<TextureSize> readTextureSizes(const RenderInitData& initData)
+{
+    std::vector<TextureSize> sizes;
+    for (auto& td : initData.textureDescriptors) {
+        int width, height, channels;
+        auto& size = sizes.emplace_back();
+        if (stbi_info(td.filePath.c_str(), &width, &height, &channels)) {
+            size = {(uint32_t) width, (uint32_t) height};
+        }
+    }
+    return sizes;
+}
+
+void groupTextureArrays(RenderInitData& initData, std::span<const TextureSize> sizes, uint32_t maxSlices)
+{
+    assert(sizes.size() == initData.textureDescriptors.size() && maxSlices > 0);
+
+    // The array which is being filled for every size.
+    std::unordered_map<uint64_t, uint32_t> openArrays;
+    auto& arrays = initData.textureArrays;
+    arrays.clear();
+    for (uint32_t t = 0; t < sizes.size(); t++) {
+        auto size = sizes[t];
+        bool known = size.width > 0 && size.height > 0;
+        uint64_t key = (uint64_t) size.width << 32 | size.height;
+
+        auto open = openArrays.find(key);
+        uint32_t array;
+        if (known && open != openArrays.end() && arrays[open->second].textures.size() < maxSlices) {
+            array = open->second;
+        } else {
+            array = arrays.size();
+            arrays.push_back({size.width, size.height, {}});
+            if (known) openArrays[key] = array;
+        }
+
+        auto& textures = arrays[array].textures;
+        initData.textureDescriptors[t].slot = {array, (uint32_t) textures.size()};
+        textures.push_back(TextureHandle{t});
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "renderer.h"
+
+// Groups the textures of a RenderInitData into texture arrays, before the
+// renderer is initialized. Textures of the same size become slices of one array,
+// the backends then create one GPU texture and one view per array instead of one
+// per texture (the DX12 backend only has room for 16 views).
+//
+// Every draw binds the array of its texture. Pipelines which declare
+// InstanceAttribute::TextureSlice read the slice per instance, so the RenderQueue 
+// merges their Object draws which only differ by textures of the same array.
+// All other draws get the slice of their texture for the whole draw.
+//
+// Without grouping every texture stays in an array of its own, see RenderInitData::addTexture().
+
+// D3D11_REQ_TEXTURE2D_ARRAY_AXIS_DIMENSION
+constexpr uint32_t maxTextureArraySlices = 2048;
+
+struct TextureSize
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
+
+// Reads the size of every texture of initData from the header of its image file,
+// the pixels are not decoded. Files which cannot be read get a size of 0.
+std::vector<TextureSize> readTextureSizes(const RenderInitData& initData);
+
+// Rebuilds initData.textureArrays and the slots of the textureDescriptors:
+// textures of the same size share an array of at most maxSlices slices, 
+// in the order they were added. Textures of size 0 keep an array of their own.
+// sizes holds the size of every texture descriptor.
+void groupTextureArrays(RenderInitData& initData, std::span<const TextureSize> sizes,
+                        uint32_t maxSlices = maxTextureArraySlices);
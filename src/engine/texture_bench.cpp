@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "frame_arena.h"
+#include "render_queue.h"
+#include "texture_arrays.h"
+
+using namespace DirectX::SimpleMath;
+
+// Measures what grouping the textures into arrays does to the draws of the RenderQueue:
+// an army of units of several types, every unit type comes in many skins of a few sizes.
+// The same frames are queued once with every texture in an array of its own and
+// once with the textures grouped by size.
+// Usage: texture_bench [units=<n>] [types=<n>] [textures=<n>] [sizes=<n>] [frames=<n>]
+int main(int argc, char ** args) {
+
+    uint32_t numUnits = 5000;
+    uint32_t numTypes = 4;
+    uint32_t numTextures = 64;
+    uint32_t numSizes = 2;
+    uint32_t numFrames = 200;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(args[i], "units=", 6) == 0) {
+            numUnits = atoi(args[i] + 6);
+        } else if (strncmp(args[i], "types=", 6) == 0) {
+            numTypes = std::max(1, atoi(args[i] + 6));
+        } else if (strncmp(args[i], "textures=", 9) == 0) {
+            numTextures = std::max(1, atoi(args[i] + 9));
+        } else if (strncmp(args[i], "sizes=", 6) == 0) {
+            numSizes = std::max(1, atoi(args[i] + 6));
+        } else if (strncmp(args[i], "frames=", 7) == 0) {
+            numFrames = std::max(1, atoi(args[i] + 7));
+        }
+    }
+
+    RenderInitData initData;
+    std::vector<MeshHandle> meshes;
+    for (uint32_t t = 0; t < numTypes; t++) {
+        meshes.push_back(initData.addMesh({"unit" + std::to_string(t), GeometryFactory::getQuadGeometry()}));
+    }
+    // The sizes are made up, there are no image files behind the textures.
+    std::vector<TextureHandle> textures;
+    std::vector<TextureSize> sizes;
+    for (uint32_t t = 0; t < numTextures; t++) {
+        textures.push_back(initData.addTexture({"skin" + std::to_string(t), ""}));
+        uint32_t size = 64u << (t % numSizes);
+        sizes.push_back({size, size});
+    }
+    PipelineState pso;
+    pso.id = "units";
+    pso.instanceFormat = InstanceFormat::PositionYawScale;
+    pso.instanceAttributes = instanceAttributeBit(InstanceAttribute::TeamColor) |
+                             instanceAttributeBit(InstanceAttribute::TextureSlice);
+    pso.inputLayout.addElement({InputElementType::POSITION}).addElement({InputElementType::UV})
+                   .addElement({InputElementType::NORMAL});
+    auto pipeline = initData.addPipelineState(pso);
+
+    RenderQueue separateQueue;
+    separateQueue.initialize(initData);
+    groupTextureArrays(initData, sizes);
+    RenderQueue groupedQueue;
+    groupedQueue.initialize(initData);
+
+    // Every unit keeps its type, skin and place, spread over a 60 x 60 field around the origin.
+    uint32_t seed = 1;
+    auto random = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return seed >> 8;
+    };
+    struct Unit
+    {
+        uint32_t type;
+        uint32_t texture;
+        Matrix transform;
+    };
+    std::vector<Unit> units;
+    for (uint32_t i = 0; i < numUnits; i++) {
+        units.push_back({random() % numTypes, random() % numTextures,
+                         Matrix::CreateTranslation(-30.0f + random() % 60, 0, -30.0f + random() % 60)});
+    }
+
+    auto frameArena = FrameArena();
+    double separateMs = 0;
+    double groupedMs = 0;
+    uint64_t submitted = 0;
+    uint64_t separateDraws = 0;
+    uint64_t groupedDraws = 0;
+    for (uint32_t f = 0; f < numFrames; f++) {
+        auto& frameMemory = frameArena.beginFrame();
+        auto frame = frameMemory.create<FrameSubmission>();
+        auto& view = frame->viewSubmissions.emplace_back();
+        view.viewMatrix = Matrix(DirectX::XMMatrixLookAtLH({0, 30, -15}, {0, 0, 0}, {0, 1, 0}));
+        view.projectionMatrix = Matrix(DirectX::XMMatrixPerspectiveFovLH(45, 1920.0f / 1080.0f, 0.1f, 200));
+
+        // As a game submits them, one ObjectRenderData per type and skin.
+        std::vector<int32_t> objects(numTypes * numTextures, -1);
+        for (auto& unit : units) {
+            auto& object = objects[unit.type * numTextures + unit.texture];
+            if (object < 0) {
+                object = view.objectRenderData.size();
+                auto& ord = view.objectRenderData.emplace_back();
+                ord.mesh = meshes[unit.type];
+                ord.texture = textures[unit.texture];
+                ord.pipeline = pipeline;
+            }
+            view.objectRenderData[object].worldMatrices.push_back(unit.transform);
+        }
+        submitted += view.objectRenderData.size();
+
+        auto start = std::chrono::steady_clock::now();
+        separateQueue.build(*frame);
+        auto separated = std::chrono::steady_clock::now();
+        groupedQueue.build(*frame);
+        auto grouped = std::chrono::steady_clock::now();
+
+        separateMs += std::chrono::duration<double, std::milli>(separated - start).count();
+        groupedMs += std::chrono::duration<double, std::milli>(grouped - separated).count();
+        separateDraws += separateQueue.viewBatches(0).size();
+        groupedDraws += groupedQueue.viewBatches(0).size();
+    }
+
+    std::cout << "units:             " << numUnits << " of " << numTypes << " types" << std::endl;
+    std::cout << "textures:          " << numTextures << " in " << initData.textureArrays.size() << " arrays" << std::endl;
+    std::cout << "objects/frame:     " << submitted / numFrames << std::endl;
+    std::cout << "draws/frame:       " << separateDraws / numFrames << " separate, "
+              << groupedDraws / numFrames << " grouped" << std::endl;
+    std::cout << "queue ms/frame:    " << separateMs / numFrames << " separate, "
+              << groupedMs / numFrames << " grouped" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include "upload_ring.h"
+#include <cassert>
+
+static size_t alignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Finds room for size bytes without changing the ring.
+// consumed is what the allocation takes off the free space,
+// alignment padding and the skipped end of the ring included.
+size_t UploadRing::place(size_t size, size_t alignment, size_t& consumed) const
+{
+    assert(alignment && (alignment & (alignment - 1)) == 0);
+    if (size > ringCapacity) return invalidOffset;
+
+    // An empty ring starts over at the front.
+    if (used == 0) {
+        consumed = size;
+        return 0;
+    }
+
+    size_t aligned = alignUp(head, alignment);
+    if (head > tail) {
+        // Free are [head, capacity) and [0, tail).
+        if (aligned + size <= ringCapacity) {
+            consumed = aligned + size - head;
+            return aligned;
+        }
+        if (size <= tail) {
+            consumed = ringCapacity - head + size;
+            return 0;
+        }
+        return invalidOffset;
+    }
+
+    // Free is [head, tail), nothing if head caught up with tail.
+    if (head < tail && aligned + size <= tail) {
+        consumed = aligned + size - head;
+        return aligned;
+    }
+    return invalidOffset;
+}
+
+size_t UploadRing::allocate(size_t size, size_t alignment)
+{
+    size_t consumed = 0;
+    size_t offset = place(size, alignment, consumed);
+    if (offset == invalidOffset) return invalidOffset;
+
+    if (used == 0) {
+        tail = 0;
+    }
+    head = offset + size;
+    used += consumed;
+    pendingBytes += consumed;
+    return offset;
+}
+
+bool UploadRing::canFit(size_t size, size_t alignment) const
+{
+    size_t consumed = 0;
+    return place(size, alignment, consumed) != invalidOffset;
+}
+
+void UploadRing::endFrame(uint64_t fenceValue)
+{
+    if (pendingBytes == 0) return;
+
+    assert(frames.empty() || frames.back().fence <= fenceValue);
+    frames.push_back({fenceValue, head, pendingBytes});
+    pendingBytes = 0;
+}
+
+void UploadRing::reclaim(uint64_t completedFenceValue)
+{
+    while (!frames.empty() && frames.front().fence <= completedFenceValue) {
+        tail = frames.front().end;
+        used -= frames.front().bytes;
+        frames.pop_front();
+    }
+}
+
+void UploadRing::reset(size_t newCapacity)
+{
+    ringCapacity = newCapacity;
+    head = 0;
+    tail = 0;
+    used = 0;
+    pendingBytes = 0;
+    frames.clear();
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+// Hands out ranges of a GPU upload buffer for per frame transient data.
+// Only the offsets are managed here, the backend owns the buffer and
+// writes through its mapping, so the ring itself does not depend on any API.
+//
+// Allocations are appended behind each other and wrap around at the end.
+// endFrame() tags everything allocated during the frame with a fence value,
+// reclaim() releases the frames whose fence the GPU has passed.
+// When the ring is full, allocate() fails and the backend decides what to do:
+// wait for the oldest frame, orphan the buffer, or grow it through reset().
+class UploadRing
+{
+    public:
+        static constexpr size_t invalidOffset = ~size_t(0);
+
+        explicit UploadRing(size_t capacity = 0) : ringCapacity(capacity) {}
+
+        // Returns the offset of size free bytes, aligned to alignment
+        // (a power of two), or invalidOffset if they don't fit right now.
+        size_t allocate(size_t size, size_t alignment);
+
+        // The allocations since the previous endFrame() stay in use
+        // until the GPU completed fenceValue.
+        void endFrame(uint64_t fenceValue);
+
+        // Releases every frame with a fence value up to completedFenceValue.
+        void reclaim(uint64_t completedFenceValue);
+
+        // Forgets all allocations, e.g. after the buffer was orphaned
+        // or recreated with newCapacity bytes.
+        void reset(size_t newCapacity);
+        void reset() { reset(ringCapacity); }
+
+        // Fence value of the oldest frame still in use, 0 if there is none.
+        uint64_t oldestFence() const { return frames.empty() ? 0 : frames.front().fence; }
+
+        size_t capacity() const { return ringCapacity; }
+        size_t bytesInUse() const { return used; }
+        bool canFit(size_t size, size_t alignment) const;
+
+    private:
+        size_t place(size_t size, size_t alignment, size_t& consumed) const;
+
+        struct FrameRange
+        {
+            uint64_t fence;
+            size_t end;
+            size_t bytes;
+        };
+
+        size_t ringCapacity;
+        size_t head = 0;
+        size_t tail = 0;
+        // Including alignment padding and the bytes skipped when wrapping.
+        size_t used = 0;
+        size_t pendingBytes = 0;
+        std::deque<FrameRange> frames;
+};
@@ -0,0 +1,87 @@
+#include "engine_tests.h"
+#include "upload_ring.h"
+
+// Allocations follow each other, the alignment padding counts as used.
+static void testAlignment()
+{
+    UploadRing ring(256);
+    CHECK(ring.allocate(100, 16) == 0);
+    CHECK(ring.allocate(50, 16) == 112);
+    CHECK(ring.bytesInUse() == 162);
+    CHECK(ring.allocate(8, 64) == 192);
+    CHECK(ring.bytesInUse() == 200);
+    CHECK(!ring.canFit(64, 64));
+    CHECK(ring.allocate(64, 64) == UploadRing::invalidOffset);
+    CHECK(ring.bytesInUse() == 200);
+}
+
+// A fake fence counter stands in for the GPU: a frame's range
+// only comes back once its fence value was completed.
+static void testWrapAndReclaim()
+{
+    UploadRing ring(256);
+    uint64_t fence = 0;
+
+    CHECK(ring.allocate(128, 16) == 0);
+    ring.endFrame(++fence);
+    CHECK(ring.allocate(96, 16) == 128);
+    ring.endFrame(++fence);
+    CHECK(ring.oldestFence() == 1);
+
+    // Neither the end nor the front of the ring is free.
+    CHECK(ring.allocate(64, 16) == UploadRing::invalidOffset);
+    ring.reclaim(0);
+    CHECK(ring.allocate(64, 16) == UploadRing::invalidOffset);
+
+    // Once the first frame completed, the allocation wraps to the front
+    // and the skipped end of the ring counts as used.
+    ring.reclaim(1);
+    CHECK(ring.oldestFence() == 2);
+    CHECK(ring.bytesInUse() == 96);
+    CHECK(ring.allocate(64, 16) == 0);
+    CHECK(ring.bytesInUse() == 192);
+    CHECK(ring.allocate(64, 16) == 64);
+    CHECK(ring.bytesInUse() == 256);
+    CHECK(ring.allocate(1, 1) == UploadRing::invalidOffset);
+    ring.endFrame(++fence);
+
+    // A frame without allocations adds no fence.
+    ring.endFrame(++fence);
+    ring.reclaim(2);
+    CHECK(ring.oldestFence() == 3);
+    CHECK(ring.bytesInUse() == 160);
+
+    // An empty ring starts over at the front.
+    ring.reclaim(fence);
+    CHECK(ring.oldestFence() == 0);
+    CHECK(ring.bytesInUse() == 0);
+    CHECK(ring.allocate(200, 16) == 0);
+}
+
+// reset() forgets everything, e.g. when the backend grows its buffer.
+static void testResetGrows()
+{
+    UploadRing ring(64);
+    CHECK(ring.allocate(128, 16) == UploadRing::invalidOffset);
+    CHECK(ring.allocate(64, 16) == 0);
+    ring.endFrame(1);
+    CHECK(!ring.canFit(16, 16));
+
+    ring.reset(256);
+    CHECK(ring.capacity() == 256);
+    CHECK(ring.bytesInUse() == 0);
+    CHECK(ring.oldestFence() == 0);
+    CHECK(ring.allocate(128, 16) == 0);
+    CHECK(ring.allocate(128, 16) == 128);
+
+    ring.reset();
+    CHECK(ring.capacity() == 256);
+    CHECK(ring.allocate(256, 16) == 0);
+}
+
+void testUploadRing()
+{
+    testAlignment();
+    testWrapAndReclaim();
+    testResetGrows();
+}
@@ -0,0 +1,46 @@
+#include "view_buckets.h"
+#include <cassert>
+
+ViewBuckets::ViewBuckets(uint32_t threadCount, size_t bytesPerThread)
+{
+    for (uint32_t i = 0; i < threadCount; i++) {
+        threadArenas.push_back(std::make_unique<LinearArena>(bytesPerThread));
+    }
+}
+
+void ViewBuckets::reset(uint32_t numBuckets)
+{
+    // The buckets point into the arenas, so they go first.
+    buckets.clear();
+    buckets.resize(numBuckets);
+    for (auto& arena : threadArenas) {
+        arena->reset();
+    }
+}
+
+FrameVector<ObjectRenderData>& ViewBuckets::bucket(uint32_t bucketIndex, uint32_t threadIndex)
+{
+    assert(threadIndex < threadArenas.size());
+    auto& b = buckets[bucketIndex];
+    if (!b) {
+        b.emplace(FrameAllocator(threadArenas[threadIndex].get()));
+    }
+    return *b;
+}
+
+void ViewBuckets::mergeInto(ViewSubmission& view)
+{
+    size_t count = view.objectRenderData.size();
+    for (auto& b : buckets) {
+        if (b) count += b->size();
+    }
+    view.objectRenderData.reserve(count);
+
+    for (auto& b : buckets) {
+        if (!b) continue;
+        for (auto& ord : *b) {
+            // Copied with the allocator of the view.
+            view.objectRenderData.push_back(ord);
+        }
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <memory>
+#include <optional>
+#include <vector>
+#include "renderer.h"
+#include "frame_arena.h"
+
+// Lets the tasks of a JobSystem::parallelFor build ObjectRenderData 
+// for one ViewSubmission side by side.
+// Every task fills its own bucket, which takes its memory from a scratch arena
+// of the thread running the task, so filling needs neither locks nor atomics.
+// mergeInto() then appends the buckets in task order, so the result does not
+// depend on which thread ran which task.
+class ViewBuckets
+{
+    public:
+        explicit ViewBuckets(uint32_t threadCount, size_t bytesPerThread = 256 * 1024);
+
+        // Starts a new round with numBuckets empty buckets.
+        // Releases the scratch memory of the previous round.
+        void reset(uint32_t numBuckets);
+
+        // The bucket of a task, threadIndex as handed to the task by the JobSystem.
+        FrameVector<ObjectRenderData>& bucket(uint32_t bucketIndex, uint32_t threadIndex);
+
+        // Copies the buckets, in bucket order, into the view (and its allocator).
+        void mergeInto(ViewSubmission& view);
+
+    private:
+        std::vector<std::unique_ptr<LinearArena>> threadArenas;
+        std::vector<std::optional<FrameVector<ObjectRenderData>>> buckets;
+};
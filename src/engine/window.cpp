@@ -8,8 +8,8 @@
 
 
 using namespace DirectX::SimpleMath;
-Vector2 resizedDimension;
-Vector2 tempDimension;
+static Vector2 resizedDimension;
+static Vector2 tempDimension;
 
 std::vector<Event*> frameEvents;
 
@@ -4,7 +4,11 @@
 #include "../engine/geometry.h"
 #include "../engine/asset_importer.h"
 #include "../engine/game_util.h"
+#include "../engine/texture_arrays.h"
 #include <filesystem>
+#include <charconv>
+#include <algorithm>
+#include <cmath>
 
 Game* getGame() {
     return new RTSGame();
@@ -23,26 +27,36 @@ RenderInitData RTSGame::getInitData(CommandLine cmdline, Window* window)
     initData.screenWidth = window->width;
     initData.screenHeight = window->height;
     initData.numFrames = 3;
-    initData.textureDescriptors.push_back({"hero", "../src/game/assets/hero.png"});
-    initData.textureDescriptors.push_back({"enemy1", "../src/game/assets/enemy1.png"});
-    initData.textureDescriptors.push_back({"default", "../src/game/assets/default_texture.png"});
-    initData.textureDescriptors.push_back({"wood_icon", "../src/game/assets/wood_icon.png"});
-    initData.fontDescriptors.push_back({"consola16", "../src/game/assets/consola.ttf", 16.0f});
-    initData.fontDescriptors.push_back({"consola32", "../src/game/assets/consola.ttf", 32.0f});
-    initData.snippetDescriptors.push_back({"consola16", "hello_world_snippet", "hello world placeholder xxxxxxxxxxx"});
-    initData.snippetDescriptors.push_back({"consola16", "wood_amount", "Wood: 999999999999"});
+    initData.jobSystem = &jobSystem;
+    heroTexture = initData.addTexture({"hero", "../src/game/assets/hero.png"});
+    enemy1Texture = initData.addTexture({"enemy1", "../src/game/assets/enemy1.png"});
+    defaultTexture = initData.addTexture({"default", "../src/game/assets/default_texture.png"});
+    woodIconTexture = initData.addTexture({"wood_icon", "../src/game/assets/wood_icon.png"});
+    // The 64 x 64 unit skins and icons end up in one texture array.
+    groupTextureArrays(initData, readTextureSizes(initData));
+    initData.addFont({"consola16", "../src/game/assets/consola.ttf", 16.0f});
+    initData.addFont({"consola32", "../src/game/assets/consola.ttf", 32.0f});
+    helloWorldSnippet = initData.addSnippet({"consola16", "hello_world_snippet", "hello world placeholder xxxxxxxxxxx"});
+    woodAmountSnippet = initData.addSnippet({"consola16", "wood_amount", "Wood: 999999999999"});
     auto quadGeometry = GeometryFactory().getQuadGeometry();
-    initData.meshDescriptors.push_back({"quad", quadGeometry});
+    quadMesh = initData.addMesh({"quad", quadGeometry});
 
     auto currPath = std::filesystem::current_path().string();
     std::cout << "cwd = " << currPath << "\n";
     Geometry houseGeometry;
     bool result = GltfStaticMeshLoader().load(("../src/game/assets/house.glb"), 
                                                 houseGeometry, true);
-    initData.meshDescriptors.push_back({"house", houseGeometry});
+    // Houses hide the units behind them.
+    MeshDescriptor houseDescriptor = {"house", houseGeometry};
+    houseDescriptor.occluder = true;
+    houseMesh = initData.addMesh(std::move(houseDescriptor));
     Geometry knightGeo;
     result = GltfStaticMeshLoader().load("../src/game/assets/knight.glb", knightGeo, true);
-    initData.meshDescriptors.push_back({"knight", knightGeo});
+    // Zoomed out, a knight only covers a few pixels.
+    MeshDescriptor knightDescriptor = {"knight", knightGeo};
+    knightDescriptor.lods.push_back({GeometryFactory::simplify(knightGeo, 16), 0.05f});
+    knightDescriptor.lods.push_back({GeometryFactory::simplify(knightGeo, 6), 0.015f});
+    knightMesh = initData.addMesh(std::move(knightDescriptor));
 
 
 
@@ -53,22 +67,91 @@ RenderInitData RTSGame::getInitData(CommandLine cmdline, Window* window)
     uiPipelineState.shader = L"../shaders/unlit_2d.hlsl";
     uiPipelineState.useDepthBuffer = true;
     uiPipelineState.wireframe = false;
+    uiPipelineState.translucent = true;
+    // Sprites may be scaled differently per axis.
+    uiPipelineState.instanceFormat = InstanceFormat::Affine;
+    // Particles fade out through the tint.
+    uiPipelineState.instanceAttributes = instanceAttributeBit(InstanceAttribute::Tint);
     uiPipelineState.inputLayout.addElement({InputElementType::POSITION}).addElement({InputElementType::UV})
                     .addElement({InputElementType::NORMAL});
-    initData.pipelineStates.push_back(uiPipelineState);
+    uiPipeline = initData.addPipelineState(uiPipelineState);
     
     auto buildingsPipelineState = PipelineState();
     buildingsPipelineState.id = "static_meshes";
     buildingsPipelineState.shader = L"../shaders/shaders.hlsl";
+    // Units and buildings stand on the ground and only turn around y.
+    buildingsPipelineState.instanceFormat = InstanceFormat::PositionYawScale;
+    // Units of all players share their draws, the shader applies the team color.
+    // So do units whose textures share an array.
+    buildingsPipelineState.instanceAttributes = instanceAttributeBit(InstanceAttribute::TeamColor) |
+                                                instanceAttributeBit(InstanceAttribute::Selection) |
+                                                instanceAttributeBit(InstanceAttribute::TextureSlice);
     buildingsPipelineState.inputLayout.addElement({InputElementType::POSITION})
                         .addElement({InputElementType::UV}).addElement({InputElementType::NORMAL});
-    initData.pipelineStates.push_back(buildingsPipelineState);
+    staticMeshesPipeline = initData.addPipelineState(buildingsPipelineState);
+
+    // Houses never move, their geometry is merged per chunk:
+    buildings.initialize(initData);
+    for (int i = 0; i < 3; i++) {
+        auto T = DirectX::SimpleMath::Matrix::CreateTranslation(-25 + (i*25), 0, 8);
+        houses.push_back(buildings.add({houseMesh, defaultTexture, staticMeshesPipeline, T}));
+    }
+
+    // Health bars and selection rings float over the units,
+    // bars and rings share a texture and neighbouring layers, so they share a draw.
+    OverlayStyle healthBar;
+    healthBar.texture = defaultTexture;
+    healthBar.size = {40, 5};
+    healthBar.worldOffset = {0, 2.5f, 0};
+    healthBar.layer = 3;
+    overlays.setStyle(OverlayType::HealthBar, healthBar);
+    OverlayStyle selectionRing;
+    selectionRing.texture = defaultTexture;
+    selectionRing.size = {36, 14};
+    selectionRing.layer = 4;
+    selectionRing.color = 0xA040FF40;
+    overlays.setStyle(OverlayType::SelectionRing, selectionRing);
+    OverlayStyle rallyMarker;
+    rallyMarker.texture = woodIconTexture;
+    rallyMarker.size = {20, 20};
+    rallyMarker.layer = 5;
+    rallyMarker.color = 0xFFFFFFFF;
+    overlays.setStyle(OverlayType::RallyMarker, rallyMarker);
+
+    // Dust rising from the knight and sparks flying off it:
+    ParticleEmitterDesc dust;
+    dust.atlas = defaultTexture;
+    dust.capacity = 256;
+    dust.spawnRate = 60;
+    dust.lifetime = 2;
+    dust.lifetimeSpread = 0.5f;
+    dust.velocity = {0, 1, 0};
+    dust.velocitySpread = {0.5f, 0.3f, 0.5f};
+    dust.gravity = 0;
+    dust.drag = 0.5f;
+    dust.startSize = 0.3f;
+    dust.endSize = 1.2f;
+    dust.color = 0xA0708090;
+    particles.createEmitter(dust, {0, 0, 3});
+
+    ParticleEmitterDesc sparks;
+    sparks.atlas = defaultTexture;
+    sparks.capacity = 512;
+    sparks.lifetime = 0.8f;
+    sparks.lifetimeSpread = 0.3f;
+    sparks.velocity = {0, 5, 0};
+    sparks.velocitySpread = {3, 2, 3};
+    sparks.drag = 1;
+    sparks.startSize = 0.15f;
+    sparks.endSize = 0.05f;
+    sparks.color = 0xFF40C0FF;
+    sparksEmitter = particles.createEmitter(sparks, {0, 1, 3});
     
     return initData;
     
 }
 
-FrameSubmission RTSGame::getFrameData()
+FrameSubmission* RTSGame::getFrameData(LinearArena& frameArena)
 {
     using namespace DirectX;
     using namespace DirectX::SimpleMath;
@@ -80,105 +163,142 @@ FrameSubmission RTSGame::getFrameData()
         // }
     }
 
-    auto frameSubmission = FrameSubmission();
+    // Everything below lives in the frame arena,
+    // so building the frame does not touch the heap.
+    auto frameSubmission = frameArena.create<FrameSubmission>();
+    frameSubmission->viewSubmissions.resize(2);
+    auto& viewSub3D = frameSubmission->viewSubmissions[0];
+    auto& viewSub2D = frameSubmission->viewSubmissions[1];
 
     // Draw some 2D objects
-    auto viewSub2D = ViewSubmission();
+    viewSub2D.objectRenderData.reserve(8);
     viewSub2D.viewMatrix = Matrix::Identity;
     viewSub2D.projectionMatrix = Matrix(XMMatrixOrthographicOffCenterLH(0, window->width, 0, window->height, 0.1, 100));
     
-    auto objData = ObjectRenderData();
-    objData.textureId = "hero";
-    objData.meshId = "quad";
-    objData.inputLayoutId = "ui";
-    objData.textureId = "hero";
-    auto S = Matrix::CreateScale(64, 64, 1);
+    // The HUD is made of sprites, they are batched by texture (atlas page) and layer.
+    viewSub2D.sprites.reserve(16);
+    Vector4 fullTexture = {0, 0, 1, 1};
+    Vector4 white = {1, 1, 1, 1};
     for (int i = 0; i < 10; i++) {
-        auto T= Matrix::CreateTranslation(40 + (i*70), 200, 10);
-        auto W = S * T;
-        objData.worldMatrices.push_back(W);
+        addSprite(viewSub2D, {40.0f + (i*70), 200}, {64, 64}, fullTexture, white, 10, heroTexture);
     }
-    viewSub2D.objectRenderData.push_back(objData);
 
-    // And a view more, but smaller rects
+    // And a view more, but smaller rects.
+    // One ObjectRenderData per squad, built in parallel:
     {
-        auto objDataSmall = ObjectRenderData();
-        objDataSmall.textureId = "enemy1";
-        objDataSmall.meshId = "quad";
-        objDataSmall.inputLayoutId = "ui";
-        int y = 10;
-        int x = 0;
-        S = Matrix::CreateScale(12, 12, 1);
-        for (int i = 0; i < 80; i++) {
-            x++;
-            if (i % 48 == 0) {
-                y += 20;
-                x = 0;
+        constexpr uint32_t numEnemies = 80;
+        constexpr uint32_t squadSize = 16;
+        constexpr uint32_t numSquads = (numEnemies + squadSize - 1) / squadSize;
+        enemyBuckets.reset(numSquads);
+        jobSystem.parallelFor(numSquads, [&](uint32_t squad, uint32_t threadIndex) {
+            auto& objDataSmall = enemyBuckets.bucket(squad, threadIndex).emplace_back();
+            objDataSmall.texture = enemy1Texture;
+            objDataSmall.mesh = quadMesh;
+            objDataSmall.pipeline = uiPipeline;
+            objDataSmall.worldMatrices.reserve(squadSize);
+            auto S = Matrix::CreateScale(12, 12, 1);
+            for (uint32_t i = squad * squadSize; i < std::min(numEnemies, (squad + 1) * squadSize); i++) {
+                int x = i % 48;
+                int y = 30 + (i / 48) * 20;
+                auto T= Matrix::CreateTranslation(10 + (x*16), y, 10);
+                auto W = S * T;
+                objDataSmall.worldMatrices.push_back(W);
             }
-            auto T= Matrix::CreateTranslation(10 + (x*16), y, 10);
-            auto W = S * T;
-            objDataSmall.worldMatrices.push_back(W);
-        }
-        viewSub2D.objectRenderData.push_back(objDataSmall);
+        });
+        enemyBuckets.mergeInto(viewSub2D);
     }
 
     // Wood icon
-    auto objDataSmall = createObjectRenderData("wood_icon", "quad", "ui", 
-            {Vector3{50, window->height - 50.0f, 1}}, Vector3(32, 32 ,1));
-    viewSub2D.objectRenderData.push_back(objDataSmall);
+    addSprite(viewSub2D, {50, window->height - 50.0f}, {32, 32}, fullTexture, white, 1, woodIconTexture);
 
     // Wood text
-    auto woodAmountText = TextRenderData();
-    woodAmountText.snippetId = "wood_amount";
+    auto& woodAmountText = viewSub2D.textRenderData.emplace_back();
+    woodAmountText.snippet = woodAmountSnippet;
     static int frame =1;
     frame++;
-    woodAmountText.updatedText = std::to_string(frame);
+    char frameText[16];
+    auto [textEnd, ec] = std::to_chars(frameText, frameText + sizeof(frameText), frame);
+    woodAmountText.updatedText.assign(frameText, textEnd);
     woodAmountText.worldMatrices.push_back(Matrix::CreateTranslation(100, 100, 1));
-    viewSub2D.textRenderData.push_back(woodAmountText);
 
     // Now some 3D objects:
     // House 3d model:
-    auto viewSub3D = ViewSubmission();
+    viewSub3D.objectRenderData.reserve(1);
     viewSub3D.viewMatrix = Matrix(XMMatrixLookAtLH({0, 30, -15}, {0, 0, 0}, {0, 1, 0}));
     float aspectRatio = (float) window->width / (float) window->height;
     viewSub3D.projectionMatrix = Matrix(XMMatrixPerspectiveFovLH(45, aspectRatio, 0.1, 200));
 
+    // Torches along the roads, flickering a little. 
+    // The renderer bins them, every pixel only sees the few which reach it.
+    {
+        constexpr uint32_t numTorches = 256;
+        viewSub3D.pointLights.reserve(numTorches);
+        for (uint32_t i = 0; i < numTorches; i++) {
+            auto& torch = viewSub3D.pointLights.emplace_back();
+            torch.position = Vector3(-40.0f + (i % 16) * 5.0f, 1.5f, -20.0f + (i / 16) * 5.0f);
+            torch.radius = 6;
+            torch.color = Vector3(1.0f, 0.6f, 0.25f);
+            torch.intensity = 1.5f + 0.3f * std::sin(frame * 0.2f + i);
+        }
+    }
+
     {
-        auto knightObjData = ObjectRenderData();
-        knightObjData.textureId = "default";
-        knightObjData.meshId = "knight";
-        knightObjData.inputLayoutId = "static_meshes";
-        S = Matrix::CreateScale(1, 1, 1);
+        auto& knightObjData = viewSub3D.objectRenderData.emplace_back();
+        knightObjData.texture = defaultTexture;
+        knightObjData.mesh = knightMesh;
+        knightObjData.pipeline = staticMeshesPipeline;
+        auto S = Matrix::CreateScale(1, 1, 1);
         static float rotY = 0;
         rotY += 0.000;
         auto R = Matrix::CreateRotationY(rotY);
+        // RGBA8 player colors, red in the low byte.
+        constexpr uint32_t playerColors[] = {0xFF3030E0, 0xFFE05030, 0xFF30C040, 0xFF20D0E0,
+                                             0xFFC040B0, 0xFFE0E0E0, 0xFF2080F0, 0xFF404040};
         for (int i = 0; i < 1; i++) {
             auto T = Matrix::CreateTranslation(0 + (i*5), 0, 3);
             auto W = S * R * T;
             knightObjData.worldMatrices.push_back(W);
+            auto& attributes = knightObjData.attributes.emplace_back();
+            attributes.teamColor = playerColors[i % std::size(playerColors)];
         }
-        viewSub3D.objectRenderData.push_back(knightObjData);
     }
 
+    // Overlays of the units, projected with the 3D camera into the HUD:
     {
-        auto houseObjData = ObjectRenderData();
-        houseObjData.textureId = "default";
-        houseObjData.meshId = "house";
-        houseObjData.inputLayoutId = "static_meshes";
-        auto S = Matrix::CreateScale(1, 1, 1);
-        static float rotY = 0;
-        rotY += 0.000;
-        auto R = Matrix::CreateRotationY(rotY);
-        for (int i = 0; i < 3; i++) {
-            auto T = Matrix::CreateTranslation(-25 + (i*25), 0, 8);
-            auto W = S * R * T;
-            houseObjData.worldMatrices.push_back(W);
+        float unitX[] = {0};
+        float unitY[] = {0};
+        float unitZ[] = {3};
+        float unitHealth[] = {0.8f};
+        uint8_t unitSelected[] = {1};
+        Vector3 rallyPoints[] = {{0, 0, 12}};
+        overlays.beginFrame(viewSub3D, window->width, window->height);
+        overlays.addUnits({unitX, unitY, unitZ, unitHealth, unitSelected, 1});
+        overlays.addRallyMarkers(rallyPoints);
+        overlays.writeSprites(viewSub2D);
+    }
+
+    // Particles, at a fixed step until the game has a clock.
+    static uint32_t sparkFrame = 0;
+    if (sparkFrame++ % 60 == 0) {
+        particles.emit(sparksEmitter, 64);
+    }
+    particles.update(1.0f / 60.0f, &jobSystem);
+    particles.writeDraws(viewSub3D, viewSub3D.viewMatrix, quadMesh, uiPipeline);
+
+    // An outpost which is built and torn down again, only its chunk is rebuilt.
+    static uint32_t outpostFrame = 0;
+    if (outpostFrame++ % 240 == 0) {
+        if (outpost.isValid()) {
+            buildings.remove(outpost);
+            outpost = {};
+        } else {
+            outpost = buildings.add({houseMesh, defaultTexture, staticMeshesPipeline, Matrix::CreateTranslation(12, 0, 20)});
         }
-        viewSub3D.objectRenderData.push_back(houseObjData);
     }
 
-    frameSubmission.viewSubmissions.push_back(viewSub3D);
-    frameSubmission.viewSubmissions.push_back(viewSub2D);
+    // The houses, one draw per visible chunk:
+    buildings.writeUpdates(*frameSubmission, frameArena);
+    buildings.writeDraws(viewSub3D);
 
     return frameSubmission;
 }
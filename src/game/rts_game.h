@@ -3,14 +3,45 @@
 #include "../engine/engine.h"
 #include "../engine/game.h"
 #include "../engine/renderer.h"
+#include "../engine/static_batcher.h"
+#include "../engine/job_system.h"
+#include "../engine/view_buckets.h"
+#include "../engine/particle_system.h"
+#include "../engine/overlay_batcher.h"
 
 struct Window;
 class RTSGame : public Game {
 
     public:
         RenderInitData getInitData(CommandLine cmdline, Window* window) override;
-        FrameSubmission getFrameData() override;
+        FrameSubmission* getFrameData(LinearArena& frameArena) override;
 
     protected:
         Window* window = nullptr;
+
+        // Handles of our registered render resources
+        TextureHandle heroTexture;
+        TextureHandle enemy1Texture;
+        TextureHandle defaultTexture;
+        TextureHandle woodIconTexture;
+        MeshHandle quadMesh;
+        MeshHandle houseMesh;
+        MeshHandle knightMesh;
+        PipelineHandle uiPipeline;
+        PipelineHandle staticMeshesPipeline;
+        SnippetHandle helloWorldSnippet;
+        SnippetHandle woodAmountSnippet;
+
+        // Placed buildings, merged per map chunk.
+        StaticBatcher buildings;
+        std::vector<StaticObjectHandle> houses;
+        // Placed and torn down again now and then.
+        StaticObjectHandle outpost;
+
+        JobSystem jobSystem;
+        ViewBuckets enemyBuckets{jobSystem.threadCount()};
+
+        ParticleSystem particles;
+        EmitterHandle sparksEmitter;
+        OverlayBatcher overlays;
 };
\ No newline at end of file